@@ -10,9 +10,11 @@
 #include <audio/audio.h>
 #include <audio/audio_out.h>
 #include <graphics/bmp.h>
+#include <graphics/compositor.h>
 #include <graphics/display.h>
 #include <graphics/font_data.h>
 #include <graphics/font_manager.h>
+#include <graphics/memory_framebuffer.h>
 #include <graphics/texture.h>
 #include <io/bt_a2dp_source_manager.h>
 #include <io/file_util.h>
@@ -49,6 +51,10 @@ struct App
     graphics::FontData fontKanji_;
     graphics::Texture texture_;
 
+    // UI は一旦 screenBuffer_ (PSRAM) に描いて差分だけ LCD に送る
+    graphics::MemoryFrameBuffer screenBuffer_;
+    graphics::Compositor compositor_;
+
     ui::UIManager uiManager_;
     ui::KeyState keyState_;
 
@@ -81,6 +87,20 @@ public:
         texture_.initialize(
             GET_LINKED_BINARY_T(graphics::BMP, m5dx_material_bmp));
 
+        {
+            auto& display = graphics::getDisplay();
+            if (screenBuffer_.initialize(display.getBufferWidth(),
+                                         display.getBufferHeight()))
+            {
+                compositor_.setBackingStore(&screenBuffer_);
+            }
+            else
+            {
+                // 確保できなければ LCD に直接描く
+                compositor_.setBackingStore(&display);
+            }
+        }
+
         //
         jobManagerHighPrio_.start(12, 2048, "JobManagerHP");
 
@@ -97,6 +117,8 @@ public:
         }
 #endif
 
+        // 繋ぐ前に設定しておけば apply() で I2S を入れ直さずに済む
+        ui::SystemSettings::instance().applyInternalSpeakerConfig();
         if (ui::SystemSettings::instance().isEnabledInternalSpeaker())
         {
             audio::attachInternalSpeaker();
@@ -215,7 +237,7 @@ public:
             }
 
             ui::RenderContext ctx;
-            ctx.setFrameBuffer(&graphics::getDisplay());
+            ctx.setFrameBuffer(&compositor_);
             ctx.setTexture(&texture_);
             auto& fm = ctx.getFontManager();
             fm.setAsciiFontData(&fontAscii_);
@@ -225,6 +247,8 @@ public:
 
             drawDebug(ctx);
 
+            compositor_.flush(graphics::getDisplay());
+
             audio::dumpFMDataDebug();
         }
         else
@@ -254,6 +278,9 @@ public:
         // char str[20];
         // sprintf(str, "F %d", counter);
         // ctx.putText(str, {0, 0}, {320, 240}, ui::TextAlignH::RIGHT);
+
+        // auto& st = compositor_.getLastStats();
+        // sprintf(str, "%d %d %d", st.regions, st.pixels, st.flushTimeUS);
 #endif
     }
 
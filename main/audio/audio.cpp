@@ -8,11 +8,16 @@
 #include "../target.h"
 #include "audio_out.h"
 #include "audio_stream.h"
+#include "delta_sigma_modulator.h"
+#include "drift_compensator.h"
 #include "sample_generator.h"
 #include "sampling_rate_converter.h"
 #include "util/ring_buffer.h"
 #include "ym_sample_decoder.h"
+#include <atomic>
+#include <stdlib.h>
 #include <string.h>
+#include <system/util.h>
 
 //
 #include <freertos/FreeRTOS.h>
@@ -26,11 +31,11 @@ namespace audio
 {
 namespace
 {
-static constexpr size_t UNIT_SAMPLE_COUNT =
-    AudioOutDriverManager::getUnitSampleCount();
+static constexpr size_t MAX_UNIT_SAMPLE_COUNT =
+    AudioOutDriverManager::getMaxUnitSampleCount();
 
 static constexpr int DEFAULT_SAMPLE_RATE =
-    AudioOutDriverManager::getSampleRate();
+    AudioOutDriverManager::getDefaultSampleRate();
 
 } // namespace
 
@@ -51,20 +56,53 @@ class InternalSpeakerOut : public AudioOutDriver
 
     float volume_ = 1.0f;
 
-    int prevSample_ = 0;
-    int pv_         = 0;
-    int pv1_        = 0;
-    int pv2_        = 0;
-    int pv3_        = 0;
-    int pv4_        = 0;
+    static constexpr int overSampleShift_ = 2;
+    static_assert(PolyphaseInterpolator4::FACTOR == 1 << overSampleShift_,
+                  "oversampling factor");
 
-    bool deltaSigma3rd_ = false;
+    PolyphaseInterpolator4 interpolator_;
+    DeltaSigmaState deltaSigmaState_{};
+    DeltaSigmaFunc deltaSigma_ =
+        getDeltaSigmaFunc(1, NoiseShape::DIFFERENTIATOR);
+    int32_t overSampled_[MAX_UNIT_SAMPLE_COUNT];
 
-    static constexpr int overSampleShift_ = 2;
+    // DMA にはこれだけは溜めておく (AudioOut タスクが 1 tick 寝ても切れない)
+    static constexpr int MIN_BUFFER_US = 2500;
+
+    uint32_t sampleRate_ = DEFAULT_SAMPLE_RATE;
+    int blockSamples_    = MAX_UNIT_SAMPLE_COUNT;
+    int dmaBufferCount_  = 2;
 
 public:
-    InternalSpeakerOut()
+    InternalSpeakerOut() { install(); }
+
+    // 止めてから呼ぶ
+    void configure(uint32_t sampleRate, size_t blockSamples)
+    {
+        // オーバーサンプリングで 4 つずつ処理するので 16 の倍数にする
+        blockSamples = std::min(blockSamples, MAX_UNIT_SAMPLE_COUNT) & ~15;
+        blockSamples = std::max<size_t>(blockSamples, 16);
+        if (sampleRate == sampleRate_ && int(blockSamples) == blockSamples_)
+        {
+            return;
+        }
+
+        i2s_driver_uninstall(port_);
+        sampleRate_   = sampleRate;
+        blockSamples_ = blockSamples;
+        install();
+        DBOUT(("speaker: %d Hz, %d samples x %d buffers\n",
+               sampleRate_,
+               blockSamples_,
+               dmaBufferCount_));
+    }
+
+    void install()
     {
+        int minSamples  = uint64_t(sampleRate_) * MIN_BUFFER_US / 1000000;
+        dmaBufferCount_ = std::max(2, (minSamples + blockSamples_ - 1) /
+                                          blockSamples_);
+
         i2s_config_t cfg{};
 #if 1
         cfg.mode =
@@ -75,8 +113,8 @@ public:
         cfg.communication_format = i2s_comm_format_t(I2S_COMM_FORMAT_I2S_MSB);
         cfg.intr_alloc_flags     = 0;
         //        cfg.intr_alloc_flags     = ESP_INTR_FLAG_LEVEL2;
-        cfg.dma_buf_count = 2;
-        cfg.dma_buf_len   = 128 << overSampleShift_;
+        cfg.dma_buf_count = dmaBufferCount_;
+        cfg.dma_buf_len   = blockSamples_ << overSampleShift_;
         cfg.use_apll      = false;
 
         auto r = i2s_driver_install(port_, &cfg, 0, nullptr);
@@ -93,8 +131,8 @@ public:
         cfg.communication_format =
             i2s_comm_format_t(I2S_COMM_FORMAT_I2S | I2S_COMM_FORMAT_I2S_MSB);
         cfg.intr_alloc_flags = 0;
-        cfg.dma_buf_count    = 2;
-        cfg.dma_buf_len      = 128 << overSampleShift_;
+        cfg.dma_buf_count    = dmaBufferCount_;
+        cfg.dma_buf_len      = blockSamples_ << overSampleShift_;
         cfg.use_apll         = false;
 
         auto r = i2s_driver_install(port_, &cfg, 0, nullptr);
@@ -123,7 +161,7 @@ public:
 
     void writeZero()
     {
-        auto n = 128 * 2 << overSampleShift_;
+        auto n = blockSamples_ * dmaBufferCount_ << overSampleShift_;
         for (int i = 0; i < n; ++i)
         {
             uint16_t zero[] = {0, 0};
@@ -131,9 +169,13 @@ public:
         }
     }
 
-    void set3rdDeltaSigmaMode(bool f) { deltaSigma3rd_ = f; }
+    void setDeltaSigma(int order, NoiseShape shape)
+    {
+        deltaSigma_ = getDeltaSigmaFunc(order, shape);
+    }
 
-    uint32_t getSampleRate() const override { return 44100; };
+    uint32_t getSampleRate() const override { return sampleRate_; };
+    size_t getBlockSampleCount() const override { return blockSamples_; }
     void setVolume(float v) override { volume_ = v; }
     float getVolume() const override { return volume_; }
 
@@ -141,89 +183,35 @@ public:
     void onAttach() override{};
     void onDetach() override { writeZero(); };
 
-    void onUpdate(const std::array<int32_t, 2>* data, size_t n) override
+    // DMA バッファの分
+    uint32_t getQueuedSampleCount() const override
     {
-        uint16_t outSampleBuffer[UNIT_SAMPLE_COUNT << 1];
+        return blockSamples_ * dmaBufferCount_;
+    }
 
-        static constexpr float baseScale = 0.3f * 2; // 歪み避け
+    OutputFormat getOutputFormat() const override
+    {
+        return OutputFormat::DAC;
+    }
 
-        int scale = int(volume_ * baseScale * 128);
-        // int bias  = 32768;
-        int bias = int(volume_ * baseScale * 32768);
-        // 0.5Vccを中心にせず、0-Volume で振る (ノイズ対策)
+    // 音量とバイアスは OutputStage でかかっている
+    // (0.5Vccを中心にせず、0-Volume で振る。ノイズ対策)
+    void onUpdate(const OutputStage::Output& out, size_t n) override
+    {
+        uint16_t outSampleBuffer[MAX_UNIT_SAMPLE_COUNT << 1];
 
+        // 4 倍にするので 1/4 ずつ処理する
         auto ns         = n >> overSampleShift_;
-        const auto* src = data;
-        int prevSample  = prevSample_;
-        int pv          = pv_;
-        int pv1         = pv1_;
-        int pv2         = pv2_;
-        int pv3         = pv3_;
-        int pv4         = pv4_;
+        const auto* src = out.dac;
+        auto modulate   = deltaSigma_;
 
         for (auto osct = 1 << overSampleShift_; osct; --osct)
         {
-            auto* dst = outSampleBuffer;
-
-            if (deltaSigma3rd_)
-            {
-                for (auto ct = ns; ct; --ct)
-                {
-                    int v = ((((*src)[0] + (*src)[1]) * scale) >> 16) + bias;
-
-                    auto update = [&](int v0, int ofs) {
-                        pv1 += (v0 - pv);
-                        pv2 += (pv1 - pv);
-                        pv3 += (pv2 - pv);
-                        int vq       = pv3 & 0xff00;
-                        pv           = vq;
-                        dst[ofs + 0] = vq;
-                        dst[ofs + 1] = vq;
-                    };
-
-                    update((prevSample * 3 + v) >> 2, 0);
-                    update((prevSample + v) >> 1, 2);
-                    update((prevSample + v * 3) >> 2, 4);
-                    update(v, 6);
-
-                    src += 1;
-                    dst += 8;
-                    prevSample = v;
-                }
-            }
-            else
-            {
-                for (auto ct = ns; ct; --ct)
-                {
-                    int v = ((((*src)[0] + (*src)[1]) * scale) >> 16) + bias;
-
-                    auto update = [&](int v0, int ofs) {
-                        pv1 += (v0 - pv);
-                        int vq       = pv1 & 0xff00;
-                        pv           = vq;
-                        dst[ofs + 0] = vq;
-                        dst[ofs + 1] = vq;
-                    };
-
-                    update((prevSample * 3 + v) >> 2, 0);
-                    update((prevSample + v) >> 1, 2);
-                    update((prevSample + v * 3) >> 2, 4);
-                    update(v, 6);
-
-                    src += 1;
-                    dst += 8;
-                    prevSample = v;
-                }
-            }
+            interpolator_.process(overSampled_, src, ns);
+            modulate(outSampleBuffer, overSampled_, n, deltaSigmaState_);
             write(outSampleBuffer, n);
+            src += ns;
         }
-
-        prevSample_ = prevSample;
-        pv_         = pv;
-        pv1_        = pv1;
-        pv2_        = pv2;
-        pv3_        = pv3;
-        pv4_        = pv4;
     }
 
     static InternalSpeakerOut& instance()
@@ -275,16 +263,31 @@ private:
     int unitReadSamples_    = 128;
     bool installed_         = false;
 
-    static constexpr size_t MAX_UPDATE_SAMPLE_COUNT = UNIT_SAMPLE_COUNT * 2;
-    static constexpr size_t BUFFER_SIZE = MAX_UPDATE_SAMPLE_COUNT * 2;
+    static constexpr size_t MAX_UPDATE_SAMPLE_COUNT = MAX_UNIT_SAMPLE_COUNT * 2;
+    static constexpr size_t BUFFER_SIZE             = 2048; // int16 L/R
     int16_t buffer_[BUFFER_SIZE];
     util::RingBuffer<int16_t> ring_{buffer_, BUFFER_SIZE};
     SimpleLinearSamplingRateConverter src_;
 
+    // FM の時計と出力の時計のずれはリングの溜まり具合で直す
+    // DMA バッファ 3 つ分くらい溜めておく
+    static constexpr int TARGET_FILL_FRAMES = 384;
+    static constexpr int REPORT_INTERVAL    = 10000; // 30 秒くらい
+    DriftCompensator drift_;
+    uint32_t outRate_ = DEFAULT_SAMPLE_RATE;
+    float baseStep_   = 1.0f;
+    int starved_      = 0; // 届くのを待った
+    int ringFull_     = 0; // リングが一杯で DMA に残した
+    int reportCount_  = 0;
+
     int nextSampleRate_ = 0;
 
 public:
-    FMOutputHandler() { install(); }
+    FMOutputHandler()
+    {
+        drift_.setTarget(TARGET_FILL_FRAMES);
+        install();
+    }
     ~FMOutputHandler() { uninstall(); }
 
     void setFormat(SourceFormat fmt)
@@ -339,17 +342,25 @@ public:
             auto r      = i2s_set_sample_rates(port_, sampleRate_);
             assert(r == ESP_OK);
 
-            src_.setSamplingStep(sampleRate_ / (float)DEFAULT_SAMPLE_RATE);
+            updateStep();
 
             nextSampleRate_ = 0;
         }
     }
 
-    void read(uint32_t* buf, size_t n)
+    void updateStep()
+    {
+        baseStep_ = sampleRate_ / (float)outRate_;
+        src_.setSamplingStep(baseStep_);
+        drift_.reset();
+    }
+
+    size_t read(uint32_t* buf, size_t n, TickType_t wait = portMAX_DELAY)
     {
         size_t bytesRead;
-        i2s_read(port_, buf, n * bytesPerSample_, &bytesRead, portMAX_DELAY);
+        i2s_read(port_, buf, n * bytesPerSample_, &bytesRead, wait);
         // i2s_read(port_, buf, n * bytesPerSample_, &bytesRead, (TickType_t)1);
+        return bytesRead / bytesPerSample_;
     }
 
     size_t decode(uint32_t* buf, size_t n)
@@ -369,12 +380,12 @@ public:
         return n;
     }
 
-    void updateRing(size_t n)
+    size_t updateRing(size_t n, TickType_t wait = portMAX_DELAY)
     {
         uint32_t tmp[MAX_UPDATE_SAMPLE_COUNT];
         assert(n * bytesPerSample_ <=
                MAX_UPDATE_SAMPLE_COUNT * sizeof(uint32_t));
-        read(tmp, n);
+        n = read(tmp, n, wait);
 
         auto ct = decode(tmp, n);
         ct      = decode(tmp + ct * (bytesPerSample_ >> 2), n - ct);
@@ -385,24 +396,72 @@ public:
         debugRawFMData_[2] = tmp[2];
         debugRawFMData_[3] = tmp[3];
 #endif
+        return n;
+    }
+
+    // DMA に届いている分は待たずに全部リングに移す
+    void pullAvailable()
+    {
+        while (1)
+        {
+            int n = std::min<int>(unitReadSamples_,
+                                  ring_.getFullWritableSize() >> 1);
+            if (!n)
+            {
+                ++ringFull_;
+                return;
+            }
+            if (updateRing(n, 0) < size_t(n))
+            {
+                return;
+            }
+        }
     }
 
     bool accum(std::array<int32_t, 2>* data, size_t nSamples, size_t sampleRate)
     {
-        int sourceCt = sampleRate_ * nSamples / sampleRate + 2;
+        if (sampleRate != outRate_)
+        {
+            outRate_ = sampleRate;
+            updateStep();
+        }
+        pullAvailable();
+
+        // 足りなければ届くのを待つ
+        // 溜まり具合から直し始められるように目標まで溜めておく
+        int sourceCt = int(sampleRate_ * drift_.getRatio() * nSamples /
+                           sampleRate) +
+                       2;
         int updateCt = sourceCt - (ring_.getFullReadableSize() >> 1);
         if (updateCt > 0)
         {
-            int ct = std::min(updateCt, unitReadSamples_);
-            updateRing(ct);
-
-            ct = updateCt - ct;
-            if (ct)
+            ++starved_;
+            updateCt += TARGET_FILL_FRAMES;
+            while (updateCt > 0)
             {
+                int ct = std::min(updateCt, unitReadSamples_);
                 updateRing(ct);
+                updateCt -= ct;
             }
         }
         bool r = src_.convertAccum(data, nSamples, ring_);
+
+        int fill = ring_.getFullReadableSize() >> 1;
+        src_.setSamplingStep(baseStep_ * drift_.update(fill));
+        if (++reportCount_ == REPORT_INTERVAL)
+        {
+            auto& st = drift_.getStats();
+            DBOUT(("FM src: fill %d..%d (target %d), %+d ppm, starved %d, "
+                   "ring full %d\n",
+                   st.minError + TARGET_FILL_FRAMES,
+                   st.maxError + TARGET_FILL_FRAMES,
+                   TARGET_FILL_FRAMES,
+                   drift_.getPPM(),
+                   starved_,
+                   ringFull_));
+            drift_.resetStats();
+            reportCount_ = 0;
+        }
 #if ENABLE_FMDATA_DEBUG
         debugSRCFMData_[0] = data[0][0];
         debugSRCFMData_[1] = data[0][1];
@@ -512,8 +571,61 @@ FMOutputHandler::uninstall()
 
 ////////////////////////////////
 
+class OnsetProbe
+{
+    // 16.8 で -36dB くらい
+    static constexpr int THRESHOLD = 512 << 8;
+
+    std::atomic<bool> armed_{false};
+    std::atomic<int> result_{-1};
+    uint32_t startUs_ = 0;
+
+public:
+    void arm(uint32_t startUs)
+    {
+        startUs_ = startUs;
+        result_  = -1;
+        armed_.store(true, std::memory_order_release);
+    }
+
+    int getResult() const { return result_; }
+
+    void check(const std::array<int32_t, 2>* data,
+               size_t nSamples,
+               size_t sampleRate)
+    {
+        if (!armed_.load(std::memory_order_acquire))
+        {
+            return;
+        }
+
+        for (size_t i = 0; i < nSamples; ++i)
+        {
+            if (abs(data[i][0]) + abs(data[i][1]) > THRESHOLD)
+            {
+                auto* driver = AudioOutDriverManager::instance().getDriver();
+                uint32_t queued = driver ? driver->getQueuedSampleCount() : 0;
+                uint32_t now    = sys::micros();
+                result_ = now - startUs_ +
+                          (uint64_t)(i + queued) * 1000000 / sampleRate;
+                armed_  = false;
+                return;
+            }
+        }
+    }
+
+    static OnsetProbe& instance()
+    {
+        static OnsetProbe inst;
+        return inst;
+    }
+};
+
 class AudioStreamOutHandler : public AudioStreamOut
 {
+    static constexpr int REPORT_INTERVAL = 10000; // 30 秒くらい
+    int reportCount_                     = 0;
+
 public:
     void onUpdateAudioStream(std::array<int32_t, 2>* data,
                              size_t nSamples,
@@ -524,9 +636,35 @@ public:
         auto& fm = FMOutputHandler::instance();
         fm.applyChanges();
         fm.accum(data, nSamples, sampleRate);
+        OnsetProbe::instance().check(data, nSamples, sampleRate);
 
-        getSampleGeneratorManager().setSampleRate(sampleRate);
-        getSampleGeneratorManager().accumSamples(data, nSamples);
+        auto& gm = getSampleGeneratorManager();
+        gm.setSampleRate(sampleRate);
+        gm.accumSamples(data, nSamples);
+        if (++reportCount_ == REPORT_INTERVAL)
+        {
+            reportGeneratorStats(gm);
+            reportCount_ = 0;
+        }
+    }
+
+    void reportGeneratorStats(SampleGeneratorManager& gm)
+    {
+        constexpr size_t N = SampleGeneratorManager::MAX_GENERATORS;
+        SampleGeneratorManager::Stats st[N];
+        size_t n = gm.getStats(st, N);
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (st[i].calls)
+            {
+                DBOUT(("generator %p: %u calls, avg %u us, max %u us\n",
+                       st[i].generator,
+                       st[i].calls,
+                       st[i].totalUs / st[i].calls,
+                       st[i].maxUs));
+            }
+        }
+        gm.resetStats();
     }
 };
 
@@ -539,6 +677,18 @@ AudioStreamOutHandler streamOutHandler_;
 
 ////////////////////////////////
 
+void
+armOnsetProbe(uint32_t startUs)
+{
+    OnsetProbe::instance().arm(startUs);
+}
+
+int
+getOnsetProbeResult()
+{
+    return OnsetProbe::instance().getResult();
+}
+
 void
 setFMClock(uint32_t freq)
 {
@@ -570,9 +720,26 @@ detachInternalSpeaker()
 }
 
 void
-setInternalSpeaker3rdDeltaSigmaMode(bool f)
+setInternalSpeakerConfig(uint32_t sampleRate, size_t blockSamples)
+{
+    auto& m       = AudioOutDriverManager::instance();
+    auto& speaker = InternalSpeakerOut::instance();
+    bool attached = m.getDriver() == &speaker;
+    if (attached)
+    {
+        m.setDriver(nullptr);
+    }
+    speaker.configure(sampleRate, blockSamples);
+    if (attached)
+    {
+        m.setDriver(&speaker);
+    }
+}
+
+void
+setInternalSpeakerDeltaSigma(int order, NoiseShape shape)
 {
-    InternalSpeakerOut::instance().set3rdDeltaSigmaMode(f);
+    InternalSpeakerOut::instance().setDeltaSigma(order, shape);
 }
 
 void
@@ -5,7 +5,9 @@
 #ifndef _6334CD6A_A133_F008_136B_B244FD882788
 #define _6334CD6A_A133_F008_136B_B244FD882788
 
+#include "delta_sigma_modulator.h"
 #include <array>
+#include <stddef.h>
 #include <stdint.h>
 
 namespace audio
@@ -18,13 +20,22 @@ void setFMVolume(float v);
 void attachInternalSpeaker();
 void detachInternalSpeaker();
 
-void setInternalSpeaker3rdDeltaSigmaMode(bool f);
+// 止めて設定し直す。ブロックを小さくすると遅延が減る (16 の倍数、128 まで)
+void setInternalSpeakerConfig(uint32_t sampleRate, size_t blockSamples);
+// ΔΣ の次数 (1..5) と雑音の零点の置き方
+void setInternalSpeakerDeltaSigma(int order, NoiseShape shape);
 
 void setFMAudioModeYM2151();
 void setFMAudioModeYMF288();
 
 void dumpFMDataDebug();
 
+// 発音から出力までの遅延を測る
+// startUs 以降で最初に FM の出力が閾値を超えたサンプルが
+// 出力されるまでの時間が結果になる
+void armOnsetProbe(uint32_t startUs);
+int getOnsetProbeResult(); // 未検出は -1 (us)
+
 // const int16_t* getRecentSampleForTest();
 
 } // namespace audio
@@ -4,6 +4,7 @@
  */
 
 #include "audio_out.h"
+#include "spectrum_analyzer.h"
 #include <algorithm>
 #include <assert.h>
 #include <debug.h>
@@ -12,6 +13,7 @@
 #include <freertos/task.h>
 #include <mutex>
 #include <string.h>
+#include <system/alloc_trap.h>
 #include <system/mutex.h>
 #include <system/util.h>
 #include <util/simple_ring_buffer.h>
@@ -21,17 +23,29 @@ namespace audio
 
 struct AudioOutDriverManager::Impl
 {
-    static constexpr size_t UNIT_SAMPLE_COUNT =
-        AudioOutDriverManager::getUnitSampleCount();
+    static constexpr size_t MAX_UNIT_SAMPLE_COUNT =
+        AudioOutDriverManager::getMaxUnitSampleCount();
     static constexpr size_t HISTORY_SAMPLE_COUNT = 1024;
     static constexpr size_t DEFAULT_SAMPLE_RATE =
-        AudioOutDriverManager::getSampleRate();
+        AudioOutDriverManager::getDefaultSampleRate();
+
+    // 出力段の統計はこれだけブロックを作るごとに見る
+    static constexpr uint32_t OUTPUT_REPORT_BLOCKS = 4096;
 
     using Sample            = AudioOutDriverManager::Sample;
     using HistorySample     = AudioOutDriverManager::HistorySample;
     using HistoryRingBuffer = AudioOutDriverManager::HistoryRingBuffer;
+    using PCMSample         = OutputStage::PCMSample;
+
+    Sample buffer_[MAX_UNIT_SAMPLE_COUNT];
+
+    // ドライバに渡すもの
+    PCMSample pcmBuffer_[MAX_UNIT_SAMPLE_COUNT];
+    int32_t dacBuffer_[MAX_UNIT_SAMPLE_COUNT];
+    OutputStage::Output driverOut_{};
 
-    Sample buffer_[UNIT_SAMPLE_COUNT];
+    OutputStage outputStage_;
+    uint32_t outputBlocks_ = 0;
 
     AudioOutDriver* driver_{};
     AudioStreamOut* stream_{};
@@ -44,6 +58,8 @@ struct AudioOutDriverManager::Impl
     HistoryRingBuffer historyRing_{historyBuffer_, HISTORY_SAMPLE_COUNT};
     sys::Mutex historyMutex_;
 
+    SpectrumAnalyzer spectrumAnalyzer_;
+
 public:
     void start()
     {
@@ -63,23 +79,36 @@ public:
     void task()
     {
         DBOUT(("Start AudioOutDriverManager task.\n"));
+        sys::registerRealtimeTask();
         mutex_.lock();
+        size_t generated = 0;
         while (1)
         {
             //            if (stream_ && (!driver_ ||
             //            driver_->isDriverUseUpdate()))
             if (stream_ && driver_ && driver_->isDriverUseUpdate())
             {
-                auto n = generateSamples(UNIT_SAMPLE_COUNT);
+                auto n = generateSamples(getBlockSampleCount(), true);
                 if (driver_)
                 {
-                    driver_->onUpdate(buffer_, n);
+                    driver_->onUpdate(driverOut_, n);
+                }
+                if (++outputBlocks_ == OUTPUT_REPORT_BLOCKS)
+                {
+                    reportOutputStats();
+                    outputBlocks_ = 0;
                 }
                 // todo:
                 // !driver_かつFM音源からの読み出しがなくても固まらないようにする
 
+                // ブロックが小さい時も寝るのは最大ブロック分ごとにする
                 mutex_.unlock();
-                sys::delay(1);
+                generated += n;
+                if (generated >= MAX_UNIT_SAMPLE_COUNT)
+                {
+                    generated = 0;
+                    sys::delay(1);
+                }
                 mutex_.lock();
             }
             else
@@ -100,50 +129,90 @@ public:
 
     void signal() { xEventGroupSetBits(eventGroupHandle_, 1); }
 
-    size_t generateSamples(size_t n)
+    size_t getBlockSampleCount() const
+    {
+        auto n = driver_ ? driver_->getBlockSampleCount() : 0;
+        return n ? std::min(n, MAX_UNIT_SAMPLE_COUNT) : MAX_UNIT_SAMPLE_COUNT;
+    }
+
+    uint32_t getSampleRate() const
     {
-        n = std::min(n, UNIT_SAMPLE_COUNT);
+        return driver_ ? driver_->getSampleRate() : DEFAULT_SAMPLE_RATE;
+    }
+
+    // forDriver ならドライバの形式も作る
+    size_t generateSamples(size_t n, bool forDriver = false)
+    {
+        n = std::min(n, MAX_UNIT_SAMPLE_COUNT);
         if (stream_)
         {
-            stream_->onUpdateAudioStream(buffer_,
-                                         n,
-                                         driver_ ? driver_->getSampleRate()
-                                                 : DEFAULT_SAMPLE_RATE);
+            stream_->onUpdateAudioStream(buffer_, n, getSampleRate());
         }
         else
         {
             memset(buffer_, 0, sizeof(buffer_));
         }
-        pushHistorySamples(buffer_, n);
+        processOutput(buffer_, n, forDriver);
         return n;
     }
 
-    void pushHistorySamples(const Sample* s, size_t n)
+    // 音量、リミッタ、履歴とドライバの形式への変換を 1 回でする
+    void processOutput(const Sample* s, size_t n, bool forDriver)
     {
         std::lock_guard<sys::Mutex> lock(historyMutex_);
 
+        OutputStage::Output out{};
+        if (forDriver && driver_)
+        {
+            if (driver_->getOutputFormat() == AudioOutDriver::OutputFormat::DAC)
+            {
+                out.dac = dacBuffer_;
+            }
+            else
+            {
+                out.pcm = pcmBuffer_;
+            }
+        }
+        driverOut_ = out;
+
+        outputStage_.setSampleRate(getSampleRate());
+        outputStage_.setVolume(driver_ ? driver_->getVolume() : 1.0f);
+
         auto p   = historyRing_.getBufferTop();
         auto pos = historyRing_.getCurrentPos();
 
-        auto update = [&](auto* dst, const auto* src, size_t n) {
-            while (n)
-            {
-                (*dst)[0] = (*src)[0] >> 8;
-                (*dst)[1] = (*src)[1] >> 8;
-                ++dst;
-                ++src;
-                --n;
-            }
-        };
-        auto n1 = std::min<int>(n, historyRing_.getMask() + 1 - pos);
-        update(p + pos, s, n1);
+        auto n1     = std::min<int>(n, historyRing_.getMask() + 1 - pos);
+        out.history = p + pos;
+        outputStage_.process(out, s, n1);
         auto n2 = n - n1;
         if (n2)
         {
             assert(n2 <= HISTORY_SAMPLE_COUNT);
-            update(p, s + n1, n2);
+            out.history = p;
+            out.pcm     = out.pcm ? out.pcm + n1 : nullptr;
+            out.dac     = out.dac ? out.dac + n1 : nullptr;
+            outputStage_.process(out, s + n1, n2);
         }
         historyRing_.advancePointer(n);
+
+        spectrumAnalyzer_.update(historyRing_, n, getSampleRate());
+    }
+
+    void reportOutputStats()
+    {
+        std::lock_guard<sys::Mutex> lock(historyMutex_);
+        auto& st = outputStage_.getStats();
+        if (st.overs || st.clips)
+        {
+            DBOUT(("output: %d/%d samples limited, %d over, %d clipped, "
+                   "min gain %d%%\n",
+                   st.limited,
+                   st.samples,
+                   st.overs,
+                   st.clips,
+                   int(st.minGain * 100)));
+        }
+        outputStage_.resetStats();
     }
 
     bool lock(const AudioOutDriver* d)
@@ -265,6 +334,31 @@ AudioOutDriverManager::unlockHistoryBuffer()
     pimpl_->historyMutex_.unlock();
 }
 
+size_t
+AudioOutDriverManager::getUnitSampleCount() const
+{
+    return pimpl_->getBlockSampleCount();
+}
+
+uint32_t
+AudioOutDriverManager::getSampleRate() const
+{
+    return pimpl_->getSampleRate();
+}
+
+SpectrumAnalyzer&
+AudioOutDriverManager::getSpectrumAnalyzer()
+{
+    return pimpl_->spectrumAnalyzer_;
+}
+
+OutputStage::Stats
+AudioOutDriverManager::getOutputStats()
+{
+    std::lock_guard<sys::Mutex> lock(pimpl_->historyMutex_);
+    return pimpl_->outputStage_.getStats();
+}
+
 AudioOutDriverManager&
 AudioOutDriverManager::instance()
 {
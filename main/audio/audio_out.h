@@ -6,24 +6,42 @@
 #define EA3337E2_0134_1394_1475_68D3301F3EEE
 
 #include "audio_stream.h"
+#include "output_stage.h"
 #include <memory>
 #include <util/simple_ring_buffer.h>
 
 namespace audio
 {
 
+class SpectrumAnalyzer;
+
 class AudioOutDriver
 {
 public:
     virtual bool isDriverUseUpdate() const = 0;
     virtual void onAttach()                = 0;
     virtual void onDetach()                = 0;
-    virtual void onUpdate(const std::array<int32_t, 2>* data, size_t n) {}
+    // 音量とリミッタをかけて getOutputFormat() の形式にしたもの
+    virtual void onUpdate(const OutputStage::Output& out, size_t n) {}
+
+    enum class OutputFormat
+    {
+        PCM16, // OutputStage::Output::pcm
+        DAC,   // OutputStage::Output::dac
+    };
+    virtual OutputFormat getOutputFormat() const { return OutputFormat::PCM16; }
 
     virtual uint32_t getSampleRate() const = 0;
     virtual void setVolume(float v)        = 0;
     virtual float getVolume() const        = 0;
 
+    // 1 回に作るサンプル数
+    // AudioOutDriverManager::getMaxUnitSampleCount() まで
+    virtual size_t getBlockSampleCount() const { return 128; }
+
+    // 渡してから実際に出力されるまでに溜まっているサンプル数
+    virtual uint32_t getQueuedSampleCount() const { return 0; }
+
     // isDriverUseUpdate() = true のドライバは onUpdate() によって更新される
     // isDriverUseUpdate() = false のドライバは
     // AudioOutDriverManager::lock()/unlock()/generateSamples()
@@ -57,8 +75,17 @@ public:
     void lockHistoryBuffer();
     void unlockHistoryBuffer();
 
-    static constexpr size_t getUnitSampleCount() { return 128; }
-    static constexpr size_t getSampleRate() { return 44100; }
+    SpectrumAnalyzer& getSpectrumAnalyzer();
+
+    // 出力段の統計。一定のブロックごとに 0 に戻る
+    OutputStage::Stats getOutputStats();
+
+    // 今のドライバの設定
+    size_t getUnitSampleCount() const;
+    uint32_t getSampleRate() const;
+
+    static constexpr size_t getMaxUnitSampleCount() { return 128; }
+    static constexpr uint32_t getDefaultSampleRate() { return 44100; }
 
     static AudioOutDriverManager& instance();
 
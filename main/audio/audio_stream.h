@@ -6,6 +6,7 @@
 #define BB3CD18D_9134_1394_1584_73E373F02F5E
 
 #include <array>
+#include <stddef.h>
 #include <stdint.h>
 
 namespace audio
@@ -0,0 +1,77 @@
+#include "delta_sigma_modulator.h"
+#include <string.h>
+
+namespace audio
+{
+
+namespace
+{
+
+// 係数は 1 相ごとに合計が 1 (Q14) になるようにしてある
+// (相によって直流のゲインが違うとイメージが出る)
+constexpr int POLYPHASE_COEF_SHIFT = 14;
+constexpr int16_t POLYPHASE_COEF[4][8] = {
+    {-8, 119, -540, 1981, 15921, -1402, 386, -73},
+    {-49, 442, -1794, 7172, 12516, -2456, 652, -99},
+    {-99, 652, -2456, 12515, 7173, -1794, 442, -49},
+    {-73, 386, -1402, 15921, 1981, -540, 119, -8},
+};
+
+static_assert(PolyphaseInterpolator4::FACTOR == 4 &&
+                  PolyphaseInterpolator4::TAPS == 8,
+              "coefficient table size");
+
+template <NoiseShape SHAPE>
+constexpr DeltaSigmaFunc deltaSigmaFuncs_[DELTA_SIGMA_MAX_ORDER] = {
+    modulateDeltaSigma<1, SHAPE>,
+    modulateDeltaSigma<2, SHAPE>,
+    modulateDeltaSigma<3, SHAPE>,
+    modulateDeltaSigma<4, SHAPE>,
+    modulateDeltaSigma<5, SHAPE>,
+};
+
+} // namespace
+
+DeltaSigmaFunc
+getDeltaSigmaFunc(int order, NoiseShape shape)
+{
+    int i = std::min(std::max(order, 1), DELTA_SIGMA_MAX_ORDER) - 1;
+    return shape == NoiseShape::OPTIMIZED_ZEROS
+               ? deltaSigmaFuncs_<NoiseShape::OPTIMIZED_ZEROS>[i]
+               : deltaSigmaFuncs_<NoiseShape::DIFFERENTIATOR>[i];
+}
+
+void
+PolyphaseInterpolator4::reset()
+{
+    memset(history_, 0, sizeof(history_));
+    pos_ = 0;
+}
+
+void
+PolyphaseInterpolator4::process(int32_t* dst, const int32_t* src, size_t n)
+{
+    int pos = pos_;
+    for (; n; --n)
+    {
+        // 新しい順に並べる
+        pos                  = (pos - 1) & (TAPS - 1);
+        history_[pos]        = *src;
+        history_[pos + TAPS] = *src;
+        ++src;
+
+        const int32_t* h = history_ + pos;
+        for (const auto& coef : POLYPHASE_COEF)
+        {
+            int32_t acc = 1 << (POLYPHASE_COEF_SHIFT - 1);
+            for (int i = 0; i < TAPS; ++i)
+            {
+                acc += coef[i] * h[i];
+            }
+            *dst++ = acc >> POLYPHASE_COEF_SHIFT;
+        }
+    }
+    pos_ = pos;
+}
+
+} // namespace audio
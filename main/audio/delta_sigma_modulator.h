@@ -0,0 +1,137 @@
+#ifndef _E2B7F40C_8D13_4A6E_9C25_71F0A3D8B649
+#define _E2B7F40C_8D13_4A6E_9C25_71F0A3D8B649
+
+#include <algorithm>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace audio
+{
+
+// 内蔵 DAC (8bit) 用の ΔΣ 変調
+//
+// 誤差フィードバック型。過去の量子化誤差を足し込んで
+//   y = x + NTF(z) e
+// にし、量子化雑音を可聴帯域の外に追い出す
+// NTF の次数 (1..5) と零点の置き方はテンプレートで決める
+enum class NoiseShape
+{
+    DIFFERENTIATOR,  // (1 - z^-1)^N。零点は全部 DC
+    OPTIMIZED_ZEROS, // 零点を可聴帯域 (20kHz まで) に散らす
+};
+
+constexpr int DELTA_SIGMA_MAX_ORDER = 5;
+
+struct DeltaSigmaState
+{
+    int32_t err[DELTA_SIGMA_MAX_ORDER]; // 過去の量子化誤差 (新しい順)
+};
+
+namespace detail
+{
+
+// NTF の z^-1 から z^-N の係数 (Q12)
+// OPTIMIZED_ZEROS は 4 倍オーバーサンプリング (176.4kHz) で 20kHz までの
+// 雑音が最小になる位置 (Legendre 多項式の根) に零点を置いたもの
+constexpr int MAX_ORDER      = DELTA_SIGMA_MAX_ORDER;
+constexpr int NTF_COEF_SHIFT = 12;
+constexpr int32_t NTF_COEF[2][MAX_ORDER][MAX_ORDER] = {
+    {
+        {-4096},
+        {-8192, 4096},
+        {-12288, 12288, -4096},
+        {-16384, 24576, -16384, 4096},
+        {-20480, 40960, -40960, 20480, -4096},
+    },
+    {
+        {-4096},
+        {-7509, 4096},
+        {-11072, 11072, -4096},
+        {-14651, 21198, -14651, 4096},
+        {-18236, 34468, -34468, 18236, -4096},
+    },
+};
+
+// 出力が振り切れた時の誤差はこれで止める (発振しないように)
+constexpr int32_t MAX_ERROR = 0x100;
+
+} // namespace detail
+
+// src (0..65535) を変調して dst に L/R 同じ値で書く
+template <int ORDER, NoiseShape SHAPE>
+void
+modulateDeltaSigma(uint16_t* dst,
+                   const int32_t* src,
+                   size_t n,
+                   DeltaSigmaState& state)
+{
+    static_assert(ORDER >= 1 && ORDER <= DELTA_SIGMA_MAX_ORDER,
+                  "unsupported order");
+    constexpr auto& coef = detail::NTF_COEF[int(SHAPE)][ORDER - 1];
+
+    int32_t e[ORDER];
+    for (int i = 0; i < ORDER; ++i)
+    {
+        e[i] = state.err[i];
+    }
+
+    for (; n; --n)
+    {
+        int32_t acc = 1 << (detail::NTF_COEF_SHIFT - 1);
+        for (int i = 0; i < ORDER; ++i)
+        {
+            acc += coef[i] * e[i];
+        }
+        int32_t u = *src++ + (acc >> detail::NTF_COEF_SHIFT);
+        int32_t y = std::min(std::max((u + 0x80) & ~0xff, 0), 0xff00);
+
+        for (int i = ORDER - 1; i > 0; --i)
+        {
+            e[i] = e[i - 1];
+        }
+        constexpr int32_t maxErr = detail::MAX_ERROR;
+        e[0] = std::min(std::max(y - u, -maxErr), maxErr);
+
+        dst[0] = y;
+        dst[1] = y;
+        dst += 2;
+    }
+
+    for (int i = 0; i < ORDER; ++i)
+    {
+        state.err[i] = e[i];
+    }
+}
+
+using DeltaSigmaFunc = void (*)(uint16_t* dst,
+                                const int32_t* src,
+                                size_t n,
+                                DeltaSigmaState& state);
+
+// 実行時に選ぶ用。order は 1..DELTA_SIGMA_MAX_ORDER に丸める
+DeltaSigmaFunc getDeltaSigmaFunc(int order, NoiseShape shape);
+
+// 4 倍のポリフェーズ補間 (32 タップ, Kaiser 窓)
+// 10kHz まで平坦、16kHz で -0.7dB、イメージは 30kHz 以上で -30dB 以下
+// (44.1kHz 入力の時)
+class PolyphaseInterpolator4
+{
+public:
+    static constexpr int FACTOR = 4;
+    static constexpr int TAPS   = 8; // 1 相あたり
+
+public:
+    void reset();
+
+    // n サンプルを 4n サンプルにする
+    void process(int32_t* dst, const int32_t* src, size_t n);
+
+private:
+    // 同じ値を pos と pos + TAPS に書いて、窓がいつも連続になるようにする
+    int32_t history_[TAPS * 2]{};
+    int pos_ = 0;
+};
+
+} // namespace audio
+
+#endif /* _E2B7F40C_8D13_4A6E_9C25_71F0A3D8B649 */
@@ -0,0 +1,76 @@
+#include "drift_compensator.h"
+#include <algorithm>
+
+namespace audio
+{
+
+namespace
+{
+
+// 1 回の update() は出力 128 frame (入力 180 frame 前後) ごと
+// ずれ 1 frame あたりの変換比の補正
+constexpr float KP = 8e-6f;
+
+// 臨界制動になるくらい (KP^2 * 入力 frame 数 / 4)
+constexpr float KI = 3e-9f;
+
+// 溜まり具合の平滑化
+constexpr float SMOOTHING = 1.0f / 32;
+
+constexpr float MAX_CORRECTION =
+    DriftCompensator::MAX_CORRECTION_PPM * 1e-6f;
+
+} // namespace
+
+void
+DriftCompensator::reset()
+{
+    error_      = 0;
+    integral_   = 0;
+    correction_ = 0;
+    first_      = true;
+}
+
+void
+DriftCompensator::resetStats()
+{
+    stats_ = {};
+}
+
+float
+DriftCompensator::update(int fill)
+{
+    int e = fill - target_;
+    if (first_)
+    {
+        error_ = e;
+        first_ = false;
+    }
+    error_ += (e - error_) * SMOOTHING;
+
+    // 振り切っている間は積分しない
+    float p = error_ * KP;
+    float i = integral_ + error_ * KI;
+    float c = p + i;
+    if (c > MAX_CORRECTION || c < -MAX_CORRECTION)
+    {
+        c = std::max(-MAX_CORRECTION, std::min(MAX_CORRECTION, c));
+    }
+    else
+    {
+        integral_ = i;
+    }
+    correction_ = c;
+
+    if (!stats_.updates++)
+    {
+        stats_.minError = e;
+        stats_.maxError = e;
+    }
+    stats_.minError = std::min(stats_.minError, e);
+    stats_.maxError = std::max(stats_.maxError, e);
+
+    return 1.0f + c;
+}
+
+} // namespace audio
@@ -0,0 +1,54 @@
+#ifndef _C3A81E5D_4F26_4B90_A7D2_5E09B16F3C84
+#define _C3A81E5D_4F26_4B90_A7D2_5E09B16F3C84
+
+#include <stdint.h>
+
+namespace audio
+{
+
+// 入力と出力の時計のずれを、間のリングバッファの溜まり具合から
+// 変換比を少しずつ直して吸収する (PI 制御)
+//
+// 溜まり具合は DMA の単位でがたがたするので平滑化してから見る
+// 直す量は MAX_CORRECTION_PPM までなので音程は聞いてわかるほど変わらない
+class DriftCompensator
+{
+public:
+    static constexpr int MAX_CORRECTION_PPM = 2000;
+
+    struct Stats
+    {
+        uint32_t updates;
+        int32_t minError; // 目標からのずれ (frame)
+        int32_t maxError;
+    };
+
+public:
+    void setTarget(int frames) { target_ = frames; }
+    int getTarget() const { return target_; }
+
+    void reset();
+
+    // 変換を 1 回した後の溜まり具合 (frame) を渡す
+    // 変換比にかける値を返す
+    float update(int fill);
+
+    float getRatio() const { return 1.0f + correction_; }
+    int getPPM() const { return int(correction_ * 1e6f); }
+    float getSmoothedError() const { return error_; }
+
+    const Stats& getStats() const { return stats_; }
+    void resetStats();
+
+private:
+    int target_       = 0;
+    float error_      = 0;
+    float integral_   = 0;
+    float correction_ = 0;
+    bool first_       = true;
+    Stats stats_{};
+};
+
+} // namespace audio
+
+#endif /* _C3A81E5D_4F26_4B90_A7D2_5E09B16F3C84 */
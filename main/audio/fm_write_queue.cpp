@@ -0,0 +1,338 @@
+#include "fm_write_queue.h"
+#include <algorithm>
+#include <string.h>
+
+namespace audio
+{
+
+namespace
+{
+
+// データを書いてから次を書けるまでのクロック数
+// YM2151 は 68clock (3.58MHz で 19us)
+constexpr int OPM_DATA_BUSY_CLOCKS = 68;
+
+// YM2608 の値。SSG のレジスタは短い
+constexpr int OPNA_ADDR_BUSY_CLOCKS     = 17;
+constexpr int OPNA_SSG_DATA_BUSY_CLOCKS = 17;
+constexpr int OPNA_DATA_BUSY_CLOCKS     = 83;
+
+// micros() の分解能の分
+constexpr int BUSY_MARGIN_US = 1;
+
+// これより長いのは時刻が一周した古い値
+constexpr int32_t MAX_WAIT_US = 1000;
+
+// 予定の時刻がこれより近ければバスを持ったまま待つ
+constexpr int32_t SESSION_SPIN_US = 50;
+
+// 予定の時刻がこれより離れていたら壊れているとみなす
+constexpr int32_t MAX_SCHEDULE_US = 1000 * 1000;
+
+// 出力側が空けるのを待つ間隔
+constexpr uint32_t FLUSH_POLL_US = 20;
+
+} // namespace
+
+void
+FMWriteQueue::setChip(ChipType type, int clock)
+{
+    flush();
+    type_  = type;
+    clock_ = clock > 0 ? clock : 3579545;
+    invalidateCache();
+}
+
+void
+FMWriteQueue::invalidateCache()
+{
+    memset(cacheValid_, 0, sizeof(cacheValid_));
+}
+
+void
+FMWriteQueue::write(int addr, int v)
+{
+    int port = addr >> 1;
+    if (!(addr & 1))
+    {
+        currentReg_[port] = v;
+
+        // OPNA のプリスケーラはアドレスを書くだけ
+        if (type_ == ChipType::OPNA && port == 0 && v >= 0x2d && v <= 0x2f)
+        {
+            push(0, v, -1);
+        }
+        return;
+    }
+
+    ++stats_.writes;
+    int reg = currentReg_[port];
+    int idx = (port << 8) | reg;
+    int bit = 1 << (idx & 7);
+    if (!isVolatile(port, reg) && (cacheValid_[idx >> 3] & bit) &&
+        cache_[idx] == v)
+    {
+        ++stats_.dropped;
+        return;
+    }
+    cache_[idx] = v;
+    cacheValid_[idx >> 3] |= bit;
+
+    push(port, reg, v);
+}
+
+void
+FMWriteQueue::beginBatch()
+{
+    beginBatch(bus_ ? bus_->getMicros() : 0);
+}
+
+void
+FMWriteQueue::beginBatch(uint32_t time)
+{
+    if (batchDepth_++ == 0)
+    {
+        batchTimeUs_ = time;
+    }
+}
+
+void
+FMWriteQueue::endBatch()
+{
+    if (batchDepth_ > 0 && --batchDepth_ == 0)
+    {
+        if (wakeup_)
+        {
+            wakeup_();
+        }
+        else
+        {
+            flush();
+        }
+    }
+}
+
+void
+FMWriteQueue::flush()
+{
+    if (!bus_)
+    {
+        tail_.store(head_.load(std::memory_order_relaxed),
+                    std::memory_order_release);
+        return;
+    }
+
+    if (wakeup_)
+    {
+        // 出力側が出し終わるのを待つ
+        while (getDepth())
+        {
+            wakeup_();
+            bus_->delayMicroseconds(FLUSH_POLL_US);
+        }
+        return;
+    }
+
+    // 出力側がないので時刻は見ずにここで全部出す
+    uint32_t tail = tail_.load(std::memory_order_relaxed);
+    uint32_t head = head_.load(std::memory_order_acquire);
+    if (tail == head)
+    {
+        return;
+    }
+
+    ++stats_.sessions;
+    auto t0 = bus_->getMicros();
+    bus_->begin();
+    while (tail != head)
+    {
+        output(fifo_[tail & (FIFO_SIZE - 1)]);
+        ++tail;
+    }
+    tail_.store(tail, std::memory_order_release);
+
+    // 最後の書き込みのビジーは次に書く時まで待たない
+    bus_->end();
+    stats_.busUs += bus_->getMicros() - t0;
+}
+
+int32_t
+FMWriteQueue::drain()
+{
+    if (!bus_)
+    {
+        return 0;
+    }
+
+    uint32_t tail = tail_.load(std::memory_order_relaxed);
+    uint32_t t0   = 0;
+    bool session  = false;
+    int32_t rest  = 0;
+
+    while (tail != head_.load(std::memory_order_acquire))
+    {
+        auto& e = fifo_[tail & (FIFO_SIZE - 1)];
+        rest    = e.time - bus_->getMicros();
+        if (rest > MAX_SCHEDULE_US || rest < -MAX_SCHEDULE_US)
+        {
+            // 壊れた時刻はすぐ出す
+            rest = 0;
+        }
+        if (rest > SESSION_SPIN_US)
+        {
+            // 先が長いのでバスを離して出直す
+            break;
+        }
+
+        if (!session)
+        {
+            ++stats_.sessions;
+            t0 = bus_->getMicros();
+            bus_->begin();
+            session = true;
+        }
+        if (rest > 0)
+        {
+            bus_->delayMicroseconds(rest);
+        }
+
+        output(e);
+
+        int32_t late = bus_->getMicros() - e.time;
+        if (late > 0 && late <= MAX_SCHEDULE_US)
+        {
+            stats_.lateTotalUs += late;
+            stats_.lateMaxUs = std::max<uint32_t>(stats_.lateMaxUs, late);
+        }
+        ++stats_.timed;
+        tail_.store(++tail, std::memory_order_release);
+        rest = 0;
+    }
+
+    if (session)
+    {
+        bus_->end();
+        stats_.busUs += bus_->getMicros() - t0;
+    }
+    return rest;
+}
+
+void
+FMWriteQueue::push(int port, int reg, int value)
+{
+    uint32_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) >= FIFO_SIZE)
+    {
+        ++stats_.fifoFull;
+        if (wakeup_)
+        {
+            while (head - tail_.load(std::memory_order_acquire) >= FIFO_SIZE)
+            {
+                wakeup_();
+                bus_->delayMicroseconds(FLUSH_POLL_US);
+            }
+        }
+        else
+        {
+            flush();
+        }
+    }
+
+    uint32_t time = batchDepth_ ? batchTimeUs_ : bus_ ? bus_->getMicros() : 0;
+    fifo_[head & (FIFO_SIZE - 1)] = {
+        time + writeDelayUs_, uint8_t(port), uint8_t(reg), int16_t(value)};
+    head_.store(head + 1, std::memory_order_release);
+
+    uint32_t depth = head + 1 - tail_.load(std::memory_order_relaxed);
+    stats_.maxDepth = std::max(stats_.maxDepth, depth);
+
+    if (!batchDepth_)
+    {
+        if (wakeup_)
+        {
+            wakeup_();
+        }
+        else
+        {
+            flush();
+        }
+    }
+}
+
+void
+FMWriteQueue::output(const Entry& e)
+{
+    int addr = e.port << 1;
+    strobe(addr, e.reg, getBusyUs(e.port, e.reg, false));
+    if (e.value >= 0)
+    {
+        strobe(addr | 1, e.value, getBusyUs(e.port, e.reg, true));
+    }
+}
+
+bool
+FMWriteQueue::isVolatile(int port, int reg) const
+{
+    // 書くこと自体に意味があるもの
+    if (type_ == ChipType::OPM)
+    {
+        // LFO リセット、キーオン、タイマー、AMD/PMD (同じアドレス)
+        return reg == 0x01 || reg == 0x08 || (reg >= 0x10 && reg <= 0x14) ||
+               reg == 0x19;
+    }
+
+    // F-Number の上位はラッチで、下位を書いた時に両方入る
+    // 上位だけ変わった時も下位を書かないといけないので両方毎回書く
+    if (reg >= 0xa0 && reg <= 0xae)
+    {
+        return true;
+    }
+    if (port == 1)
+    {
+        // ADPCM
+        return reg <= 0x10;
+    }
+    // SSG のエンベロープ形状、リズムのキーオン、タイマー、キーオン
+    return reg == 0x0d || reg == 0x10 || (reg >= 0x24 && reg <= 0x28);
+}
+
+int
+FMWriteQueue::getBusyUs(int port, int reg, bool data) const
+{
+    int clocks;
+    if (type_ == ChipType::OPM)
+    {
+        clocks = data ? OPM_DATA_BUSY_CLOCKS : 0;
+    }
+    else if (!data)
+    {
+        clocks = OPNA_ADDR_BUSY_CLOCKS;
+    }
+    else
+    {
+        clocks = port == 0 && reg < 0x10 ? OPNA_SSG_DATA_BUSY_CLOCKS
+                                         : OPNA_DATA_BUSY_CLOCKS;
+    }
+    return (int64_t(clocks) * 1000000 + clock_ - 1) / clock_;
+}
+
+void
+FMWriteQueue::strobe(int addr, int v, int busyUs)
+{
+    int32_t wait = readyUs_ - bus_->getMicros();
+    if (wait > 0 && wait <= MAX_WAIT_US)
+    {
+        bus_->delayMicroseconds(wait);
+        stats_.waitUs += wait;
+    }
+
+    bus_->write(addr, v);
+    ++stats_.strobes;
+
+    if (busyUs)
+    {
+        readyUs_ = bus_->getMicros() + busyUs + BUSY_MARGIN_US;
+    }
+}
+
+} // namespace audio
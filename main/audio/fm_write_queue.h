@@ -0,0 +1,150 @@
+#ifndef _91D4B6E3_0F2A_4C87_B953_E17A28C04D6F
+#define _91D4B6E3_0F2A_4C87_B953_E17A28C04D6F
+
+#include <atomic>
+#include <functional>
+#include <stdint.h>
+
+namespace audio
+{
+
+// FM チップへの書き込みを溜めておき、まとめてバスに出す
+//
+// - beginBatch() から endBatch() までの書き込みは 1 回のバスの確保で出す
+// - 次の書き込みはチップのビジー時間だけ空ける (固定の待ちにしない)
+// - 値が変わらないレジスタへの書き込みは捨てる
+//
+// 書き込みは出す予定の時刻を付けてリングバッファに入れる。
+// setWakeup() で出力側のタスクを登録すると、書く側はバッファに入れるだけで
+// 戻り、出力側が drain() で予定の時刻に出す。
+// 書く側 (チップを確保したタスク) と出力側はそれぞれ 1 つだけ
+//
+// 出力側がない時はバッチの終わりでその場で出す
+class FMWriteQueue
+{
+public:
+    // チップがつながっているバス
+    class Bus
+    {
+    public:
+        virtual ~Bus() = default;
+
+        virtual void begin() = 0; // バスを FM 用にする
+        virtual void end()   = 0;
+
+        // CS を 1 回出す
+        virtual void write(int addr, int v) = 0;
+
+        virtual uint32_t getMicros()                = 0;
+        virtual void delayMicroseconds(uint32_t us) = 0;
+    };
+
+    enum class ChipType
+    {
+        OPM,
+        OPNA,
+    };
+
+    struct Stats
+    {
+        // 書く側
+        uint32_t writes;   // setValue() で受けたデータの書き込み
+        uint32_t dropped;  // 値が変わらないので捨てた
+        uint32_t fifoFull; // バッファが一杯で空くのを待った
+        uint32_t maxDepth; // バッファに溜まった最大数
+
+        // 出力側
+        uint32_t strobes;     // バスに出した回数 (アドレスも含む)
+        uint32_t sessions;    // バスを確保した回数
+        uint32_t waitUs;      // ビジーが明けるのを待った時間
+        uint32_t busUs;       // バスを確保していた時間
+        uint32_t timed;       // drain() で出した数
+        uint32_t lateTotalUs; // 予定の時刻からの遅れ
+        uint32_t lateMaxUs;
+    };
+
+    // 2 のべき乗
+    static constexpr int FIFO_SIZE = 512;
+
+public:
+    void setBus(Bus* bus) { bus_ = bus; }
+
+    // 出力側のタスクを起こす関数。空なら書く側で出す
+    void setWakeup(std::function<void()>&& f) { wakeup_ = std::move(f); }
+
+    // 予定の時刻をバッチの始まりからこれだけ遅らせる
+    // 書く側の処理時間のばらつきを吸収する
+    void setWriteDelay(uint32_t us) { writeDelayUs_ = us; }
+    uint32_t getWriteDelay() const { return writeDelayUs_; }
+
+    // レジスタの内容がわからなくなるので覚えている値も捨てる
+    void setChip(ChipType type, int clock);
+    void invalidateCache();
+
+    // SoundChipBase::setValue() と同じ
+    void write(int addr, int v);
+
+    // 入れ子にできる。一番外の endBatch() で出す
+    // time はバッチの予定の時刻 (省略したら今)
+    void beginBatch();
+    void beginBatch(uint32_t time);
+    void endBatch();
+
+    // 全部出し終わるまで待つ
+    void flush();
+
+    // 出力側から呼ぶ。予定の時刻が来たものを出す
+    // 0 なら空、正なら次の予定まで (us)
+    int32_t drain();
+
+    int getDepth() const
+    {
+        return head_.load(std::memory_order_acquire) -
+               tail_.load(std::memory_order_acquire);
+    }
+
+    const Stats& getStats() const { return stats_; }
+    void resetStats() { stats_ = {}; }
+
+protected:
+    struct Entry
+    {
+        uint32_t time;
+        uint8_t port;
+        uint8_t reg;
+        int16_t value; // 負ならアドレスだけ書く
+    };
+
+    void push(int port, int reg, int value);
+    void output(const Entry& e);
+    bool isVolatile(int port, int reg) const;
+    int getBusyUs(int port, int reg, bool data) const;
+    void strobe(int addr, int v, int busyUs);
+
+private:
+    Bus* bus_{};
+    std::function<void()> wakeup_;
+    ChipType type_  = ChipType::OPM;
+    int clock_      = 3579545;
+    int batchDepth_ = 0;
+
+    uint32_t writeDelayUs_ = 0;
+    uint32_t batchTimeUs_  = 0;
+
+    Entry fifo_[FIFO_SIZE];
+    std::atomic<uint32_t> head_{0}; // 書く側が進める
+    std::atomic<uint32_t> tail_{0}; // 出力側が進める
+
+    uint8_t currentReg_[2]{};
+    uint8_t cache_[512]{};
+    uint8_t cacheValid_[512 / 8]{};
+
+    // この時刻まではチップがビジー
+    uint32_t readyUs_ = 0;
+
+    Stats stats_{};
+};
+
+} // namespace audio
+
+#endif /* _91D4B6E3_0F2A_4C87_B953_E17A28C04D6F */
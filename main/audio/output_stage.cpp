@@ -0,0 +1,327 @@
+#include "output_stage.h"
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace audio
+{
+
+namespace
+{
+
+// 16.0 の振り切れ
+constexpr float FULL_SCALE = 32767.0f;
+
+// ここを超えないようにゲインを下げる (-1dBFS)
+constexpr float THRESHOLD = FULL_SCALE * 0.891f;
+
+// ゲインを戻す時定数
+constexpr float RELEASE_SEC = 0.05f;
+
+// ここまで戻ったら 1 にする (指数で近づけると 1 にならない)
+constexpr float RELEASE_SNAP = 0.9999f;
+
+// これより下げていたら limited に数える (-0.1dB)
+constexpr float LIMITED_GAIN = 0.9886f;
+
+constexpr float DAC_BIAS_FULL = OutputStage::DAC_SWING * 32768;
+
+inline float
+saturate(float v)
+{
+    return std::min(std::max(v, -32768.0f), 32767.0f);
+}
+
+} // namespace
+
+OutputStage::OutputStage()
+{
+    setSampleRate(44100);
+    resetStats();
+}
+
+void
+OutputStage::setSampleRate(uint32_t rate)
+{
+    if (rate == sampleRate_ || !rate)
+    {
+        return;
+    }
+    sampleRate_ = rate;
+    release_    = 1.0f - expf(-1.0f / (RELEASE_SEC * rate));
+}
+
+void
+OutputStage::reset()
+{
+    memset(delay_, 0, sizeof(delay_));
+    gain_   = 1.0f;
+    target_ = 1.0f;
+    step_   = 0;
+    hold_   = 0;
+}
+
+void
+OutputStage::resetStats()
+{
+    stats_         = {};
+    stats_.minGain = 1.0f;
+}
+
+void
+OutputStage::process(const Output& out, const Sample* src, size_t n)
+{
+    if (out.pcm && out.dac)
+    {
+        processImpl<true, true>(out, src, n);
+    }
+    else if (out.pcm)
+    {
+        processImpl<true, false>(out, src, n);
+    }
+    else if (out.dac)
+    {
+        processImpl<false, true>(out, src, n);
+    }
+    else
+    {
+        processImpl<false, false>(out, src, n);
+    }
+}
+
+float
+OutputStage::getInputLimit() const
+{
+    // 16.8 に音量をかけて 16.0 にした時に THRESHOLD を超えるところ
+    return THRESHOLD * 256 / volume_;
+}
+
+void
+OutputStage::updateGain(float* gain, const Sample* src, size_t n)
+{
+    float inScale = volume_ * (1.0f / 256);
+    float inLimit = getInputLimit();
+
+    float g      = gain_;
+    float target = target_;
+    float step   = step_;
+    int hold     = hold_;
+
+    uint32_t overs   = 0;
+    uint32_t limited = 0;
+    float minGain    = stats_.minGain;
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        // 入ってきたサンプルが振り切れるなら、出ていくまでに下げ切る
+        int32_t peak = std::max(abs(src[i][0]), abs(src[i][1]));
+        if (peak > inLimit)
+        {
+            float level = peak * inScale;
+            float req   = THRESHOLD / level;
+            overs += level > FULL_SCALE;
+            target = std::min(target, req);
+            step   = std::max(step, (g - req) * (1.0f / LOOKAHEAD));
+            hold   = LOOKAHEAD * 2;
+        }
+
+        if (g > target)
+        {
+            g = std::max(target, g - step);
+        }
+        else if (hold)
+        {
+            --hold;
+        }
+        else
+        {
+            target = 1.0f;
+            step   = 0;
+            g += (1.0f - g) * release_;
+            if (g > RELEASE_SNAP)
+            {
+                g = 1.0f;
+            }
+        }
+        limited += g < LIMITED_GAIN;
+        minGain = std::min(minGain, g);
+
+        // 16.8 から 16.0 にする分も入れておく
+        gain[i] = g * (1.0f / 256);
+    }
+
+    gain_   = g;
+    target_ = target;
+    step_   = step;
+    hold_   = hold;
+
+    stats_.overs += overs;
+    stats_.limited += limited;
+    stats_.minGain = minGain;
+}
+
+namespace
+{
+
+template <bool PCM, bool DAC>
+uint32_t
+convert(const OutputStage::Output& out,
+        const OutputStage::Sample* src,
+        const float* gain,
+        size_t n,
+        float volume)
+{
+    float dacScale = OutputStage::DAC_SWING * 0.5f;
+    float dacBias  = std::min(volume, 1.0f) * DAC_BIAS_FULL;
+
+    auto* history = out.history;
+    auto* pcm     = out.pcm;
+    auto* dac     = out.dac;
+
+    uint32_t clips = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        float l = src[i][0] * gain[i];
+        float r = src[i][1] * gain[i];
+
+        // 音量をかける前なので振り切れは数えない
+        history[i][0] = int16_t(saturate(l));
+        history[i][1] = int16_t(saturate(r));
+
+        l *= volume;
+        r *= volume;
+        clips += (fabsf(l) > FULL_SCALE) | (fabsf(r) > FULL_SCALE);
+        int16_t pl = int16_t(saturate(l));
+        int16_t pr = int16_t(saturate(r));
+        if (PCM)
+        {
+            pcm[i][0] = pl;
+            pcm[i][1] = pr;
+        }
+        if (DAC)
+        {
+            dac[i] = int32_t((pl + pr) * dacScale + dacBias);
+        }
+    }
+    return clips;
+}
+
+// ゲインが 1 のままの時は float にせず整数でする
+// (float の方とは丸めで 1LSB 違うことがある)
+// 振り切れは入った時に見てあるので数えない。音量が途中で上がった時の
+// ためにはみ出さないようにだけしておく
+template <bool PCM, bool DAC>
+void
+convertUnity(const OutputStage::Output& out,
+             const OutputStage::Sample* src,
+             size_t n,
+             float volume)
+{
+    int32_t vol     = int32_t(volume * 32768);
+    int32_t dacBias = int32_t(std::min(volume, 1.0f) * DAC_BIAS_FULL);
+    constexpr int32_t dacScale = int32_t(OutputStage::DAC_SWING * 0.5f * 32768);
+
+    auto clamp16 = [](int32_t v) {
+        return int16_t(std::min(std::max(v, -32768), 32767));
+    };
+
+    auto* history = out.history;
+    auto* pcm     = out.pcm;
+    auto* dac     = out.dac;
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        history[i][0] = clamp16(src[i][0] / 256);
+        history[i][1] = clamp16(src[i][1] / 256);
+
+        // 16.8 * Q15 から 16.0 に
+        int16_t pl = clamp16(int32_t(int64_t(src[i][0]) * vol >> 23));
+        int16_t pr = clamp16(int32_t(int64_t(src[i][1]) * vol >> 23));
+        if (PCM)
+        {
+            pcm[i][0] = pl;
+            pcm[i][1] = pr;
+        }
+        if (DAC)
+        {
+            dac[i] = ((pl + pr) * dacScale >> 15) + dacBias;
+        }
+    }
+}
+
+int32_t
+getPeak(const OutputStage::Sample* src, size_t n)
+{
+    int32_t peak = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        peak = std::max(peak, std::max(abs(src[i][0]), abs(src[i][1])));
+    }
+    return peak;
+}
+
+OutputStage::Output
+advance(const OutputStage::Output& out, size_t n)
+{
+    return {out.history + n,
+            out.pcm ? out.pcm + n : nullptr,
+            out.dac ? out.dac + n : nullptr};
+}
+
+} // namespace
+
+template <bool PCM, bool DAC>
+void
+OutputStage::processImpl(const Output& out, const Sample* src, size_t n)
+{
+    auto o = out;
+    stats_.samples += n;
+
+    while (n)
+    {
+        size_t ct = std::min<size_t>(n, CHUNK);
+
+        // 出ていくのは LOOKAHEAD 前に入ったもの
+        size_t nd = std::min<size_t>(ct, LOOKAHEAD);
+
+        // ゲインが 1 に戻っていて、入ってくるものも下げなくてよいなら
+        // 包絡は作らない (遅らせている分は入った時に見てある)
+        if (gain_ == 1.0f && !hold_ && getPeak(src, ct) <= getInputLimit())
+        {
+            convertUnity<PCM, DAC>(o, delay_, nd, volume_);
+            if (ct >= LOOKAHEAD)
+            {
+                convertUnity<PCM, DAC>(advance(o, nd), src, ct - nd, volume_);
+            }
+        }
+        else
+        {
+            float gain[CHUNK];
+            updateGain(gain, src, ct);
+
+            stats_.clips += convert<PCM, DAC>(o, delay_, gain, nd, volume_);
+            if (ct >= LOOKAHEAD)
+            {
+                stats_.clips += convert<PCM, DAC>(
+                    advance(o, nd), src, gain + nd, ct - nd, volume_);
+            }
+        }
+
+        if (ct >= LOOKAHEAD)
+        {
+            memcpy(delay_, src + ct - LOOKAHEAD, sizeof(delay_));
+        }
+        else
+        {
+            memmove(delay_, delay_ + ct, (LOOKAHEAD - ct) * sizeof(Sample));
+            memcpy(delay_ + LOOKAHEAD - ct, src, ct * sizeof(Sample));
+        }
+
+        o = advance(o, ct);
+        src += ct;
+        n -= ct;
+    }
+}
+
+} // namespace audio
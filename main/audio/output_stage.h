@@ -0,0 +1,91 @@
+#ifndef _5A0C9E71_3B64_4F28_A1D7_C6E28B93F015
+#define _5A0C9E71_3B64_4F28_A1D7_C6E28B93F015
+
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace audio
+{
+
+// AudioOut タスクで作ったサンプル (16.8) に音量とリミッタをかけて
+// 出力の形式にするまでを 1 回のループでする
+// ゲインだけ先に作っておくので、変換のループは分岐がなく 1 サンプルずつ
+// 独立している (コンパイラがベクトル化できる)
+// ゲインが 1 のままで下げる必要もない間は、包絡を作らず整数で変換する
+//
+// リミッタは LOOKAHEAD サンプル先のピークを見て、そこまでにゲインを
+// 下げ切る。振り切れる前に下がるので歪まない
+// そのかわり出力は LOOKAHEAD サンプル遅れる
+class OutputStage
+{
+public:
+    using Sample    = std::array<int32_t, 2>; // 16.8 L/R
+    using PCMSample = std::array<int16_t, 2>; // 16.0 L/R
+
+    // 2 のべき乗
+    static constexpr int LOOKAHEAD = 32;
+
+    // 内蔵 DAC の振れ幅 (歪み避け)
+    static constexpr float DAC_SWING = 0.3f * 2;
+
+    // 出力先。pcm と dac は nullptr なら作らない
+    struct Output
+    {
+        PCMSample* history; // 表示用。音量をかける前
+        PCMSample* pcm;     // 音量をかけたもの
+        int32_t* dac;       // 内蔵 DAC 用。L+R を 0..65535 に
+    };
+
+    struct Stats
+    {
+        uint32_t samples;
+        uint32_t overs;   // リミッタがなければ振り切れていた
+        uint32_t clips;   // リミッタを通しても振り切れた
+        uint32_t limited; // ゲインを 0.1dB より下げていた
+        float minGain;
+    };
+
+public:
+    OutputStage();
+
+    void setSampleRate(uint32_t rate);
+    void setVolume(float v) { volume_ = v; }
+    void reset();
+
+    void process(const Output& out, const Sample* src, size_t n);
+
+    const Stats& getStats() const { return stats_; }
+    void resetStats();
+
+protected:
+    float getInputLimit() const;
+
+    // ゲインの包絡を作る (前のサンプルに依存するのでここだけ 1 つずつ)
+    void updateGain(float* gain, const Sample* src, size_t n);
+
+    template <bool PCM, bool DAC>
+    void processImpl(const Output& out, const Sample* src, size_t n);
+
+private:
+    // ゲインは CHUNK ずつ作る
+    static constexpr int CHUNK = 64;
+    static_assert(CHUNK >= LOOKAHEAD, "chunk size");
+
+    Sample delay_[LOOKAHEAD]{}; // 古い順
+
+    float gain_   = 1.0f; // 今かけているゲイン
+    float target_ = 1.0f; // 下げ切る先
+    float step_   = 0;    // 1 サンプルで下げる量
+    int hold_     = 0;    // 戻し始めるまで
+
+    uint32_t sampleRate_ = 0;
+    float release_       = 0;
+    float volume_        = 1.0f;
+
+    Stats stats_{};
+};
+
+} // namespace audio
+
+#endif /* _5A0C9E71_3B64_4F28_A1D7_C6E28B93F015 */
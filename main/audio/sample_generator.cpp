@@ -4,7 +4,9 @@
  */
 
 #include "sample_generator.h"
+#include "../debug.h"
 #include <mutex>
+#include <system/util.h>
 
 namespace audio
 {
@@ -20,54 +22,175 @@ getSampleGeneratorManager()
     return manager_;
 }
 
-void
+SampleGeneratorManager::SampleGeneratorManager()
+    : current_(new Snapshot{})
+{
+}
+
+SampleGeneratorManager::~SampleGeneratorManager()
+{
+    delete current_.load();
+}
+
+bool
 SampleGeneratorManager::add(SampleGenerator* s)
 {
     std::lock_guard<sys::Mutex> lock(mutex_);
-    s->setSampleRate(sampleRate_);
-    for (auto p : generators_)
+    auto* cur = current_.load();
+    for (int i = 0; i < cur->count; ++i)
     {
-        if (p == s)
+        if (cur->generators[i] == s)
         {
-            return;
+            return true;
         }
     }
-    generators_.push_back(s);
+    if (cur->count == MAX_GENERATORS)
+    {
+        DBOUT(("SampleGeneratorManager: too many generators.\n"));
+        return false;
+    }
+
+    // 空いている統計の場所
+    int slot = 0;
+    while (stats_[slot].generator.load())
+    {
+        ++slot;
+    }
+    auto& st = stats_[slot];
+    st.calls.store(0);
+    st.totalUs.store(0);
+    st.maxUs.store(0);
+    st.generator.store(s);
+
+    auto* next = new Snapshot(*cur);
+    next->generators[next->count] = s;
+    next->slots[next->count]      = slot;
+    ++next->count;
+    publish(next);
+    return true;
 }
+
 void
 SampleGeneratorManager::remove(SampleGenerator* s)
 {
     std::lock_guard<sys::Mutex> lock(mutex_);
-    for (auto p = generators_.begin(); p != generators_.end();)
+    auto* cur  = current_.load();
+    auto* next = new Snapshot(*cur);
+
+    next->count = 0;
+    int slot    = -1;
+    for (int i = 0; i < cur->count; ++i)
+    {
+        if (cur->generators[i] == s)
+        {
+            slot = cur->slots[i];
+            continue;
+        }
+        next->generators[next->count] = cur->generators[i];
+        next->slots[next->count]      = cur->slots[i];
+        ++next->count;
+    }
+    if (slot < 0)
+    {
+        delete next;
+        return;
+    }
+    publish(next);
+    stats_[slot].generator.store(nullptr);
+}
+
+void
+SampleGeneratorManager::publish(Snapshot* s)
+{
+    s->serial = current_.load()->serial + 1;
+    auto* old = current_.exchange(s);
+
+    // 古い方を読み終わるまで待ってから捨てる
+    // 読むのは 1 ブロックの間だけ
+    while (reading_.load() == old)
+    {
+        sys::delay(1);
+    }
+    delete old;
+}
+
+void
+SampleGeneratorManager::accumSamples(std::array<int32_t, 2>* buffer,
+                                     uint32_t samples)
+{
+    // 読み始めたものを書く側に知らせる。知らせる間に差し替わっていたら
+    // 読み直す
+    Snapshot* s;
+    do
     {
-        if (*p == s)
+        s = current_.load();
+        reading_.store(s);
+    } while (s != current_.load());
+
+    float rate = sampleRate_.load(std::memory_order_relaxed);
+    if (s->serial != appliedSerial_ || rate != appliedRate_)
+    {
+        for (int i = 0; i < s->count; ++i)
         {
-            p = generators_.erase(p);
+            s->generators[i]->setSampleRate(rate);
         }
-        else
+        appliedSerial_ = s->serial;
+        appliedRate_   = rate;
+    }
+
+    for (int i = 0; i < s->count; ++i)
+    {
+        auto t0 = sys::micros();
+        s->generators[i]->accumSamples(buffer, samples);
+        uint32_t dt = sys::micros() - t0;
+
+        auto& st = stats_[s->slots[i]];
+        st.calls.fetch_add(1, std::memory_order_relaxed);
+        st.totalUs.fetch_add(dt, std::memory_order_relaxed);
+        if (dt > st.maxUs.load(std::memory_order_relaxed))
         {
-            ++p;
+            st.maxUs.store(dt, std::memory_order_relaxed);
         }
     }
+
+    reading_.store(nullptr, std::memory_order_release);
 }
 
-void SampleGeneratorManager::accumSamples(std::array<int32_t, 2>* buffer,
-                                          uint32_t samples)
+void
+SampleGeneratorManager::setSampleRate(float rate)
 {
-    std::lock_guard<sys::Mutex> lock(mutex_);
-    for (auto p : generators_)
+    // 実際に伝えるのは次の accumSamples()
+    sampleRate_.store(rate, std::memory_order_relaxed);
+}
+
+size_t
+SampleGeneratorManager::getStats(Stats* stats, size_t maxCount) const
+{
+    size_t n = 0;
+    for (auto& st : stats_)
     {
-        p->accumSamples(buffer, samples);
+        auto* g = st.generator.load(std::memory_order_relaxed);
+        if (!g || n == maxCount)
+        {
+            continue;
+        }
+        stats[n].generator = g;
+        stats[n].calls     = st.calls.load(std::memory_order_relaxed);
+        stats[n].totalUs   = st.totalUs.load(std::memory_order_relaxed);
+        stats[n].maxUs     = st.maxUs.load(std::memory_order_relaxed);
+        ++n;
     }
+    return n;
 }
+
 void
-SampleGeneratorManager::setSampleRate(float rate)
+SampleGeneratorManager::resetStats()
 {
-    std::lock_guard<sys::Mutex> lock(mutex_);
-    sampleRate_ = rate;
-    for (auto p : generators_)
+    for (auto& st : stats_)
     {
-        p->setSampleRate(rate);
+        st.calls.store(0, std::memory_order_relaxed);
+        st.totalUs.store(0, std::memory_order_relaxed);
+        st.maxUs.store(0, std::memory_order_relaxed);
     }
 }
 
@@ -6,9 +6,10 @@
 #define _88AA8384_C134_13F8_1630_CF77341533DD
 
 #include <array>
+#include <atomic>
+#include <stddef.h>
 #include <stdint.h>
 #include <system/mutex.h>
-#include <vector>
 
 namespace audio
 {
@@ -23,19 +24,76 @@ public:
     virtual void setSampleRate(float rate)      = 0;
 };
 
+// 登録されている SampleGenerator を鳴らす
+//
+// 一覧は書き換えるたびに新しく作って差し替える。オーディオのスレッドは
+// その時の一覧を読むだけなのでロックを取らない
+// 古い一覧はオーディオのスレッドが読み終わるのを待ってから捨てる
+//
+// accumSamples() と setSampleRate() はオーディオのスレッドから呼ぶ
+// (SampleGenerator::setSampleRate() もそこから呼ぶ)
 class SampleGeneratorManager
 {
-    std::vector<SampleGenerator*> generators_;
-    sys::Mutex mutex_;
+public:
+    static constexpr int MAX_GENERATORS = 8;
 
-    float sampleRate_ = 44100;
+    struct Stats
+    {
+        const SampleGenerator* generator;
+        uint32_t calls;
+        uint32_t totalUs;
+        uint32_t maxUs;
+    };
 
 public:
-    void add(SampleGenerator* s);
+    SampleGeneratorManager();
+    ~SampleGeneratorManager();
+
+    // 一杯なら false
+    bool add(SampleGenerator* s);
+
+    // 戻ったら s はもう呼ばれない
     void remove(SampleGenerator* s);
 
     void accumSamples(std::array<int32_t, 2>* buffer, uint32_t samples);
     void setSampleRate(float rate);
+
+    // 登録されているものの分 (最大 MAX_GENERATORS) を返す
+    size_t getStats(Stats* stats, size_t maxCount) const;
+    void resetStats();
+
+protected:
+    // 書き換えない一覧
+    struct Snapshot
+    {
+        uint32_t serial;
+        int count;
+        SampleGenerator* generators[MAX_GENERATORS];
+        int slots[MAX_GENERATORS]; // stats_ の位置
+    };
+
+    struct Slot
+    {
+        std::atomic<const SampleGenerator*> generator{};
+        std::atomic<uint32_t> calls{};
+        std::atomic<uint32_t> totalUs{};
+        std::atomic<uint32_t> maxUs{};
+    };
+
+    void publish(Snapshot* s);
+
+private:
+    std::atomic<Snapshot*> current_;
+    std::atomic<Snapshot*> reading_{}; // オーディオのスレッドが読んでいる
+    sys::Mutex mutex_;                 // 書き換える側だけ
+
+    std::atomic<float> sampleRate_{44100};
+
+    // オーディオのスレッドだけが触る
+    uint32_t appliedSerial_ = 0;
+    float appliedRate_      = 0;
+
+    Slot stats_[MAX_GENERATORS];
 };
 
 SampleGeneratorManager& getSampleGeneratorManager();
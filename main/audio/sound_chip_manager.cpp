@@ -7,8 +7,13 @@
 #include "../debug.h"
 #include "../target.h"
 #include "audio.h"
+#include "fm_write_queue.h"
 #include "opna_volume_adjuster.h"
 #include <esp32-hal.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <system/alloc_trap.h>
 #include <system/util.h>
 
 namespace audio
@@ -26,38 +31,61 @@ enum class ChipType
 
 ChipType attachedChip_ = ChipType::NONE;
 
-class FMChip : public SoundChipBase
+// バスに書くタスク。タイマータスク (21) より上で、Bluetooth のいない側
+constexpr int WRITER_PRIORITY = 22;
+constexpr int WRITER_CORE     = 1;
+
+// タイマーが鳴ってからこれだけ後に書く
+// コールバックの処理時間が変わっても書く間隔が揺れないようにする
+constexpr uint32_t WRITE_DELAY_US = 500;
+
+class TargetFMBus final : public FMWriteQueue::Bus
 {
 public:
-    void setValue(int addr, int v) override
+    void begin() override { target::setupBus(useA1_); }
+
+    void end() override
     {
-#if 1
-        if (mode_ != ChipType::NONE)
+        target::setBusIdle();
+        target::restoreBus(useA1_);
+    }
+
+    void write(int addr, int v) override
+    {
+        target::writeBusData(v);
+        target::setFMA0(addr & 1);
+        if (useA1_)
         {
-            bool useA1 = mode_ == ChipType::YMF288;
-            target::setupBus(useA1);
+            target::setFMA1(addr & 2 ? 1 : 0);
+        }
 
-            target::writeBusData(v);
-            target::setFMA0(addr & 1);
-            if (useA1)
-            {
-                target::setFMA1(addr & 2 ? 1 : 0);
-            }
+        target::assertFMCS();
 
-            target::assertFMCS();
+        delayMicroseconds(1); // 250nsくらいでいい
 
-            delayMicroseconds(1); // 250nsくらいでいい
+        target::negateFMCS();
+    }
+
+    uint32_t getMicros() override { return sys::micros(); }
+    void delayMicroseconds(uint32_t us) override { ::delayMicroseconds(us); }
 
-            target::negateFMCS();
+    void setUseA1(bool f) { useA1_ = f; }
 
-            // 3.579545MHz 68clock = 19us
-            delayMicroseconds(10);
-            target::setBusIdle();
-            delayMicroseconds(9);
+private:
+    bool useA1_ = false;
+};
 
-            target::restoreBus(useA1);
+class FMChip : public SoundChipBase
+{
+public:
+    FMChip() { queue_.setBus(&bus_); }
+
+    void setValue(int addr, int v) override
+    {
+        if (mode_ != ChipType::NONE)
+        {
+            queue_.write(addr, v);
         }
-#endif
     }
 
     int getValue(int addr) override { return 0; }
@@ -67,13 +95,86 @@ public:
         DBOUT(("setClock: %d\n", clock));
         //        target::startFMClock(clock);
         setFMClock(clock);
+        clock_ = clock;
+        updateQueue();
         return clock;
     }
 
-    void setMode(ChipType mode) { mode_ = mode; }
+    void setMode(ChipType mode)
+    {
+        mode_ = mode;
+        updateQueue();
+    }
+
+    FMWriteQueue& getQueue() { return queue_; }
+
+    void startWriter()
+    {
+        if (writerTask_)
+        {
+            return;
+        }
+
+        // tick より短い待ちも空回りせずに寝て待つ
+        esp_timer_create_args_t args{};
+        args.callback = [](void* p) {
+            xTaskNotifyGive(static_cast<FMChip*>(p)->writerTask_);
+        };
+        args.arg             = this;
+        args.dispatch_method = ESP_TIMER_TASK;
+        args.name            = "FMWriter";
+        esp_timer_create(&args, &wakeupTimer_);
+
+        xTaskCreatePinnedToCore(
+            [](void* p) { static_cast<FMChip*>(p)->task(); },
+            "FMWriter",
+            2048,
+            this,
+            WRITER_PRIORITY,
+            &writerTask_,
+            WRITER_CORE);
+
+        queue_.setWriteDelay(WRITE_DELAY_US);
+        queue_.setWakeup([this] { xTaskNotifyGive(writerTask_); });
+    }
+
+protected:
+    void task()
+    {
+        sys::registerRealtimeTask();
+        while (1)
+        {
+            int32_t rest = queue_.drain();
+            if (rest)
+            {
+                // 次の予定の時刻にタイマーで起こす
+                // 先に書き込みで起こされても drain() し直すだけ
+                esp_timer_stop(wakeupTimer_);
+                esp_timer_start_once(wakeupTimer_, rest);
+            }
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+    }
+
+    void updateQueue()
+    {
+        // 溜まっているものは前の設定で出す
+        bool opna = mode_ == ChipType::YMF288;
+        queue_.setChip(opna ? FMWriteQueue::ChipType::OPNA
+                            : FMWriteQueue::ChipType::OPM,
+                       clock_);
+        bus_.setUseA1(opna);
+    }
 
 public:
     ChipType mode_ = {};
+    int clock_     = 3579545;
+
+private:
+    TargetFMBus bus_;
+    FMWriteQueue queue_;
+    TaskHandle_t writerTask_{};
+    esp_timer_handle_t wakeupTimer_{};
 };
 
 FMChip chip_;
@@ -114,6 +215,7 @@ allocateYM2151()
     if (!occupied_ && attachedChip_ == ChipType::YM2151)
     {
         occupied_ = true;
+        chip_.startWriter();
         chip_.setMode(ChipType::YM2151);
         return &chip_;
     }
@@ -126,6 +228,7 @@ allocateYMF288()
     if (!occupied_ && attachedChip_ == ChipType::YMF288)
     {
         occupied_ = true;
+        chip_.startWriter();
         chip_.setMode(ChipType::YMF288);
         return &chip288_;
     }
@@ -144,6 +247,30 @@ freeYMF288(SoundChipBase* p)
     occupied_ = false;
 }
 
+void
+beginFMWriteBatch()
+{
+    chip_.getQueue().beginBatch();
+}
+
+void
+beginFMWriteBatch(uint32_t time)
+{
+    chip_.getQueue().beginBatch(time);
+}
+
+void
+endFMWriteBatch()
+{
+    chip_.getQueue().endBatch();
+}
+
+const FMWriteQueue::Stats&
+getFMWriteStats()
+{
+    return chip_.getQueue().getStats();
+}
+
 void
 setYMF288FMVolume(int adj)
 {
@@ -166,11 +293,13 @@ resetYM2151()
     chip_.setMode(ChipType::YM2151);
     chip_.setClock(3579545);
     sys::delay(1);
+    beginFMWriteBatch();
     for (int i = 0; i < 8; ++i)
     {
         chip_.setValue(0, 8);
         chip_.setValue(1, i);
     }
+    endFMWriteBatch();
 }
 
 void
@@ -180,6 +309,7 @@ resetYMF288()
     chip_.setMode(ChipType::YMF288);
     chip_.setClock(8000000);
     sys::delay(1);
+    beginFMWriteBatch();
     for (int i = 0; i < 256; ++i)
     {
         chip_.setValue(0, i);
@@ -205,6 +335,7 @@ resetYMF288()
         chip_.setValue(0, 0xb4 + i);
         chip_.setValue(1, 128 + 64);
     }
+    endFMWriteBatch();
 }
 
 } // namespace
@@ -6,6 +6,7 @@
 #ifndef _1F321D27_9133_F071_1F24_8F8A844D1FA3
 #define _1F321D27_9133_F071_1F24_8F8A844D1FA3
 
+#include "fm_write_queue.h"
 #include "sound_chip.h"
 
 namespace audio
@@ -17,6 +18,13 @@ void freeYM2151(SoundChipBase* p);
 SoundChipBase* allocateYMF288();
 void freeYMF288(SoundChipBase* p);
 
+// この間の書き込みはまとめてバスに出す (入れ子にできる)
+// time を渡すとその時刻を基準に書く
+void beginFMWriteBatch();
+void beginFMWriteBatch(uint32_t time);
+void endFMWriteBatch();
+const FMWriteQueue::Stats& getFMWriteStats();
+
 void setYMF288FMVolume(int adj);
 void setYMF288RhythmVolume(int adj);
 
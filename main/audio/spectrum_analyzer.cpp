@@ -0,0 +1,107 @@
+#include "spectrum_analyzer.h"
+#include "roudness.h"
+#include <assert.h>
+#include <math.h>
+
+namespace audio
+{
+
+namespace
+{
+// 画面の更新より少し速ければ十分
+constexpr uint32_t ANALYSIS_PER_SEC = 60;
+} // namespace
+
+void
+SpectrumAnalyzer::update(const HistoryRingBuffer& history,
+                         size_t n,
+                         uint32_t sampleRate)
+{
+    pendingSamples_ += n;
+    if (pendingSamples_ < sampleRate / ANALYSIS_PER_SEC)
+    {
+        return;
+    }
+    pendingSamples_ = 0;
+
+    analyze(history, sampleRate);
+}
+
+void
+SpectrumAnalyzer::analyze(const HistoryRingBuffer& history,
+                          uint32_t sampleRate)
+{
+    assert(FFT_SIZE * DECIMATION <= history.getMask() + 1);
+
+    if (tableSampleRate_ != sampleRate)
+    {
+        updateWeightTable(sampleRate);
+    }
+
+    auto& r        = results_[back_];
+    r.binFrequency = static_cast<float>(sampleRate) / DECIMATION / FFT_SIZE;
+
+    // wave, level
+    history.copyLatest(r.wave.data(), WAVE_SAMPLE_COUNT);
+    {
+        std::array<float, 2> total{};
+        for (auto& v : r.wave)
+        {
+            total[0] += v[0] * v[0];
+            total[1] += v[1] * v[1];
+        }
+        constexpr float lvs = 1.0f / (32768.0f * 32768.0f * WAVE_SAMPLE_COUNT);
+        r.level[0]          = total[0] * lvs;
+        r.level[1]          = total[1] * lvs;
+    }
+
+    // spectrum
+    // 窓関数を掛けつつ1/3に周波数下げてコピー (44100 -> 14700Hz)
+    const int16_t* window = fft_.getWindow();
+    history.copyLatest(
+        fftBuffer_, FFT_SIZE, DECIMATION, [&](const HistorySample& v) {
+            int wf = *window++;                // [0:32767]
+            return ((v[0] + v[1]) * wf) >> 16; // (15+1)+15-16=15
+        });
+
+    int exp       = fft_.apply(fftBuffer_);
+    fftBuffer_[0] = 0;
+
+    // X[k] = (a[k], a[n-k]) << exp
+    const float powerScale = ldexpf(1.0f, exp * 2);
+    for (int k = 0; k < BIN_COUNT; ++k)
+    {
+        float re = fftBuffer_[k];
+        float im = k && k < FFT_SIZE / 2 ? fftBuffer_[FFT_SIZE - k] : 0;
+        float pw = (re * re + im * im) * powerScale;
+
+        r.power[k]  = pw;
+        r.weight[k] = pw * roudnessTable_[k];
+    }
+
+    back_ = shared_.exchange(back_ | FRESH) & ~FRESH;
+}
+
+void
+SpectrumAnalyzer::updateWeightTable(uint32_t sampleRate)
+{
+    tableSampleRate_ = sampleRate;
+
+    float binFreq = static_cast<float>(sampleRate) / DECIMATION / FFT_SIZE;
+    for (int k = 0; k < BIN_COUNT; ++k)
+    {
+        roudnessTable_[k] = computeRoudness(binFreq * k);
+    }
+}
+
+const SpectrumAnalyzer::Result&
+SpectrumAnalyzer::acquire()
+{
+    if (shared_.load() & FRESH)
+    {
+        front_ = shared_.exchange(front_) & ~FRESH;
+    }
+    return results_[front_];
+}
+
+} // namespace audio
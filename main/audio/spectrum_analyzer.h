@@ -0,0 +1,65 @@
+#ifndef BB36A095_C915_4A55_AAB0_301F40AC0A32
+#define BB36A095_C915_4A55_AAB0_301F40AC0A32
+
+#include <array>
+#include <atomic>
+#include <stdint.h>
+#include <util/fft.h>
+#include <util/simple_ring_buffer.h>
+
+namespace audio
+{
+
+// 出力履歴から波形, レベル, スペクトルを一定間隔で計算して公開する
+// 画面とNeoPixelで共有する
+class SpectrumAnalyzer
+{
+public:
+    static constexpr int FFT_SIZE          = 256;
+    static constexpr int DECIMATION        = 3;
+    static constexpr int WAVE_SAMPLE_COUNT = 128;
+    static constexpr int BIN_COUNT         = FFT_SIZE / 2 + 1;
+
+    using HistorySample     = std::array<int16_t, 2>;
+    using HistoryRingBuffer = util::SimpleRingBuffer<HistorySample>;
+
+    struct Result
+    {
+        std::array<HistorySample, WAVE_SAMPLE_COUNT> wave{};
+        std::array<float, 2> level{};          // 平均二乗 (full scale = 1)
+        std::array<float, BIN_COUNT> power{};  // |X[k]|^2
+        std::array<float, BIN_COUNT> weight{}; // |X[k]|^2 * roudness
+        float binFrequency = 44100.0f / DECIMATION / FFT_SIZE; // Hz/bin
+    };
+
+public:
+    // オーディオ側から毎ブロック呼ぶ. 一定サンプル毎に解析する
+    void update(const HistoryRingBuffer& history,
+                size_t n,
+                uint32_t sampleRate);
+
+    // 最新の結果. 読み出し側は1スレッドのみ
+    const Result& acquire();
+
+private:
+    void analyze(const HistoryRingBuffer& history, uint32_t sampleRate);
+    void updateWeightTable(uint32_t sampleRate);
+
+private:
+    util::RealFFT fft_{FFT_SIZE};
+    int16_t fftBuffer_[FFT_SIZE];
+    std::array<float, BIN_COUNT> roudnessTable_{};
+    uint32_t tableSampleRate_ = 0;
+    uint32_t pendingSamples_  = 0;
+
+    // triple buffer
+    static constexpr int FRESH = 4;
+    Result results_[3];
+    int back_  = 0;
+    int front_ = 1;
+    std::atomic<int> shared_{2};
+};
+
+} // namespace audio
+
+#endif /* BB36A095_C915_4A55_AAB0_301F40AC0A32 */
@@ -0,0 +1,292 @@
+#include "compositor.h"
+#include <algorithm>
+#include <assert.h>
+#include <system/util.h>
+
+namespace graphics
+{
+
+namespace
+{
+
+DirtyRegion::Rect
+merge(const DirtyRegion::Rect& a, const DirtyRegion::Rect& b)
+{
+    return {std::min(a.x0, b.x0),
+            std::min(a.y0, b.y0),
+            std::max(a.x1, b.x1),
+            std::max(a.y1, b.y1)};
+}
+
+} // namespace
+
+void
+DirtyRegion::add(Rect r)
+{
+    if (r.isEmpty())
+    {
+        return;
+    }
+
+    // 結合すると別の矩形にかかるようになることがあるので収束するまで繰り返す
+    bool merged = true;
+    while (merged)
+    {
+        merged = false;
+        for (int i = 0; i < n_; ++i)
+        {
+            auto& e = rects_[i];
+            auto u  = merge(e, r);
+            if (u.getArea() <= e.getArea() + r.getArea() + MERGE_COST_PIXELS)
+            {
+                r = u;
+                e = rects_[--n_];
+                merged = true;
+                break;
+            }
+        }
+    }
+
+    if (n_ < MAX_RECTS)
+    {
+        rects_[n_++] = r;
+        return;
+    }
+
+    // 一杯なら一番増分が少ないものと結合する
+    int best     = 0;
+    int bestCost = 0;
+    for (int i = 0; i < n_; ++i)
+    {
+        auto& e  = rects_[i];
+        int cost = merge(e, r).getArea() - e.getArea();
+        if (i == 0 || cost < bestCost)
+        {
+            best     = i;
+            bestCost = cost;
+        }
+    }
+    r           = merge(rects_[best], r);
+    rects_[best] = rects_[--n_];
+    add(r);
+}
+
+////
+
+void
+Compositor::setBackingStore(FrameBufferBase* fb)
+{
+    backing_ = fb;
+    dirty_.clear();
+    if (fb)
+    {
+        invalidate(0, 0, fb->getBufferWidth(), fb->getBufferHeight());
+    }
+}
+
+void
+Compositor::invalidate(int x, int y, int w, int h)
+{
+    int bw = backing_->getBufferWidth();
+    int bh = backing_->getBufferHeight();
+    dirty_.add({std::max(0, x),
+                std::max(0, y),
+                std::min(bw, x + w),
+                std::min(bh, y + h)});
+}
+
+void
+Compositor::addDirty(int x, int y, int w, int h)
+{
+    int wx0 = getLeft();
+    int wy0 = getTop();
+    int wx1 = wx0 + getWidth();
+    int wy1 = wy0 + getHeight();
+    dirty_.add({std::max(wx0, x),
+                std::max(wy0, y),
+                std::min(wx1, x + w),
+                std::min(wy1, y + h)});
+}
+
+void
+Compositor::flush(FrameBufferBase& dst)
+{
+    assert(backing_);
+
+    if (backing_ == &dst)
+    {
+        // 直接描いているので送るものはない
+        dirty_.clear();
+        stats_ = {};
+        return;
+    }
+
+    auto t0 = sys::micros();
+
+    stats_.regions = dirty_.getCount();
+    stats_.pixels  = 0;
+
+    dst.setWindow(0, 0, dst.getBufferWidth(), dst.getBufferHeight());
+    for (int i = 0; i < dirty_.getCount(); ++i)
+    {
+        auto& r = dirty_.get(i);
+        backing_->transferTo(
+            dst, r.x0, r.y0, r.x0, r.y0, r.getWidth(), r.getHeight());
+        stats_.pixels += r.getArea();
+    }
+    dirty_.clear();
+
+    stats_.flushTimeUS = sys::micros() - t0;
+}
+
+void
+Compositor::setWindow(uint32_t x, uint32_t y, uint32_t w, uint32_t h)
+{
+    backing_->setWindow(x, y, w, h);
+}
+
+uint32_t
+Compositor::getLeft() const
+{
+    return backing_->getLeft();
+}
+
+uint32_t
+Compositor::getTop() const
+{
+    return backing_->getTop();
+}
+
+uint32_t
+Compositor::getWidth() const
+{
+    return backing_->getWidth();
+}
+
+uint32_t
+Compositor::getHeight() const
+{
+    return backing_->getHeight();
+}
+
+uint32_t
+Compositor::getBufferWidth() const
+{
+    return backing_->getBufferWidth();
+}
+
+uint32_t
+Compositor::getBufferHeight() const
+{
+    return backing_->getBufferHeight();
+}
+
+uint32_t
+Compositor::makeColor(int r, int g, int b) const
+{
+    return backing_->makeColor(r, g, b);
+}
+
+void
+Compositor::fill(uint32_t c)
+{
+    // fill, setPixel は window でクリップされない
+    invalidate(0, 0, getBufferWidth(), getBufferHeight());
+    backing_->fill(c);
+}
+
+void
+Compositor::fill(int x, int y, int w, int h, uint32_t c)
+{
+    invalidate(x, y, w, h);
+    backing_->fill(x, y, w, h, c);
+}
+
+void
+Compositor::setPixel(uint32_t x, uint32_t y, uint32_t c)
+{
+    invalidate(x, y, 1, 1);
+    backing_->setPixel(x, y, c);
+}
+
+uint32_t
+Compositor::getPixel(uint32_t x, uint32_t y) const
+{
+    return backing_->getPixel(x, y);
+}
+
+void
+Compositor::drawBits16(
+    int x, int y, int w, int h, int pitchInBytes, const void* img16)
+{
+    addDirty(x, y, w, h);
+    backing_->drawBits16(x, y, w, h, pitchInBytes, img16);
+}
+
+void
+Compositor::put(
+    const Texture& tex, int dx, int dy, int sx, int sy, int w, int h)
+{
+    addDirty(dx, dy, w, h);
+    backing_->put(tex, dx, dy, sx, sy, w, h);
+}
+
+void
+Compositor::putTrans(
+    const Texture& tex, int dx, int dy, int sx, int sy, int w, int h)
+{
+    addDirty(dx, dy, w, h);
+    backing_->putTrans(tex, dx, dy, sx, sy, w, h);
+}
+
+void
+Compositor::putReplaced(const Texture& tex,
+                        int dx,
+                        int dy,
+                        int sx,
+                        int sy,
+                        int w,
+                        int h,
+                        uint16_t color,
+                        uint16_t bg)
+{
+    addDirty(dx, dy, w, h);
+    backing_->putReplaced(tex, dx, dy, sx, sy, w, h, color, bg);
+}
+
+// backing store 側の kernel を使うため丸ごと委譲する
+void
+Compositor::drawBits(
+    int x, int y, int w, int h, const uint8_t* bits, uint32_t color)
+{
+    addDirty(x, y, w, h);
+    backing_->drawBits(x, y, w, h, bits, color);
+}
+
+void
+Compositor::drawBits(int x,
+                     int y,
+                     int w,
+                     int h,
+                     const uint8_t* bits,
+                     uint32_t color,
+                     uint32_t bgColor)
+{
+    addDirty(x, y, w, h);
+    backing_->drawBits(x, y, w, h, bits, color, bgColor);
+}
+
+void
+Compositor::drawBitsThick(int x,
+                          int y,
+                          int w,
+                          int h,
+                          const uint8_t* bits,
+                          uint32_t color,
+                          uint32_t edgeColor)
+{
+    addDirty(x - 1, y - 1, w + 2, h + 2);
+    backing_->drawBitsThick(x, y, w, h, bits, color, edgeColor);
+}
+
+} // namespace graphics
@@ -0,0 +1,141 @@
+#ifndef _88AE2C89_7AE0_4978_B269_CEE823611D3C
+#define _88AE2C89_7AE0_4978_B269_CEE823611D3C
+
+#include "framebuffer_base.h"
+#include <array>
+#include <stdint.h>
+
+namespace graphics
+{
+
+// 書き込まれた領域を記録して、まとめて転送する
+class DirtyRegion
+{
+public:
+    struct Rect
+    {
+        int x0, y0, x1, y1;
+
+    public:
+        int getWidth() const { return x1 - x0; }
+        int getHeight() const { return y1 - y0; }
+        int getArea() const { return getWidth() * getHeight(); }
+        bool isEmpty() const { return x0 >= x1 || y0 >= y1; }
+    };
+
+    static constexpr int MAX_RECTS = 16;
+
+    // 転送1回の準備コストを pixel 数に換算したもの
+    // これ以下の無駄で済むなら結合する
+    static constexpr int MERGE_COST_PIXELS = 256;
+
+public:
+    void add(Rect r);
+    void clear() { n_ = 0; }
+
+    int getCount() const { return n_; }
+    const Rect& get(int i) const { return rects_[i]; }
+
+private:
+    std::array<Rect, MAX_RECTS> rects_;
+    int n_ = 0;
+};
+
+// 画面と同じ大きさの backing store に描画し、flush() で差分だけ転送する
+class Compositor final : public FrameBufferBase
+{
+public:
+    struct Stats
+    {
+        uint32_t regions;
+        uint32_t pixels;
+        uint32_t flushTimeUS;
+    };
+
+public:
+    // flush() の転送先そのものを渡すと、そこに直接描いて flush() では送らない
+    // (backing store を確保できなかった時用)
+    void setBackingStore(FrameBufferBase* fb);
+    FrameBufferBase* getBackingStore() { return backing_; }
+
+    void invalidate(int x, int y, int w, int h);
+    void flush(FrameBufferBase& dst);
+
+    const Stats& getLastStats() const { return stats_; }
+
+    void setWindow(uint32_t x, uint32_t y, uint32_t w, uint32_t h) override;
+    uint32_t getLeft() const override;
+    uint32_t getTop() const override;
+    uint32_t getWidth() const override;
+    uint32_t getHeight() const override;
+    uint32_t getBufferWidth() const override;
+    uint32_t getBufferHeight() const override;
+
+    uint32_t makeColor(int r, int g, int b) const override;
+
+    void fill(uint32_t c) override;
+    void fill(int x, int y, int w, int h, uint32_t c) override;
+
+    void setPixel(uint32_t x, uint32_t y, uint32_t c) override;
+    uint32_t getPixel(uint32_t x, uint32_t y) const override;
+
+    void drawBits16(int x,
+                    int y,
+                    int w,
+                    int h,
+                    int pitchInBytes,
+                    const void* img16) override;
+
+    void put(const Texture& tex, int dx, int dy, int sx, int sy, int w, int h)
+        override;
+    void putTrans(const Texture& tex,
+                  int dx,
+                  int dy,
+                  int sx,
+                  int sy,
+                  int w,
+                  int h) override;
+    void putReplaced(const Texture& tex,
+                     int dx,
+                     int dy,
+                     int sx,
+                     int sy,
+                     int w,
+                     int h,
+                     uint16_t color,
+                     uint16_t bg) override;
+
+    void drawBits(int x,
+                  int y,
+                  int w,
+                  int h,
+                  const uint8_t* bits,
+                  uint32_t color) override;
+    void drawBits(int x,
+                  int y,
+                  int w,
+                  int h,
+                  const uint8_t* bits,
+                  uint32_t color,
+                  uint32_t bgColor) override;
+    void drawBitsThick(int x,
+                       int y,
+                       int w,
+                       int h,
+                       const uint8_t* bits,
+                       uint32_t color,
+                       uint32_t edgeColor) override;
+
+protected:
+    // window でクリップして記録
+    void addDirty(int x, int y, int w, int h);
+
+private:
+    FrameBufferBase* backing_{};
+    DirtyRegion dirty_;
+    Stats stats_{};
+};
+
+} // namespace graphics
+
+#endif /* _88AE2C89_7AE0_4978_B269_CEE823611D3C */
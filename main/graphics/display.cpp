@@ -6,6 +6,7 @@
 #include "display.h"
 #include "../debug.h"
 #include "texture.h"
+#include <algorithm>
 
 namespace graphics
 {
@@ -125,16 +126,18 @@ Display::drawBits16(
     p += sx << 1;
     p += sy * pitchInBytes;
 
+    static constexpr uint32_t unitTransferPixels = 1280;
+    // 40Mで2500pixelが1ms
+    // FM音源とバスを共有しているので長時間占有しないように分割する
+
+    int unitLine = std::max<int>(1, unitTransferPixels / w);
+    auto* lcd    = _getLCD();
     if (pitchInBytes == w << 1)
     {
-        static constexpr uint32_t unitTransferPixels = 1280;
-        // 40Mで2500pixelが1ms
-
-        int unitLine = unitTransferPixels / w;
         while (h)
         {
             auto hh = std::min(unitLine, h);
-            _getLCD()->pushImage(x, y, w, hh, (uint16_t*)p);
+            lcd->pushImage(x, y, w, hh, (uint16_t*)p);
             y += hh;
             p += pitchInBytes * hh;
             h -= hh;
@@ -142,11 +145,21 @@ Display::drawBits16(
     }
     else
     {
-        for (; h; --h)
+        // 1ラインずつ pushImage するとラインごとにウィンドウ設定が入るので
+        // 矩形単位でまとめて送る
+        while (h)
         {
-            _getLCD()->pushImage(x, y, w, 1, (uint16_t*)p);
-            ++y;
-            p += pitchInBytes;
+            auto hh = std::min(unitLine, h);
+            lcd->startWrite();
+            lcd->setWindow(x, y, x + w - 1, y + hh - 1);
+            for (int i = 0; i < hh; ++i)
+            {
+                lcd->pushColors((uint16_t*)p, w, false);
+                p += pitchInBytes;
+            }
+            lcd->endWrite();
+            y += hh;
+            h -= hh;
         }
     }
 }
@@ -5,8 +5,10 @@
 
 #include "font_manager.h"
 #include "font_data.h"
-#include "framebuffer.h"
+#include "framebuffer_base.h"
+#include <algorithm>
 #include <debug.h>
+#include <utility>
 
 namespace graphics
 {
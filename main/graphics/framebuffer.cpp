@@ -7,6 +7,7 @@
 #include "display.h"
 #include <algorithm>
 #include <debug.h>
+#include <string.h>
 
 namespace graphics
 {
@@ -143,6 +144,35 @@ FrameBuffer::getPixel(uint32_t x, uint32_t y) const
     return const_cast<Img*>(&img_)->readPixel(x, y);
 }
 
+void
+FrameBuffer::drawBits16(
+    int x, int y, int w, int h, int pitchInBytes, const void* img16)
+{
+    if (bpp_ != 16)
+    {
+        FrameBufferBase::drawBits16(x, y, w, h, pitchInBytes, img16);
+        return;
+    }
+
+    int sx = 0;
+    int sy = 0;
+    adjustTransferRegion(x, y, sx, sy, w, h);
+    if (w <= 0 || h <= 0)
+    {
+        return;
+    }
+
+    // Sprite の中身も LCD と同じバイト順なのでそのままコピーできる
+    auto src = (const uint8_t*)img16 + (sx << 1) + sy * pitchInBytes;
+    auto dst = (uint8_t*)buffer_ + ((x + y * bw_) << 1);
+    for (; h; --h)
+    {
+        memcpy(dst, src, w << 1);
+        src += pitchInBytes;
+        dst += bw_ << 1;
+    }
+}
+
 void
 FrameBuffer::transferTo(
     FrameBufferBase& dst, int dx, int dy, int sx, int sy, int w, int h) const
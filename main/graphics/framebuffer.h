@@ -40,6 +40,13 @@ public:
     void setPixel(uint32_t x, uint32_t y, uint32_t c) override;
     uint32_t getPixel(uint32_t x, uint32_t y) const override;
 
+    void drawBits16(int x,
+                    int y,
+                    int w,
+                    int h,
+                    int pitchInBytes,
+                    const void* img16) override;
+
     void transferTo(FrameBufferBase& dst,
                     int dx,
                     int dy,
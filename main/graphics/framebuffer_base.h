@@ -65,23 +65,23 @@ public:
                   int w  = 0,
                   int h  = 0);
 
-    void
+    virtual void
     drawBits(int x, int y, int w, int h, const uint8_t* bits, uint32_t color);
-    void drawBits(int x,
-                  int y,
-                  int w,
-                  int h,
-                  const uint8_t* bits,
-                  uint32_t color,
-                  uint32_t bgColor);
-
-    void drawBitsThick(int x,
-                       int y,
-                       int w,
-                       int h,
-                       const uint8_t* bits,
-                       uint32_t color,
-                       uint32_t edgeColor);
+    virtual void drawBits(int x,
+                          int y,
+                          int w,
+                          int h,
+                          const uint8_t* bits,
+                          uint32_t color,
+                          uint32_t bgColor);
+
+    virtual void drawBitsThick(int x,
+                               int y,
+                               int w,
+                               int h,
+                               const uint8_t* bits,
+                               uint32_t color,
+                               uint32_t edgeColor);
 
 protected:
     virtual void _drawBitsLineTrans(
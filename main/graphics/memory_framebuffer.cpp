@@ -0,0 +1,603 @@
+#include "memory_framebuffer.h"
+#include "../debug.h"
+#include "texture.h"
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+namespace graphics
+{
+
+namespace
+{
+
+// 2pixel 分をまとめて書く
+// d は 4byte 境界にあること。little endian なので若い方の pixel が下位
+typedef uint32_t __attribute__((__may_alias__)) PixelPair;
+
+inline void
+storePair(uint16_t* d, uint32_t c0, uint32_t c1)
+{
+    *reinterpret_cast<PixelPair*>(d) = c0 | (c1 << 16);
+}
+
+inline bool
+isPairAligned(const uint16_t* d)
+{
+    return !(reinterpret_cast<uintptr_t>(d) & 2);
+}
+
+// bits の ofs bit 目から2bit 取り出す (先の pixel が bit1)
+inline int
+get2Bits(const uint8_t* bits, int ofs)
+{
+    auto* p = bits + (ofs >> 3);
+    int b   = ofs & 7;
+    return b == 7 ? ((p[0] << 1) | (p[1] >> 7)) & 3 : (p[0] >> (6 - b)) & 3;
+}
+
+// w pixel 分の 1bit 行を MSB 詰めで取り出す (w <= 32)
+inline uint32_t
+getBitsRow(const uint8_t* bits, int w)
+{
+    uint32_t v = 0;
+    for (int i = 0; i < (w + 7) >> 3; ++i)
+    {
+        v |= uint32_t(bits[i]) << (24 - i * 8);
+    }
+    return v & (~0u << (32 - w));
+}
+
+} // namespace
+
+MemoryFrameBuffer::MemoryFrameBuffer(uint32_t w, uint32_t h)
+{
+    initialize(w, h);
+}
+
+bool
+MemoryFrameBuffer::initialize(uint32_t w, uint32_t h)
+{
+    release();
+
+    // 大きいものは PSRAM に行く
+    buffer_ = static_cast<uint16_t*>(calloc(w * h, sizeof(uint16_t)));
+    if (!buffer_)
+    {
+        DBOUT(("MemoryFrameBuffer: allocate %dx%d failed.\n", (int)w, (int)h));
+        return false;
+    }
+    bw_ = w;
+    bh_ = h;
+    setWindow(0, 0, w, h);
+    return true;
+}
+
+void
+MemoryFrameBuffer::release()
+{
+    free(buffer_);
+    buffer_ = nullptr;
+    bw_     = 0;
+    bh_     = 0;
+    setWindow(0, 0, 0, 0);
+}
+
+void
+MemoryFrameBuffer::setWindow(uint32_t x, uint32_t y, uint32_t w, uint32_t h)
+{
+    // kernel がバッファ外に書かないように window はバッファ内に収める
+    wx_ = std::min(x, bw_);
+    wy_ = std::min(y, bh_);
+    ww_ = std::min(w, bw_ - wx_);
+    wh_ = std::min(h, bh_ - wy_);
+}
+
+uint32_t
+MemoryFrameBuffer::getLeft() const
+{
+    return wx_;
+}
+
+uint32_t
+MemoryFrameBuffer::getTop() const
+{
+    return wy_;
+}
+
+uint32_t
+MemoryFrameBuffer::getWidth() const
+{
+    return ww_;
+}
+
+uint32_t
+MemoryFrameBuffer::getHeight() const
+{
+    return wh_;
+}
+
+uint32_t
+MemoryFrameBuffer::getBufferWidth() const
+{
+    return bw_;
+}
+
+uint32_t
+MemoryFrameBuffer::getBufferHeight() const
+{
+    return bh_;
+}
+
+uint32_t
+MemoryFrameBuffer::makeColor(int r, int g, int b) const
+{
+    return ((r & 0xf8) << 8) | ((g & 0xfc) << 3) | (b >> 3);
+}
+
+void
+MemoryFrameBuffer::fill(uint32_t c)
+{
+    std::fill_n(buffer_, bw_ * bh_, toNative(c));
+}
+
+void
+MemoryFrameBuffer::fill(int x, int y, int w, int h, uint32_t c)
+{
+    // Sprite と同じくバッファの範囲でだけクリップする
+    int x0 = std::max(0, x);
+    int y0 = std::max(0, y);
+    int x1 = std::min<int>(bw_, x + w);
+    int y1 = std::min<int>(bh_, y + h);
+    if (x0 >= x1 || y0 >= y1)
+    {
+        return;
+    }
+
+    auto v = toNative(c);
+    auto p = buffer_ + x0 + y0 * bw_;
+    for (; y0 < y1; ++y0)
+    {
+        std::fill_n(p, x1 - x0, v);
+        p += bw_;
+    }
+}
+
+void
+MemoryFrameBuffer::setPixel(uint32_t x, uint32_t y, uint32_t c)
+{
+    if (x < bw_ && y < bh_)
+    {
+        buffer_[x + y * bw_] = toNative(c);
+    }
+}
+
+uint32_t
+MemoryFrameBuffer::getPixel(uint32_t x, uint32_t y) const
+{
+    if (x < bw_ && y < bh_)
+    {
+        return toNative(buffer_[x + y * bw_]);
+    }
+    return 0;
+}
+
+void
+MemoryFrameBuffer::drawBits16(
+    int x, int y, int w, int h, int pitchInBytes, const void* img16)
+{
+    int sx = 0;
+    int sy = 0;
+    adjustTransferRegion(x, y, sx, sy, w, h);
+    if (w <= 0 || h <= 0)
+    {
+        return;
+    }
+
+    auto src = (const uint8_t*)img16 + (sx << 1) + sy * pitchInBytes;
+    auto dst = buffer_ + x + y * bw_;
+    for (; h; --h)
+    {
+        memcpy(dst, src, w << 1);
+        src += pitchInBytes;
+        dst += bw_;
+    }
+}
+
+void
+MemoryFrameBuffer::transferTo(
+    FrameBufferBase& dst, int dx, int dy, int sx, int sy, int w, int h) const
+{
+    if (w == 0)
+    {
+        w = bw_;
+    }
+    if (h == 0)
+    {
+        h = bh_;
+    }
+
+    dst.drawBits16(dx, dy, w, h, bw_ << 1, buffer_ + sx + sy * bw_);
+}
+
+void
+MemoryFrameBuffer::put(
+    const Texture& tex, int dx, int dy, int sx, int sy, int w, int h)
+{
+    adjustTransferRegion(dx, dy, sx, sy, w, h);
+    if (w <= 0 || h <= 0)
+    {
+        return;
+    }
+
+    auto srcPitch   = tex.getPitch();
+    const auto* src = tex.getBits() + sx + srcPitch * sy;
+    const auto* pal = tex.getPalette();
+    auto* dst       = getLine(dx, dy);
+
+    for (; h; --h)
+    {
+        int x = 0;
+        if (!isPairAligned(dst))
+        {
+            dst[0] = toNative(pal[src[0]]);
+            x      = 1;
+        }
+        for (; x + 1 < w; x += 2)
+        {
+            storePair(dst + x,
+                      toNative(pal[src[x]]),
+                      toNative(pal[src[x + 1]]));
+        }
+        if (x < w)
+        {
+            dst[x] = toNative(pal[src[x]]);
+        }
+        src += srcPitch;
+        dst += bw_;
+    }
+}
+
+void
+MemoryFrameBuffer::putTrans(
+    const Texture& tex, int dx, int dy, int sx, int sy, int w, int h)
+{
+    adjustTransferRegion(dx, dy, sx, sy, w, h);
+    if (w <= 0 || h <= 0)
+    {
+        return;
+    }
+
+    auto srcPitch   = tex.getPitch();
+    const auto* src = tex.getBits() + sx + srcPitch * sy;
+    const auto* pal = tex.getPalette();
+    auto* dst       = getLine(dx, dy);
+
+    for (; h; --h)
+    {
+        for (int x = 0; x < w; ++x)
+        {
+            // 0 が抜き色
+            if (auto p = src[x])
+            {
+                dst[x] = toNative(pal[p]);
+            }
+        }
+        src += srcPitch;
+        dst += bw_;
+    }
+}
+
+void
+MemoryFrameBuffer::putReplaced(const Texture& tex,
+                               int dx,
+                               int dy,
+                               int sx,
+                               int sy,
+                               int w,
+                               int h,
+                               uint16_t color,
+                               uint16_t bg)
+{
+    adjustTransferRegion(dx, dy, sx, sy, w, h);
+    if (w <= 0 || h <= 0)
+    {
+        return;
+    }
+
+    auto srcPitch   = tex.getPitch();
+    const auto* src = tex.getBits() + sx + srcPitch * sy;
+    auto* dst       = getLine(dx, dy);
+
+    const uint32_t cols[2] = {toNative(bg), toNative(color)};
+
+    for (; h; --h)
+    {
+        int x = 0;
+        if (!isPairAligned(dst))
+        {
+            dst[0] = cols[src[0] != 0];
+            x      = 1;
+        }
+        for (; x + 1 < w; x += 2)
+        {
+            storePair(dst + x, cols[src[x] != 0], cols[src[x + 1] != 0]);
+        }
+        if (x < w)
+        {
+            dst[x] = cols[src[x] != 0];
+        }
+        src += srcPitch;
+        dst += bw_;
+    }
+}
+
+void
+MemoryFrameBuffer::_drawBitsLineTrans(
+    const uint8_t* bits, int bitOfs, uint32_t color, int x, int y, int w)
+{
+    // drawBits() で window にクリップ済み
+    auto* dst   = getLine(x, y);
+    const auto c = toNative(color);
+
+    // 1byte ずつ見て立っている bit だけ書く
+    bits += bitOfs >> 3;
+    int b = bitOfs & 7;
+    for (int i = 0; i < w; b = 0)
+    {
+        int n = std::min(8 - b, w - i);
+        int v = (*bits++ << b) & (0xff00 >> n) & 0xff;
+        while (v)
+        {
+            int k      = __builtin_clz(v) - 24;
+            dst[i + k] = c;
+            v &= ~(0x80 >> k);
+        }
+        i += n;
+    }
+}
+
+void
+MemoryFrameBuffer::_drawBitsLine(const uint8_t* bits,
+                                 int bitOfs,
+                                 uint32_t color,
+                                 uint32_t bgColor,
+                                 int x,
+                                 int y,
+                                 int w)
+{
+    auto* dst = getLine(x, y);
+
+    const uint32_t cols[2] = {toNative(bgColor), toNative(color)};
+    auto getBit = [&](int i) {
+        int ofs = bitOfs + i;
+        return (bits[ofs >> 3] >> (7 - (ofs & 7))) & 1;
+    };
+
+    int i = 0;
+    if (w && !isPairAligned(dst))
+    {
+        dst[0] = cols[getBit(0)];
+        i      = 1;
+    }
+    for (; i + 1 < w; i += 2)
+    {
+        int v = get2Bits(bits, bitOfs + i);
+        storePair(dst + i, cols[v >> 1], cols[v & 1]);
+    }
+    if (i < w)
+    {
+        dst[i] = cols[getBit(i)];
+    }
+}
+
+void
+MemoryFrameBuffer::drawBitsThick(int x,
+                                 int y,
+                                 int w,
+                                 int h,
+                                 const uint8_t* bits,
+                                 uint32_t color,
+                                 uint32_t edgeColor)
+{
+    // 縁取りを含めて1行32pixelに収まらないものは汎用版で
+    if (w > 30)
+    {
+        FrameBufferBase::drawBitsThick(x, y, w, h, bits, color, edgeColor);
+        return;
+    }
+    if (w <= 0 || h <= 0)
+    {
+        return;
+    }
+
+    // 上下左右に1pixelずつずらして重ねたものと同じ結果を1パスで描く
+    // 行は bit31 が x - 1 の位置
+    int wx0 = getLeft();
+    int wx1 = wx0 + getWidth();
+    int wy0 = getTop();
+    int wy1 = wy0 + getHeight();
+
+    int x0 = std::max(wx0, x - 1);
+    int x1 = std::min(wx1, x + w + 1);
+    int y0 = std::max(wy0, y - 1);
+    int y1 = std::min(wy1, y + h + 1);
+    if (x0 >= x1 || y0 >= y1)
+    {
+        return;
+    }
+
+    // 窓外の列は書かないようにマスクする
+    const int k0            = x0 - (x - 1);
+    const int k1            = x1 - (x - 1);
+    const uint32_t clipMask = (~0u >> k0) & ~(k1 < 32 ? ~0u >> k1 : 0u);
+
+    const int pitch = (w + 7) >> 3;
+    auto row        = [&](int r) {
+        return r < 0 || r >= h ? 0u : getBitsRow(bits + r * pitch, w) >> 1;
+    };
+
+    const uint16_t c  = toNative(color);
+    const uint16_t ec = toNative(edgeColor);
+
+    int r      = y0 - y;
+    uint32_t u = row(r - 1);
+    uint32_t m = row(r);
+    auto* dst  = getLine(x0, y0) - k0;
+    for (; y0 < y1; ++y0, ++r)
+    {
+        uint32_t d   = row(r + 1);
+        uint32_t fg  = m & clipMask;
+        uint32_t all = ((m << 1) | (m >> 1) | u | d | m) & clipMask;
+        while (all)
+        {
+            int k  = __builtin_clz(all);
+            dst[k] = fg & (0x80000000u >> k) ? c : ec;
+            all &= ~(0x80000000u >> k);
+        }
+        u = m;
+        m = d;
+        dst += bw_;
+    }
+}
+
+////
+
+namespace
+{
+
+class PNGWriter
+{
+    FILE* fp_;
+    uint32_t crcTable_[256];
+    uint32_t crc_ = 0;
+
+public:
+    PNGWriter(FILE* fp)
+        : fp_(fp)
+    {
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k)
+            {
+                c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            }
+            crcTable_[i] = c;
+        }
+    }
+
+    void write(const void* p, size_t size)
+    {
+        auto* b = static_cast<const uint8_t*>(p);
+        for (size_t i = 0; i < size; ++i)
+        {
+            crc_ = crcTable_[(crc_ ^ b[i]) & 255] ^ (crc_ >> 8);
+        }
+        fwrite(p, 1, size, fp_);
+    }
+
+    void write32(uint32_t v)
+    {
+        uint8_t b[4] = {uint8_t(v >> 24), uint8_t(v >> 16), uint8_t(v >> 8), uint8_t(v)};
+        write(b, 4);
+    }
+
+    void beginChunk(const char* type, uint32_t size)
+    {
+        write32(size);
+        crc_ = 0xffffffff;
+        write(type, 4);
+    }
+
+    void endChunk() { write32(crc_ ^ 0xffffffff); }
+};
+
+} // namespace
+
+bool
+writePNG(const char* filename, const MemoryFrameBuffer& fb)
+{
+    const uint32_t w = fb.getBufferWidth();
+    const uint32_t h = fb.getBufferHeight();
+    if (!fb.getBits() || !w || !h)
+    {
+        return false;
+    }
+
+    FILE* fp = fopen(filename, "wb");
+    if (!fp)
+    {
+        return false;
+    }
+
+    PNGWriter pw(fp);
+
+    static const uint8_t signature[] = {
+        0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    fwrite(signature, 1, sizeof(signature), fp);
+
+    pw.beginChunk("IHDR", 13);
+    pw.write32(w);
+    pw.write32(h);
+    static const uint8_t ihdr[] = {8 /* depth */,
+                                   2 /* RGB */,
+                                   0 /* deflate */,
+                                   0 /* filter */,
+                                   0 /* interlace */};
+    pw.write(ihdr, sizeof(ihdr));
+    pw.endChunk();
+
+    // 1ライン 1 deflate stored block (無圧縮) にする
+    const uint32_t lineBytes = 1 + w * 3;
+    const uint32_t blockSize = 5 + lineBytes;
+    pw.beginChunk("IDAT", 2 + blockSize * h + 4);
+    static const uint8_t zlibHeader[] = {0x78, 0x01};
+    pw.write(zlibHeader, sizeof(zlibHeader));
+
+    std::vector<uint8_t> line(lineBytes);
+    uint32_t adlerA = 1;
+    uint32_t adlerB = 0;
+    for (uint32_t y = 0; y < h; ++y)
+    {
+        auto* p = line.data();
+        *p++    = 0; // filter none
+        for (uint32_t x = 0; x < w; ++x)
+        {
+            auto c = fb.getPixel(x, y);
+            int r  = (c >> 11) & 31;
+            int g  = (c >> 5) & 63;
+            int b  = c & 31;
+            *p++   = (r << 3) | (r >> 2);
+            *p++   = (g << 2) | (g >> 4);
+            *p++   = (b << 3) | (b >> 2);
+        }
+
+        uint8_t bh[5] = {uint8_t(y == h - 1 ? 1 : 0),
+                         uint8_t(lineBytes),
+                         uint8_t(lineBytes >> 8),
+                         uint8_t(~lineBytes),
+                         uint8_t(~lineBytes >> 8)};
+        pw.write(bh, sizeof(bh));
+        pw.write(line.data(), lineBytes);
+
+        for (auto v : line)
+        {
+            adlerA = (adlerA + v) % 65521;
+            adlerB = (adlerB + adlerA) % 65521;
+        }
+    }
+    pw.write32((adlerB << 16) | adlerA);
+    pw.endChunk();
+
+    pw.beginChunk("IEND", 0);
+    pw.endChunk();
+
+    bool r = !ferror(fp);
+    fclose(fp);
+    return r;
+}
+
+} // namespace graphics
@@ -0,0 +1,122 @@
+#ifndef E3183128_7C12_43BD_BD9A_7D6E74407E9B
+#define E3183128_7C12_43BD_BD9A_7D6E74407E9B
+
+#include "framebuffer_base.h"
+#include <stdint.h>
+
+namespace graphics
+{
+
+// RGB565 のメモリ上のフレームバッファ
+// LCD に合わせて上位バイトが先に来る並びで持つ (TFT_eSprite と同じ)
+// デバイスに依存しないのでホストでも使える
+class MemoryFrameBuffer final : public FrameBufferBase
+{
+public:
+    MemoryFrameBuffer() = default;
+    MemoryFrameBuffer(uint32_t w, uint32_t h);
+    ~MemoryFrameBuffer() noexcept override { release(); }
+
+    // 確保できなければ false. その後の描画は何もしない
+    bool initialize(uint32_t w, uint32_t h);
+    void release();
+
+    uint16_t* getBits() { return buffer_; }
+    const uint16_t* getBits() const { return buffer_; }
+    uint32_t getPitch() const { return bw_; } // pixel 単位
+
+    void setWindow(uint32_t x, uint32_t y, uint32_t w, uint32_t h) override;
+    uint32_t getLeft() const override;
+    uint32_t getTop() const override;
+    uint32_t getWidth() const override;
+    uint32_t getHeight() const override;
+    uint32_t getBufferWidth() const override;
+    uint32_t getBufferHeight() const override;
+
+    uint32_t makeColor(int r, int g, int b) const override;
+
+    void fill(uint32_t c) override;
+    void fill(int x, int y, int w, int h, uint32_t c) override;
+
+    void setPixel(uint32_t x, uint32_t y, uint32_t c) override;
+    uint32_t getPixel(uint32_t x, uint32_t y) const override;
+
+    void drawBits16(int x,
+                    int y,
+                    int w,
+                    int h,
+                    int pitchInBytes,
+                    const void* img16) override;
+
+    void transferTo(FrameBufferBase& dst,
+                    int dx,
+                    int dy,
+                    int sx,
+                    int sy,
+                    int w,
+                    int h) const override;
+
+    // setPixel() を介さずバッファに直接書く kernel
+    void put(const Texture& tex, int dx, int dy, int sx, int sy, int w, int h)
+        override;
+    void putTrans(const Texture& tex,
+                  int dx,
+                  int dy,
+                  int sx,
+                  int sy,
+                  int w,
+                  int h) override;
+    void putReplaced(const Texture& tex,
+                     int dx,
+                     int dy,
+                     int sx,
+                     int sy,
+                     int w,
+                     int h,
+                     uint16_t color,
+                     uint16_t bg) override;
+
+    void drawBitsThick(int x,
+                       int y,
+                       int w,
+                       int h,
+                       const uint8_t* bits,
+                       uint32_t color,
+                       uint32_t edgeColor) override;
+
+    static uint16_t toNative(uint32_t c) { return (c >> 8) | (c << 8); }
+
+protected:
+    void _drawBitsLineTrans(const uint8_t* bits,
+                            int bitOfs,
+                            uint32_t color,
+                            int x,
+                            int y,
+                            int w) override;
+    void _drawBitsLine(const uint8_t* bits,
+                       int bitOfs,
+                       uint32_t color,
+                       uint32_t bgColor,
+                       int x,
+                       int y,
+                       int w) override;
+
+    uint16_t* getLine(int x, int y) { return buffer_ + x + y * bw_; }
+
+private:
+    uint32_t wx_ = 0;
+    uint32_t wy_ = 0;
+    uint32_t ww_ = 0;
+    uint32_t wh_ = 0;
+
+    uint16_t* buffer_ = nullptr;
+    uint32_t bw_      = 0;
+    uint32_t bh_      = 0;
+};
+
+// 24bit RGB の無圧縮 PNG として保存する
+bool writePNG(const char* filename, const MemoryFrameBuffer& fb);
+
+} // namespace graphics
+
+#endif /* E3183128_7C12_43BD_BD9A_7D6E74407E9B */
@@ -5,9 +5,15 @@
 
 #include "ble_midi.h"
 #include "../debug.h"
+#include "ble_midi_packet.h"
+#include <stdio.h>
+#include <system/util.h>
 
 #define ENABLE_DEBUG_PRINT 1
 
+// 受信したパケットをそのまま出す
+#define ENABLE_PACKET_CAPTURE 0
+
 #if ENABLE_DEBUG_PRINT
 #define DB DBOUT
 #else
@@ -75,62 +81,34 @@ BLEMidiClient::onNotify(const uint8_t* p, size_t size, int handle)
 {
     if (handle == handle_ && midiIn_)
     {
+        auto rxUs = sys::micros();
         DB(("Midi in: handle %d, %zd bytes.\n", handle, size));
 
-        if (size < 3)
+#if ENABLE_PACKET_CAPTURE
+        // tools/ble_midi_replay で再生できる形で出す
+        printf("BLEMIDI %u", rxUs);
+        for (size_t i = 0; i < size; ++i)
         {
-            DB((" too short message.\n"));
-            return;
+            printf(" %02x", p[i]);
         }
+        printf("\n");
+#endif
 
-        auto process = [this](int timeH,
-                              int timeL,
-                              const uint8_t* top,
-                              const uint8_t* bottom) {
-            DB(("time %d\n", timeL | (timeH << 7)));
+        auto process = [&](int timestamp,
+                           const uint8_t* top,
+                           const uint8_t* bottom) {
+            DB(("time %d\n", timestamp));
+            auto time = jitter_.schedule(timestamp, rxUs);
             midiInMessageMaker_.analyze(
-                top, bottom, [this](const MidiMessage& m) {
-                    midiIn_->put(m);
+                top, bottom, [&](const MidiMessage& m) {
+                    midiIn_->put(m, time);
                     m.dump();
                 });
         };
 
-        auto tail = p + size;
-
-        if ((*p & 0x80) == 0)
-        {
-            DB(("invalid timestamp (H) %02x\n", *p));
-            return;
-        }
-        auto timeH = *p & 0x3f;
-        ++p;
-
-        while (p < tail)
+        if (!parseBLEMidiPacket(p, size, process))
         {
-            if (p + 2 > tail)
-            {
-                DB(("invalid message length.\n"));
-                return;
-            }
-
-            if ((p[0] & 0x80) == 0)
-            {
-                DB(("invalid timestamp (L) %02x\n", p[0]));
-                return;
-            }
-            auto timeL      = p[0] & 0x7f;
-            auto messageTop = p + 1;
-            p += 2;
-
-            while (p < tail)
-            {
-                if (*p & 0x80)
-                {
-                    break;
-                }
-                ++p;
-            }
-            process(timeH, timeL, messageTop, p);
+            DB(("invalid packet.\n"));
         }
     }
 }
@@ -7,6 +7,7 @@
 
 #include "ble_manager.h"
 #include "midi.h"
+#include "midi_jitter_buffer.h"
 
 namespace io
 {
@@ -23,6 +24,7 @@ class BLEMidiClient : public BLEClientHandler, public MidiOut
     MidiMessageQueue* midiIn_ = nullptr;
 
     MidiMessageMaker midiInMessageMaker_;
+    MidiJitterBuffer jitter_;
 
 public:
     // BLEClientHandler
@@ -41,6 +43,8 @@ public:
 
     void setMIDIIn(MidiMessageQueue* m) { midiIn_ = m; }
 
+    MidiJitterBuffer& getJitterBuffer() { return jitter_; }
+
     static BLEMidiClient& instance();
 };
 
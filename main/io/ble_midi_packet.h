@@ -0,0 +1,54 @@
+#ifndef _B5E07A3C_19F4_4D86_8C2B_6A0F5D91E374
+#define _B5E07A3C_19F4_4D86_8C2B_6A0F5D91E374
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace io
+{
+
+// BLE MIDI のパケットをタイムスタンプごとのメッセージ列に分ける
+// func(int timestamp, const uint8_t* top, const uint8_t* bottom)
+// timestamp は 13bit (ms)。パケットの途中で下位が戻ったら上位を進める
+template <class Func>
+bool
+parseBLEMidiPacket(const uint8_t* p, size_t size, const Func& func)
+{
+    if (size < 3 || (*p & 0x80) == 0)
+    {
+        return false;
+    }
+
+    auto tail = p + size;
+    int timeH = *p & 0x3f;
+    int prevL = -1;
+    ++p;
+
+    while (p < tail)
+    {
+        if (p + 2 > tail || (p[0] & 0x80) == 0)
+        {
+            return false;
+        }
+
+        int timeL = p[0] & 0x7f;
+        if (timeL < prevL)
+        {
+            timeH = (timeH + 1) & 0x3f;
+        }
+        prevL = timeL;
+
+        auto top = p + 1;
+        p += 2;
+        while (p < tail && !(*p & 0x80))
+        {
+            ++p;
+        }
+        func((timeH << 7) | timeL, top, p);
+    }
+    return true;
+}
+
+} // namespace io
+
+#endif /* _B5E07A3C_19F4_4D86_8C2B_6A0F5D91E374 */
@@ -14,12 +14,16 @@
 #include <esp_bt_device.h>
 #include <esp_bt_main.h>
 #include <esp_gap_bt_api.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include <math.h>
+#include <memory>
 #include <mutex>
 #include <string.h>
 #include <system/job_manager.h>
 #include <system/mutex.h>
 #include <system/util.h>
+#include <util/ring_buffer.h>
 
 namespace io
 {
@@ -106,6 +110,19 @@ getName(esp_avrc_pt_cmd_t cmd)
     return cmd == p->cmd ? p->name : nullptr;
 };
 
+constexpr uint32_t DEFAULT_SAMPLE_RATE =
+    audio::AudioOutDriverManager::getDefaultSampleRate();
+constexpr size_t MAX_BLOCK_SAMPLE_COUNT =
+    audio::AudioOutDriverManager::getMaxUnitSampleCount();
+
+// 先に作っておくサンプルのバッファ (2^n)
+constexpr uint32_t FIFO_SIZE = 4096;
+
+constexpr int DEFAULT_LATENCY_MS = 50;
+
+// BT が読まない時に AudioOut タスクを待たせる時間
+constexpr TickType_t FIFO_WAIT_TICKS = 20 / portTICK_PERIOD_MS;
+
 } // namespace
 
 struct Impl : public audio::AudioOutDriver
@@ -153,6 +170,22 @@ struct Impl : public audio::AudioOutDriver
 
     float volume_ = 1.0f;
 
+    // AudioOut タスクが作って BT のコールバックが読む
+    // 音量とリミッタは OutputStage でかかっている
+    using PCMSample = std::array<int16_t, 2>;
+    std::unique_ptr<PCMSample[]> fifoBuffer_;
+    util::RingBuffer<PCMSample> fifo_;
+    SemaphoreHandle_t fifoSpace_{};
+    uint32_t targetSamples_ = 0;
+    bool primed_            = false;
+
+    // サンプリング周波数はシンクとの間で決まったものにする
+    uint32_t sampleRate_ = DEFAULT_SAMPLE_RATE;
+    size_t blockSamples_ = MAX_BLOCK_SAMPLE_COUNT;
+    int latencyMs_       = DEFAULT_LATENCY_MS;
+
+    BTA2DPSourceManager::Stats stats_{};
+
     sys::Mutex mutex_;
     BTA2DPSourceManager::EntryContainer entries_;
 
@@ -511,8 +544,34 @@ public:
         }
 
         case ESP_A2D_AUDIO_CFG_EVT:
-            DBOUT(("A2DP audio config event.\n"));
+        {
+            const auto& mcc = param->audio_cfg.mcc;
+            DBOUT(("A2DP audio config event. codec %d\n", mcc.type));
+            if (mcc.type == ESP_A2D_MCT_SBC)
+            {
+                uint32_t rate = DEFAULT_SAMPLE_RATE;
+                int oct0      = mcc.cie.sbc[0];
+                if (oct0 & (0x01 << 7))
+                {
+                    rate = 16000;
+                }
+                else if (oct0 & (0x01 << 6))
+                {
+                    rate = 32000;
+                }
+                else if (oct0 & (0x01 << 5))
+                {
+                    rate = 44100;
+                }
+                else if (oct0 & (0x01 << 4))
+                {
+                    rate = 48000;
+                }
+                DBOUT(("A2DP SBC: %d Hz\n", rate));
+                reconfigure(rate, blockSamples_);
+            }
             break;
+        }
 
         case ESP_A2D_MEDIA_CTRL_ACK_EVT:
         {
@@ -603,6 +662,8 @@ public:
                     if (auto& cb =
                             remoteCommandCallback_[static_cast<size_t>(cmd)])
                     {
+                        // スタックからのものは全部同じ優先度で積んで
+                        // 来た順に処理する
                         sys::getDefaultJobManager().add([&] { cb(); });
                     }
                 }
@@ -833,6 +894,10 @@ public:
 
         case State::CONNECTED:
             updateMediaState(nullptr);
+            if (mediaState_ == MediaState::STARTED)
+            {
+                reportStats();
+            }
             break;
 
             // case State::DISCONNECTING:
@@ -851,6 +916,63 @@ public:
         }
     }
 
+    void setLatency(int ms)
+    {
+        latencyMs_     = ms;
+        uint32_t unit  = MAX_BLOCK_SAMPLE_COUNT;
+        uint32_t n     = uint32_t(std::max(ms, 0)) * sampleRate_ / 1000;
+        n              = std::min(n, FIFO_SIZE - unit * 2);
+        targetSamples_ = std::max(n, unit * 2);
+    }
+
+    // AudioOut タスクを止めてから変える
+    void reconfigure(uint32_t rate, size_t blockSamples)
+    {
+        blockSamples = std::max<size_t>(
+            16, std::min(blockSamples, MAX_BLOCK_SAMPLE_COUNT));
+        if (rate == sampleRate_ && blockSamples == blockSamples_)
+        {
+            return;
+        }
+
+        auto& m       = audio::AudioOutDriverManager::instance();
+        bool attached = m.getDriver() == this;
+        if (attached)
+        {
+            m.setDriver(nullptr);
+        }
+        sampleRate_   = rate;
+        blockSamples_ = blockSamples;
+        setLatency(latencyMs_);
+        if (attached)
+        {
+            m.setDriver(this);
+        }
+    }
+
+    void reportStats()
+    {
+        auto& st = stats_;
+        DBOUT(("a2dp fifo: depth %d (%d..%d / %d), underrun %d, dropped %d, "
+               "callback %d us (max %d)\n",
+               st.depth,
+               st.depthMin,
+               st.depthMax,
+               targetSamples_,
+               st.underruns,
+               st.dropped,
+               st.callbacks ? st.callbackTotalUs / st.callbacks : 0,
+               st.callbackMaxUs));
+
+        // 区間ごとの値
+        st.depthMin        = st.depth;
+        st.depthMax        = st.depth;
+        st.callbackMaxUs   = 0;
+        st.callbackTotalUs = 0;
+        st.callbacks       = 0;
+    }
+
+    // BT のタスクから呼ばれる。作っておいたものを写すだけ
     size_t updateSampleData(int16_t* data, size_t nSamples)
     {
 //        DBOUT(("update sample %zd\n", nSamples));
@@ -874,38 +996,100 @@ public:
         }
         return nSamples;
 #else
-        auto& audioOutMan = audio::AudioOutDriverManager::instance();
-        if (!audioOutMan.lock(this))
+        if (audio::AudioOutDriverManager::instance().getDriver() != this ||
+            !fifoBuffer_)
         {
             return 0;
         }
-        auto scale = int(volume_ * 256);
-        for (auto ct = nSamples; ct;)
+
+        auto t0    = sys::micros();
+        auto depth = fifo_.getFullReadableSize();
+
+        // 足りなくなったら目標まで溜まるのを待ってから出す
+        if (!primed_ && depth + blockSamples_ > targetSamples_)
+        {
+            primed_ = true;
+        }
+
+        size_t done = 0;
+        while (primed_ && done < nSamples)
         {
-            auto n = audioOutMan.generateSamples(ct);
-            ct -= n;
-            auto samples = audioOutMan.getSampleBuffer();
-            while (n)
+            auto n = std::min<size_t>(nSamples - done, fifo_.getReadableSize());
+            if (!n)
             {
-                data[0] = (*samples)[0] * scale >> 16;
-                data[1] = (*samples)[1] * scale >> 16;
-                data += 2;
-                ++samples;
-                --n;
+                ++stats_.underruns;
+                primed_ = false;
+                break;
             }
+            memcpy(data, fifo_.getReadPointer(), n * sizeof(PCMSample));
+            data += n * 2;
+            fifo_.advanceReadPointer(n);
+            done += n;
         }
-        audioOutMan.unlock();
+        if (done < nSamples)
+        {
+            memset(data, 0, (nSamples - done) * sizeof(int16_t) * 2);
+        }
+        xSemaphoreGive(fifoSpace_);
+
+        depth       = fifo_.getFullReadableSize();
+        auto dt     = sys::micros() - t0;
+        auto& st    = stats_;
+        st.depth    = depth;
+        st.depthMin = std::min(st.depthMin, depth);
+        st.depthMax = std::max(st.depthMax, depth);
+        st.callbackTotalUs += dt;
+        st.callbackMaxUs = std::max(st.callbackMaxUs, dt);
+        ++st.callbacks;
         return nSamples;
 #endif
     }
 
+    // AudioOut タスクから呼ばれる
+    void pushSamples(const PCMSample* data, size_t n)
+    {
+        // 目標まで溜まっていたら BT が読むのを待つ
+        while (fifo_.getFullReadableSize() + n > targetSamples_)
+        {
+            if (!xSemaphoreTake(fifoSpace_, FIFO_WAIT_TICKS))
+            {
+                // 読まれていない
+                stats_.dropped += n;
+                return;
+            }
+        }
+
+        while (n)
+        {
+            auto ct = std::min<size_t>(n, fifo_.getWritableSize());
+            memcpy(fifo_.getWritePointer(), data, ct * sizeof(PCMSample));
+            fifo_.advanceWritePointer(ct);
+            data += ct;
+            n -= ct;
+        }
+    }
+
     // AudioOutDriver
-    bool isDriverUseUpdate() const override { return false; };
-    void onAttach() override{};
+    bool isDriverUseUpdate() const override { return true; };
+    void onAttach() override { primed_ = false; };
     void onDetach() override{};
-    uint32_t getSampleRate() const override { return 44100; };
+    uint32_t getSampleRate() const override { return sampleRate_; };
+    size_t getBlockSampleCount() const override { return blockSamples_; }
     void setVolume(float v) override { volume_ = v; };
     float getVolume() const override { return volume_; };
+
+    uint32_t getQueuedSampleCount() const override
+    {
+        return fifo_.getFullReadableSize();
+    }
+
+    void onUpdate(const audio::OutputStage::Output& out, size_t n) override
+    {
+        if (fifoBuffer_)
+        {
+            pushSamples(out.pcm, n);
+        }
+    }
 };
 Impl pimpl_;
 
@@ -914,6 +1098,11 @@ BTA2DPSourceManager::initialize(sys::JobManager* jm)
 {
     pimpl_.jobManager_ = jm;
 
+    pimpl_.fifoBuffer_.reset(new Impl::PCMSample[FIFO_SIZE]);
+    pimpl_.fifo_.setBuffer(pimpl_.fifoBuffer_.get(), FIFO_SIZE);
+    pimpl_.fifoSpace_ = xSemaphoreCreateBinary();
+    pimpl_.setLatency(pimpl_.latencyMs_);
+
     jm->add([] {
         esp_bt_gap_register_callback(
             [](esp_bt_gap_cb_event_t event, esp_bt_gap_cb_param_t* param) {
@@ -1069,6 +1258,42 @@ BTA2DPSourceManager::setRemoteCommandCallback(RemoteCommand cmd,
     pimpl_.remoteCommandCallback_[static_cast<size_t>(cmd)] = std::move(cb);
 }
 
+void
+BTA2DPSourceManager::setLatency(int ms)
+{
+    pimpl_.setLatency(ms);
+}
+
+int
+BTA2DPSourceManager::getLatency() const
+{
+    return pimpl_.targetSamples_ * 1000 / pimpl_.sampleRate_;
+}
+
+void
+BTA2DPSourceManager::setBlockSampleCount(size_t n)
+{
+    pimpl_.reconfigure(pimpl_.sampleRate_, n);
+}
+
+size_t
+BTA2DPSourceManager::getBlockSampleCount() const
+{
+    return pimpl_.blockSamples_;
+}
+
+uint32_t
+BTA2DPSourceManager::getSampleRate() const
+{
+    return pimpl_.sampleRate_;
+}
+
+BTA2DPSourceManager::Stats
+BTA2DPSourceManager::getStats() const
+{
+    return pimpl_.stats_;
+}
+
 BTA2DPSourceManager&
 BTA2DPSourceManager::instance()
 {
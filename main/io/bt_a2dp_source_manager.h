@@ -36,6 +36,19 @@ public:
 
     using EntryContainer = std::set<Entry>;
 
+    // 先に作っておくサンプルのバッファの状態
+    struct Stats
+    {
+        uint32_t callbacks;       // BT からの読み出し
+        uint32_t underruns;       // 読み出しに足りなかった
+        uint32_t dropped;         // BT が読まないので捨てたサンプル
+        uint32_t callbackTotalUs; // 読み出しにかかった時間
+        uint32_t callbackMaxUs;
+        uint32_t depth; // 今溜まっているサンプル
+        uint32_t depthMin;
+        uint32_t depthMax;
+    };
+
     enum class RemoteCommand
     {
         PLAY,
@@ -67,6 +80,19 @@ public:
     void setRemoteCommandCallback(RemoteCommand cmd,
                                   std::function<void()>&& cb);
 
+    // これだけ先までサンプルを作っておく
+    void setLatency(int ms);
+    int getLatency() const;
+
+    // AudioOut タスクが 1 回に作るサンプル数
+    void setBlockSampleCount(size_t n);
+    size_t getBlockSampleCount() const;
+
+    // シンクとの間で決まったもの
+    uint32_t getSampleRate() const;
+
+    Stats getStats() const;
+
     static BTA2DPSourceManager& instance();
 };
 
@@ -4,12 +4,61 @@
  */
 
 #include "file_stream.h"
+#include <algorithm>
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
 namespace io
 {
 
+FileBinaryStream::FileBinaryStream(FILE* fp, int s, size_t windowSize)
+    : windowSize_(windowSize)
+{
+    setFile(fp, s);
+}
+
+void
+FileBinaryStream::setFile(FILE* fp, int s)
+{
+    fp_    = fp;
+    size_  = s;
+    stats_ = {};
+
+    uint32_t pos = 0;
+    if (fp_)
+    {
+        pos = ftell(fp_);
+        if (size_ < 0)
+        {
+            fseek(fp_, 0, SEEK_END);
+            size_ = ftell(fp_);
+            fseek(fp_, pos, SEEK_SET);
+        }
+    }
+    filePos_ = pos;
+    resetWindow(pos);
+}
+
+void
+FileBinaryStream::resetWindow(uint32_t pos)
+{
+    windowPos_ = pos;
+    cur_       = 0;
+    end_       = 0;
+}
+
+void
+FileBinaryStream::seekFile(uint32_t pos)
+{
+    if (filePos_ != pos)
+    {
+        fseek(fp_, pos, SEEK_SET);
+        filePos_ = pos;
+        ++stats_.seeks;
+    }
+}
+
 bool
 FileBinaryStream::seek(int pos, bool tail)
 {
@@ -18,40 +67,85 @@ FileBinaryStream::seek(int pos, bool tail)
         assert(size_ >= 0);
         pos += size_;
     }
-    fseek(fp_, pos, SEEK_SET);
-    adj_ = 0;
+
+    // 窓の中なら読み直さない
+    if (pos >= (int)windowPos_ && pos <= (int)(windowPos_ + end_))
+    {
+        cur_ = pos - windowPos_;
+    }
+    else
+    {
+        resetWindow(pos);
+    }
     return true;
 }
 
-uint32_t
-FileBinaryStream::tell() const
+bool
+FileBinaryStream::fill(size_t size)
 {
-    return ftell(fp_) + adj_;
-}
+    if (!fp_)
+    {
+        return false;
+    }
 
-void
-FileBinaryStream::adjustPointer() const
-{
-    if (adj_ != 0)
+    const uint32_t pos   = tell();
+    const uint32_t start = pos & ~(SECTOR_SIZE - 1);
+    const size_t need =
+        (pos - start + size + SECTOR_SIZE - 1) & ~(SECTOR_SIZE - 1);
+
+    // 窓の続きを読むなら先読みを増やし、飛んだ先なら 1 セクタに戻す
+    const uint32_t windowEnd = windowPos_ + end_;
+    const bool sequential = end_ && start >= windowPos_ && start <= windowEnd;
+    readAhead_ =
+        sequential ? std::min(readAhead_ * 2, windowSize_) : SECTOR_SIZE;
+
+    const size_t wsize = std::max(readAhead_, need);
+    if (window_.size() < wsize)
+    {
+        window_.resize(wsize);
+    }
+
+    // 窓の後ろに残っている分は前に詰めて続きだけ読む
+    size_t kept = 0;
+    if (start >= windowPos_ && start < windowEnd)
+    {
+        kept = windowEnd - start;
+        memmove(window_.data(), window_.data() + (start - windowPos_), kept);
+    }
+    const uint32_t readPos = start + kept;
+
+    size_t readSize = wsize - kept;
+    if (size_ >= 0)
+    {
+        readSize = readPos < (uint32_t)size_
+                       ? std::min<size_t>(readSize, size_ - readPos)
+                       : 0;
+    }
+
+    size_t r = 0;
+    if (readSize)
     {
-        fseek(fp_, adj_, SEEK_CUR);
-        adj_ = 0;
+        seekFile(readPos);
+        r = fread(window_.data() + kept, 1, readSize, fp_);
+        filePos_ += r;
+        ++stats_.reads;
+        stats_.bytesRead += r;
     }
+
+    windowPos_ = start;
+    cur_       = pos - start;
+    end_       = kept + r;
+    return end_ - cur_ >= size;
 }
 
 const char*
 FileBinaryStream::peek(size_t size)
 {
-    adjustPointer();
-
-    if (cache_.size() < size)
+    if (end_ - cur_ < size && !fill(size))
     {
-        cache_.resize(size);
+        return nullptr;
     }
-
-    fread(cache_.data(), 1, size, fp_);
-    adj_ = -size;
-    return cache_.data();
+    return window_.data() + cur_;
 }
 
 BinaryStream::DataPtr
@@ -62,30 +156,76 @@ FileBinaryStream::get(size_t size)
     {
         return {};
     }
+    auto* dst = const_cast<uint8_t*>(p.get());
+
+    if (size_t n = std::min(end_ - cur_, size))
+    {
+        memcpy(dst, window_.data() + cur_, n);
+        cur_ += n;
+        dst += n;
+        size -= n;
+    }
 
-    adjustPointer();
-    fread(const_cast<uint8_t*>(p.get()), 1, size, fp_);
+    if (!size)
+    {
+        return p;
+    }
+
+    if (size < windowSize_)
+    {
+        if (!fill(size))
+        {
+            return {};
+        }
+        memcpy(dst, window_.data() + cur_, size);
+        cur_ += size;
+        return p;
+    }
+
+    // 大きいものは窓を通さず直接読む
+    auto pos = tell();
+    seekFile(pos);
+    auto r = fread(dst, 1, size, fp_);
+    filePos_ += r;
+    ++stats_.reads;
+    stats_.bytesRead += r;
+    resetWindow(pos + r);
+    if (r != size)
+    {
+        return {};
+    }
     return p;
 }
 
 bool
 FileBinaryStream::advance(size_t size)
 {
-    adj_ += size;
+    if (end_ - cur_ >= size)
+    {
+        cur_ += size;
+    }
+    else
+    {
+        resetWindow(tell() + size);
+    }
     return true;
 }
 
 bool
 FileBinaryStream::isEndOfStream() const
 {
-    adjustPointer();
-    return feof(fp_);
+    return !fp_ || tell() >= (uint32_t)size_;
 }
 
 void
 FileBinaryStream::flush()
 {
-    adjustPointer();
+    if (fp_)
+    {
+        auto pos = tell();
+        seekFile(pos);
+        resetWindow(pos);
+    }
 }
 
 } // namespace io
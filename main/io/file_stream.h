@@ -12,42 +12,105 @@
 namespace io
 {
 
+// 先読み窓を持つファイルストリーム
+// 窓の中に収まっている間は fread/fseek を呼ばない
+// 先読みは 1 セクタから始めて、続けて読む間は windowSize まで倍にしていく
+// (ヘッダだけ見るものは少なく、曲データを流して読むものはまとめて読む)
 class FileBinaryStream final : public BinaryStream
 {
 public:
-    FileBinaryStream(FILE* fp = 0, int s = -1)
-        : fp_(fp)
-        , size_(s)
-        , adj_(0)
-        , cache_(16)
-    {
-    }
+    // 窓の位置は SD のセクタ境界に合わせる
+    static constexpr size_t SECTOR_SIZE         = 512;
+    static constexpr size_t DEFAULT_WINDOW_SIZE = 4096;
 
-    void setFile(FILE* fp, int s = -1)
+    struct Stats
     {
-        fp_   = fp;
-        size_ = s;
-        adj_  = 0;
-    }
+        uint32_t reads;
+        uint32_t seeks;
+        uint32_t bytesRead;
+    };
+
+public:
+    FileBinaryStream(FILE* fp         = 0,
+                     int s            = -1,
+                     size_t windowSize = DEFAULT_WINDOW_SIZE);
+
+    // s < 0 ならファイルサイズを調べる
+    // fp の現在位置からストリームが始まる
+    void setFile(FILE* fp, int s = -1);
 
     bool seek(int pos, bool tail = false) override;
-    uint32_t tell() const override;
+    uint32_t tell() const override { return windowPos_ + cur_; }
     const char* peek(size_t size) override;
     DataPtr get(size_t size) override;
     bool advance(size_t size) override;
     bool isEndOfStream() const override;
 
+    uint_fast8_t getU8() override
+    {
+        if (cur_ < end_)
+        {
+            return static_cast<uint8_t>(window_[cur_++]);
+        }
+        return BinaryStream::getU8();
+    }
+
+    uint_fast16_t getU16() override
+    {
+        if (end_ - cur_ >= 2)
+        {
+            auto p = getCurrent();
+            cur_ += 2;
+            return p[0] | (p[1] << 8);
+        }
+        return BinaryStream::getU16();
+    }
+
+    uint_fast32_t getU32() override
+    {
+        if (end_ - cur_ >= 4)
+        {
+            auto p = getCurrent();
+            cur_ += 4;
+            uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+            return v;
+        }
+        return BinaryStream::getU32();
+    }
+
+    uint_fast16_t getU16Aligned() override { return getU16(); }
+    uint_fast32_t getU32Aligned() override { return getU32(); }
+
+    // fp の位置をストリームの位置に合わせる
     void flush();
 
+    const Stats& getStats() const { return stats_; }
+
 protected:
-    void adjustPointer() const;
+    // 現在位置から size byte を窓に読み込む
+    bool fill(size_t size);
+    void seekFile(uint32_t pos);
+    void resetWindow(uint32_t pos);
+
+    const uint8_t* getCurrent() const
+    {
+        return reinterpret_cast<const uint8_t*>(window_.data()) + cur_;
+    }
 
 private:
-    FILE* fp_;
+    FILE* fp_{};
     int32_t size_ = -1;
 
-    mutable int adj_;
-    std::vector<char> cache_;
+    size_t windowSize_;
+    size_t readAhead_ = SECTOR_SIZE; // 次に読む量
+    std::vector<char> window_;
+    uint32_t windowPos_ = 0; // window_[0] のファイル上の位置
+    size_t cur_         = 0;
+    size_t end_         = 0;
+
+    uint32_t filePos_ = 0; // fp_ の実際の位置
+
+    Stats stats_{};
 };
 
 } // namespace io
@@ -6,6 +6,7 @@
 #include "file_util.h"
 #include "../debug.h"
 #include <stdio.h>
+#include <sys/stat.h>
 
 namespace io
 {
@@ -27,6 +28,21 @@ getFileSize(const char* filename)
     return (int)pos;
 }
 
+bool
+getFileInfo(const char* filename, FileInfo& info)
+{
+    // open しないので getFileSize() より軽い
+    struct stat st;
+    if (stat(filename, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        return false;
+    }
+
+    info.size  = (int)st.st_size;
+    info.mtime = (uint32_t)st.st_mtime;
+    return true;
+}
+
 int
 readFile(void* buffer, const char* filename, size_t size, size_t pos)
 {
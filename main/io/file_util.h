@@ -12,7 +12,14 @@
 namespace io
 {
 
+struct FileInfo
+{
+    int size;
+    uint32_t mtime;
+};
+
 int getFileSize(const char* filename);
+bool getFileInfo(const char* filename, FileInfo& info);
 int readFile(void* buffer, const char* filename, size_t size, size_t pos = 0);
 bool writeFile(const void* buffer, const char* filename, size_t size);
 bool
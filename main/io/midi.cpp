@@ -5,6 +5,7 @@
 
 #include "midi.h"
 #include <assert.h>
+#include <system/util.h>
 
 namespace io
 {
@@ -66,20 +67,41 @@ MidiMessageQueue::get(MidiMessage* m)
 {
     if (queue_.size())
     {
-        if (queue_.pop(m))
+        Entry e;
+        if (queue_.pop(&e))
         {
+            *m = e.m;
             return true;
         }
     }
     return false;
 }
 
+bool
+MidiMessageQueue::wait(MidiMessage* m, uint32_t* time, uint32_t timeoutMs)
+{
+    Entry e;
+    if (!queue_.pop(&e, timeoutMs / portTICK_PERIOD_MS))
+    {
+        return false;
+    }
+    *m    = e.m;
+    *time = e.time;
+    return true;
+}
+
 void
 MidiMessageQueue::put(const MidiMessage& m)
+{
+    put(m, sys::micros());
+}
+
+void
+MidiMessageQueue::put(const MidiMessage& m, uint32_t time)
 {
     if (queue_.getSpace())
     {
-        queue_.push(m);
+        queue_.push({m, time});
     }
 }
 
@@ -52,7 +52,13 @@ public:
 /////
 class MidiMessageQueue : public MidiIn, public MidiOut
 {
-    using Queue = sys::QueueWithSwitch<MidiMessage>;
+    struct Entry
+    {
+        MidiMessage m;
+        uint32_t time; // 出すべき時刻 (us)
+    };
+
+    using Queue = sys::QueueWithSwitch<Entry>;
     Queue queue_;
 
 public:
@@ -60,7 +66,11 @@ public:
 
     bool get(MidiMessage* m) override;
 
-    void put(const MidiMessage& m);
+    // 来るまで timeoutMs だけ待つ。time には出すべき時刻が入る
+    bool wait(MidiMessage* m, uint32_t* time, uint32_t timeoutMs);
+
+    void put(const MidiMessage& m) override; // 今すぐ
+    void put(const MidiMessage& m, uint32_t time);
     void setActive(bool f); // 消費先に接続するときに有効にする
 };
 
@@ -0,0 +1,74 @@
+#include "midi_jitter_buffer.h"
+#include <algorithm>
+
+namespace io
+{
+
+namespace
+{
+
+constexpr int TIMESTAMP_MASK = 8191; // 13bit ms
+
+// 一番速く届いたものが更新されなくても基準をこの割合で遅らせていく
+// (1/4096 = 244ppm。送信側との水晶のずれより大きくしておく)
+constexpr int DRIFT_SHIFT = 12;
+
+// これより外れたら送信側が変わったものとして取り直す
+constexpr int32_t RESYNC_US       = 1000 * 1000;
+constexpr uint32_t RESYNC_IDLE_US = 60 * 1000 * 1000;
+
+} // namespace
+
+uint32_t
+MidiJitterBuffer::schedule(int timestamp, uint32_t rxUs)
+{
+    ++stats_.events;
+    timestamp &= TIMESTAMP_MASK;
+
+    uint32_t elapsedUs = rxUs - lastRxUs_;
+    if (valid_ && elapsedUs > RESYNC_IDLE_US)
+    {
+        valid_ = false;
+    }
+
+    if (valid_)
+    {
+        // 13bit は 8 秒で一周するので、届いた間隔から近い方を選ぶ
+        int elapsedMs = elapsedUs / 1000;
+        int expected  = (lastTimestamp_ + elapsedMs) & TIMESTAMP_MASK;
+        int d         = ((timestamp - expected + 4096) & TIMESTAMP_MASK) - 4096;
+        senderUs_ += (elapsedMs + d) * 1000;
+    }
+    else
+    {
+        senderUs_ = rxUs;
+    }
+
+    int32_t sample = rxUs - senderUs_;
+    if (!valid_ || sample - offsetUs_ > RESYNC_US ||
+        offsetUs_ - sample > RESYNC_US)
+    {
+        offsetUs_ = sample;
+        valid_    = true;
+        ++stats_.resyncs;
+    }
+    else
+    {
+        int32_t limit = offsetUs_ + int32_t(elapsedUs >> DRIFT_SHIFT);
+        offsetUs_     = std::min(sample, limit);
+    }
+
+    lastRxUs_       = rxUs;
+    lastTimestamp_  = timestamp;
+    stats_.offsetUs = offsetUs_;
+
+    uint32_t release = senderUs_ + offsetUs_ + delayUs_;
+    if (int32_t(release - rxUs) < 0)
+    {
+        ++stats_.late;
+        release = rxUs;
+    }
+    return release;
+}
+
+} // namespace io
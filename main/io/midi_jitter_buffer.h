@@ -0,0 +1,50 @@
+#ifndef _2E86C4A1_7B03_4F59_9D1E_C8A53F07B612
+#define _2E86C4A1_7B03_4F59_9D1E_C8A53F07B612
+
+#include <stdint.h>
+
+namespace io
+{
+
+// BLE MIDI のタイムスタンプをローカルの時刻 (us) に写して
+// 送信側と同じ間隔で出すための時刻を決める
+//
+// 接続間隔 (7.5-30ms) ごとにまとめて届くので、一番速く届いたものを
+// 基準にして delay だけ遅らせて出す
+class MidiJitterBuffer
+{
+public:
+    static constexpr uint32_t DEFAULT_DELAY_US = 20000;
+
+    struct Stats
+    {
+        uint32_t events;
+        uint32_t late;    // delay に間に合わなかった
+        uint32_t resyncs; // 基準を取り直した
+        int32_t offsetUs; // ローカル時刻 - 送信側の時刻
+    };
+
+public:
+    void setDelay(uint32_t us) { delayUs_ = us; }
+    uint32_t getDelay() const { return delayUs_; }
+
+    void reset() { valid_ = false; }
+
+    // rxUs に届いたパケットの timestamp (13bit ms) のイベントを出す時刻
+    uint32_t schedule(int timestamp, uint32_t rxUs);
+
+    const Stats& getStats() const { return stats_; }
+
+private:
+    bool valid_        = false;
+    int lastTimestamp_ = 0;
+    uint32_t senderUs_ = 0; // 展開した送信側の時刻
+    uint32_t lastRxUs_ = 0;
+    int32_t offsetUs_  = 0;
+    uint32_t delayUs_  = DEFAULT_DELAY_US;
+    Stats stats_{};
+};
+
+} // namespace io
+
+#endif /* _2E86C4A1_7B03_4F59_9D1E_C8A53F07B612 */
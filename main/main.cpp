@@ -9,6 +9,7 @@
 #include <io/ble_midi.h>
 #include <io/bluetooth.h>
 #include <io/file_util.h>
+#include <music_player/midi_synth.h>
 #include <utility/Config.h>
 #include <utility>
 #include <wire.h>
@@ -46,7 +47,8 @@ setup()
     Serial.flush();
     Serial.print("M5Stack initializing...\n");
 
-    sys::getDefaultJobManager().start(0, 4096, "JobManager0");
+    // タイトル読みや PDX の先読み・展開 (LOW) はもう 1 つの worker でも拾う
+    sys::getDefaultJobManager().start(0, 4096, "JobManager0", 1, 1);
 
     graphics::getDisplay().initialize();
     //    graphics::getDisplay().setWindow(120, 30, 20, 20);
@@ -94,6 +96,7 @@ setup()
 
     static io::MidiMessageQueue midiIn;
     io::BLEMidiClient::instance().setMIDIIn(&midiIn);
+    music_player::getMidiSynth().setInput(&midiIn);
     io::BLEManager::instance().registerClientProfile(
         io::BLEMidiClient::instance());
 
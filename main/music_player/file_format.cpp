@@ -21,6 +21,9 @@ getFileFormatString(FileFormat fmt)
 
     case FileFormat::VGM:
         return "VGM";
+
+    case FileFormat::MIDI:
+        return "MID";
     }
     return "---";
 }
@@ -13,6 +13,7 @@ enum class FileFormat
     MDX,
     S98,
     VGM,
+    MIDI,
 };
 
 const char* getFileFormatString(FileFormat fmt);
@@ -11,9 +11,12 @@
 #include <audio/sample_generator.h>
 #include <audio/sound_chip_manager.h>
 #include <io/file_util.h>
+#include <music_player/music_player_manager.h>
+#include <music_player/pdx_cache.h>
 #include <mxdrv/mxdrv.h>
 #include <mxdrv/sys.h>
 #include <string.h>
+#include <system/arena.h>
 
 #include <audio/audio.h>
 
@@ -48,7 +51,19 @@ removeEscapeSequence(std::string& str)
 bool
 MDXPlayer::loadMDX(const char* filename)
 {
-    ByteArray().swap(mdx_);
+    auto& pcmStats = pcm8_.getStats();
+    if (pcmStats.adpcmNibbles || pcmStats.decodedNibbles)
+    {
+        DBOUT(("PCM8: %d nibbles decoded while playing, %d pre-decoded.\n",
+               pcmStats.adpcmNibbles,
+               pcmStats.decodedNibbles));
+        pcm8_.resetStats();
+    }
+
+    auto& arena = getSongArena();
+    arena.resetFront();
+    mdx_     = nullptr;
+    mdxSize_ = 0;
 
     int size = io::getFileSize(filename);
     if (size < 0)
@@ -57,8 +72,20 @@ MDXPlayer::loadMDX(const char* filename)
         return false;
     }
 
-    mdx_.resize(size + 8);
-    if (io::readFile(mdx_.data() + 8, filename, size) < 0)
+    mdx_ = static_cast<uint8_t*>(arena.allocate(size + 8));
+    if (!mdx_)
+    {
+        // アリーナに入らず、ヒープが PDX で埋まっている時
+        unloadPDX();
+        getPDXCache().clear();
+        mdx_ = static_cast<uint8_t*>(arena.allocate(size + 8));
+    }
+    if (!mdx_)
+    {
+        return false;
+    }
+    mdxSize_ = size + 8;
+    if (io::readFile(mdx_ + 8, filename, size) < 0)
     {
         DBOUT(("file read error. %s\n", filename));
         return false;
@@ -74,16 +101,21 @@ MDXPlayer::loadMDX(const char* filename)
     if (!analyzePDXFilename(pdxName))
         return false;
 
-    if (!pdxName.empty() && !loadPDX(filename, pdxName))
+    if (pdxName.empty())
+    {
+        unloadPDX();
+    }
+    else if (!loadPDX(filename, pdxName))
     {
         DBOUT(("PDX load error %s %s.\n", filename, pdxName.c_str()));
+        unloadPDX();
     }
 
     //
     int mdxBodyOfs = title_.size() + 3 + pdxName.size() + 1 + 8 /*header*/;
     mdx_[0]        = 0;
     mdx_[1]        = 0;
-    mdx_[2]        = pdx_.size() ? 0 : 0xff;
+    mdx_[2]        = pdx_ ? 0 : 0xff;
     mdx_[3]        = mdx_[2];
     mdx_[4]        = mdxBodyOfs >> 8;
     mdx_[5]        = mdxBodyOfs;
@@ -149,9 +181,10 @@ MDXPlayer::terminate()
     DBOUT(("terminate MDX!\n"));
     stop();
     MXDRV_End();
-    ByteArray().swap(mdx_);
-    ByteArray().swap(pdx_);
-    std::string().swap(currentPDXPath_);
+    mdx_     = nullptr;
+    mdxSize_ = 0;
+    unloadPDX();
+    getSongArena().reset();
     std::string().swap(pdxPath_);
     std::string().swap(title_);
 
@@ -171,11 +204,14 @@ MDXPlayer::play(int)
     DBOUT(("MDXPlayer::play\n"));
     MXDRV_Stop();
 
-    void* pdx = pdx_.size() ? &pdx_[0] : 0;
+    if (!mdx_)
+    {
+        return false;
+    }
 
     //  if (!initialized_)
     {
-        int res = MXDRV_Start(&mdx_[0], mdx_.size(), pdx, pdx_.size());
+        int res = MXDRV_Start(mdx_, mdxSize_, pdx_, pdxSize_);
         if (res)
         {
             DBOUT(("mxdrv start error. %d\n", res));
@@ -186,7 +222,7 @@ MDXPlayer::play(int)
     fadeout_ = false;
     paused_  = false;
 
-    MXDRV_Play(&mdx_[0], mdx_.size(), pdx, pdx_.size());
+    MXDRV_Play(mdx_, mdxSize_, pdx_, pdxSize_);
 
     return true;
 }
@@ -285,11 +321,11 @@ MDXPlayer::analyzeTitle()
 {
     std::string().swap(title_);
 
-    auto top = mdx_.begin() + 8;
-    auto end = mdx_.end();
+    auto top = mdx_ + 8;
+    auto end = mdx_ + mdxSize_;
 
     auto tail = std::find(top, end, 0x1a);
-    if ((tail == mdx_.end()) || (tail - mdx_.begin() < 2) ||
+    if ((tail == end) || (tail - mdx_ < 2) ||
         (*(tail - 1) != 0xa) || (*(tail - 2) != 0xd))
         return false;
 
@@ -301,7 +337,7 @@ MDXPlayer::analyzeTitle()
         return false;
     }
 
-    title_.assign((const char*)&*top, (const char*)&*tail);
+    title_.assign((const char*)top, (const char*)tail);
     DBOUT(("title: %s\n", title_.c_str()));
     return true;
 }
@@ -309,18 +345,23 @@ MDXPlayer::analyzeTitle()
 bool
 MDXPlayer::analyzePDXFilename(std::string& name) const
 {
-    auto top  = mdx_.begin() + title_.size() + 3 + 8 /*header*/;
-    auto tail = std::find(top, mdx_.end(), 0);
-    if (tail == mdx_.end())
+    auto top  = mdx_ + title_.size() + 3 + 8 /*header*/;
+    auto end  = mdx_ + mdxSize_;
+    if (top > end)
         return false;
 
-    name.assign((const char*)&*top, (const char*)&*tail);
+    auto tail = std::find(top, end, 0);
+    if (tail == end)
+        return false;
+
+    name.assign((const char*)top, (const char*)tail);
     DBOUT(("pdx: %s\n", name.c_str()));
     return true;
 }
 
-bool
-MDXPlayer::loadPDX(const char* mdxFilename, const std::string& pdxName)
+std::string
+MDXPlayer::resolvePDXPath(const char* mdxFilename,
+                          const std::string& pdxName) const
 {
     const char* mdxPathTail = strrchr(mdxFilename, '/');
     std::string mdxPath(mdxFilename,
@@ -331,79 +372,93 @@ MDXPlayer::loadPDX(const char* mdxFilename, const std::string& pdxName)
            mdxPath.c_str(),
            pdxPath_.c_str()));
 
-    auto path_size = [&]() -> std::pair<std::string, int> {
-        auto path = mdxPath + pdxName;
-        int size  = io::getFileSize(path.c_str());
-        if (size >= 0)
-        {
-            return {path, size};
-        }
-
-        path += ".pdx";
-        size = io::getFileSize(path.c_str());
-        if (size >= 0)
-        {
-            return {path, size};
-        }
-
-        path = pdxPath_ + pdxName;
-        size = io::getFileSize(path.c_str());
-        if (size >= 0)
+    io::FileInfo info;
+    const std::string* dirs[] = {&mdxPath, &pdxPath_};
+    for (auto dir : dirs)
+    {
+        auto path = *dir + pdxName;
+        if (io::getFileInfo(path.c_str(), info))
         {
-            return {path, size};
+            return path;
         }
 
         path += ".pdx";
-        size = io::getFileSize(path.c_str());
-        if (size >= 0)
+        if (io::getFileInfo(path.c_str(), info))
         {
-            return {path, size};
+            return path;
         }
+    }
+    return {};
+}
 
-        return {};
-    }();
-
-    if (path_size.first.empty())
+bool
+MDXPlayer::loadPDX(const char* mdxFilename, const std::string& pdxName)
+{
+    auto path = resolvePDXPath(mdxFilename, pdxName);
+    if (path.empty())
     {
         DBOUT(("pdx not found.\n"));
-        path_size.first.swap(currentPDXPath_);
         return false;
     }
 
-    if (path_size.first == currentPDXPath_)
+    DBOUT(("PDX : %s\n", path.c_str()));
+
+    // 同じものなら参照が増えるだけ
+    auto e = getPDXCache().acquire(path);
+    unloadPDX();
+    if (!e)
     {
-        DBOUT(("pdx %s already loaded.\n", currentPDXPath_.c_str()));
         return false;
     }
 
-    currentPDXPath_ = path_size.first;
-    DBOUT(("PDX : %s\n", currentPDXPath_.c_str()));
+    pdxEntry_ = e;
+    pdx_      = e->data;
+    pdxSize_  = e->size;
+    pcm8_.setADPCMBank(e->adpcmBank.get());
+    return true;
+}
 
-    //
-    ByteArray().swap(pdx_);
+void
+MDXPlayer::unloadPDX()
+{
+    pcm8_.setADPCMBank(nullptr);
+    getPDXCache().release(pdxEntry_);
+    pdxEntry_ = nullptr;
+    pdx_      = nullptr;
+    pdxSize_  = 0;
+}
 
-    int fileSize   = path_size.second;
-    int pdxbodyptr = (8 + currentPDXPath_.size() + 1) & (-2);
-    pdx_.resize(fileSize + pdxbodyptr);
-    if (io::readFile(
-            pdx_.data() + pdxbodyptr, currentPDXPath_.c_str(), fileSize) < 0)
+void
+MDXPlayer::prewarmPDX(const char* mdxFilename)
+{
+    // タイトルの後ろに PDX 名があるので頭だけ読めば足りる
+    uint8_t buf[256];
+    int size = io::readFile(buf, mdxFilename, sizeof(buf));
+    if (size <= 0)
     {
-        DBOUT(("load PDX error"));
-        return false;
+        return;
     }
 
-    strcpy((char*)&pdx_[8], currentPDXPath_.c_str());
+    auto end = buf + size;
+    auto top = std::find(buf, end, 0x1a);
+    if (top == end)
+    {
+        return;
+    }
+    ++top;
 
-    pdx_[0] = 0x00;
-    pdx_[1] = 0x00;
-    pdx_[2] = 0x00;
-    pdx_[3] = 0x00;
-    pdx_[4] = pdxbodyptr >> 8;
-    pdx_[5] = pdxbodyptr;
-    pdx_[6] = currentPDXPath_.size() >> 8;
-    pdx_[7] = currentPDXPath_.size();
+    auto tail = std::find(top, end, 0);
+    if (tail == end || tail == top)
+    {
+        return;
+    }
 
-    return true;
+    std::string pdxName((const char*)top, (const char*)tail);
+    auto path = resolvePDXPath(mdxFilename, pdxName);
+    if (!path.empty())
+    {
+        getPDXCache().prewarm(path);
+    }
 }
 
 void
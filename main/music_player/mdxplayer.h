@@ -9,6 +9,7 @@
 #define _4560C35E_C133_F071_1515_1239749E5F78
 
 #include "music_player.h"
+#include "pdx_cache.h"
 #include <sound_sys/swpcm8.h>
 #include <sound_sys/ym2151.h>
 #include <stdint.h>
@@ -20,11 +21,13 @@ namespace music_player
 
 class MDXPlayer : public MusicPlayer
 {
-    typedef std::vector<uint8_t> ByteArray;
-    ByteArray mdx_;
-    ByteArray pdx_;
+    // MDX は曲のアリーナに、PDX は PDXCache に置く
+    uint8_t* mdx_{};
+    size_t mdxSize_ = 0;
+    uint8_t* pdx_{};
+    size_t pdxSize_ = 0;
+    const PDXCache::Entry* pdxEntry_{};
 
-    std::string currentPDXPath_;
     std::string pdxPath_;
 
     std::string title_;
@@ -64,11 +67,17 @@ public:
     const std::string& getPDXPath() const { return pdxPath_; }
     void setPDXPath(const char* s);
 
+    // mdxFilename が使う PDX を PDXCache に読み込んでおく
+    void prewarmPDX(const char* mdxFilename);
+
 protected:
     bool analyzeTitle();
     bool analyzePDXFilename(std::string& name) const;
 
+    std::string resolvePDXPath(const char* mdxFilename,
+                               const std::string& pdxName) const;
     bool loadPDX(const char* mdxFilename, const std::string& pdxName);
+    void unloadPDX();
 
     void freeAudioChips();
 };
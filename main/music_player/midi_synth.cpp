@@ -0,0 +1,278 @@
+#include "midi_synth.h"
+#include "../debug.h"
+#include "music_player_manager.h"
+#include <algorithm>
+#include <audio/audio.h>
+#include <audio/sound_chip_manager.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <io/file_util.h>
+#include <mutex>
+#include <system/util.h>
+#include <vector>
+
+namespace music_player
+{
+
+namespace
+{
+
+// タイマータスク (21) よりは下、UI よりは上
+constexpr int TASK_PRIORITY = 15;
+
+// この時間鳴っていなければ無音とみなして発音の遅延を測る
+constexpr uint32_t PROBE_SILENCE_US = 500 * 1000;
+
+// これだけノートオンを処理したら統計を出す
+constexpr uint32_t REPORT_INTERVAL = 64;
+
+// 音程の表は 3.58MHz 前提
+constexpr int OPM_CLOCK = 3579545;
+
+// 出す時刻がこれより先なら壊れたタイムスタンプとみなしてすぐ出す
+constexpr int32_t MAX_WAIT_US = 200 * 1000;
+
+} // namespace
+
+bool
+MidiSynth::start(const char* patchFile)
+{
+    if (running_)
+    {
+        return true;
+    }
+
+    terminateActiveMusicPlayerWithout(nullptr);
+
+    std::lock_guard<sys::Mutex> lock(mutex_);
+    auto chip = audio::allocateYM2151();
+    if (!chip)
+    {
+        DBOUT(("MIDI synth: YM2151 is not available.\n"));
+        return false;
+    }
+    ym2151_.setChip(chip);
+    ym2151_.setClock(OPM_CLOCK);
+    audio::setFMVolume(1.0f);
+
+    if (!patchFile || !loadPatchBank(patchFile))
+    {
+        allocator_.setPatchBank({});
+    }
+    allocator_.setSystem(&ym2151_);
+    allocator_.reset();
+    allocator_.resetStats();
+
+    stats_       = {};
+    stats_.minUs = UINT32_MAX;
+    probing_     = false;
+    lastNoteUs_  = sys::micros() - PROBE_SILENCE_US;
+
+    if (in_)
+    {
+        // 止まっている間に溜まったものは捨てる
+        io::MidiMessage m;
+        while (in_->get(&m))
+        {
+        }
+        in_->setActive(true);
+    }
+
+    if (!taskStarted_)
+    {
+        xTaskCreate([](void* p) { static_cast<MidiSynth*>(p)->task(); },
+                    "MidiSynth",
+                    3072,
+                    this,
+                    TASK_PRIORITY,
+                    nullptr);
+        taskStarted_ = true;
+    }
+
+    running_ = true;
+    DBOUT(("MIDI synth started. %d patches.\n",
+           (int)allocator_.getPatchCount()));
+    return true;
+}
+
+void
+MidiSynth::stop()
+{
+    std::lock_guard<sys::Mutex> lock(mutex_);
+    if (!running_)
+    {
+        return;
+    }
+
+    allocator_.allNotesOff();
+    allocator_.setSystem(nullptr);
+    audio::freeYM2151(ym2151_.detachChip());
+    running_ = false;
+
+    auto& st = allocator_.getStats();
+    DBOUT(("MIDI synth stopped. note on %d, steal %d, patch load %d/%d, "
+           "%d writes.\n",
+           st.noteOns,
+           st.steals,
+           st.patchLoads,
+           st.patchLoads + st.patchReuses,
+           st.regWrites));
+}
+
+MidiSynth::LatencyStats
+MidiSynth::getLatencyStats()
+{
+    std::lock_guard<sys::Mutex> lock(mutex_);
+    return stats_;
+}
+
+bool
+MidiSynth::loadPatchBank(const char* filename)
+{
+    int size = io::getFileSize(filename);
+    if (size <= 0)
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> buf(size);
+    if (io::readFile(buf.data(), filename, size) != size)
+    {
+        return false;
+    }
+
+    std::vector<sound_sys::OPMPatch> bank;
+    if (!sound_sys::loadMDXVoices(bank, buf.data(), size))
+    {
+        DBOUT(("'%s': no voice data.\n", filename));
+        return false;
+    }
+    DBOUT(("'%s': %d voices.\n", filename, (int)bank.size()));
+    allocator_.setPatchBank(std::move(bank));
+    return true;
+}
+
+void
+MidiSynth::task()
+{
+    while (1)
+    {
+        io::MidiMessage m;
+        uint32_t time;
+        bool received = in_ && in_->wait(&m, &time, 100);
+        if (!in_)
+        {
+            sys::delay(100);
+        }
+        if (received)
+        {
+            waitUntil(time);
+        }
+
+        std::lock_guard<sys::Mutex> lock(mutex_);
+        if (!running_)
+        {
+            continue;
+        }
+        if (received)
+        {
+            audio::beginFMWriteBatch();
+            process(m, time);
+            audio::endFMWriteBatch();
+        }
+        checkOnsetProbe();
+    }
+}
+
+void
+MidiSynth::waitUntil(uint32_t time)
+{
+    // tick 単位で寝て、残りは回して待つ
+    int32_t rest = time - sys::micros();
+    if (rest > MAX_WAIT_US)
+    {
+        return;
+    }
+    if (rest > 1000 * portTICK_PERIOD_MS)
+    {
+        vTaskDelay(rest / 1000 / portTICK_PERIOD_MS);
+        rest = time - sys::micros();
+    }
+    if (rest > 0)
+    {
+        sys::delayMicroseconds(rest);
+    }
+}
+
+void
+MidiSynth::process(const io::MidiMessage& m, uint32_t time)
+{
+    bool noteOn = m.size == 3 && (m.data[0] & 0xf0) == 0x90 && m.data[2];
+    bool silent = !allocator_.getKeyOnVoiceCount() &&
+                  time - lastNoteUs_ > PROBE_SILENCE_US;
+
+    allocator_.message(m.data.data(), m.size);
+
+    if (!noteOn)
+    {
+        return;
+    }
+
+    auto now = sys::micros();
+    auto dt  = now - time;
+    ++stats_.noteOns;
+    stats_.totalUs += dt;
+    stats_.minUs = std::min(stats_.minUs, dt);
+    stats_.maxUs = std::max(stats_.maxUs, dt);
+    lastNoteUs_  = now;
+
+    if (silent && !probing_)
+    {
+        audio::armOnsetProbe(time);
+        probing_ = true;
+    }
+
+    if (stats_.noteOns % REPORT_INTERVAL == 0)
+    {
+        DBOUT(("MIDI synth latency: sched->keyon %d/%d/%d us (min/avg/max), "
+               "sched->output %d us (max %d, %d samples)\n",
+               stats_.minUs,
+               stats_.totalUs / stats_.noteOns,
+               stats_.maxUs,
+               stats_.lastOnsetUs,
+               stats_.maxOnsetUs,
+               stats_.onsetCount));
+    }
+}
+
+void
+MidiSynth::checkOnsetProbe()
+{
+    if (!probing_)
+    {
+        return;
+    }
+
+    int r = audio::getOnsetProbeResult();
+    if (r >= 0)
+    {
+        ++stats_.onsetCount;
+        stats_.lastOnsetUs = r;
+        stats_.maxOnsetUs  = std::max(stats_.maxOnsetUs, r);
+        probing_           = false;
+    }
+    else if (sys::micros() - lastNoteUs_ > PROBE_SILENCE_US)
+    {
+        // 閾値を超えなかった (音量が小さい)
+        probing_ = false;
+    }
+}
+
+MidiSynth&
+getMidiSynth()
+{
+    static MidiSynth inst;
+    return inst;
+}
+
+} // namespace music_player
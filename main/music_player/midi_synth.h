@@ -0,0 +1,70 @@
+#ifndef _9F2D6B08_E371_4C5A_A1F4_0B87C6D35E29
+#define _9F2D6B08_E371_4C5A_A1F4_0B87C6D35E29
+
+#include <atomic>
+#include <io/midi.h>
+#include <sound_sys/opm_voice_allocator.h>
+#include <sound_sys/ym2151.h>
+#include <stdint.h>
+#include <system/mutex.h>
+
+namespace music_player
+{
+
+// 受信した MIDI で YM2151 を鳴らす
+// 動いている間はチップを占有するので、曲の再生とは排他
+class MidiSynth
+{
+public:
+    struct LatencyStats
+    {
+        // 出すべき時刻 (BLE MIDI はタイムスタンプから決める) から
+        // キーオンを書き終えるまで
+        uint32_t noteOns;
+        uint32_t minUs;
+        uint32_t maxUs;
+        uint32_t totalUs;
+
+        // 出すべき時刻から出力に音が現れるまで (無音からの発音で測る)
+        uint32_t onsetCount;
+        int lastOnsetUs;
+        int maxOnsetUs;
+    };
+
+public:
+    void setInput(io::MidiMessageQueue* in) { in_ = in; }
+
+    // patchFile は音色を取り出す MDX。nullptr ならデフォルトの音色
+    bool start(const char* patchFile = nullptr);
+    void stop();
+    bool isRunning() const { return running_; }
+
+    LatencyStats getLatencyStats();
+    sound_sys::SoundSystem* getSystem() { return &ym2151_; }
+
+protected:
+    void task();
+    void waitUntil(uint32_t time);
+    void process(const io::MidiMessage& m, uint32_t time);
+    void checkOnsetProbe();
+    bool loadPatchBank(const char* filename);
+
+private:
+    io::MidiMessageQueue* in_{};
+    sound_sys::YM2151 ym2151_;
+    sound_sys::OPMVoiceAllocator allocator_;
+
+    sys::Mutex mutex_;
+    std::atomic<bool> running_{false};
+    bool taskStarted_ = false;
+
+    LatencyStats stats_{};
+    bool probing_        = false;
+    uint32_t lastNoteUs_ = 0;
+};
+
+MidiSynth& getMidiSynth();
+
+} // namespace music_player
+
+#endif /* _9F2D6B08_E371_4C5A_A1F4_0B87C6D35E29 */
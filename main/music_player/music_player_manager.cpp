@@ -6,10 +6,16 @@
 #include "music_player_manager.h"
 
 #include "play_list.h"
+#include <atomic>
 #include <debug.h>
 #include <music_player/mdxplayer.h>
+#include <music_player/midi_synth.h>
 #include <music_player/s98player.h>
+#include <music_player/smfplayer.h>
 #include <string>
+#include <system/alloc_trap.h>
+#include <system/arena.h>
+#include <system/job_manager.h>
 #include <system/mutex.h>
 #include <ui/system_setting.h>
 
@@ -19,10 +25,21 @@ namespace music_player
 namespace
 {
 
+// MDX や S98、SMF が収まる大きさ。PDX は PDXCache に置く
+// 収まらないものはヒープから取る (sys::Arena::allocate())
+constexpr size_t SONG_ARENA_SIZE = 1024 * 1024;
+
+// プレイリストの先の曲をいくつ先読みするか
+constexpr int PREWARM_AHEAD = 2;
+
+sys::Arena songArena_;
+bool songArenaTried_ = false;
+
 MDXPlayer mdxPlayer_;
 S98Player s98Player_;
+SMFPlayer smfPlayer_;
 
-MusicPlayer* musicPlayers_[] = {&mdxPlayer_, &s98Player_};
+MusicPlayer* musicPlayers_[] = {&mdxPlayer_, &s98Player_, &smfPlayer_};
 
 MusicPlayer* activeMusicPlayer_ = {};
 std::string currentPlayListFile_;
@@ -44,6 +61,60 @@ Song currentSong_;
 
 sys::Mutex mutex_;
 
+// 曲が変わったら古い先読みは捨てる
+std::atomic<uint32_t> prewarmGeneration_{0};
+
+int
+getNextListIndex(int idx)
+{
+    auto& pl = getDefaultPlayList();
+    int ct   = pl.getListCount();
+    if (ct == 0)
+    {
+        return -1;
+    }
+
+    if (ui::SystemSettings::instance().isShuffleMode())
+    {
+        auto* entry = pl.get(idx);
+        return entry ? pl.findOrder((entry->order + 1) % ct) : -1;
+    }
+    return (idx + 1) % ct;
+}
+
+void
+prewarmPlayList(int idx)
+{
+    auto& pl = getDefaultPlayList();
+    auto gen = ++prewarmGeneration_;
+
+    int next = idx;
+    for (int i = 0; i < PREWARM_AHEAD; ++i)
+    {
+        next = getNextListIndex(next);
+        if (next < 0 || next == idx)
+        {
+            break;
+        }
+
+        auto* entry = pl.get(next);
+        if (!entry || findMusicPlayerFromFile(entry->filename.c_str()) !=
+                          &mdxPlayer_)
+        {
+            continue;
+        }
+
+        sys::getDefaultJobManager().add(
+            [filename = entry->filename, gen] {
+                if (gen == prewarmGeneration_)
+                {
+                    mdxPlayer_.prewarmPDX(filename.c_str());
+                }
+            },
+            sys::JobManager::Priority::LOW);
+    }
+}
+
 } // namespace
 
 sys::Mutex&
@@ -52,6 +123,21 @@ getMutex()
     return mutex_;
 }
 
+sys::Arena&
+getSongArena()
+{
+    // 取れなければ (PSRAM が無いなど) 作り直さず、毎回ヒープから取る
+    if (!songArenaTried_)
+    {
+        songArenaTried_ = true;
+        if (!songArena_.initialize(SONG_ARENA_SIZE))
+        {
+            DBOUT(("song arena is not available. use heap.\n"));
+        }
+    }
+    return songArena_;
+}
+
 MusicPlayer*
 findMusicPlayerFromFile(const char* filename)
 {
@@ -99,6 +185,7 @@ playMusicFile(const char* filename, int track, bool terminateOld)
 {
     DBOUT(("playMusicFile %s, %d\n", filename, track));
     std::lock_guard<sys::Mutex> lock(mutex_);
+    auto allocCount = sys::getAllocCount();
 
     auto* player = findMusicPlayerFromFile(filename);
     if (!player)
@@ -106,6 +193,9 @@ playMusicFile(const char* filename, int track, bool terminateOld)
         return false;
     }
 
+    // シンセがチップを使っている
+    getMidiSynth().stop();
+
     if (terminateOld)
     {
         terminateActiveMusicPlayerWithout(player);
@@ -123,7 +213,14 @@ playMusicFile(const char* filename, int track, bool terminateOld)
 
     setActiveMusicPlayer(player);
 
-    return player->play(track);
+    bool r = player->play(track);
+
+    sys::reportAllocations("song start", allocCount);
+    DBOUT(("song arena: %d/%d bytes used, %d bytes from heap\n",
+           (int)songArena_.getUsed(),
+           (int)songArena_.getCapacity(),
+           (int)songArena_.getOverflowBytes()));
+    return r;
 }
 
 void
@@ -181,7 +278,13 @@ playPlayList(int idx, int track)
         track = entry->track;
     }
 
-    return playMusicFile(entry->filename.c_str(), track, true);
+    if (!playMusicFile(entry->filename.c_str(), track, true))
+    {
+        return false;
+    }
+
+    prewarmPlayList(idx);
+    return true;
 }
 
 bool
@@ -11,7 +11,8 @@
 namespace sys
 {
 class Mutex;
-}
+class Arena;
+} // namespace sys
 
 namespace music_player
 {
@@ -36,6 +37,9 @@ int getCurrentListIndex();
 
 sys::Mutex& getMutex();
 
+// 曲ごとのデータを置く領域。プレイヤーの terminate でリセットされる
+sys::Arena& getSongArena();
+
 } // namespace music_player
 
 #endif /* _5B147C5A_8134_13F9_1444_443F1EFDAF7D */
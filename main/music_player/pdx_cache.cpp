@@ -0,0 +1,326 @@
+#include "pdx_cache.h"
+#include "../debug.h"
+#include <esp_heap_caps.h>
+#include <mutex>
+#include <string.h>
+#include <system/job_manager.h>
+#include <system/util.h>
+
+namespace music_player
+{
+
+namespace
+{
+
+uint8_t*
+allocateBuffer(size_t size)
+{
+    auto p = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!p)
+    {
+        p = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    }
+    return static_cast<uint8_t*>(p);
+}
+
+} // namespace
+
+PDXCache::~PDXCache()
+{
+    for (auto& e : entries_)
+    {
+        heap_caps_free(e->data);
+    }
+}
+
+const PDXCache::Entry*
+PDXCache::acquire(const std::string& path)
+{
+    auto e = get(path, true);
+    if (e)
+    {
+        auto st = getStats();
+        DBOUT(("PDX cache: hit %d, miss %d, prewarm %d, %d bytes saved.\n",
+               st.hits,
+               st.misses,
+               st.prewarms,
+               st.bytesSaved));
+    }
+    return e;
+}
+
+void
+PDXCache::release(const Entry* e)
+{
+    if (!e)
+    {
+        return;
+    }
+
+    std::lock_guard<sys::Mutex> lock(mutex_);
+    auto p = const_cast<Entry*>(e);
+    if (--p->refs == 0 && p->path.empty())
+    {
+        evict(p);
+    }
+}
+
+bool
+PDXCache::prewarm(const std::string& path)
+{
+    return get(path, false);
+}
+
+void
+PDXCache::clear()
+{
+    std::lock_guard<sys::Mutex> lock(mutex_);
+    for (size_t i = 0; i < entries_.size();)
+    {
+        auto e = entries_[i].get();
+        if (e->refs == 0)
+        {
+            evict(e);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
+PDXCache::Stats
+PDXCache::getStats()
+{
+    std::lock_guard<sys::Mutex> lock(mutex_);
+    return stats_;
+}
+
+PDXCache::Entry*
+PDXCache::get(const std::string& path, bool pin)
+{
+    io::FileInfo info;
+    if (!io::getFileInfo(path.c_str(), info))
+    {
+        DBOUT(("'%s' not found.\n", path.c_str()));
+        return nullptr;
+    }
+
+    size_t bodyOfs = (8 + path.size() + 1) & ~1;
+    size_t size    = info.size + bodyOfs;
+
+    uint8_t* data;
+    {
+        std::lock_guard<sys::Mutex> lock(mutex_);
+        if (auto e = find(path, info))
+        {
+            if (pin)
+            {
+                ++e->refs;
+                ++stats_.hits;
+                stats_.bytesSaved += info.size;
+            }
+            touch(e);
+            return e;
+        }
+
+        makeRoom(size);
+        data = allocateBuffer(size);
+        if (!data)
+        {
+            DBOUT(("PDX cache: allocate %d bytes failed.\n", (int)size));
+            return nullptr;
+        }
+    }
+
+    // 読んでいる間は他から使えるようにロックを外しておく
+    if (io::readFile(data + bodyOfs, path.c_str(), info.size) != info.size)
+    {
+        DBOUT(("load PDX error. %s\n", path.c_str()));
+        heap_caps_free(data);
+        return nullptr;
+    }
+
+    memset(data, 0, bodyOfs);
+    strcpy((char*)&data[8], path.c_str());
+    data[4] = bodyOfs >> 8;
+    data[5] = bodyOfs;
+    data[6] = path.size() >> 8;
+    data[7] = path.size();
+
+    std::lock_guard<sys::Mutex> lock(mutex_);
+    stats_.bytesRead += info.size;
+
+    auto e = find(path, info);
+    if (e)
+    {
+        // 読んでいる間に他で読み込まれた
+        heap_caps_free(data);
+    }
+    else
+    {
+        entries_.push_back(std::make_unique<Entry>());
+        e       = entries_.back().get();
+        e->path = path;
+        e->info = info;
+        e->data = data;
+        e->size = size;
+        e->refs = 0;
+
+        e->decodedBytes = 0;
+        usedBytes_ += size;
+
+        if (predecodeADPCM_)
+        {
+            startPredecode(e);
+        }
+    }
+
+    if (pin)
+    {
+        ++e->refs;
+        ++stats_.misses;
+    }
+    else
+    {
+        ++stats_.prewarms;
+    }
+    touch(e);
+    return e;
+}
+
+PDXCache::Entry*
+PDXCache::find(const std::string& path, const io::FileInfo& info)
+{
+    for (auto& p : entries_)
+    {
+        auto e = p.get();
+        if (e->path != path)
+        {
+            continue;
+        }
+
+        if (e->info.size == info.size && e->info.mtime == info.mtime)
+        {
+            return e;
+        }
+
+        // ファイルが更新されている
+        if (e->refs)
+        {
+            e->path.clear();
+        }
+        else
+        {
+            evict(e);
+        }
+        return nullptr;
+    }
+    return nullptr;
+}
+
+void
+PDXCache::makeRoom(size_t size)
+{
+    while (usedBytes_ + size > maxBytes_ ||
+           heap_caps_get_free_size(MALLOC_CAP_8BIT) <
+               size + HEAP_RESERVE_BYTES ||
+           heap_caps_get_largest_free_block(MALLOC_CAP_8BIT) < size)
+    {
+        Entry* lru = nullptr;
+        for (auto& p : entries_)
+        {
+            auto e = p.get();
+            if (e->refs == 0 && (!lru || e->lastUse < lru->lastUse))
+            {
+                lru = e;
+            }
+        }
+        if (!lru)
+        {
+            return;
+        }
+        evict(lru);
+    }
+}
+
+void
+PDXCache::evict(Entry* e)
+{
+    DBOUT(("PDX cache: evict '%s'\n", e->path.c_str()));
+    for (auto it = entries_.begin(); it != entries_.end(); ++it)
+    {
+        if (it->get() == e)
+        {
+            usedBytes_ -= e->size + e->decodedBytes;
+            heap_caps_free(e->data);
+            entries_.erase(it);
+            ++stats_.evictions;
+            return;
+        }
+    }
+}
+
+void
+PDXCache::startPredecode(Entry* e)
+{
+    // 展開が終わるまでは捨てられないように参照しておく
+    ++e->refs;
+    e->adpcmBank = std::make_unique<sound_sys::ADPCMBank>();
+    sys::getDefaultJobManager().add([this, e] { predecode(e); },
+                                    sys::JobManager::Priority::LOW);
+}
+
+void
+PDXCache::predecode(Entry* e)
+{
+    auto body = e->data + ((e->data[4] << 8) | e->data[5]);
+    auto size = e->info.size;
+    auto need = sound_sys::ADPCMBank::computeDecodedBytes(body, size);
+    {
+        std::lock_guard<sys::Mutex> lock(mutex_);
+        makeRoom(need);
+        if (heap_caps_get_free_size(MALLOC_CAP_8BIT) <
+            need + HEAP_RESERVE_BYTES)
+        {
+            DBOUT(("ADPCM bank: %d bytes not available. skip '%s'.\n",
+                   (int)need,
+                   e->path.c_str()));
+            release(e);
+            return;
+        }
+    }
+
+    auto t0 = sys::micros();
+    bool r  = e->adpcmBank->build(body, size);
+    auto dt = sys::micros() - t0;
+
+    std::lock_guard<sys::Mutex> lock(mutex_);
+    if (r)
+    {
+        auto& bank      = *e->adpcmBank;
+        e->decodedBytes = need;
+        usedBytes_ += need;
+
+        // 再生時の decode は nibble ごとにこれだけかかっていた
+        int nibbles = bank.getSourceBytes() * 2;
+        DBOUT(("ADPCM bank '%s': %d entries, %d -> %d bytes, %d us "
+               "(%d ns/nibble)\n",
+               e->path.c_str(),
+               (int)bank.getEntryCount(),
+               (int)bank.getSourceBytes(),
+               (int)bank.getDecodedBytes(),
+               (int)dt,
+               nibbles ? (int)((uint64_t)dt * 1000 / nibbles) : 0));
+    }
+    release(e);
+}
+
+PDXCache&
+getPDXCache()
+{
+    static PDXCache inst;
+    return inst;
+}
+
+} // namespace music_player
@@ -0,0 +1,94 @@
+#ifndef _6E0B93D4_2A7F_4C15_8B61_F4D28A3C9E70
+#define _6E0B93D4_2A7F_4C15_8B61_F4D28A3C9E70
+
+#include <io/file_util.h>
+#include <memory>
+#include <sound_sys/adpcm_bank.h>
+#include <stdint.h>
+#include <string>
+#include <system/mutex.h>
+#include <vector>
+
+namespace music_player
+{
+
+// 読み込んだ PDX をパスと更新時刻をキーにして取っておく
+// 一杯になったら使用中でないものを古い順に捨てる
+class PDXCache
+{
+public:
+    struct Entry
+    {
+        std::string path; // 古くなったものは空
+        io::FileInfo info;
+        uint8_t* data; // MXDRV に渡す形 (ヘッダ付き)
+        size_t size;
+        int refs;
+        uint32_t lastUse;
+
+        // setPredecodeADPCM(true) の時だけ。展開はジョブで後から行われる
+        std::unique_ptr<sound_sys::ADPCMBank> adpcmBank;
+        size_t decodedBytes;
+    };
+
+    struct Stats
+    {
+        uint32_t hits;
+        uint32_t misses;
+        uint32_t prewarms;
+        uint32_t evictions;
+        uint32_t bytesRead;
+        uint32_t bytesSaved; // ヒットして読まずに済んだ量
+    };
+
+    static constexpr size_t DEFAULT_MAX_BYTES = 1536 * 1024;
+
+    // ヒープの空きをこれだけは残す
+    static constexpr size_t HEAP_RESERVE_BYTES = 256 * 1024;
+
+public:
+    ~PDXCache();
+
+    void setMaxBytes(size_t size) { maxBytes_ = size; }
+
+    // ADPCM を 16bit PCM に展開しておく
+    // 4倍のメモリと引き換えに再生時の decode が不要になる
+    void setPredecodeADPCM(bool f) { predecodeADPCM_ = f; }
+
+    // 無ければ読み込む。使い終わったら release() すること
+    const Entry* acquire(const std::string& path);
+    void release(const Entry* e);
+
+    // 次に使いそうなものを読み込んでおく
+    bool prewarm(const std::string& path);
+
+    // 使用中のもの以外を捨てる
+    void clear();
+
+    Stats getStats();
+    size_t getUsedBytes() const { return usedBytes_; }
+
+protected:
+    Entry* get(const std::string& path, bool pin);
+    Entry* find(const std::string& path, const io::FileInfo& info);
+    void makeRoom(size_t size);
+    void evict(Entry* e);
+    void touch(Entry* e) { e->lastUse = ++useCounter_; }
+    void startPredecode(Entry* e);
+    void predecode(Entry* e);
+
+private:
+    std::vector<std::unique_ptr<Entry>> entries_;
+    size_t usedBytes_    = 0;
+    size_t maxBytes_     = DEFAULT_MAX_BYTES;
+    uint32_t useCounter_ = 0;
+    bool predecodeADPCM_ = false;
+    Stats stats_{};
+    sys::Mutex mutex_;
+};
+
+PDXCache& getPDXCache();
+
+} // namespace music_player
+
+#endif /* _6E0B93D4_2A7F_4C15_8B61_F4D28A3C9E70 */
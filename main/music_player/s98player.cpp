@@ -9,7 +9,11 @@
 #include <audio/sound_chip_manager.h>
 #include <io/file_stream.h>
 #include <io/file_util.h>
+#include <music_player/music_player_manager.h>
+#include <music_player/pdx_cache.h>
+#include <new>
 #include <string.h>
+#include <system/arena.h>
 #include <system/timer.h>
 #include <system/util.h>
 
@@ -71,6 +75,9 @@ S98Player::loadTitle(const char* filename)
         return {};
     }
 
+    // FileBinaryStream 側で窓単位に読むので stdio のバッファは使わない
+    setvbuf(fp, nullptr, _IONBF, 0);
+
     io::FileBinaryStream stream(fp);
     Header h;
     h.load(&stream);
@@ -113,7 +120,8 @@ S98Player::terminate()
     stop();
 
     finalizeDeviceInterfaces();
-    decltype(data_)().swap(data_);
+    data_ = nullptr;
+    getSongArena().reset();
     header_ = Header();
     std::string().swap(title_);
     return true;
@@ -122,19 +130,41 @@ S98Player::terminate()
 bool
 S98Player::load(const char* filename)
 {
-    if (!io::readFile(data_, filename))
+    // デバイスもアリーナにあるので先に片付ける
+    finalizeDeviceInterfaces();
+
+    auto& arena = getSongArena();
+    arena.resetFront();
+    data_ = nullptr;
+
+    int size = io::getFileSize(filename);
+    if (size < 0)
+    {
+        DBOUT(("'%s' stat error.\n", filename));
+        return false;
+    }
+
+    auto p = static_cast<uint8_t*>(arena.allocate(size));
+    if (!p)
+    {
+        // アリーナに入らない大きさで、ヒープが PDX で埋まっている時
+        getPDXCache().clear();
+        p = static_cast<uint8_t*>(arena.allocate(size));
+    }
+    if (!p || io::readFile(p, filename, size) < 0)
     {
         DBOUT(("'%s' load error.\n", filename));
         return false;
     }
 
-    stream_.setMemory(data_.data(), data_.size());
+    stream_.setMemory(p, size);
     if (!header_.load(&stream_))
     {
         DBOUT(("'%s' parse error.\n", filename));
-        decltype(data_)().swap(data_);
+        arena.resetFront();
         return false;
     }
+    data_ = p;
 
     title_ = header_.findTitle();
     createDeviceInterfaces();
@@ -151,7 +181,7 @@ S98Player::load(const char* filename)
 bool
 S98Player::play(int track)
 {
-    if (data_.empty())
+    if (!data_)
     {
         return false;
     }
@@ -170,9 +200,12 @@ bool
 S98Player::stop()
 {
     playing_ = false;
-    for (auto& d : deviceInterfaces_)
+    for (auto d : deviceInterfaces_)
     {
-        d->mute();
+        if (d)
+        {
+            d->mute();
+        }
     }
     return true;
 }
@@ -181,9 +214,12 @@ bool
 S98Player::pause()
 {
     paused_ = true;
-    for (auto& d : deviceInterfaces_)
+    for (auto d : deviceInterfaces_)
     {
-        d->mute();
+        if (d)
+        {
+            d->mute();
+        }
     }
     return true;
 }
@@ -253,7 +289,8 @@ S98Player::getFormat() const
 sound_sys::SoundSystem*
 S98Player::getSystem(int idx)
 {
-    if (idx < static_cast<int>(deviceInterfaces_.size()))
+    if (idx < static_cast<int>(deviceInterfaces_.size()) &&
+        deviceInterfaces_[idx])
     {
         return deviceInterfaces_[idx]->getSoundSystem();
     }
@@ -290,37 +327,51 @@ S98Player::tick()
 void
 S98Player::finalizeDeviceInterfaces()
 {
+    // 領域はアリーナごと捨てるのでデストラクタだけ呼ぶ
+    for (auto d : deviceInterfaces_)
+    {
+        if (d)
+        {
+            d->~DeviceInterface();
+        }
+    }
     deviceInterfaces_.clear();
 }
 
 void
 S98Player::createDeviceInterfaces()
 {
-    auto create = [](auto type) -> std::unique_ptr<DeviceInterface> {
+    auto& arena = getSongArena();
+    auto createYM2608 = [&]() -> DeviceInterface* {
+        auto p = arena.allocate(sizeof(YM2608), alignof(YM2608));
+        return p ? new (p) YM2608() : nullptr;
+    };
+
+    auto create = [&](auto type) -> DeviceInterface* {
         switch (type)
         {
         case Header::DeviceType::OPNA:
             DBOUT(("create OPNA\n"));
-            return std::make_unique<YM2608>();
+            return createYM2608();
 
         case Header::DeviceType::OPN:
             DBOUT(("create OPN\n"));
-            return std::make_unique<YM2608>();
+            return createYM2608();
 
         default:
-            return {};
+            return nullptr;
         }
     };
 
     finalizeDeviceInterfaces();
     for (auto& di : header_.deviceInfos_)
     {
-        auto p = std::unique_ptr<DeviceInterface>(create(di.type_));
+        auto p = create(di.type_);
         if (p)
         {
             p->initialize(di.clock_, di.pan_);
         }
-        deviceInterfaces_.push_back(std::move(p));
+        deviceInterfaces_.push_back(p);
     }
 
     DBOUT(("%d device interfaces.\n", deviceInterfaces_.size()));
@@ -342,7 +393,7 @@ S98Player::processCommand(io::BinaryStream* stream)
         //        addr,
         //        reg,
         //        val));
-        auto& p = deviceInterfaces_[dev];
+        auto p = deviceInterfaces_[dev];
         if (p)
         {
             p->write(addr, reg, val);
@@ -8,7 +8,6 @@
 #include "music_player.h"
 #include <io/memory_stream.h>
 #include <map>
-#include <memory>
 #include <sound_sys/ymf288.h>
 #include <string>
 #include <vector>
@@ -31,7 +30,8 @@ class S98Player final : public MusicPlayer
 
     float samplesPerUs_ = 0;
 
-    std::vector<uint8_t> data_;
+    // 曲のアリーナに置く
+    uint8_t* data_{};
     io::MemoryBinaryStream stream_;
 
     struct Header
@@ -41,6 +41,7 @@ class S98Player final : public MusicPlayer
         uint32_t startOffset_{};
         uint32_t loopOffset_{};
 
+        // 読み込み時にしか触らないのでヒープで良い
         std::map<std::string, std::string> tags_;
 
         enum class DeviceType
@@ -89,7 +90,8 @@ class S98Player final : public MusicPlayer
     };
     class YM2608;
 
-    std::vector<std::unique_ptr<DeviceInterface>> deviceInterfaces_;
+    // 実体は曲のアリーナ上にある
+    std::vector<DeviceInterface*> deviceInterfaces_;
 
 public:
     S98Player();
@@ -0,0 +1,294 @@
+#include "smf_sequence.h"
+#include <algorithm>
+#include <functional>
+#include <string.h>
+
+namespace music_player
+{
+
+namespace
+{
+
+constexpr uint32_t DEFAULT_TEMPO = 500000; // 120BPM
+
+// SMPTE の時は tick の長さが固定
+constexpr uint32_t SMPTE_TEMPO = 1000000;
+
+constexpr uint8_t messageSize_[8] = {3, 3, 3, 3, 2, 2, 3, 0};
+
+uint32_t
+getBE(const uint8_t* p, int n)
+{
+    uint32_t v = 0;
+    while (n--)
+    {
+        v = (v << 8) | *p++;
+    }
+    return v;
+}
+
+bool
+getVLQ(const uint8_t*& p, const uint8_t* end, uint32_t* v)
+{
+    *v = 0;
+    for (int i = 0; i < 4 && p < end; ++i)
+    {
+        int c = *p++;
+        *v    = (*v << 7) | (c & 127);
+        if (!(c & 128))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+bool
+SMFSequence::load(const uint8_t* data, size_t size)
+{
+    clear();
+
+    if (size < 14 || memcmp(data, "MThd", 4))
+    {
+        return false;
+    }
+
+    // format 2 はトラックごとに別の曲なので扱わない
+    int format  = getBE(data + 8, 2);
+    int nTracks = getBE(data + 10, 2);
+    int div     = getBE(data + 12, 2);
+    if (format > 1)
+    {
+        return false;
+    }
+
+    if (div & 0x8000)
+    {
+        // 上位は -fps、下位はフレームあたりの tick
+        smpte_    = true;
+        division_ = -int8_t(div >> 8) * (div & 0xff);
+    }
+    else
+    {
+        smpte_    = false;
+        division_ = div;
+    }
+    if (division_ <= 0)
+    {
+        return false;
+    }
+
+    size_t pos = 8 + getBE(data + 4, 4);
+    while ((int)tracks_.size() < nTracks && pos + 8 <= size)
+    {
+        size_t len = getBE(data + pos + 4, 4);
+        auto top   = data + pos + 8;
+        auto end   = top + std::min(len, size - pos - 8);
+        if (memcmp(data + pos, "MTrk", 4) == 0)
+        {
+            tracks_.push_back({top, end, top, 0, 0});
+        }
+        pos += 8 + len;
+    }
+    heap_.reserve(tracks_.size());
+
+    rewind();
+    return !tracks_.empty();
+}
+
+void
+SMFSequence::clear()
+{
+    tracks_.clear();
+    heap_.clear();
+}
+
+void
+SMFSequence::rewind()
+{
+    heap_.clear();
+    tempo_     = smpte_ ? SMPTE_TEMPO : DEFAULT_TEMPO;
+    tempoTick_ = 0;
+    tempoUs_   = 0;
+
+    for (int i = 0; i < (int)tracks_.size(); ++i)
+    {
+        auto& t   = tracks_[i];
+        t.p       = t.top;
+        t.tick    = 0;
+        t.running = 0;
+        pushTrack(i);
+    }
+}
+
+bool
+SMFSequence::pop(Message* m, uint64_t limitUs)
+{
+    while (!heap_.empty())
+    {
+        auto h = heap_.front();
+        if (tickToUs(h.tick) > limitUs)
+        {
+            return false;
+        }
+        std::pop_heap(heap_.begin(), heap_.end(), std::greater<HeapEntry>());
+        heap_.pop_back();
+
+        bool isMessage = false;
+        if (readEvent(tracks_[h.track], h.tick, m, &isMessage))
+        {
+            pushTrack(h.track);
+        }
+        if (isMessage)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t
+SMFSequence::getNextEventUs() const
+{
+    return heap_.empty() ? UINT64_MAX : tickToUs(heap_.front().tick);
+}
+
+std::string
+SMFSequence::findTitle(const uint8_t* data, size_t size)
+{
+    SMFSequence seq;
+    if (!seq.load(data, size))
+    {
+        return {};
+    }
+
+    auto t = seq.tracks_.front();
+    uint32_t delta;
+    while (getVLQ(t.p, t.end, &delta) && t.p + 2 < t.end)
+    {
+        if (t.p[0] == 0xff && t.p[1] == 0x03)
+        {
+            auto p = t.p + 2;
+            uint32_t n;
+            if (!getVLQ(p, t.end, &n) || n > uint32_t(t.end - p))
+            {
+                break;
+            }
+            return std::string(reinterpret_cast<const char*>(p), n);
+        }
+
+        Message m;
+        bool isMessage;
+        if (!seq.readEvent(t, 0, &m, &isMessage))
+        {
+            break;
+        }
+    }
+    return {};
+}
+
+void
+SMFSequence::pushTrack(int idx)
+{
+    auto& t = tracks_[idx];
+    uint32_t delta;
+    if (!getVLQ(t.p, t.end, &delta) || t.p >= t.end)
+    {
+        return;
+    }
+    t.tick += delta;
+    heap_.push_back({t.tick, uint16_t(idx)});
+    std::push_heap(heap_.begin(), heap_.end(), std::greater<HeapEntry>());
+}
+
+bool
+SMFSequence::readEvent(Track& t, uint32_t tick, Message* m, bool* isMessage)
+{
+    *isMessage = false;
+
+    uint8_t st = *t.p;
+    if (st == 0xff)
+    {
+        if (t.p + 2 > t.end)
+        {
+            return false;
+        }
+        int type = t.p[1];
+        t.p += 2;
+
+        uint32_t n;
+        if (!getVLQ(t.p, t.end, &n) || n > uint32_t(t.end - t.p))
+        {
+            return false;
+        }
+        if (type == 0x51 && n == 3)
+        {
+            setTempo(tick, getBE(t.p, 3));
+        }
+        t.p += n;
+        return type != 0x2f; // end of track
+    }
+
+    if (st == 0xf0 || st == 0xf7)
+    {
+        // SysEx は送らない
+        ++t.p;
+        uint32_t n;
+        if (!getVLQ(t.p, t.end, &n) || n > uint32_t(t.end - t.p))
+        {
+            return false;
+        }
+        t.p += n;
+        return true;
+    }
+
+    if (st & 0x80)
+    {
+        if (st >= 0xf0)
+        {
+            return false;
+        }
+        t.running = st;
+        ++t.p;
+    }
+    if (!t.running)
+    {
+        return false;
+    }
+
+    int size   = messageSize_[(t.running >> 4) & 7];
+    m->data[0] = t.running;
+    m->size    = size;
+    for (int i = 1; i < size; ++i)
+    {
+        if (t.p >= t.end)
+        {
+            return false;
+        }
+        m->data[i] = *t.p++;
+    }
+    *isMessage = true;
+    return true;
+}
+
+uint64_t
+SMFSequence::tickToUs(uint32_t tick) const
+{
+    return tempoUs_ + uint64_t(tick - tempoTick_) * tempo_ / division_;
+}
+
+void
+SMFSequence::setTempo(uint32_t tick, uint32_t tempo)
+{
+    if (smpte_ || !tempo)
+    {
+        return;
+    }
+    tempoUs_   = tickToUs(tick);
+    tempoTick_ = tick;
+    tempo_     = tempo;
+}
+
+} // namespace music_player
@@ -0,0 +1,98 @@
+#ifndef _A6F0C2D8_3E71_4B95_92AC_47D1E8B5F063
+#define _A6F0C2D8_3E71_4B95_92AC_47D1E8B5F063
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace music_player
+{
+
+// SMF (format 0/1) の全トラックを時刻順に 1 列にして出す
+// トラックごとの次のイベントを tick の min-heap に入れておく
+// データはコピーしないので呼び出し側で持っておく
+class SMFSequence
+{
+public:
+    struct Message
+    {
+        uint8_t data[3];
+        uint8_t size;
+    };
+
+public:
+    bool load(const uint8_t* data, size_t size);
+    void clear();
+    void rewind();
+
+    // timeUs (曲の頭から) までのメッセージを func(const Message&) に渡す
+    template <class Func>
+    void advance(uint64_t timeUs, const Func& func)
+    {
+        Message m;
+        while (pop(&m, timeUs))
+        {
+            func(m);
+        }
+    }
+
+    // limitUs までに出すものがあれば 1 つ取り出す
+    bool pop(Message* m, uint64_t limitUs);
+
+    bool isFinished() const { return heap_.empty(); }
+
+    // 次のイベントの時刻。終わっていれば UINT64_MAX
+    uint64_t getNextEventUs() const;
+
+    int getTrackCount() const { return (int)tracks_.size(); }
+    int getDivision() const { return division_; }
+
+    // 最初のトラックのシーケンス名
+    // 途中までしか読んでいないデータでもよい
+    static std::string findTitle(const uint8_t* data, size_t size);
+
+protected:
+    struct Track
+    {
+        const uint8_t* top;
+        const uint8_t* end;
+        const uint8_t* p;
+        uint32_t tick;
+        uint8_t running;
+    };
+
+    struct HeapEntry
+    {
+        uint32_t tick;
+        uint16_t track;
+
+        // 同じ tick ならトラック順 (conductor track が先)
+        bool operator>(const HeapEntry& h) const
+        {
+            return tick > h.tick || (tick == h.tick && track > h.track);
+        }
+    };
+
+    void pushTrack(int idx);
+
+    // トラックが終わったら false
+    bool readEvent(Track& t, uint32_t tick, Message* m, bool* isMessage);
+
+    uint64_t tickToUs(uint32_t tick) const;
+    void setTempo(uint32_t tick, uint32_t tempo);
+
+private:
+    std::vector<Track> tracks_;
+    std::vector<HeapEntry> heap_;
+
+    int division_       = 480;
+    bool smpte_         = false;
+    uint32_t tempo_     = 500000; // us/四分音符
+    uint32_t tempoTick_ = 0;
+    uint64_t tempoUs_   = 0;
+};
+
+} // namespace music_player
+
+#endif /* _A6F0C2D8_3E71_4B95_92AC_47D1E8B5F063 */
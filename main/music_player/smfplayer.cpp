@@ -0,0 +1,324 @@
+#include "smfplayer.h"
+#include "../debug.h"
+#include <audio/audio.h>
+#include <audio/sound_chip_manager.h>
+#include <io/file_util.h>
+#include <music_player/music_player_manager.h>
+#include <sound_sys/gm_fm_bank.h>
+#include <stdio.h>
+#include <string.h>
+#include <system/arena.h>
+#include <system/timer.h>
+#include <system/util.h>
+#include <vector>
+
+namespace music_player
+{
+
+namespace
+{
+
+// 音程の表は 3.58MHz 前提
+constexpr int OPM_CLOCK = 3579545;
+
+// タイトルを探すのに読む大きさ
+constexpr size_t TITLE_READ_SIZE = 2048;
+
+} // namespace
+
+bool
+SMFPlayer::isSupported(const char* filename)
+{
+    auto p = strrchr(filename, '.');
+    return p ? strcasecmp(p, ".MID") == 0 || strcasecmp(p, ".SMF") == 0
+             : false;
+}
+
+std::experimental::optional<std::string>
+SMFPlayer::loadTitle(const char* filename)
+{
+    FILE* fp = fopen(filename, "rb");
+    if (!fp)
+    {
+        DBOUT(("'%s' open error.\n", filename));
+        return {};
+    }
+
+    std::vector<uint8_t> buf(TITLE_READ_SIZE);
+    buf.resize(fread(buf.data(), 1, buf.size(), fp));
+    fclose(fp);
+
+    return SMFSequence::findTitle(buf.data(), buf.size());
+}
+
+bool
+SMFPlayer::start()
+{
+    if (started_)
+    {
+        return true;
+    }
+
+    DBOUT(("start\n"));
+    if (!allocateChip())
+    {
+        DBOUT(("no FM chip is available.\n"));
+        return false;
+    }
+
+    audio::setFMVolume(1.0f);
+    sys::initTimer(1000000);
+    sys::setTimerPeriod(1000, true);
+    sys::setTimerCallback([&] { tick(); });
+    sys::startTimer();
+    sys::enableTimerInterrupt();
+
+    started_ = true;
+    return true;
+}
+
+bool
+SMFPlayer::terminate()
+{
+    DBOUT(("terminate\n"));
+    started_ = false;
+
+    sys::stopTimer();
+    sys::resetTimerCallback();
+
+    stop();
+    freeChip();
+
+    data_ = nullptr;
+    sequence_.clear();
+    getSongArena().reset();
+    std::string().swap(title_);
+    return true;
+}
+
+bool
+SMFPlayer::load(const char* filename)
+{
+    auto& arena = getSongArena();
+    arena.resetFront();
+    data_ = nullptr;
+
+    int size = io::getFileSize(filename);
+    if (size < 0)
+    {
+        DBOUT(("'%s' stat error.\n", filename));
+        return false;
+    }
+
+    auto p = static_cast<uint8_t*>(arena.allocate(size));
+    if (!p || io::readFile(p, filename, size) < 0)
+    {
+        DBOUT(("'%s' load error.\n", filename));
+        return false;
+    }
+
+    if (!sequence_.load(p, size))
+    {
+        DBOUT(("'%s' parse error.\n", filename));
+        arena.resetFront();
+        return false;
+    }
+    data_ = p;
+
+    title_ = SMFSequence::findTitle(p, size);
+    DBOUT(("%d tracks, division %d\n",
+           sequence_.getTrackCount(),
+           sequence_.getDivision()));
+    return true;
+}
+
+bool
+SMFPlayer::play(int track)
+{
+    if (!data_ || !allocator_)
+    {
+        return false;
+    }
+
+    allocator_->reset();
+    sequence_.rewind();
+    paused_     = false;
+    playing_    = true;
+    playTimeUs_ = 0;
+    prevTimeUs_ = sys::micros();
+    return true;
+}
+
+bool
+SMFPlayer::stop()
+{
+    playing_ = false;
+    if (allocator_)
+    {
+        allocator_->allNotesOff();
+    }
+    return true;
+}
+
+bool
+SMFPlayer::pause()
+{
+    paused_ = true;
+    if (allocator_)
+    {
+        allocator_->allNotesOff();
+    }
+    return true;
+}
+
+bool
+SMFPlayer::cont()
+{
+    paused_ = false;
+    return true;
+}
+
+bool
+SMFPlayer::fadeout()
+{
+    return stop();
+}
+
+bool
+SMFPlayer::isFinished() const
+{
+    return !playing_;
+}
+
+bool
+SMFPlayer::isPaused() const
+{
+    return paused_;
+}
+
+int
+SMFPlayer::getCurrentLoop() const
+{
+    return 0;
+}
+
+int
+SMFPlayer::getTrackCount() const
+{
+    return -1;
+}
+
+int
+SMFPlayer::getCurrentTrack() const
+{
+    return -1;
+}
+
+float
+SMFPlayer::getPlayTime() const
+{
+    return playTimeUs_ * 0.000001f;
+}
+
+const char*
+SMFPlayer::getTitle() const
+{
+    return title_.c_str();
+}
+
+FileFormat
+SMFPlayer::getFormat() const
+{
+    return FileFormat::MIDI;
+}
+
+sound_sys::SoundSystem*
+SMFPlayer::getSystem(int idx)
+{
+    return idx == 0 ? system_ : nullptr;
+}
+
+bool
+SMFPlayer::allocateChip()
+{
+    // 8ch ある YM2151 を優先する
+    if (auto chip = audio::allocateYM2151())
+    {
+        ym2151_.setChip(chip);
+        ym2151_.setClock(OPM_CLOCK);
+        opm_.setSystem(&ym2151_);
+        allocator_ = &opm_;
+        system_    = &ym2151_;
+    }
+    else if (auto chip = audio::allocateYMF288())
+    {
+        ymf288_.setChip(chip);
+        ymf288_.setClock(sound_sys::OPNAVoiceAllocator::DEFAULT_CLOCK);
+        opna_.setSystem(&ymf288_);
+        allocator_ = &opna_;
+        system_    = &ymf288_;
+    }
+    else
+    {
+        return false;
+    }
+
+    allocator_->setPatchBank(sound_sys::makeGMBank());
+    allocator_->reset();
+    allocator_->resetStats();
+    return true;
+}
+
+void
+SMFPlayer::freeChip()
+{
+    if (allocator_ == &opm_)
+    {
+        opm_.setSystem(nullptr);
+        audio::freeYM2151(ym2151_.detachChip());
+    }
+    else if (allocator_ == &opna_)
+    {
+        opna_.setSystem(nullptr);
+        audio::freeYMF288(ymf288_.detachChip());
+    }
+
+    if (allocator_)
+    {
+        auto& st = allocator_->getStats();
+        DBOUT(("note on %d, steal %d, patch load %d/%d, %d writes.\n",
+               st.noteOns,
+               st.steals,
+               st.patchLoads,
+               st.patchLoads + st.patchReuses,
+               st.regWrites));
+    }
+    allocator_ = nullptr;
+    system_    = nullptr;
+}
+
+void
+SMFPlayer::tick()
+{
+    auto curTime = sys::micros();
+    auto dt      = curTime - prevTimeUs_;
+    prevTimeUs_  = curTime;
+
+    if (!(playing_ && !paused_))
+    {
+        return;
+    }
+
+    playTimeUs_ += dt;
+    sequence_.advance(playTimeUs_, [&](const SMFSequence::Message& m) {
+        allocator_->message(m.data, m.size);
+    });
+
+    if (sequence_.isFinished())
+    {
+        DBOUT(("end of data.\n"));
+        playing_ = false;
+    }
+}
+
+} // namespace music_player
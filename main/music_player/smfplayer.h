@@ -0,0 +1,71 @@
+#ifndef _0B7E4F29_D85A_4C13_B6E0_92F35A7C1D48
+#define _0B7E4F29_D85A_4C13_B6E0_92F35A7C1D48
+
+#include "music_player.h"
+#include "smf_sequence.h"
+#include <sound_sys/opm_voice_allocator.h>
+#include <sound_sys/opna_voice_allocator.h>
+#include <sound_sys/ym2151.h>
+#include <sound_sys/ymf288.h>
+#include <string>
+
+namespace music_player
+{
+
+// SMF を YM2151 (無ければ YMF288) で鳴らす
+class SMFPlayer final : public MusicPlayer
+{
+    std::string title_;
+
+    bool started_ = false;
+    bool playing_ = false;
+    bool paused_  = false;
+
+    uint64_t playTimeUs_ = 0;
+    uint32_t prevTimeUs_ = 0;
+
+    // 曲のアリーナに置く
+    uint8_t* data_{};
+    SMFSequence sequence_;
+
+    sound_sys::YM2151 ym2151_;
+    sound_sys::YMF288 ymf288_;
+    sound_sys::OPMVoiceAllocator opm_;
+    sound_sys::OPNAVoiceAllocator opna_;
+
+    // 確保できた方
+    sound_sys::FMVoiceAllocator* allocator_{};
+    sound_sys::SoundSystem* system_{};
+
+public:
+    bool isSupported(const char* filename) override;
+    std::experimental::optional<std::string>
+    loadTitle(const char* filename) override;
+    bool start() override;
+    bool terminate() override;
+    bool load(const char* filename) override;
+    bool play(int track) override;
+    bool stop() override;
+    bool pause() override;
+    bool cont() override;
+    bool fadeout() override;
+    bool isFinished() const override;
+    bool isPaused() const override;
+    int getCurrentLoop() const override;
+    int getTrackCount() const override;
+    int getCurrentTrack() const override;
+    float getPlayTime() const override;
+    const char* getTitle() const override;
+    FileFormat getFormat() const override;
+    sound_sys::SoundSystem* getSystem(int idx) override;
+
+protected:
+    bool allocateChip();
+    void freeChip();
+
+    void tick();
+};
+
+} // namespace music_player
+
+#endif /* _0B7E4F29_D85A_4C13_B6E0_92F35A7C1D48 */
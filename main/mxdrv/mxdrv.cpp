@@ -45,7 +45,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <system/timer.h>
 
 //#include <mmsystem.h>
 
@@ -320,7 +319,7 @@ MXDRV_Start(void* mdxbuf_ptr,
     {
         int clock = 4000000;
         getMXDRVSoundSystemSet().ym2151->setClock(clock);
-        sys::initTimer(clock >> 2); // clock / 1024 * 256
+        X68Sound_OpmClock(clock);
     }
 
     return (0);
@@ -329,8 +328,7 @@ MXDRV_Start(void* mdxbuf_ptr,
 void
 MXDRV_End(void)
 {
-    sys::stopTimer();
-    sys::disableTimerInterrupt();
+    X68Sound_Reset();
 
     X68Sound_OpmInt(NULL);
     MXCALLBACK_OPMINT = NULL;
@@ -488,6 +486,7 @@ MXDRV_MeasurePlayTime(
     void (*opmintback)(void);
 
     X68Sound_OpmInt(NULL);
+    X68Sound_OpmTimerOffline(TRUE);
 
     MeasurePlayTime = TRUE;
     TerminatePlay   = FALSE;
@@ -520,14 +519,19 @@ MXDRV_MeasurePlayTime(
     reg.d1 = -1;
     MXDRV(&reg);
 
+    // OPM のタイマを数えて実時間より速く回す
     while (!TerminatePlay)
-        OPMINTFUNC();
+    {
+        if (!X68Sound_OpmTimerRun(OPMINTFUNC))
+            break;
+    }
 
     MXDRV_Stop();
 
     MXCALLBACK_OPMINT = opmintback;
     MeasurePlayTime   = FALSE;
     X68Sound_OpmInt(&OPMINTFUNC);
+    X68Sound_OpmTimerOffline(FALSE);
 
     return ((DWORD)(G.PLAYTIME * (LONGLONG)1024 / 4000 + (1 - DBL_EPSILON)) +
             2000);
@@ -546,6 +550,7 @@ MXDRV_PlayAt(DWORD playat, int loop, int fadeout
     //	int opmwaitback;
 
     X68Sound_OpmInt(NULL);
+    X68Sound_OpmTimerOffline(TRUE);
 
     TerminatePlay = FALSE;
     LoopCount     = 0;
@@ -569,13 +574,15 @@ MXDRV_PlayAt(DWORD playat, int loop, int fadeout
     {
         if (TerminatePlay)
             break;
-        OPMINTFUNC();
+        if (!X68Sound_OpmTimerRun(OPMINTFUNC))
+            break;
     }
     //	X68Sound_OpmWait(opmwaitback);
 
     G.L001e1c         = chmaskback;
     MXCALLBACK_OPMINT = opmintback;
     X68Sound_OpmInt(&OPMINTFUNC);
+    X68Sound_OpmTimerOffline(FALSE);
 }
 
 /***************************************************************/
@@ -626,7 +633,11 @@ OPM_SUB(void)
 #endif
 
     if (MeasurePlayTime)
+    {
+        // 音源には書かずタイマだけ動かす
+        X68Sound_OpmTimerPoke((BYTE)D1, (BYTE)D2);
         return;
+    }
 
     _iocs_opmset((BYTE)D1, (BYTE)D2);
 }
@@ -3976,9 +3987,8 @@ L000c44:;
                                                                                                                     ori.b   #$08,$00e88015
                                                                                                                     rte
     */
-    D1 = 0x14;
-    D2 = 0x1b;
-    L_WRITEOPM();
+    // アドレスを $1b にしておくだけでデータは書かない
+    // (ここで $14 に $1b を書くとタイマ A が動き出す)
     G.L002245 = MXDRV_CLR;
     D0 = d0, D1 = d1, D2 = d2, D3 = d3, D4 = d4, D5 = d5, D6 = d6, D7 = d7,
     A0 = a0, A1 = a1, A2 = a2, A3 = a3, A4 = a4, A5 = a5, A6 = a6;
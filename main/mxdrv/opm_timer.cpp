@@ -0,0 +1,136 @@
+#include "opm_timer.h"
+#include <algorithm>
+
+namespace
+{
+
+constexpr uint8_t LOAD[]    = {0x01, 0x02};
+constexpr uint8_t IRQ_EN[]  = {0x04, 0x08};
+constexpr uint8_t F_RESET[] = {0x10, 0x20};
+constexpr uint8_t STATUS[]  = {OPMTimer::STATUS_A, OPMTimer::STATUS_B};
+
+} // namespace
+
+void
+OPMTimer::reset()
+{
+    write(0x14, F_RESET[TIMER_A] | F_RESET[TIMER_B]);
+}
+
+bool
+OPMTimer::isTimerRegister(int addr)
+{
+    return addr >= 0x10 && addr <= 0x14 && addr != 0x13;
+}
+
+void
+OPMTimer::write(int addr, int data)
+{
+    switch (addr)
+    {
+    case 0x10: // CLKA1 (上位 8bit)
+        na_ = (na_ & 3) | (data << 2);
+        break;
+
+    case 0x11: // CLKA2 (下位 2bit)
+        na_ = (na_ & ~3) | (data & 3);
+        break;
+
+    case 0x12: // CLKB
+        nb_ = data;
+        break;
+
+    case 0x14:
+        for (int i = 0; i < TIMER_COUNT; ++i)
+        {
+            // LOAD を 0 から 1 にした時に数え始める
+            // 動いている間に 1 を書き直しても数え直さない
+            bool load = data & LOAD[i];
+            if (load && !running_[i])
+            {
+                remain_[i] = getPeriod(Timer(i));
+            }
+            running_[i] = load;
+
+            if (data & F_RESET[i])
+            {
+                status_ &= ~STATUS[i];
+            }
+        }
+        control_ = data;
+        break;
+    }
+}
+
+uint32_t
+OPMTimer::getPeriod(Timer t) const
+{
+    return t == TIMER_A ? 64 * (1024 - na_) : 1024 * (256 - nb_);
+}
+
+bool
+OPMTimer::overflow(Timer t)
+{
+    // あふれたらその時の値を読み直す
+    remain_[t] = getPeriod(t);
+    if (!(control_ & IRQ_EN[t]))
+    {
+        return false;
+    }
+    bool rise = !status_;
+    status_ |= STATUS[t];
+    return rise;
+}
+
+uint32_t
+OPMTimer::getCyclesToOverflow() const
+{
+    uint32_t r = 0;
+    for (int i = 0; i < TIMER_COUNT; ++i)
+    {
+        if (running_[i] && (!r || remain_[i] < r))
+        {
+            r = remain_[i];
+        }
+    }
+    return r;
+}
+
+uint32_t
+OPMTimer::advance(uint32_t cycles, bool* irq)
+{
+    *irq          = false;
+    uint32_t done = 0;
+    while (done < cycles)
+    {
+        uint32_t next = getCyclesToOverflow();
+        if (!next)
+        {
+            return cycles;
+        }
+
+        uint32_t step = std::min(next, cycles - done);
+        done += step;
+        for (int i = 0; i < TIMER_COUNT; ++i)
+        {
+            if (running_[i])
+            {
+                remain_[i] -= step;
+            }
+        }
+
+        // 同時にあふれたものは両方済ませてから返す
+        for (int i = 0; i < TIMER_COUNT; ++i)
+        {
+            if (running_[i] && !remain_[i])
+            {
+                *irq |= overflow(Timer(i));
+            }
+        }
+        if (*irq)
+        {
+            break;
+        }
+    }
+    return done;
+}
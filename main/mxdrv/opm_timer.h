@@ -0,0 +1,71 @@
+#ifndef _7F14B2C8_95E0_4A3D_B6C1_2E8D05A9F347
+#define _7F14B2C8_95E0_4A3D_B6C1_2E8D05A9F347
+
+#include <stdint.h>
+
+// YM2151 のタイマ A/B をマスタークロックの数で数える
+//
+// レジスタ 0x10-0x12 で周期、0x14 で LOAD/IRQ EN/F-RESET を書き、
+// ステータスでオーバーフローのフラグを読む
+// フラグは IRQ EN の時だけ立ち、F-RESET で下ろすまでそのまま
+// IRQ はフラグが全部下りている所から立った時に上がる (エッジ)
+// CSM は扱わない
+//
+// advance() でクロックを数えて進める。実時間で回す時も、次にあふれる
+// 所 (getCyclesToOverflow()) に実時間のタイマを合わせて進めるので、
+// 実時間より速く回す時と割り込みの位置が変わらない
+class OPMTimer
+{
+public:
+    enum Timer
+    {
+        TIMER_A,
+        TIMER_B,
+        TIMER_COUNT,
+    };
+
+    enum : uint8_t
+    {
+        STATUS_A = 0x01,
+        STATUS_B = 0x02,
+    };
+
+    static constexpr uint32_t DEFAULT_CLOCK = 4000000;
+
+public:
+    void setClock(uint32_t clock) { clock_ = clock; }
+    uint32_t getClock() const { return clock_; }
+
+    // 止めてフラグも下ろす。周期の値は残す
+    void reset();
+
+    static bool isTimerRegister(int addr);
+    void write(int addr, int data);
+
+    uint8_t readStatus() const { return status_; }
+    bool isRunning(Timer t) const { return running_[t]; }
+    // 1 周期のマスタークロック数
+    uint32_t getPeriod(Timer t) const;
+
+    // t があふれた。IRQ が上がったら true
+    bool overflow(Timer t);
+
+    // 最大 cycles 進める。IRQ が上がったらそこで止める
+    // 進めたクロック数を返す
+    uint32_t advance(uint32_t cycles, bool* irq);
+
+    // 次にどちらかがあふれるまで。どちらも止まっていれば 0
+    uint32_t getCyclesToOverflow() const;
+
+private:
+    uint32_t clock_ = DEFAULT_CLOCK;
+
+    uint16_t na_                  = 0;
+    uint8_t nb_                   = 0;
+    uint8_t control_              = 0; // レジスタ 0x14
+    uint8_t status_               = 0;
+    bool running_[TIMER_COUNT]    = {};
+    uint32_t remain_[TIMER_COUNT] = {}; // あふれるまで (advance() の時だけ)
+};
+
+#endif /* _7F14B2C8_95E0_4A3D_B6C1_2E8D05A9F347 */
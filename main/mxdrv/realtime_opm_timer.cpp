@@ -0,0 +1,141 @@
+#include "realtime_opm_timer.h"
+#include <algorithm>
+
+void
+RealtimeOPMTimer::setHost(Host* host)
+{
+    if (host_)
+    {
+        host_->stopTimer();
+    }
+    host_ = host;
+    rebase();
+    arm();
+}
+
+void
+RealtimeOPMTimer::setClock(uint32_t clock)
+{
+    catchUp();
+    timer_.setClock(clock);
+    rebase();
+    arm();
+}
+
+void
+RealtimeOPMTimer::write(int addr, int data)
+{
+    catchUp();
+    timer_.write(addr, data);
+    if (!inTimer_)
+    {
+        // 割り込みの中なら終わってから合わせる
+        arm();
+    }
+}
+
+void
+RealtimeOPMTimer::reset()
+{
+    catchUp();
+    timer_.reset();
+    arm();
+}
+
+void
+RealtimeOPMTimer::setOffline(bool f)
+{
+    catchUp();
+    offline_ = f;
+    rebase();
+    arm();
+}
+
+void
+RealtimeOPMTimer::onTimer()
+{
+    if (offline_ || !host_)
+    {
+        return;
+    }
+
+    // 鳴らした後に書き換えられていたら合わせ直すだけ
+    uint32_t next = timer_.getCyclesToOverflow();
+    if (next && host_->getTime() >= cycleTime(cycles_ + next))
+    {
+        inTimer_ = true;
+        bool irq;
+        cycles_ += timer_.advance(next, &irq);
+        if (irq)
+        {
+            host_->onIRQ();
+        }
+        inTimer_ = false;
+    }
+    arm();
+}
+
+RealtimeOPMTimer::Time
+RealtimeOPMTimer::cycleTime(uint64_t cycles) const
+{
+    return baseTime_ + host_->toTime(cycles, timer_.getClock());
+}
+
+// 仮想クロックを今から数え直す
+void
+RealtimeOPMTimer::rebase()
+{
+    if (!host_)
+    {
+        return;
+    }
+    baseTime_ = host_->getTime();
+    cycles_   = 0;
+}
+
+void
+RealtimeOPMTimer::arm()
+{
+    if (!host_)
+    {
+        return;
+    }
+    uint32_t next = timer_.getCyclesToOverflow();
+    if (offline_ || !next)
+    {
+        host_->stopTimer();
+        return;
+    }
+    host_->startTimerAt(cycleTime(cycles_ + next));
+}
+
+// 割り込みの外から書く時は、今の時刻まで仮想クロックを進めておく
+// あふれるのはタイマから進めた時だけにするので、その手前まで
+void
+RealtimeOPMTimer::catchUp()
+{
+    if (inTimer_ || offline_ || !host_)
+    {
+        return;
+    }
+    auto now = host_->getTime();
+    if (now <= baseTime_)
+    {
+        return;
+    }
+    auto target = host_->toCycles(now - baseTime_, timer_.getClock());
+    if (target <= cycles_)
+    {
+        return;
+    }
+
+    uint32_t next = timer_.getCyclesToOverflow();
+    if (!next)
+    {
+        cycles_ = target;
+        return;
+    }
+    uint64_t n = std::min<uint64_t>(target - cycles_, next - 1);
+    bool irq;
+    cycles_ += timer_.advance(n, &irq);
+}
@@ -0,0 +1,71 @@
+#ifndef _E4E0E2F6_53A2_493B_BC1E_A887C6012B0B
+#define _E4E0E2F6_53A2_493B_BC1E_A887C6012B0B
+
+#include "opm_timer.h"
+#include <stdint.h>
+
+// OPMTimer を実時間のタイマで進めるもの
+// OPM のマスタークロックを数えた仮想クロックで次にあふれる所に合わせて
+// 1 回ずつ鳴らす。周期は毎回 baseTime_ から出し直すのでずれていかない
+//
+// 実時間のタイマと割り込みの処理は Host で与える
+// (本体は sys::startTimerAt()、ホストのテストは TimerScheduler)
+class RealtimeOPMTimer
+{
+public:
+    using Time = uint64_t;
+
+    class Host
+    {
+    public:
+        virtual ~Host() = default;
+
+        virtual Time getTime() = 0;
+        virtual Time toTime(uint64_t cycles, uint32_t clock) = 0;
+        virtual uint64_t toCycles(Time t, uint32_t clock) = 0;
+        // deadline に 1 回だけ onTimer() を呼ぶ。過ぎていればすぐ
+        virtual void startTimerAt(Time deadline) = 0;
+        virtual void stopTimer() = 0;
+        // 割り込み。中から write() してよい
+        virtual void onIRQ() = 0;
+    };
+
+public:
+    // null の間は実時間では進めない
+    void setHost(Host* host);
+
+    void setClock(uint32_t clock);
+    uint32_t getClock() const { return timer_.getClock(); }
+
+    void write(int addr, int data);
+    void reset();
+
+    // 実時間のタイマを止めて、getTimer().advance() で進めるようにする
+    // 戻す時は今から数え直す
+    void setOffline(bool f);
+
+    // Host のタイマから呼ぶ
+    void onTimer();
+
+    OPMTimer& getTimer() { return timer_; }
+    const OPMTimer& getTimer() const { return timer_; }
+
+    uint64_t getCycles() const { return cycles_; }
+    bool isInTimer() const { return inTimer_; }
+
+protected:
+    Time cycleTime(uint64_t cycles) const;
+    void rebase();
+    void arm();
+    void catchUp();
+
+private:
+    OPMTimer timer_;
+    Host* host_      = nullptr;
+    Time baseTime_   = 0; // 仮想クロックが 0 の時刻
+    uint64_t cycles_ = 0; // 仮想クロック (timer_ を進めた所)
+    bool inTimer_    = false;
+    bool offline_    = false;
+};
+
+#endif /* _E4E0E2F6_53A2_493B_BC1E_A887C6012B0B */
@@ -4,8 +4,6 @@
 #include "sound_iocs.h"
 #include "x68sound.h"
 
-#include <system/timer.h>
-
 #include "sys.h"
 
 /*
@@ -52,51 +50,22 @@ _iocs_opmset(int addr, int data)
     //		OpmReg1B = (OpmReg1B&0xC0)|(data&0x3F);
     //		data = OpmReg1B;
     //	}
-    //  OpmWait();
-    //  X68Sound_OpmReg(addr);
-    //  OpmWait();
-    //  X68Sound_OpmPoke(data);
-
-    auto* _2151 = getMXDRVSoundSystemSet().ym2151;
-    _2151->setValue(0, addr);
-    _2151->setValue(1, data);
-
-    if (addr == 0x12)
-    {
-        // CLKB
-        sys::setTimerPeriod((256 - data) << 8, true);
-        //      printf ("setTimerPeriod %d\n", data);
-    }
-    else if (addr == 0x14)
-    {
-        // timer control
-        bool start     = data & 2;
-        bool irqEnable = data & 8;
-
-        if (start)
-            sys::startTimer();
-        else
-            sys::stopTimer();
-
-        if (irqEnable)
-            sys::enableTimerInterrupt();
-        else
-            sys::disableTimerInterrupt();
-    }
-    //  else
-    //    printf ("y %02x:%02x\n", addr, data);
+    OpmWait();
+    X68Sound_OpmReg(addr);
+    OpmWait();
+    X68Sound_OpmPoke(data);
 }
 
-/*
 // IOCS _OPMSNS ($69) の処理
 // [戻り値]
 //   bit 0 : タイマーAオーバーフローのとき1になる
 //   bit 1 : タイマーBオーバーフローのとき1になる
 //   bit 7 : 0ならばデータ書き込み可能
-int _iocs_opmsns() {
-        return X68Sound_OpmPeek();
+int
+_iocs_opmsns()
+{
+    return X68Sound_OpmPeek();
 }
-*/
 
 /*
 void (*OpmIntProc)()=NULL;		// OPMのタイマー割り込み処理アドレス
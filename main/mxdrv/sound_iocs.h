@@ -23,7 +23,7 @@ struct _chain2 {
 void sound_iocs_init();
 
 void _iocs_opmset(int addr, int data);
-// int _iocs_opmsns();
+int _iocs_opmsns();
 // int _iocs_opmintst(void *addr);
 void _iocs_adpcmout(void* addr, int mode, int len);
 // void _iocs_adpcmaot(struct _chain *tbl, int mode, int cnt);
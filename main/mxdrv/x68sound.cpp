@@ -1,88 +1,222 @@
-/* -*- mode:C++; -*-
- *
- * author(s) : Shuichi TAKANO
- * since 2014/06/24(Tue) 10:59:45
- */
-
-#include "x68sound.h"
-#include "mxdrv.h"
-#include "sys.h"
-#include <stdint.h>
-#include <system/timer.h>
-
-MXDRVSoundSystemSet mxdrvSoundSystemSet_;
-
-extern "C"
-{
-
-    void X68Sound_OpmInt(void (*proc)())
-    {
-        sys::setTimerCallback([=] {
-            if (!proc)
-            {
-                return;
-            }
-
-            proc();
-
-            auto* _2151 = getMXDRVSoundSystemSet().ym2151;
-            for (int i = 0; i < 8; ++i)
-            {
-                auto w = &((MXWORK_CH*)MXDRV_GetWork(MXDRV_WORK_FM))[i];
-                if (w->S0004)
-                {
-                    _2151->setInstrumentNumber(i, w->S0004[-1]);
-                }
-            }
-        });
-    }
-
-    void X68Sound_AdpcmPoke(unsigned char data)
-    {
-        auto* p = getMXDRVSoundSystemSet().m6258;
-
-        if (data & 2)
-        {
-            p->play();
-
-            auto ch  = &((MXWORK_CH*)MXDRV_GetWork(MXDRV_WORK_FM))[8];
-            int note = (ch->S0012 + 27) >> 6;
-            //      printf ("note %d %d\n", ch->S0012, note);
-            p->setNote(0, note - 48);
-        }
-        if (data & 1)
-            p->stop();
-    }
-
-    void X68Sound_PpiPoke(unsigned char data)
-    {
-        auto* p = getMXDRVSoundSystemSet().m6258;
-        p->setChMask(data & 2 ? false : true, data & 1 ? false : true);
-        p->setSampleRate6258((data >> 2) & 3);
-    }
-
-    int X68Sound_Pcm8_Out(int ch, void* adrs, int mode, int len)
-    {
-        //  printf ("pcm8 out %d: %p, %d(%d %d %d) %d\n", ch, adrs, mode,
-        //  vol, rate, m, len);
-        auto* p = getMXDRVSoundSystemSet().m6258;
-        p->pcm8(ch, adrs, mode, len);
-
-        MXWORK_CH* work;
-        if (ch == 0)
-            work = &((MXWORK_CH*)MXDRV_GetWork(MXDRV_WORK_FM))[8];
-        else
-            work = &((MXWORK_CH*)MXDRV_GetWork(MXDRV_WORK_PCM))[ch - 1];
-        int note = (work->S0012 + 27) >> 6;
-        p->setNote(ch, note - 48);
-
-        return 0;
-    }
-
-    int X68Sound_Pcm8_Abort()
-    {
-        auto* p = getMXDRVSoundSystemSet().m6258;
-        p->resetPCM8();
-        return 0;
-    }
-}
+/* -*- mode:C++; -*-
+ *
+ * author(s) : Shuichi TAKANO
+ * since 2014/06/24(Tue) 10:59:45
+ */
+
+#include "x68sound.h"
+#include "mxdrv.h"
+#include "realtime_opm_timer.h"
+#include "sys.h"
+#include <stdint.h>
+#include <system/timer.h>
+
+MXDRVSoundSystemSet mxdrvSoundSystemSet_;
+
+namespace
+{
+void (*opmIntProc_)() = nullptr;
+
+RealtimeOPMTimer opmTimer_;
+unsigned char opmReg_ = 0;
+
+// タイマータスクで呼ばれるのでヒープを使わないこと
+void
+opmInt()
+{
+    auto proc = opmIntProc_;
+    if (!proc)
+    {
+        return;
+    }
+
+    proc();
+
+    auto* _2151 = getMXDRVSoundSystemSet().ym2151;
+    for (int i = 0; i < 8; ++i)
+    {
+        auto w = &((MXWORK_CH*)MXDRV_GetWork(MXDRV_WORK_FM))[i];
+        if (w->S0004)
+        {
+            _2151->setInstrumentNumber(i, w->S0004[-1]);
+        }
+    }
+}
+
+// OPM のタイマを仮想タイマで進める
+class TimerHost final : public RealtimeOPMTimer::Host
+{
+    sys::TimerID id_ = -1;
+
+public:
+    bool isCreated() const { return id_ >= 0; }
+
+    void create()
+    {
+        id_ = sys::createTimer([] { opmTimer_.onTimer(); });
+    }
+
+    sys::TimerTime getTime() override { return sys::getTimerTime(); }
+
+    sys::TimerTime toTime(uint64_t cycles, uint32_t clock) override
+    {
+        return sys::cyclesToTimerTime(cycles, clock);
+    }
+
+    uint64_t toCycles(sys::TimerTime t, uint32_t clock) override
+    {
+        return sys::timerTimeToCycles(t, clock);
+    }
+
+    void startTimerAt(sys::TimerTime deadline) override
+    {
+        sys::startTimerAt(id_, deadline);
+    }
+
+    void stopTimer() override { sys::stopTimer(id_); }
+
+    void onIRQ() override { opmInt(); }
+};
+
+TimerHost timerHost_;
+
+} // namespace
+
+extern "C"
+{
+
+    unsigned char X68Sound_OpmPeek()
+    {
+        return opmTimer_.getTimer().readStatus();
+    }
+
+    void X68Sound_OpmReg(unsigned char no)
+    {
+        opmReg_ = no;
+        getMXDRVSoundSystemSet().ym2151->setValue(0, no);
+    }
+
+    void X68Sound_OpmPoke(unsigned char data)
+    {
+        getMXDRVSoundSystemSet().ym2151->setValue(1, data);
+        X68Sound_OpmTimerPoke(opmReg_, data);
+    }
+
+    void X68Sound_OpmInt(void (*proc)())
+    {
+        // 割り込みは OPM のタイマから呼ぶ
+        opmIntProc_ = proc;
+    }
+
+    int X68Sound_OpmClock(int clock)
+    {
+        if (!timerHost_.isCreated())
+        {
+            // タイマータスクの中で確保しないように先に作っておく
+            timerHost_.create();
+            if (timerHost_.isCreated())
+            {
+                opmTimer_.setHost(&timerHost_);
+            }
+        }
+
+        int prev = opmTimer_.getClock();
+        opmTimer_.setClock(clock);
+        return prev;
+    }
+
+    void X68Sound_OpmTimerPoke(unsigned char no, unsigned char data)
+    {
+        if (!OPMTimer::isTimerRegister(no))
+        {
+            return;
+        }
+        opmTimer_.write(no, data);
+    }
+
+    void X68Sound_OpmTimerOffline(int offline)
+    {
+        opmTimer_.setOffline(offline);
+    }
+
+    unsigned X68Sound_OpmTimerRun(void (*proc)())
+    {
+        // 割り込みが来ないまま 10 秒分進んだらあきらめる
+        auto& t        = opmTimer_.getTimer();
+        uint32_t limit = t.getClock() * 10;
+        uint32_t total = 0;
+        while (total < limit)
+        {
+            uint32_t next = t.getCyclesToOverflow();
+            if (!next)
+            {
+                break;
+            }
+            bool irq;
+            total += t.advance(next, &irq);
+            if (irq)
+            {
+                if (proc)
+                {
+                    proc();
+                }
+                return total;
+            }
+        }
+        return 0;
+    }
+
+    void X68Sound_Reset()
+    {
+        opmTimer_.reset();
+    }
+
+    void X68Sound_AdpcmPoke(unsigned char data)
+    {
+        auto* p = getMXDRVSoundSystemSet().m6258;
+
+        if (data & 2)
+        {
+            p->play();
+
+            auto ch  = &((MXWORK_CH*)MXDRV_GetWork(MXDRV_WORK_FM))[8];
+            int note = (ch->S0012 + 27) >> 6;
+            //      printf ("note %d %d\n", ch->S0012, note);
+            p->setNote(0, note - 48);
+        }
+        if (data & 1)
+            p->stop();
+    }
+
+    void X68Sound_PpiPoke(unsigned char data)
+    {
+        auto* p = getMXDRVSoundSystemSet().m6258;
+        p->setChMask(data & 2 ? false : true, data & 1 ? false : true);
+        p->setSampleRate6258((data >> 2) & 3);
+    }
+
+    int X68Sound_Pcm8_Out(int ch, void* adrs, int mode, int len)
+    {
+        //  printf ("pcm8 out %d: %p, %d(%d %d %d) %d\n", ch, adrs, mode,
+        //  vol, rate, m, len);
+        auto* p = getMXDRVSoundSystemSet().m6258;
+        p->pcm8(ch, adrs, mode, len);
+
+        MXWORK_CH* work;
+        if (ch == 0)
+            work = &((MXWORK_CH*)MXDRV_GetWork(MXDRV_WORK_FM))[8];
+        else
+            work = &((MXWORK_CH*)MXDRV_GetWork(MXDRV_WORK_PCM))[ch - 1];
+        int note = (work->S0012 + 27) >> 6;
+        p->setNote(ch, note - 48);
+
+        return 0;
+    }
+
+    int X68Sound_Pcm8_Abort()
+    {
+        auto* p = getMXDRVSoundSystemSet().m6258;
+        p->resetPCM8();
+        return 0;
+    }
+}
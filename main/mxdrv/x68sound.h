@@ -11,12 +11,22 @@
 // adpcmflag=1, int pcmbuf=5); extern "C" int X68Sound_GetPcm(void *buf, int
 // len);
 
-// extern "C" unsigned char X68Sound_OpmPeek();
-// extern "C" void X68Sound_OpmReg(unsigned char no);
-// extern "C" void X68Sound_OpmPoke(unsigned char data);
+extern "C" unsigned char X68Sound_OpmPeek();
+extern "C" void X68Sound_OpmReg(unsigned char no);
+extern "C" void X68Sound_OpmPoke(unsigned char data);
 extern "C" void X68Sound_OpmInt(void (*proc)() = NULL);
 // extern "C" int X68Sound_OpmWait(int wait=240);
-// extern "C" int X68Sound_OpmClock(int clock=4000000);
+extern "C" int X68Sound_OpmClock(int clock = 4000000);
+
+// OPM のタイマだけに書く (音源には書かない)
+extern "C" void X68Sound_OpmTimerPoke(unsigned char no, unsigned char data);
+// 実時間のタイマを止めて、X68Sound_OpmTimerRun() で進めるようにする
+extern "C" void X68Sound_OpmTimerOffline(int offline);
+// 次の割り込みまで OPM のタイマを進めて proc を呼ぶ
+// 進めたマスタークロック数を返す。割り込みが来なければ 0
+extern "C" unsigned X68Sound_OpmTimerRun(void (*proc)());
+// OPM のタイマを止める
+extern "C" void X68Sound_Reset();
 
 // extern "C" unsigned char X68Sound_AdpcmPeek();
 extern "C" void X68Sound_AdpcmPoke(unsigned char data);
@@ -0,0 +1,149 @@
+#include "adpcm_bank.h"
+#include "m6258_coder.h"
+#include <algorithm>
+#include <stdlib.h>
+#include <utility>
+
+namespace sound_sys
+{
+
+namespace
+{
+
+inline uint32_t
+getBE32(const uint8_t* p)
+{
+    return (uint32_t(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+using Region = std::pair<uint32_t, uint32_t>; // offset, size
+
+// 先頭の (offset, size) の表を読む
+// 表は最初のデータの手前まで続く (96 個ごとのバンクが複数あることもある)
+void
+collectRegions(std::vector<Region>& regions, const uint8_t* pdx, size_t size)
+{
+    size_t tableEnd = size;
+    for (size_t p = 0; p + 8 <= tableEnd; p += 8)
+    {
+        uint32_t ofs = getBE32(pdx + p);
+        uint32_t len = getBE32(pdx + p + 4);
+        if (!len || ofs < p + 8 || ofs > size || len > size - ofs)
+        {
+            continue;
+        }
+        tableEnd = std::min<size_t>(tableEnd, ofs);
+        regions.push_back({ofs, len});
+    }
+
+    // 同じ所を指すものは長い方だけ残す
+    std::sort(regions.begin(),
+              regions.end(),
+              [](const Region& a, const Region& b) {
+                  return a.first < b.first ||
+                         (a.first == b.first && a.second > b.second);
+              });
+    regions.erase(std::unique(regions.begin(),
+                              regions.end(),
+                              [](const Region& a, const Region& b) {
+                                  return a.first == b.first;
+                              }),
+                  regions.end());
+}
+
+} // namespace
+
+size_t
+ADPCMBank::computeDecodedBytes(const uint8_t* pdx, size_t size)
+{
+    std::vector<Region> regions;
+    collectRegions(regions, pdx, size);
+
+    size_t total = 0;
+    for (auto& r : regions)
+    {
+        total += r.second * 4;
+    }
+    return total;
+}
+
+bool
+ADPCMBank::build(const uint8_t* pdx, size_t size)
+{
+    release();
+
+    std::vector<Region> regions;
+    collectRegions(regions, pdx, size);
+
+    size_t total = 0;
+    for (auto& r : regions)
+    {
+        total += r.second;
+    }
+    if (!total)
+    {
+        return false;
+    }
+
+    // 1 byte = 2 サンプル
+    buffer_ = static_cast<int16_t*>(malloc(total * 4));
+    if (!buffer_)
+    {
+        return false;
+    }
+
+    entries_.reserve(regions.size());
+    auto dst = buffer_;
+    for (auto& r : regions)
+    {
+        auto src = pdx + r.first;
+
+        M6258Coder coder;
+        bool inRange = coder.decodeBlock(dst, src, r.second);
+
+        // int16_t に収まらないものは展開せずに再生時に decode する
+        if (inRange)
+        {
+            entries_.push_back({src, r.second, dst});
+            dst += r.second * 2;
+            sourceBytes_ += r.second;
+        }
+    }
+
+    ready_.store(true, std::memory_order_release);
+    return true;
+}
+
+void
+ADPCMBank::release()
+{
+    ready_.store(false, std::memory_order_release);
+    entries_.clear();
+    free(buffer_);
+    buffer_      = nullptr;
+    sourceBytes_ = 0;
+}
+
+const int16_t*
+ADPCMBank::find(const void* addr, int len) const
+{
+    if (!isReady())
+    {
+        return nullptr;
+    }
+
+    auto p  = static_cast<const uint8_t*>(addr);
+    auto it = std::lower_bound(entries_.begin(),
+                               entries_.end(),
+                               p,
+                               [](const Entry& e, const uint8_t* a) {
+                                   return e.src < a;
+                               });
+    if (it == entries_.end() || it->src != p || (uint32_t)len > it->srcSize)
+    {
+        return nullptr;
+    }
+    return it->pcm;
+}
+
+} // namespace sound_sys
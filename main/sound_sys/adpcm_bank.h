@@ -0,0 +1,59 @@
+#ifndef _1C7F52E8_94A3_4D0B_A6E2_5B08D3F417C9
+#define _1C7F52E8_94A3_4D0B_A6E2_5B08D3F417C9
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace sound_sys
+{
+
+// PDX の ADPCM をあらかじめ 16bit PCM に展開しておくもの
+// 展開結果は M6258Coder を reset() して頭から update() したものと同じ
+class ADPCMBank
+{
+public:
+    struct Entry
+    {
+        const uint8_t* src;
+        uint32_t srcSize;
+        const int16_t* pcm; // srcSize * 2 サンプル
+    };
+
+public:
+    ADPCMBank() = default;
+    ~ADPCMBank() { release(); }
+
+    // pdx は PDX ファイルの中身そのもの
+    // 展開できた分だけ登録する
+    bool build(const uint8_t* pdx, size_t size);
+    void release();
+
+    // build() が終わるまでは find() は何も返さない
+    bool isReady() const { return ready_.load(std::memory_order_acquire); }
+
+    // addr から len バイトの ADPCM を展開したもの
+    const int16_t* find(const void* addr, int len) const;
+
+    size_t getEntryCount() const { return entries_.size(); }
+    size_t getSourceBytes() const { return sourceBytes_; }
+    size_t getDecodedBytes() const { return sourceBytes_ * 4; }
+
+    // 展開に必要な大きさ
+    static size_t computeDecodedBytes(const uint8_t* pdx, size_t size);
+
+private:
+    ADPCMBank(const ADPCMBank&) = delete;
+    ADPCMBank& operator=(const ADPCMBank&) = delete;
+
+private:
+    std::vector<Entry> entries_; // src 順
+    int16_t* buffer_{};
+    size_t sourceBytes_ = 0;
+    std::atomic<bool> ready_{false};
+};
+
+} // namespace sound_sys
+
+#endif /* _1C7F52E8_94A3_4D0B_A6E2_5B08D3F417C9 */
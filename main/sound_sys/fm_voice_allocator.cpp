@@ -0,0 +1,473 @@
+#include "fm_voice_allocator.h"
+#include <algorithm>
+#include <math.h>
+#include <utility>
+
+namespace sound_sys
+{
+
+namespace
+{
+
+// MIDI の 0-127 を TL (0.75dB 単位) の減衰量にする
+// GM と同じく 40log(v/127)
+const uint8_t*
+getAttenuationTable()
+{
+    static uint8_t tbl[128];
+    static bool initialized = false;
+    if (!initialized)
+    {
+        tbl[0] = 127;
+        for (int i = 1; i < 128; ++i)
+        {
+            float db = -40.0f * log10f(i / 127.0f);
+            tbl[i]   = std::min(127, int(db / 0.75f + 0.5f));
+        }
+        initialized = true;
+    }
+    return tbl;
+}
+
+} // namespace
+
+FMVoiceAllocator::FMVoiceAllocator(int voiceCount)
+    : voiceCount_(std::min(voiceCount, MAX_VOICE_COUNT))
+{
+    getAttenuationTable();
+    setPatchBank({});
+}
+
+void
+FMVoiceAllocator::setPatchBank(std::vector<OPMPatch> bank)
+{
+    bank_ = std::move(bank);
+    if (bank_.empty())
+    {
+        bank_.push_back(OPMPatch::getDefault());
+    }
+
+    // 番号が変わるので書き直させる
+    for (auto& v : voices_)
+    {
+        v.patch = -1;
+    }
+}
+
+void
+FMVoiceAllocator::reset()
+{
+    resetChip();
+    for (auto& v : voices_)
+    {
+        v = {};
+    }
+    for (auto& ch : channels_)
+    {
+        ch = {};
+    }
+    ageCounter_ = 0;
+}
+
+void
+FMVoiceAllocator::message(const uint8_t* data, int size)
+{
+    if (size < 2)
+    {
+        return;
+    }
+
+    int ch = data[0] & 15;
+    int d1 = data[1] & 127;
+    int d2 = size > 2 ? data[2] & 127 : 0;
+    switch (data[0] >> 4)
+    {
+    case 0x8:
+        noteOff(ch, d1);
+        break;
+
+    case 0x9:
+        noteOn(ch, d1, d2);
+        break;
+
+    case 0xb:
+        controlChange(ch, d1, d2);
+        break;
+
+    case 0xc:
+        programChange(ch, d1);
+        break;
+
+    case 0xe:
+        pitchBend(ch, ((d2 << 7) | d1) - 8192);
+        break;
+
+    default:
+        break;
+    }
+}
+
+void
+FMVoiceAllocator::noteOn(int ch, int note, int vel)
+{
+    if (vel == 0)
+    {
+        noteOff(ch, note);
+        return;
+    }
+    if (ch == DRUM_CH && !drumChannelEnabled_)
+    {
+        drumNoteOn(note, vel);
+        return;
+    }
+    ++stats_.noteOns;
+
+    int patch = getPatchIndex(ch);
+    int vi    = findVoice(ch, note);
+    if (vi < 0)
+    {
+        vi = allocate(patch);
+    }
+
+    auto& v = voices_[vi];
+    if (v.isSounding())
+    {
+        keyOff(vi);
+    }
+
+    int pan = getPanBits(channels_[ch].pan);
+    if (v.patch != patch)
+    {
+        loadPatch(vi, patch, pan);
+    }
+    else
+    {
+        ++stats_.patchReuses;
+        updatePan(vi, pan);
+    }
+
+    v.ch      = ch;
+    v.note    = note;
+    v.vel     = vel;
+    v.keyOn   = true;
+    v.sustain = false;
+    v.age     = ++ageCounter_;
+
+    updateVolume(vi);
+    updatePitch(vi);
+
+    int mask = bank_[patch].slotMask & 15;
+    writeKeyOn(vi, mask ? mask : 15);
+    setInstrumentNumber(vi, bank_[patch].number);
+}
+
+void
+FMVoiceAllocator::noteOff(int ch, int note)
+{
+    for (int i = 0; i < voiceCount_; ++i)
+    {
+        auto& v = voices_[i];
+        if (!v.keyOn || v.ch != ch || v.note != note)
+        {
+            continue;
+        }
+
+        v.keyOn = false;
+        v.age   = ++ageCounter_;
+        if (channels_[ch].sustain)
+        {
+            v.sustain = true;
+        }
+        else
+        {
+            keyOff(i);
+        }
+    }
+}
+
+void
+FMVoiceAllocator::controlChange(int ch, int cc, int value)
+{
+    auto& c = channels_[ch];
+    switch (cc)
+    {
+    case 6: // data entry
+        if (c.rpnMSB == 0 && c.rpnLSB == 0)
+        {
+            c.bendRange = std::min(value, 24);
+        }
+        return;
+
+    case 7:
+        c.volume = value;
+        break;
+
+    case 10:
+        c.pan = value;
+        for (int i = 0; i < voiceCount_; ++i)
+        {
+            if (voices_[i].ch == ch && voices_[i].isSounding())
+            {
+                updatePan(i, getPanBits(value));
+            }
+        }
+        return;
+
+    case 11:
+        c.expression = value;
+        break;
+
+    case 64:
+        c.sustain = value >= 64;
+        if (!c.sustain)
+        {
+            releaseSustain(ch);
+        }
+        return;
+
+    case 100:
+        c.rpnLSB = value;
+        return;
+
+    case 101:
+        c.rpnMSB = value;
+        return;
+
+    case 120: // all sound off
+    case 123: // all notes off
+        c.sustain = false;
+        for (int i = 0; i < voiceCount_; ++i)
+        {
+            if (voices_[i].ch == ch && voices_[i].isSounding())
+            {
+                keyOff(i);
+            }
+        }
+        return;
+
+    case 121: // reset all controllers
+    {
+        auto program = c.program;
+        c            = {};
+        c.program    = program;
+        releaseSustain(ch);
+        break;
+    }
+
+    default:
+        return;
+    }
+
+    // 音量が変わった
+    for (int i = 0; i < voiceCount_; ++i)
+    {
+        if (voices_[i].ch == ch && voices_[i].isSounding())
+        {
+            updateVolume(i);
+        }
+    }
+}
+
+void
+FMVoiceAllocator::programChange(int ch, int prog)
+{
+    channels_[ch].program = prog;
+}
+
+void
+FMVoiceAllocator::pitchBend(int ch, int value)
+{
+    channels_[ch].bend = value;
+    for (int i = 0; i < voiceCount_; ++i)
+    {
+        if (voices_[i].ch == ch && voices_[i].isSounding())
+        {
+            updatePitch(i);
+        }
+    }
+}
+
+void
+FMVoiceAllocator::allNotesOff()
+{
+    for (auto& c : channels_)
+    {
+        c.sustain = false;
+    }
+    for (int i = 0; i < voiceCount_; ++i)
+    {
+        if (voices_[i].isSounding())
+        {
+            keyOff(i);
+        }
+    }
+}
+
+int
+FMVoiceAllocator::getKeyOnVoiceCount() const
+{
+    int n = 0;
+    for (auto& v : voices_)
+    {
+        n += v.isSounding();
+    }
+    return n;
+}
+
+int
+FMVoiceAllocator::allocate(int patch)
+{
+    // 1. 空いている中で同じ音色が残っているもの
+    // 2. 空いている中で一番前に離したもの (リリースが一番進んでいる)
+    // 3. ペダルで伸ばしているだけのものか、一番古いものを奪う
+    int same   = -1;
+    int free   = -1;
+    int sus    = -1;
+    int oldest = -1;
+    auto older = [&](int cur, int i) {
+        return cur < 0 || voices_[i].age < voices_[cur].age;
+    };
+
+    for (int i = 0; i < voiceCount_; ++i)
+    {
+        auto& v = voices_[i];
+        if (!v.isSounding())
+        {
+            if (v.patch == patch && older(same, i))
+            {
+                same = i;
+            }
+            if (older(free, i))
+            {
+                free = i;
+            }
+        }
+        else if (v.sustain)
+        {
+            if (older(sus, i))
+            {
+                sus = i;
+            }
+        }
+        else if (older(oldest, i))
+        {
+            oldest = i;
+        }
+    }
+
+    if (same >= 0)
+    {
+        return same;
+    }
+    if (free >= 0)
+    {
+        return free;
+    }
+    ++stats_.steals;
+    return sus >= 0 ? sus : oldest;
+}
+
+int
+FMVoiceAllocator::findVoice(int ch, int note) const
+{
+    for (int i = 0; i < voiceCount_; ++i)
+    {
+        auto& v = voices_[i];
+        if (v.isSounding() && v.ch == ch && v.note == note)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void
+FMVoiceAllocator::keyOff(int vi)
+{
+    auto& v   = voices_[vi];
+    v.keyOn   = false;
+    v.sustain = false;
+    writeKeyOff(vi);
+}
+
+void
+FMVoiceAllocator::loadPatch(int vi, int patch, int pan)
+{
+    ++stats_.patchLoads;
+
+    auto& p = bank_[patch];
+    auto& v = voices_[vi];
+    v.patch = patch;
+    v.pan   = pan;
+
+    // TL はキャリアだけ音量で変わるので updateVolume() で書く
+    writePatch(vi, p, pan);
+}
+
+void
+FMVoiceAllocator::updatePan(int vi, int pan)
+{
+    auto& v = voices_[vi];
+    if (v.pan != pan)
+    {
+        v.pan = pan;
+        writePan(vi, bank_[v.patch], pan);
+    }
+}
+
+void
+FMVoiceAllocator::updateVolume(int vi)
+{
+    auto& v   = voices_[vi];
+    auto& c   = channels_[v.ch];
+    auto& p   = bank_[v.patch];
+    auto tbl  = getAttenuationTable();
+    int att   = tbl[v.vel] + tbl[c.volume] + tbl[c.expression];
+    int carry = p.getCarrierMask();
+
+    for (int op = 0; op < 4; ++op)
+    {
+        if (carry & (1 << op))
+        {
+            writeTL(vi, op, std::min(127, p.tl[op] + att));
+        }
+    }
+}
+
+void
+FMVoiceAllocator::updatePitch(int vi)
+{
+    auto& v = voices_[vi];
+    auto& c = channels_[v.ch];
+
+    // 1/64 半音単位
+    int pitch = v.note * 64 + c.bend * c.bendRange * 64 / 8192;
+    writePitch(vi, std::max(0, std::min(128 * 64 - 1, pitch)));
+}
+
+void
+FMVoiceAllocator::releaseSustain(int ch)
+{
+    for (int i = 0; i < voiceCount_; ++i)
+    {
+        auto& v = voices_[i];
+        if (v.ch == ch && v.sustain)
+        {
+            keyOff(i);
+        }
+    }
+}
+
+int
+FMVoiceAllocator::getPatchIndex(int ch) const
+{
+    return channels_[ch].program % bank_.size();
+}
+
+int
+FMVoiceAllocator::getPanBits(int pan)
+{
+    return pan < 32 ? PAN_L : pan >= 96 ? PAN_R : PAN_L | PAN_R;
+}
+
+} // namespace sound_sys
@@ -0,0 +1,137 @@
+#ifndef _7F1C3B52_9A64_4E0D_8D27_51E6A0C49B83
+#define _7F1C3B52_9A64_4E0D_8D27_51E6A0C49B83
+
+#include "opm_patch.h"
+#include <stdint.h>
+#include <vector>
+
+namespace sound_sys
+{
+
+// MIDI のノートを FM 音源のチャンネルに割り当てる
+// 空きが無ければ一番古いものを奪う
+// チップへの書き込みは派生クラスで行う
+class FMVoiceAllocator
+{
+public:
+    static constexpr int MAX_VOICE_COUNT = 8;
+    static constexpr int MIDI_CH_COUNT   = 16;
+    static constexpr int DRUM_CH         = 9;
+
+    // write*() に渡すパン
+    static constexpr int PAN_L = 1;
+    static constexpr int PAN_R = 2;
+
+    struct Stats
+    {
+        uint32_t noteOns;
+        uint32_t steals;
+        uint32_t patchLoads;  // 音色を書き込んだ
+        uint32_t patchReuses; // 同じ音色が残っていて書かずに済んだ
+        uint32_t regWrites;
+    };
+
+public:
+    explicit FMVoiceAllocator(int voiceCount);
+    virtual ~FMVoiceAllocator() = default;
+
+    int getVoiceCount() const { return voiceCount_; }
+
+    // 空なら OPMPatch::getDefault() だけになる
+    void setPatchBank(std::vector<OPMPatch> bank);
+    size_t getPatchCount() const { return bank_.size(); }
+
+    // GM のドラムチャンネルも音程のある音として鳴らすか
+    void setDrumChannelEnabled(bool f) { drumChannelEnabled_ = f; }
+
+    // チップと状態を初期化する
+    void reset();
+
+    // running status を解決済みの 1 メッセージ
+    void message(const uint8_t* data, int size);
+
+    void noteOn(int ch, int note, int vel);
+    void noteOff(int ch, int note);
+    void controlChange(int ch, int cc, int v);
+    void programChange(int ch, int prog);
+    void pitchBend(int ch, int v); // -8192 - 8191
+    void allNotesOff();
+
+    int getKeyOnVoiceCount() const;
+    const Stats& getStats() const { return stats_; }
+    void resetStats() { stats_ = {}; }
+
+protected:
+    virtual void resetChip()                     = 0;
+    virtual void writeKeyOn(int v, int slotMask) = 0;
+    virtual void writeKeyOff(int v)              = 0;
+
+    // キャリアの TL は writeTL() で書く
+    virtual void writePatch(int v, const OPMPatch& p, int pan) = 0;
+    virtual void writePan(int v, const OPMPatch& p, int pan)   = 0;
+    virtual void writeTL(int v, int op, int tl)                = 0;
+
+    // pitch は MIDI のノート番号の 1/64 半音単位
+    virtual void writePitch(int v, int pitch) = 0;
+
+    virtual void setInstrumentNumber(int v, int n) {}
+
+    // ドラムチャンネルを音程のある音として鳴らさない時
+    virtual void drumNoteOn(int note, int vel) {}
+
+    void countWrite() { ++stats_.regWrites; }
+
+protected:
+    struct Voice
+    {
+        int8_t ch     = -1;
+        uint8_t note  = 0;
+        uint8_t vel   = 0;
+        bool keyOn    = false;
+        bool sustain  = false; // ノートオフ済みでペダルで伸ばしている
+        int16_t patch = -1;    // チップに書いてある音色
+        uint8_t pan   = 0;
+        uint32_t age  = 0; // 最後にオン/オフした時
+
+        bool isSounding() const { return keyOn || sustain; }
+    };
+
+    struct Channel
+    {
+        uint8_t program    = 0;
+        uint8_t volume     = 100;
+        uint8_t expression = 127;
+        uint8_t pan        = 64;
+        bool sustain       = false;
+        int16_t bend       = 0;
+        uint8_t bendRange  = 2;
+        uint8_t rpnMSB     = 127;
+        uint8_t rpnLSB     = 127;
+    };
+
+    int allocate(int patch);
+    int findVoice(int ch, int note) const;
+
+    void keyOff(int v);
+    void loadPatch(int v, int patch, int pan);
+    void updatePan(int v, int pan);
+    void updateVolume(int v);
+    void updatePitch(int v);
+    void releaseSustain(int ch);
+
+    int getPatchIndex(int ch) const;
+    static int getPanBits(int pan);
+
+private:
+    int voiceCount_;
+    std::vector<OPMPatch> bank_;
+    Voice voices_[MAX_VOICE_COUNT];
+    Channel channels_[MIDI_CH_COUNT];
+    uint32_t ageCounter_     = 0;
+    bool drumChannelEnabled_ = false;
+    Stats stats_{};
+};
+
+} // namespace sound_sys
+
+#endif /* _7F1C3B52_9A64_4E0D_8D27_51E6A0C49B83 */
@@ -0,0 +1,108 @@
+#include "gm_fm_bank.h"
+
+namespace sound_sys
+{
+
+namespace
+{
+
+// オペレータはレジスタ順 (M1, M2, C1, C2)
+// キャリアの TL は音量で足されるので 0 付近にしておく
+constexpr OPMPatch familyPatches_[16] = {
+    // 0: Piano
+    {0, (5 << 3) | 4, 15,
+     {0x01, 0x03, 0x01, 0x01}, {32, 44, 0, 6},
+     {0x5f, 0x5f, 0x5f, 0x5f}, {10, 12, 8, 9},
+     {3, 3, 4, 4}, {0x36, 0x36, 0x27, 0x27}},
+    // 1: Chromatic Percussion
+    {0, (3 << 3) | 4, 15,
+     {0x07, 0x0e, 0x01, 0x03}, {36, 40, 0, 10},
+     {0x5f, 0x5f, 0x5f, 0x5f}, {12, 14, 9, 11},
+     {5, 5, 4, 5}, {0xf5, 0xf5, 0xf4, 0xf4}},
+    // 2: Organ
+    {0, (0 << 3) | 7, 15,
+     {0x01, 0x02, 0x00, 0x04}, {10, 16, 14, 22},
+     {0x1f, 0x1f, 0x1f, 0x1f}, {0, 0, 0, 0},
+     {0, 0, 0, 0}, {0x07, 0x07, 0x07, 0x07}},
+    // 3: Guitar
+    {0, (6 << 3) | 3, 15,
+     {0x01, 0x03, 0x01, 0x01}, {30, 40, 28, 0},
+     {0x5f, 0x5f, 0x5f, 0x5f}, {8, 10, 6, 5},
+     {2, 2, 2, 3}, {0x26, 0x26, 0x25, 0x28}},
+    // 4: Bass
+    {0, (5 << 3) | 0, 15,
+     {0x00, 0x01, 0x00, 0x01}, {28, 34, 30, 0},
+     {0x1f, 0x1f, 0x1f, 0x1f}, {12, 10, 8, 6},
+     {3, 3, 3, 2}, {0x28, 0x28, 0x28, 0x28}},
+    // 5: Strings
+    {0, (3 << 3) | 4, 15,
+     {0x31, 0x71, 0x01, 0x41}, {30, 38, 4, 4},
+     {0x12, 0x12, 0x12, 0x12}, {0, 0, 0, 0},
+     {0, 0, 0, 0}, {0x08, 0x08, 0x08, 0x08}},
+    // 6: Ensemble
+    {0, (2 << 3) | 5, 15,
+     {0x01, 0x31, 0x01, 0x71}, {28, 8, 8, 8},
+     {0x10, 0x10, 0x10, 0x10}, {0, 0, 0, 0},
+     {0, 0, 0, 0}, {0x17, 0x17, 0x17, 0x17}},
+    // 7: Brass
+    {0, (6 << 3) | 4, 15,
+     {0x01, 0x01, 0x01, 0x01}, {26, 28, 2, 4},
+     {0x16, 0x16, 0x18, 0x18}, {4, 4, 2, 2},
+     {0, 0, 0, 0}, {0x16, 0x16, 0x17, 0x17}},
+    // 8: Reed
+    {0, (4 << 3) | 3, 15,
+     {0x01, 0x03, 0x02, 0x01}, {30, 38, 34, 2},
+     {0x16, 0x16, 0x16, 0x18}, {2, 2, 2, 2},
+     {0, 0, 0, 0}, {0x17, 0x17, 0x17, 0x17}},
+    // 9: Pipe
+    {0, (0 << 3) | 4, 15,
+     {0x02, 0x01, 0x01, 0x02}, {45, 50, 4, 8},
+     {0x14, 0x14, 0x14, 0x14}, {0, 0, 0, 0},
+     {0, 0, 0, 0}, {0x17, 0x17, 0x17, 0x17}},
+    // 10: Synth Lead
+    {0, (7 << 3) | 7, 15,
+     {0x01, 0x01, 0x01, 0x02}, {6, 127, 127, 127},
+     {0x1f, 0x1f, 0x1f, 0x1f}, {0, 0, 0, 0},
+     {0, 0, 0, 0}, {0x08, 0x08, 0x08, 0x08}},
+    // 11: Synth Pad
+    {0, (4 << 3) | 5, 15,
+     {0x01, 0x32, 0x01, 0x72}, {30, 8, 8, 8},
+     {0x0a, 0x0a, 0x0a, 0x0a}, {0, 0, 0, 0},
+     {0, 0, 0, 0}, {0x04, 0x04, 0x04, 0x04}},
+    // 12: Synth Effects
+    {0, (5 << 3) | 4, 15,
+     {0x0b, 0x05, 0x01, 0x03}, {34, 40, 6, 8},
+     {0x0e, 0x0e, 0x10, 0x10}, {2, 2, 1, 1},
+     {1, 1, 1, 1}, {0x25, 0x25, 0x24, 0x24}},
+    // 13: Ethnic
+    {0, (6 << 3) | 3, 15,
+     {0x03, 0x05, 0x01, 0x01}, {30, 36, 30, 0},
+     {0x5f, 0x5f, 0x5f, 0x5f}, {10, 12, 8, 7},
+     {4, 4, 3, 4}, {0x37, 0x37, 0x36, 0x37}},
+    // 14: Percussive
+    {0, (4 << 3) | 4, 15,
+     {0x01, 0x05, 0x01, 0x01}, {28, 36, 0, 4},
+     {0x5f, 0x5f, 0x5f, 0x5f}, {16, 18, 14, 15},
+     {8, 8, 7, 8}, {0xf8, 0xf8, 0xf7, 0xf7}},
+    // 15: Sound Effects
+    {0, (7 << 3) | 5, 15,
+     {0x0f, 0x0d, 0x07, 0x03}, {20, 10, 10, 10},
+     {0x1f, 0x1f, 0x1f, 0x1f}, {6, 4, 4, 4},
+     {2, 2, 2, 2}, {0x35, 0x35, 0x35, 0x35}},
+};
+
+} // namespace
+
+std::vector<OPMPatch>
+makeGMBank()
+{
+    std::vector<OPMPatch> bank(128);
+    for (int i = 0; i < 128; ++i)
+    {
+        bank[i]        = familyPatches_[i >> 3];
+        bank[i].number = i;
+    }
+    return bank;
+}
+
+} // namespace sound_sys
@@ -0,0 +1,17 @@
+#ifndef _5D93A0E7_21C8_4B6F_A7E4_0C6B18F2D359
+#define _5D93A0E7_21C8_4B6F_A7E4_0C6B18F2D359
+
+#include "opm_patch.h"
+#include <vector>
+
+namespace sound_sys
+{
+
+// GM の 128 音色を FM の音色にしたもの
+// 8 音色ずつの系統 (ピアノ、オルガン…) ごとに 1 つの音色を割り当てる
+// number には GM の音色番号が入る
+std::vector<OPMPatch> makeGMBank();
+
+} // namespace sound_sys
+
+#endif /* _5D93A0E7_21C8_4B6F_A7E4_0C6B18F2D359 */
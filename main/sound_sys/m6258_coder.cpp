@@ -35,8 +35,9 @@ namespace sound_sys
         M6258_TBL_VAL(12, i), M6258_TBL_VAL(13, i), M6258_TBL_VAL(14, i),      \
         M6258_TBL_VAL(15, i)
 
+// 次の index は表を引きやすいように 16 倍しておく
 #define M6258_TBL_VAL(x, i)                                                    \
-    (((uint16_t)(M6258_GET_DELTA(x, i)) << 16) | (M6258_GET_NEXTI(x, i)))
+    (((uint16_t)(M6258_GET_DELTA(x, i)) << 16) | (M6258_GET_NEXTI(x, i) << 4))
 
 #define M6258_GET_DELTA(x, i)                                                  \
     M6258_ADJ_SIGN(x, M6258_GET_PRED_VEC(i) * M6258_GET_SCALE(x) >> 3)
@@ -173,6 +174,23 @@ getPredictVector(int i)
     return predictTable_[i];
 }
 
+// 差分を 3bit + 符号に量子化する
+// sp > 4p, 2p, p と順に比べて引いていくのを分岐無しで
+inline int
+quantize(int diff, int predict)
+{
+    int sign = diff >> 31; // 0 or -1
+    int sp   = ((diff ^ sign) - sign) << 2;
+
+    int b2 = sp > (predict << 2);
+    sp -= (predict << 2) & -b2;
+    int b1 = sp > (predict << 1);
+    sp -= (predict << 1) & -b1;
+    int b0 = sp > predict;
+
+    return (sign & 8) | (b2 << 2) | (b1 << 1) | b0;
+}
+
 } /* namespace */
 
 int
@@ -194,7 +212,7 @@ M6258Coder::update(int x)
 #else
     int32_t v = updateTable_[x | (predictIdx_ << 4)];
     currentValue_ += v >> 16;
-    predictIdx_ = v & 65535;
+    predictIdx_ = (v & 65535) >> 4;
 #endif
 
     return currentValue_;
@@ -203,33 +221,75 @@ M6258Coder::update(int x)
 int
 M6258Coder::encodeSample(int v)
 {
-    int predict = getPredictVector(predictIdx_);
-    int diff    = v - currentValue_;
-    bool sign   = diff < 0;
-    int d       = sign ? -diff : diff;
+    int x = quantize(v - currentValue_, getPredictVector(predictIdx_));
+    update(x);
+    return x;
+}
 
-    int sp = d << 2;
-    int p4 = predict << 2;
-    int p2 = predict << 1;
+bool
+M6258Coder::decodeBlock(int16_t* dst, const uint8_t* src, size_t srcSize)
+{
+    // 状態はローカルに持って回す。idx は 16 倍したまま
+    int v   = currentValue_;
+    int idx = predictIdx_ << 4;
 
-    int x = sign ? 8 : 0;
-    if (sp > p4)
-    {
-        x += 4;
-        sp -= p4;
-    }
-    if (sp > p2)
+    // int16_t からはみ出すと 0 でなくなる
+    uint32_t over = 0;
+
+    while (srcSize--)
     {
-        x += 2;
-        sp -= p2;
+        int x = *src++;
+
+        int32_t t0 = updateTable_[idx | (x & 15)];
+        v += t0 >> 16;
+        idx    = t0 & 65535;
+        dst[0] = v;
+        over |= (uint32_t)(v + 32768) >> 16;
+
+        int32_t t1 = updateTable_[idx | (x >> 4)];
+        v += t1 >> 16;
+        idx    = t1 & 65535;
+        dst[1] = v;
+        over |= (uint32_t)(v + 32768) >> 16;
+
+        dst += 2;
     }
-    if (sp > predict)
+
+    currentValue_ = v;
+    predictIdx_   = idx >> 4;
+    return !over;
+}
+
+void
+M6258Coder::encodeBlock(uint8_t* dst,
+                        const int16_t* src,
+                        size_t srcCount,
+                        int shift)
+{
+    int v   = currentValue_;
+    int idx = predictIdx_ << 4;
+
+    auto encode = [&](int s) {
+        s     = std::min(2047, std::max(-2048, s >> shift));
+        int x = quantize(s - v, predictTable_[idx >> 4]);
+
+        int32_t t = updateTable_[idx | x];
+        v += t >> 16;
+        idx = t & 65535;
+        return x;
+    };
+
+    while (srcCount >= 2)
     {
-        x += 1;
+        int x0 = encode(src[0]);
+        int x1 = encode(src[1]);
+        *dst++ = x0 | (x1 << 4);
+        src += 2;
+        srcCount -= 2;
     }
 
-    update(x);
-    return x;
+    currentValue_ = v;
+    predictIdx_   = idx >> 4;
 }
 
 } // namespace sound_sys
@@ -6,6 +6,7 @@
 #define _52A47F05_4134_13F8_245B_5E8991F9011E
 
 #include <algorithm>
+#include <stddef.h>
 #include <stdint.h>
 
 namespace sound_sys
@@ -76,6 +77,16 @@ public:
 
     int update(int x);
     int encodeSample(int v);
+
+    // まとめて処理する版
+    // update() の結果をそのまま書く。int16_t に収まらないものがあれば false
+    bool decodeBlock(int16_t* dst, const uint8_t* src, size_t srcSize);
+
+    // src >> shift を 12bit に丸めて符号化する。srcCount は偶数
+    void encodeBlock(uint8_t* dst,
+                     const int16_t* src,
+                     size_t srcCount,
+                     int shift = 0);
 };
 
 } // namespace sound_sys
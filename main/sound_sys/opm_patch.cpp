@@ -0,0 +1,67 @@
+#include "opm_patch.h"
+#include <algorithm>
+#include <string.h>
+
+namespace sound_sys
+{
+
+const OPMPatch&
+OPMPatch::getDefault()
+{
+    // 音色が読めなかった時用の EP っぽいもの (CON4)
+    static constexpr OPMPatch patch = {
+        0,
+        (5 << 3) | 4,
+        15,
+        {0x01, 0x0e, 0x01, 0x01},
+        {30, 40, 0, 8},
+        {0x5f, 0x5f, 0x5f, 0x5f},
+        {8, 12, 6, 10},
+        {0, 0, 2, 2},
+        {0x27, 0x37, 0x1a, 0x1a},
+    };
+    return patch;
+}
+
+bool
+loadMDXVoices(std::vector<OPMPatch>& bank, const uint8_t* mdx, size_t size)
+{
+    bank.clear();
+
+    // タイトル (0x0d 0x0a 0x1a まで) と PDX 名 (0 まで) の後ろが本体
+    auto end   = mdx + size;
+    auto title = std::find(mdx, end, 0x1a);
+    if (title == end)
+    {
+        return false;
+    }
+    auto top = std::find(title + 1, end, 0);
+    if (top == end)
+    {
+        return false;
+    }
+    ++top;
+
+    if (end - top < 2)
+    {
+        return false;
+    }
+    size_t voiceOfs = (top[0] << 8) | top[1];
+    if (voiceOfs >= size_t(end - top))
+    {
+        return false;
+    }
+
+    // 音色データは最後まで続く
+    auto p = top + voiceOfs;
+    while (end - p >= (int)sizeof(OPMPatch))
+    {
+        OPMPatch patch;
+        memcpy(&patch, p, sizeof(patch));
+        bank.push_back(patch);
+        p += sizeof(OPMPatch);
+    }
+    return !bank.empty();
+}
+
+} // namespace sound_sys
@@ -0,0 +1,44 @@
+#ifndef _3A9E2C71_58D4_4B0F_9E17_C26F0B84D5A3
+#define _3A9E2C71_58D4_4B0F_9E17_C26F0B84D5A3
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace sound_sys
+{
+
+// MDX の音色データと同じ並び (27 bytes)
+// オペレータはレジスタ順 (M1, M2, C1, C2)
+struct OPMPatch
+{
+    uint8_t number;
+    uint8_t flCon; // FL(5-3) CON(2-0)
+    uint8_t slotMask;
+    uint8_t dt1Mul[4];
+    uint8_t tl[4];
+    uint8_t ksAr[4];
+    uint8_t ameD1r[4];
+    uint8_t dt2D2r[4];
+    uint8_t d1lRr[4];
+
+    int getConnection() const { return flCon & 7; }
+
+    // キャリアになるオペレータ (bit0 = M1)
+    int getCarrierMask() const
+    {
+        static constexpr uint8_t tbl[] = {8, 8, 8, 8, 12, 14, 14, 15};
+        return tbl[getConnection()];
+    }
+
+    static const OPMPatch& getDefault();
+};
+
+static_assert(sizeof(OPMPatch) == 27, "OPMPatch must match MDX voice data");
+
+// MDX の中の音色を全部取り出す
+bool loadMDXVoices(std::vector<OPMPatch>& bank, const uint8_t* mdx, size_t size);
+
+} // namespace sound_sys
+
+#endif /* _3A9E2C71_58D4_4B0F_9E17_C26F0B84D5A3 */
@@ -0,0 +1,123 @@
+#include "opm_voice_allocator.h"
+#include "ym2151.h"
+#include <algorithm>
+
+namespace sound_sys
+{
+
+namespace
+{
+
+// OCT の中は C# から始まって 4 つおきに欠番がある
+constexpr uint8_t noteCode_[12] = {0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14};
+
+// OCT=4 の C# (KC 0x40) が MIDI の 61
+constexpr int KC_BASE_NOTE = 61;
+
+} // namespace
+
+void
+OPMVoiceAllocator::resetChip()
+{
+    for (int i = 0; i < VOICE_COUNT; ++i)
+    {
+        write(0x08, i);
+    }
+
+    // LFO とノイズは使わない
+    write(0x01, 2);
+    write(0x01, 0);
+    write(0x0f, 0);
+    write(0x18, 0);
+    write(0x19, 0);
+    write(0x19, 0x80);
+    write(0x1b, 0);
+}
+
+void
+OPMVoiceAllocator::writeKeyOn(int vi, int slotMask)
+{
+    write(0x08, (slotMask << 3) | vi);
+}
+
+void
+OPMVoiceAllocator::writeKeyOff(int vi)
+{
+    write(0x08, vi);
+}
+
+void
+OPMVoiceAllocator::writePatch(int vi, const OPMPatch& p, int pan)
+{
+    write(0x20 + vi, getRLBits(pan) | (p.flCon & 0x3f));
+    write(0x38 + vi, 0);
+
+    int carrier = p.getCarrierMask();
+    for (int op = 0; op < 4; ++op)
+    {
+        int r = vi + op * 8;
+        write(0x40 + r, p.dt1Mul[op]);
+        if (!(carrier & (1 << op)))
+        {
+            write(0x60 + r, p.tl[op]);
+        }
+        write(0x80 + r, p.ksAr[op]);
+        write(0xa0 + r, p.ameD1r[op]);
+        write(0xc0 + r, p.dt2D2r[op]);
+        write(0xe0 + r, p.d1lRr[op]);
+    }
+}
+
+void
+OPMVoiceAllocator::writePan(int vi, const OPMPatch& p, int pan)
+{
+    write(0x20 + vi, getRLBits(pan) | (p.flCon & 0x3f));
+}
+
+void
+OPMVoiceAllocator::writeTL(int vi, int op, int tl)
+{
+    write(0x60 + vi + op * 8, tl);
+}
+
+void
+OPMVoiceAllocator::writePitch(int vi, int pitch)
+{
+    pitch += (4 * 12 - KC_BASE_NOTE) * 64;
+    pitch = std::max(0, std::min(8 * 12 * 64 - 1, pitch));
+
+    int semi = pitch >> 6;
+    int oct  = semi / 12;
+    int kc   = (oct << 4) | noteCode_[semi % 12];
+    write(0x28 + vi, kc);
+    write(0x30 + vi, (pitch & 63) << 2);
+}
+
+void
+OPMVoiceAllocator::setInstrumentNumber(int vi, int n)
+{
+    if (sys_)
+    {
+        sys_->setInstrumentNumber(vi, n);
+    }
+}
+
+void
+OPMVoiceAllocator::write(int reg, int v)
+{
+    countWrite();
+    if (sys_)
+    {
+        sys_->setValue(0, reg);
+        sys_->setValue(1, v);
+    }
+}
+
+int
+OPMVoiceAllocator::getRLBits(int pan)
+{
+    // bit6 = L, bit7 = R
+    return (pan & PAN_L ? 0x40 : 0) | (pan & PAN_R ? 0x80 : 0);
+}
+
+} // namespace sound_sys
@@ -0,0 +1,44 @@
+#ifndef _C84E1F06_2D9B_4A73_B5E0_7F13A96D28C4
+#define _C84E1F06_2D9B_4A73_B5E0_7F13A96D28C4
+
+#include "fm_voice_allocator.h"
+
+namespace sound_sys
+{
+
+class YM2151;
+
+// MIDI のノートを YM2151 の 8ch に割り当てる
+class OPMVoiceAllocator final : public FMVoiceAllocator
+{
+public:
+    static constexpr int VOICE_COUNT = 8;
+
+public:
+    OPMVoiceAllocator()
+        : FMVoiceAllocator(VOICE_COUNT)
+    {
+    }
+
+    void setSystem(YM2151* sys) { sys_ = sys; }
+
+protected:
+    void resetChip() override;
+    void writeKeyOn(int v, int slotMask) override;
+    void writeKeyOff(int v) override;
+    void writePatch(int v, const OPMPatch& p, int pan) override;
+    void writePan(int v, const OPMPatch& p, int pan) override;
+    void writeTL(int v, int op, int tl) override;
+    void writePitch(int v, int pitch) override;
+    void setInstrumentNumber(int v, int n) override;
+
+    void write(int reg, int v);
+    static int getRLBits(int pan);
+
+private:
+    YM2151* sys_{};
+};
+
+} // namespace sound_sys
+
+#endif /* _C84E1F06_2D9B_4A73_B5E0_7F13A96D28C4 */
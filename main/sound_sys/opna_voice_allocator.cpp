@@ -0,0 +1,187 @@
+#include "opna_voice_allocator.h"
+#include "ymf288.h"
+#include <algorithm>
+#include <math.h>
+
+namespace sound_sys
+{
+
+namespace
+{
+
+// BLOCK 4 の C が MIDI の 60
+constexpr int BLOCK4_BASE_NOTE = 60;
+
+// GM のドラム (35-59) をリズム音源のどれで鳴らすか
+// 0:BD 1:SD 2:TOP 3:HH 4:TOM 5:RIM, -1 は鳴らさない
+constexpr int GM_DRUM_BASE = 35;
+constexpr int8_t gmDrumMap_[] = {
+    0, 0, 5, 1, 1, 1, 4, 3, 4, 3, 4, 3, 4, // 35-47
+    4, 2, 4, 2, 2, 2, 3, 2, 5, 2, -1, 2,   // 48-59
+};
+
+} // namespace
+
+OPNAVoiceAllocator::OPNAVoiceAllocator()
+    : FMVoiceAllocator(VOICE_COUNT)
+{
+    setClock(DEFAULT_CLOCK);
+}
+
+void
+OPNAVoiceAllocator::setClock(int clock)
+{
+    // fnum = 144 * f * 2^(21 - BLOCK) / clock
+    for (int i = 0; i < 12 * 64; ++i)
+    {
+        double note   = BLOCK4_BASE_NOTE + i / 64.0;
+        double f      = 440.0 * pow(2.0, (note - 69) / 12);
+        fnumTable_[i] = uint16_t(144 * f * (1 << 17) / clock + 0.5);
+    }
+}
+
+void
+OPNAVoiceAllocator::resetChip()
+{
+    for (int i = 0; i < VOICE_COUNT; ++i)
+    {
+        write(0, 0x28, (i / 3) << 2 | (i % 3));
+    }
+
+    // LFO と 3ch の効果音モードは使わない。SSG は鳴らさない
+    write(0, 0x22, 0);
+    write(0, 0x27, 0);
+    write(0, 0x29, 0x80);
+    write(0, 0x07, 0x3f);
+    for (int i = 0; i < 3; ++i)
+    {
+        write(0, 0x08 + i, 0);
+    }
+
+    write(0, 0x10, 0x80 | 0x3f);
+    write(0, 0x11, 0x3f);
+    for (int i = 0; i < 6; ++i)
+    {
+        write(0, 0x18 + i, 0xc0 | 31);
+    }
+}
+
+void
+OPNAVoiceAllocator::writeKeyOn(int vi, int slotMask)
+{
+    write(0, 0x28, (slotMask << 4) | (vi / 3) << 2 | (vi % 3));
+}
+
+void
+OPNAVoiceAllocator::writeKeyOff(int vi)
+{
+    write(0, 0x28, (vi / 3) << 2 | (vi % 3));
+}
+
+void
+OPNAVoiceAllocator::writePatch(int vi, const OPMPatch& p, int pan)
+{
+    writeVoice(vi, 0xb0, 0, p.flCon & 0x3f);
+    writeVoice(vi, 0xb4, 0, getLRBits(pan));
+
+    // オペレータの並びは OPM と同じ。DT2 は無い
+    int carrier = p.getCarrierMask();
+    for (int op = 0; op < 4; ++op)
+    {
+        int ofs = op * 4;
+        writeVoice(vi, 0x30, ofs, p.dt1Mul[op] & 0x7f);
+        if (!(carrier & (1 << op)))
+        {
+            writeVoice(vi, 0x40, ofs, p.tl[op]);
+        }
+        writeVoice(vi, 0x50, ofs, p.ksAr[op]);
+        writeVoice(vi, 0x60, ofs, p.ameD1r[op]);
+        writeVoice(vi, 0x70, ofs, p.dt2D2r[op] & 0x1f);
+        writeVoice(vi, 0x80, ofs, p.d1lRr[op]);
+        writeVoice(vi, 0x90, ofs, 0);
+    }
+}
+
+void
+OPNAVoiceAllocator::writePan(int vi, const OPMPatch&, int pan)
+{
+    writeVoice(vi, 0xb4, 0, getLRBits(pan));
+}
+
+void
+OPNAVoiceAllocator::writeTL(int vi, int op, int tl)
+{
+    writeVoice(vi, 0x40, op * 4, tl);
+}
+
+void
+OPNAVoiceAllocator::writePitch(int vi, int pitch)
+{
+    // BLOCK が変わっても F-Number は同じ
+    constexpr int OCT = 12 * 64;
+    int ofs   = pitch - (BLOCK4_BASE_NOTE - 12 * 4) * 64;
+    int block = ofs >= 0 ? ofs / OCT : -((OCT - 1 - ofs) / OCT);
+    int fnum  = fnumTable_[ofs - block * OCT];
+    if (block < 0)
+    {
+        fnum >>= -block;
+        block = 0;
+    }
+    else if (block > 7)
+    {
+        fnum  = std::min(2047, fnum << (block - 7));
+        block = 7;
+    }
+
+    writeVoice(vi, 0xa4, 0, (block << 3) | (fnum >> 8));
+    writeVoice(vi, 0xa0, 0, fnum & 0xff);
+}
+
+void
+OPNAVoiceAllocator::setInstrumentNumber(int vi, int n)
+{
+    if (sys_)
+    {
+        sys_->setInstrumentNumber(vi, n);
+    }
+}
+
+void
+OPNAVoiceAllocator::drumNoteOn(int note, int vel)
+{
+    int i = note - GM_DRUM_BASE;
+    if (i < 0 || i >= (int)sizeof(gmDrumMap_) || gmDrumMap_[i] < 0)
+    {
+        return;
+    }
+
+    int inst = gmDrumMap_[i];
+    write(0, 0x18 + inst, 0xc0 | (vel >> 2));
+    write(0, 0x10, 1 << inst);
+}
+
+void
+OPNAVoiceAllocator::write(int port, int reg, int v)
+{
+    countWrite();
+    if (sys_)
+    {
+        sys_->setValue(port * 2, reg);
+        sys_->setValue(port * 2 + 1, v);
+    }
+}
+
+void
+OPNAVoiceAllocator::writeVoice(int vi, int reg, int opOfs, int v)
+{
+    write(vi / 3, reg + opOfs + vi % 3, v);
+}
+
+int
+OPNAVoiceAllocator::getLRBits(int pan)
+{
+    // bit7 = L, bit6 = R
+    return (pan & PAN_L ? 0x80 : 0) | (pan & PAN_R ? 0x40 : 0);
+}
+
+} // namespace sound_sys
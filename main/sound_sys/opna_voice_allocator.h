@@ -0,0 +1,51 @@
+#ifndef _E4A2D913_6C0B_47F8_A153_9B2F7D08C6E1
+#define _E4A2D913_6C0B_47F8_A153_9B2F7D08C6E1
+
+#include "fm_voice_allocator.h"
+
+namespace sound_sys
+{
+
+class YMF288;
+
+// MIDI のノートを YMF288 の FM 6ch に割り当てる
+// ドラムチャンネルはリズム音源で鳴らす
+class OPNAVoiceAllocator final : public FMVoiceAllocator
+{
+public:
+    static constexpr int VOICE_COUNT   = 6;
+    static constexpr int DEFAULT_CLOCK = 7987200;
+
+public:
+    OPNAVoiceAllocator();
+
+    void setSystem(YMF288* sys) { sys_ = sys; }
+
+    // F-Number の計算に使う
+    void setClock(int clock);
+
+protected:
+    void resetChip() override;
+    void writeKeyOn(int v, int slotMask) override;
+    void writeKeyOff(int v) override;
+    void writePatch(int v, const OPMPatch& p, int pan) override;
+    void writePan(int v, const OPMPatch& p, int pan) override;
+    void writeTL(int v, int op, int tl) override;
+    void writePitch(int v, int pitch) override;
+    void setInstrumentNumber(int v, int n) override;
+    void drumNoteOn(int note, int vel) override;
+
+    void write(int port, int reg, int v);
+    void writeVoice(int vi, int reg, int opOfs, int v);
+    static int getLRBits(int pan);
+
+private:
+    YMF288* sys_{};
+
+    // C から 1 オクターブ分の 1/64 半音ごとの F-Number (BLOCK 4)
+    uint16_t fnumTable_[12 * 64];
+};
+
+} // namespace sound_sys
+
+#endif /* _E4A2D913_6C0B_47F8_A153_9B2F7D08C6E1 */
@@ -69,7 +69,17 @@ SWPCM8::setChRate(int ch, float r)
 void
 SWPCM8::play(int ch, const void* addr, int len, Type type)
 {
-    auto& v      = voices_[ch];
+    auto& v = voices_[ch];
+    if (type == TYPE_ADPCM)
+    {
+        auto bank = adpcmBank_.load();
+        if (auto pcm = bank ? bank->find(addr, len) : nullptr)
+        {
+            type = TYPE_DECODED_ADPCM;
+            addr = pcm;
+        }
+    }
+
     v.nextType   = type;
     v.nextPosEnd = len;
     v.nextSample.store(static_cast<const uint8_t*>(addr),
@@ -145,6 +155,9 @@ SWPCM8::accumSamples(std::array<int32_t, 2>* buffer, uint32_t samples)
         auto pos    = v.pos;
         auto posEnd = v.posEnd;
         auto sample = v.sample;
+        auto pcm    = v.type == TYPE_DECODED_ADPCM
+                          ? reinterpret_cast<const int16_t*>(sample)
+                          : nullptr;
         auto pan    = panShare_ ? pan_ : v.pan;
         auto vol    = v.volume * volume_;
         auto volL   = pan & 1 ? vol : 0;
@@ -181,9 +194,16 @@ SWPCM8::accumSamples(std::array<int32_t, 2>* buffer, uint32_t samples)
                     ct      = 1;
                     break;
                 }
-                int data = sample[spos];
-                int smp  = pos & 1 ? data >> 4 : data & 15;
-                val      = v.coder.update(smp);
+                if (pcm)
+                {
+                    val = pcm[pos];
+                }
+                else
+                {
+                    int data = sample[spos];
+                    int smp  = pos & 1 ? data >> 4 : data & 15;
+                    val      = v.coder.update(smp);
+                }
             }
 
             int32_t dd = val - prev;
@@ -194,6 +214,8 @@ SWPCM8::accumSamples(std::array<int32_t, 2>* buffer, uint32_t samples)
             ++buf;
         } while (--ct);
 
+        (pcm ? stats_.decodedNibbles : stats_.adpcmNibbles) += pos - v.pos;
+
         v.pos  = pos;
         v.frac = frac;
         v.prev = prev;
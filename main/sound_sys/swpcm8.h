@@ -5,6 +5,7 @@
 #ifndef _VGM_SWPCM8_HF82945CEC14C4D56A63177C905481210
 #define _VGM_SWPCM8_HF82945CEC14C4D56A63177C905481210
 
+#include "adpcm_bank.h"
 #include "m6258_coder.h"
 #include "sound_system.h"
 #include <atomic>
@@ -22,6 +23,7 @@ public:
         TYPE_ADPCM,
         TYPE_PCM16,
         TYPE_PCM8,
+        TYPE_DECODED_ADPCM, // ADPCMBank で展開済み
     };
 
     enum Mode
@@ -45,6 +47,12 @@ public:
 
     using FinishTransferFunc = void (*)();
 
+    struct Stats
+    {
+        uint32_t adpcmNibbles;   // 再生時に decode したもの
+        uint32_t decodedNibbles; // 展開済みのものを使ったもの
+    };
+
 private:
     static constexpr int MAX_VOICE = 8;
 
@@ -95,6 +103,9 @@ private:
     //    FinishTransferFunc finishTransferFunc_{};
     SystemInfo sysInfo_;
 
+    std::atomic<const ADPCMBank*> adpcmBank_{};
+    Stats stats_{};
+
 public:
     SWPCM8() { initialize(); }
     void initialize();
@@ -142,6 +153,12 @@ public:
     void stop() { stop(0); }
     void setSampleRate6258(int r);
 
+    // play() する ADPCM が bank にあれば展開済みのものを使う
+    void setADPCMBank(const ADPCMBank* bank) { adpcmBank_ = bank; }
+
+    const Stats& getStats() const { return stats_; }
+    void resetStats() { stats_ = {}; }
+
 protected:
     void updateDelta();
 };
@@ -0,0 +1,141 @@
+#include "alloc_trap.h"
+#include "../debug.h"
+#include <atomic>
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <rom/ets_sys.h>
+#include <stdlib.h>
+
+#define ENABLE_ALLOC_TRAP 0
+
+namespace sys
+{
+
+namespace
+{
+constexpr int MAX_REALTIME_TASKS = 4;
+
+std::atomic<TaskHandle_t> realtimeTasks_[MAX_REALTIME_TASKS];
+std::atomic<int> realtimeTaskCount_{0};
+
+std::atomic<uint32_t> allocCount_{0};
+std::atomic<uint32_t> allocBytes_{0};
+
+#if ENABLE_ALLOC_TRAP
+bool
+isRealtimeTask()
+{
+    // スケジューラ起動前の静的初期化からも呼ばれる
+    if (xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED)
+    {
+        return false;
+    }
+    auto cur = xTaskGetCurrentTaskHandle();
+    int n    = realtimeTaskCount_;
+    for (int i = 0; i < n; ++i)
+    {
+        if (realtimeTasks_[i] == cur)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+#endif
+
+void*
+countedAlloc(size_t size)
+{
+#if ENABLE_ALLOC_TRAP
+    if (isRealtimeTask())
+    {
+        // printf は確保するかもしれないので ROM の方で
+        ets_printf("heap allocation (%d bytes) on realtime task '%s'\n",
+                   (int)size,
+                   pcTaskGetTaskName(nullptr));
+        abort();
+    }
+#endif
+    allocCount_.fetch_add(1, std::memory_order_relaxed);
+    allocBytes_.fetch_add(size, std::memory_order_relaxed);
+
+    auto p = malloc(size ? size : 1);
+    if (!p)
+    {
+        abort();
+    }
+    return p;
+}
+
+} // namespace
+
+void
+registerRealtimeTask()
+{
+    int i = realtimeTaskCount_;
+    if (i < MAX_REALTIME_TASKS)
+    {
+        realtimeTasks_[i]  = xTaskGetCurrentTaskHandle();
+        realtimeTaskCount_ = i + 1;
+    }
+}
+
+AllocCount
+getAllocCount()
+{
+    return {allocCount_, allocBytes_};
+}
+
+void
+reportAllocations(const char* label, const AllocCount& since)
+{
+    auto cur = getAllocCount();
+    DBOUT(("%s: %d operator new (%d bytes), heap free %d largest %d, "
+           "internal free %d largest %d\n",
+           label,
+           (int)(cur.count - since.count),
+           (int)(cur.bytes - since.bytes),
+           (int)heap_caps_get_free_size(MALLOC_CAP_8BIT),
+           (int)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT),
+           (int)heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+           (int)heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL)));
+}
+
+} // namespace sys
+
+void*
+operator new(size_t size)
+{
+    return sys::countedAlloc(size);
+}
+
+void*
+operator new[](size_t size)
+{
+    return sys::countedAlloc(size);
+}
+
+void
+operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void
+operator delete[](void* p) noexcept
+{
+    free(p);
+}
+
+void
+operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+void
+operator delete[](void* p, size_t) noexcept
+{
+    free(p);
+}
@@ -0,0 +1,33 @@
+#ifndef _A8E25C91_0F4D_4B7A_8E36_1D9C5B7F2A04
+#define _A8E25C91_0F4D_4B7A_8E36_1D9C5B7F2A04
+
+#include <stdint.h>
+
+namespace sys
+{
+
+// operator new を横取りして回数と大きさを数える (いつも)
+// ENABLE_ALLOC_TRAP (alloc_trap.cpp) が有効な時は、登録したタスク上の
+// 確保で abort する
+// 数えるのは operator new だけで、malloc() や heap_caps_malloc() を直に
+// 呼ぶもの (ESP-IDF やドライバの大半) は見えない
+
+// 呼び出したタスクを実時間タスクとして登録する
+void registerRealtimeTask();
+
+struct AllocCount
+{
+    uint32_t count;
+    uint32_t bytes;
+};
+
+// 起動してからの operator new の回数と大きさ
+AllocCount getAllocCount();
+
+// since からの operator new の回数とヒープの空き (断片化の目安) を
+// 出力する
+void reportAllocations(const char* label, const AllocCount& since);
+
+} // namespace sys
+
+#endif /* _A8E25C91_0F4D_4B7A_8E36_1D9C5B7F2A04 */
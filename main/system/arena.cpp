@@ -0,0 +1,125 @@
+#include "arena.h"
+#include "../debug.h"
+#include <algorithm>
+#include <esp_heap_caps.h>
+
+namespace sys
+{
+
+bool
+Arena::initialize(size_t size)
+{
+    release();
+
+    // 大きいので PSRAM に置く。無ければ内部 RAM から
+    top_ = static_cast<uint8_t*>(
+        heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT));
+    if (!top_)
+    {
+        top_ = static_cast<uint8_t*>(heap_caps_malloc(size, MALLOC_CAP_8BIT));
+    }
+    if (!top_)
+    {
+        DBOUT(("Arena: allocate %d bytes failed.\n", (int)size));
+        return false;
+    }
+
+    capacity_ = size;
+    reset();
+    return true;
+}
+
+void
+Arena::release()
+{
+    heap_caps_free(top_);
+    top_      = nullptr;
+    capacity_ = 0;
+    reset();
+}
+
+void*
+Arena::allocate(size_t size, size_t align)
+{
+    size_t pos = (front_ + align - 1) & ~(align - 1);
+    if (pos + size + back_ > capacity_)
+    {
+        return allocateOverflow(size, align);
+    }
+    front_ = pos + size;
+    updatePeak();
+    return top_ + pos;
+}
+
+void*
+Arena::allocateBack(size_t size, size_t align)
+{
+    // 後ろから詰めるので先頭を align に合わせる
+    if (size > capacity_ - front_ - back_)
+    {
+        DBOUT(("Arena: out of memory. %d bytes requested, %d/%d used.\n",
+               (int)size,
+               (int)getUsed(),
+               (int)capacity_));
+        return nullptr;
+    }
+    size_t pos = (capacity_ - back_ - size) & ~(align - 1);
+    if (pos < front_)
+    {
+        return nullptr;
+    }
+    back_ = capacity_ - pos;
+    updatePeak();
+    return top_ + pos;
+}
+
+void
+Arena::resetFront()
+{
+    front_ = 0;
+    for (int i = 0; i < overflowCount_; ++i)
+    {
+        heap_caps_free(overflows_[i]);
+        overflows_[i] = nullptr;
+    }
+    overflowCount_ = 0;
+    overflowBytes_ = 0;
+}
+
+// 領域に入らないものはヒープから取る。align に揃えるため少し余分に取る
+// (PSRAM の無いボードではこちらだけになる)
+void*
+Arena::allocateOverflow(size_t size, size_t align)
+{
+    DBOUT(("Arena: %d bytes requested, %d/%d used. use heap.\n",
+           (int)size,
+           (int)getUsed(),
+           (int)capacity_));
+    if (overflowCount_ == MAX_OVERFLOWS)
+    {
+        return nullptr;
+    }
+    size_t n = size + align - 1;
+    void* p  = heap_caps_malloc(n, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!p)
+    {
+        p = heap_caps_malloc(n, MALLOC_CAP_8BIT);
+    }
+    if (!p)
+    {
+        DBOUT(("Arena: heap allocate %d bytes failed.\n", (int)size));
+        return nullptr;
+    }
+    overflows_[overflowCount_++] = p;
+    overflowBytes_ += n;
+    auto addr = (reinterpret_cast<uintptr_t>(p) + align - 1) & ~(align - 1);
+    return reinterpret_cast<void*>(addr);
+}
+
+void
+Arena::updatePeak()
+{
+    peak_ = std::max(peak_, getUsed());
+}
+
+} // namespace sys
@@ -0,0 +1,72 @@
+#ifndef _3D0F7A2E_6B1C_4E8D_9A52_C7E41B0D5F36
+#define _3D0F7A2E_6B1C_4E8D_9A52_C7E41B0D5F36
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace sys
+{
+
+// 固定の領域から切り出すだけのアロケータ
+// 個別の解放はなく、reset でまとめて捨てる
+// 前からは曲ごとのデータ、後ろからは曲をまたいで使い回すデータを取る
+//
+// 前から取るものは、領域に収まらなければ (領域が無くても) ヒープから取り
+// resetFront() で返す
+class Arena
+{
+    static constexpr int MAX_OVERFLOWS = 4;
+
+    uint8_t* top_{};
+    size_t capacity_ = 0;
+    size_t front_    = 0; // 前から使った量
+    size_t back_     = 0; // 後ろから使った量
+    size_t peak_     = 0;
+
+    void* overflows_[MAX_OVERFLOWS]{}; // ヒープから取ったもの
+    int overflowCount_    = 0;
+    size_t overflowBytes_ = 0;
+
+public:
+    Arena() = default;
+    ~Arena() { release(); }
+
+    bool initialize(size_t size);
+    void release();
+    bool isInitialized() const { return top_; }
+
+    // 足りなければヒープから。それも無理なら nullptr
+    void* allocate(size_t size, size_t align = 4);
+    // 足りなければ nullptr
+    void* allocateBack(size_t size, size_t align = 4);
+
+    template <class T>
+    T* allocateArray(size_t n)
+    {
+        return static_cast<T*>(allocate(sizeof(T) * n, alignof(T)));
+    }
+
+    void resetFront();
+    void resetBack() { back_ = 0; }
+    void reset()
+    {
+        resetFront();
+        resetBack();
+    }
+
+    size_t getCapacity() const { return capacity_; }
+    size_t getUsed() const { return front_ + back_; }
+    size_t getPeak() const { return peak_; }
+    size_t getOverflowBytes() const { return overflowBytes_; }
+
+private:
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void updatePeak();
+    void* allocateOverflow(size_t size, size_t align);
+};
+
+} // namespace sys
+
+#endif /* _3D0F7A2E_6B1C_4E8D_9A52_C7E41B0D5F36 */
@@ -4,38 +4,147 @@
  */
 
 #include "job_manager.h"
+#include "util.h"
+#include <algorithm>
 #include <assert.h>
 #include <debug.h>
 #include <mutex>
+#include <stdio.h>
 
 namespace sys
 {
 
 namespace
 {
-constexpr int EVENT_ADD_JOB = 1 << 0;
-constexpr int EVENT_EXIT    = 1 << 1;
-constexpr int EVENT_IDLE    = 1 << 2;
+constexpr int EVENT_EXIT = 1 << 1;
+constexpr int EVENT_IDLE = 1 << 2;
+
+constexpr int EVENT_GROUP_DONE = 1 << 0;
+
+// セマフォのカウント = 積まれているジョブ数 (上限は実質なし)
+constexpr UBaseType_t MAX_PENDING_JOBS = 0x7fffffff;
 } // namespace
 
+JobGroup::JobGroup()
+{
+    eventGroupHandle_ = xEventGroupCreate();
+    assert(eventGroupHandle_);
+    xEventGroupSetBits(eventGroupHandle_, EVENT_GROUP_DONE);
+}
+
+JobGroup::~JobGroup()
+{
+    assert(pending_ == 0);
+    vEventGroupDelete(eventGroupHandle_);
+}
+
+void
+JobGroup::addRef()
+{
+    std::lock_guard<sys::Mutex> lock(mutex_);
+    if (pending_++ == 0)
+    {
+        xEventGroupClearBits(eventGroupHandle_, EVENT_GROUP_DONE);
+    }
+}
+
+void
+JobGroup::release()
+{
+    std::lock_guard<sys::Mutex> lock(mutex_);
+    if (--pending_ == 0)
+    {
+        cancelReq_ = false;
+        xEventGroupSetBits(eventGroupHandle_, EVENT_GROUP_DONE);
+    }
+}
+
+void
+JobGroup::cancel()
+{
+    // 何も無ければ解除する機会が無いので立てない
+    std::lock_guard<sys::Mutex> lock(mutex_);
+    if (pending_)
+    {
+        cancelReq_ = true;
+    }
+}
+
+void
+JobGroup::wait()
+{
+    xEventGroupWaitBits(eventGroupHandle_,
+                        EVENT_GROUP_DONE,
+                        pdFALSE /* clear */,
+                        pdFALSE /* wait for all bit */,
+                        portMAX_DELAY);
+
+    // release() がロックを抜けるまで待つ
+    // 戻った直後に JobGroup が破棄されてもいいように
+    std::lock_guard<sys::Mutex> lock(mutex_);
+}
+
+void
+JobGroup::cancelAndWait()
+{
+    cancel();
+    wait();
+}
+
+////
+
 JobManager::~JobManager()
 {
     stop();
 }
 
 void
-JobManager::start(int prio, size_t stackSize, const char* name)
+JobManager::start(int prio,
+                  size_t stackSize,
+                  const char* name,
+                  int workerCount,
+                  int lowWorkerCount)
 {
     if (started_)
     {
         return;
     }
 
-    eventGroupHandle_ = xEventGroupCreate();
-    assert(eventGroupHandle_);
+    if (!eventGroupHandle_)
+    {
+        eventGroupHandle_ = xEventGroupCreate();
+        assert(eventGroupHandle_);
+        xEventGroupSetBits(eventGroupHandle_, EVENT_IDLE);
+    }
 
-    auto r = xTaskCreate(taskEntry, name, stackSize, this, prio, &taskHandle_);
-    assert(r);
+    jobSemaphore_ = xSemaphoreCreateCounting(MAX_PENDING_JOBS, 0);
+    assert(jobSemaphore_);
+    lowJobSemaphore_ = xSemaphoreCreateCounting(MAX_PENDING_JOBS, 0);
+    assert(lowJobSemaphore_);
+
+    exitReq_        = false;
+    exited_         = 0;
+    workerCount_    = std::max(1, workerCount);
+    lowWorkerCount_ = std::max(0, lowWorkerCount);
+    int n           = getWorkerCount();
+    for (int i = 0; i < n; ++i)
+    {
+        char taskName[configMAX_TASK_NAME_LEN];
+        if (n > 1)
+        {
+            snprintf(taskName, sizeof(taskName), "%s%d", name, i);
+        }
+        else
+        {
+            snprintf(taskName, sizeof(taskName), "%s", name);
+        }
+
+        auto entry = i < workerCount_ ? taskEntry : lowTaskEntry;
+        int core   = n > 1 ? i % portNUM_PROCESSORS : tskNO_AFFINITY;
+        auto r     = xTaskCreatePinnedToCore(
+            entry, taskName, stackSize, this, prio, nullptr, core);
+        assert(r == pdPASS);
+    }
 
     started_ = true;
 }
@@ -43,31 +152,115 @@ JobManager::start(int prio, size_t stackSize, const char* name)
 void
 JobManager::stop()
 {
-    if (started_)
+    if (!started_)
     {
+        return;
+    }
+
+    {
+        std::lock_guard<sys::Mutex> lock(mutex_);
         exitReq_ = true;
-        xEventGroupWaitBits(eventGroupHandle_,
-                            EVENT_EXIT,
-                            pdTRUE /* clear */,
-                            pdFALSE /* wait for all bit */,
-                            portMAX_DELAY);
     }
+    for (int i = 0; i < workerCount_; ++i)
+    {
+        xSemaphoreGive(jobSemaphore_);
+    }
+    for (int i = 0; i < lowWorkerCount_; ++i)
+    {
+        xSemaphoreGive(lowJobSemaphore_);
+    }
+    xEventGroupWaitBits(eventGroupHandle_,
+                        EVENT_EXIT,
+                        pdTRUE /* clear */,
+                        pdFALSE /* wait for all bit */,
+                        portMAX_DELAY);
+
+    // 最後の worker がロックを抜けるまで待つ
+    std::lock_guard<sys::Mutex> lock(mutex_);
+
+    // 実行されなかったものは捨てる
+    for (auto& q : jobs_)
+    {
+        for (auto& e : q)
+        {
+            e.job.reset();
+            if (e.group)
+            {
+                e.group->release();
+            }
+        }
+        q.clear();
+    }
+    idle_ = true;
+    xEventGroupSetBits(eventGroupHandle_, EVENT_IDLE);
+
+    vSemaphoreDelete(jobSemaphore_);
+    vSemaphoreDelete(lowJobSemaphore_);
+    jobSemaphore_    = nullptr;
+    lowJobSemaphore_ = nullptr;
+    started_         = false;
 }
 
 void
 JobManager::taskEntry(void* p)
 {
-    ((JobManager*)p)->task();
+    ((JobManager*)p)->task(false);
+    vTaskDelete(nullptr);
 }
 
 void
-JobManager::add(Job&& f)
+JobManager::lowTaskEntry(void* p)
 {
-    std::lock_guard<sys::Mutex> lock(mutex_);
-    jobs_.push_back(std::move(f));
+    ((JobManager*)p)->task(true);
+    vTaskDelete(nullptr);
+}
+
+void
+JobManager::add(Job&& f, Priority prio)
+{
+    push({std::move(f), nullptr, micros()}, prio);
+}
+
+void
+JobManager::add(JobGroup& group, Job&& f, Priority prio)
+{
+    group.addRef();
+    push({std::move(f), &group, micros()}, prio);
+}
+
+void
+JobManager::push(Entry&& e, Priority prio)
+{
+    {
+        std::lock_guard<sys::Mutex> lock(mutex_);
+        jobs_[static_cast<size_t>(prio)].push_back(std::move(e));
+        idle_ = false;
+        xEventGroupClearBits(eventGroupHandle_, EVENT_IDLE);
+    }
+    // LOW はどちらの worker も取れるので両方起こす
+    // 先に取られた方は空振りする
+    xSemaphoreGive(jobSemaphore_);
+    if (prio == Priority::LOW && lowWorkerCount_)
+    {
+        xSemaphoreGive(lowJobSemaphore_);
+    }
+}
 
-    xEventGroupSetBits(eventGroupHandle_, EVENT_ADD_JOB);
-    xEventGroupClearBits(eventGroupHandle_, EVENT_IDLE);
+bool
+JobManager::pop(Entry& e, bool lowOnly)
+{
+    // 優先度の高いものから。lowOnly なら LOW だけ
+    auto top = lowOnly ? jobs_.rend() - 1 : jobs_.rbegin();
+    for (auto q = top; q != jobs_.rend(); ++q)
+    {
+        if (!q->empty())
+        {
+            e = std::move(q->front());
+            q->pop_front();
+            return true;
+        }
+    }
+    return false;
 }
 
 void
@@ -80,38 +273,71 @@ JobManager::waitIdle()
                         portMAX_DELAY);
 }
 
+JobManager::Stats
+JobManager::getStats()
+{
+    std::lock_guard<sys::Mutex> lock(mutex_);
+    return stats_;
+}
+
 void
-JobManager::task()
+JobManager::task(bool lowOnly)
 {
-    mutex_.lock();
-    while (!exitReq_)
+    while (true)
     {
-        if (jobs_.empty())
-        {
-            idle_ = true;
-            mutex_.unlock();
+        // 積まれたジョブの数だけ give されている
+        xSemaphoreTake(lowOnly ? lowJobSemaphore_ : jobSemaphore_,
+                       portMAX_DELAY);
 
-            xEventGroupSetBits(eventGroupHandle_, EVENT_IDLE);
-            xEventGroupWaitBits(eventGroupHandle_,
-                                EVENT_ADD_JOB,
-                                pdTRUE /* clear */,
-                                pdFALSE /* wait for all bit */,
-                                portMAX_DELAY);
+        Entry e;
+        {
+            std::lock_guard<sys::Mutex> lock(mutex_);
+            if (exitReq_)
+            {
+                break;
+            }
+            if (!pop(e, lowOnly))
+            {
+                continue;
+            }
+            ++running_;
+        }
 
-            mutex_.lock();
+        bool canceled = e.group && e.group->isCancelRequested();
+        if (!canceled)
+        {
+            auto latency = micros() - e.addTime;
+            {
+                std::lock_guard<sys::Mutex> lock(mutex_);
+                stats_.lastLatencyUS = latency;
+                stats_.maxLatencyUS  = std::max(stats_.maxLatencyUS, latency);
+            }
+            e.job();
         }
-        else
+        // キャプチャしたものを片付けてから終了を知らせる
+        e.job.reset();
+        if (e.group)
         {
-            idle_ = false;
-            mutex_.unlock();
-            jobs_.front()();
-            mutex_.lock();
-            jobs_.pop_front();
+            e.group->release();
+        }
+
+        std::lock_guard<sys::Mutex> lock(mutex_);
+        ++(canceled ? stats_.canceled : stats_.executed);
+        if (--running_ == 0 &&
+            std::all_of(jobs_.begin(), jobs_.end(), [](const auto& q) {
+                return q.empty();
+            }))
+        {
+            idle_ = true;
+            xEventGroupSetBits(eventGroupHandle_, EVENT_IDLE);
         }
     }
-    mutex_.unlock();
 
-    xEventGroupSetBits(eventGroupHandle_, EVENT_EXIT);
+    std::lock_guard<sys::Mutex> lock(mutex_);
+    if (++exited_ == getWorkerCount())
+    {
+        xEventGroupSetBits(eventGroupHandle_, EVENT_EXIT);
+    }
 }
 
 namespace
@@ -6,44 +6,255 @@
 #define _99A8897A_4134_1399_10B0_E9EA535CAB62
 
 #include "mutex.h"
+#include <array>
+#include <atomic>
+#include <cstddef>
 #include <deque>
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
+#include <freertos/semphr.h>
 #include <freertos/task.h>
-#include <functional>
+#include <new>
+#include <stdint.h>
+#include <type_traits>
+#include <utility>
 
 namespace sys
 {
 
-class JobManager
+// void() の関数オブジェクト
+// INPLACE_SIZE に収まるものはヒープを使わずに持つ
+class Job
+{
+public:
+    static constexpr size_t INPLACE_SIZE = 32;
+
+public:
+    Job() = default;
+
+    template <class F,
+              class = std::enable_if_t<
+                  !std::is_same<std::decay_t<F>, Job>::value>>
+    Job(F&& f)
+    {
+        using H = Holder<std::decay_t<F>>;
+        H::construct(storage_,
+                     std::forward<F>(f),
+                     std::integral_constant<bool, H::INPLACE>());
+        ops_ = &H::ops;
+    }
+
+    Job(Job&& other) noexcept { moveFrom(other); }
+
+    Job& operator=(Job&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    ~Job() { reset(); }
+
+    void operator()() { ops_->invoke(storage_); }
+    explicit operator bool() const { return ops_; }
+
+    void reset()
+    {
+        if (ops_)
+        {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+
+private:
+    struct Ops
+    {
+        void (*invoke)(void* p);
+        void (*move)(void* dst, void* src); // src は破棄される
+        void (*destroy)(void* p);
+    };
+
+    template <class T>
+    struct Holder
+    {
+        static constexpr bool INPLACE =
+            sizeof(T) <= INPLACE_SIZE &&
+            alignof(T) <= alignof(std::max_align_t) &&
+            std::is_nothrow_move_constructible<T>::value;
+
+        template <class F>
+        static void construct(void* p, F&& f, std::true_type)
+        {
+            new (p) T(std::forward<F>(f));
+        }
+
+        template <class F>
+        static void construct(void* p, F&& f, std::false_type)
+        {
+            *static_cast<T**>(p) = new T(std::forward<F>(f));
+        }
+
+        static T* get(void* p)
+        {
+            return INPLACE ? static_cast<T*>(p) : *static_cast<T**>(p);
+        }
+
+        static void invoke(void* p) { (*get(p))(); }
+
+        static void move(void* dst, void* src)
+        {
+            if (INPLACE)
+            {
+                new (dst) T(std::move(*get(src)));
+                get(src)->~T();
+            }
+            else
+            {
+                *static_cast<T**>(dst) = get(src);
+            }
+        }
+
+        static void destroy(void* p)
+        {
+            if (INPLACE)
+            {
+                get(p)->~T();
+            }
+            else
+            {
+                delete get(p);
+            }
+        }
+
+        static constexpr Ops ops{invoke, move, destroy};
+    };
+
+    void moveFrom(Job& other)
+    {
+        ops_ = other.ops_;
+        if (ops_)
+        {
+            ops_->move(storage_, other.storage_);
+            other.ops_ = nullptr;
+        }
+    }
+
+private:
+    alignas(std::max_align_t) unsigned char storage_[INPLACE_SIZE];
+    const Ops* ops_{};
+};
+
+template <class T>
+constexpr Job::Ops Job::Holder<T>::ops;
+
+// 関連するジョブをまとめて待ったりキャンセルしたりする
+class JobGroup
 {
-    using Job = std::function<void()>;
-    std::deque<Job> jobs_;
+public:
+    JobGroup();
+    ~JobGroup();
+
+    // 未実行のジョブは実行されずに捨てられる
+    // 実行中のジョブは isCancelRequested() を見て自分で止まること
+    // 全部終わった所で解除されるので、その後に add() したものは実行される
+    void cancel();
+    bool isCancelRequested() const { return cancelReq_; }
+
+    void wait();
+    bool isIdle() const { return pending_ == 0; }
+
+    void cancelAndWait();
+
+protected:
+    friend class JobManager;
+    void addRef();
+    void release();
+
+private:
+    std::atomic<bool> cancelReq_{false};
+    std::atomic<int> pending_{0};
     sys::Mutex mutex_;
-    TaskHandle_t taskHandle_{};
     EventGroupHandle_t eventGroupHandle_{};
+};
 
-    bool started_ = false;
-    bool exitReq_ = false;
-    bool idle_    = true;
+class JobManager
+{
+public:
+    enum class Priority
+    {
+        LOW,
+        NORMAL,
+        HIGH,
+        MAX,
+    };
+
+    struct Stats
+    {
+        uint32_t executed;
+        uint32_t canceled;
+        uint32_t lastLatencyUS; // add() から実行開始まで
+        uint32_t maxLatencyUS;
+    };
 
 public:
     ~JobManager();
 
-    void start(int prio         = 0,
-               size_t stackSize = 2048,
-               const char* name = "JobManager");
+    // worker が 2 つ以上なら worker をコアごとに固定する
+    // workerCount が 1 ならジョブは add() した順 (優先度が同じもの同士) に
+    // 1つずつ実行される
+    // lowWorkerCount の worker は LOW のジョブだけを取る
+    // 長くかかる LOW のジョブで NORMAL 以上が待たされないように
+    void start(int prio           = 0,
+               size_t stackSize   = 2048,
+               const char* name   = "JobManager",
+               int workerCount    = 1,
+               int lowWorkerCount = 0);
     void stop();
 
-    void add(Job&& f);
+    void add(Job&& f, Priority prio = Priority::NORMAL);
+    void add(JobGroup& group, Job&& f, Priority prio = Priority::NORMAL);
 
     void waitIdle();
     bool isIdle() const { return idle_; }
 
+    int getWorkerCount() const { return workerCount_ + lowWorkerCount_; }
+    Stats getStats();
+
 protected:
-    void task();
+    struct Entry
+    {
+        Job job;
+        JobGroup* group{};
+        uint32_t addTime{};
+    };
+
+    void push(Entry&& e, Priority prio);
+    bool pop(Entry& e, bool lowOnly);
+    void task(bool lowOnly);
     static void taskEntry(void* p);
-}; // namespace sys
+    static void lowTaskEntry(void* p);
+
+private:
+    std::array<std::deque<Entry>, static_cast<size_t>(Priority::MAX)> jobs_;
+    sys::Mutex mutex_;
+    SemaphoreHandle_t jobSemaphore_{};
+    SemaphoreHandle_t lowJobSemaphore_{};
+    EventGroupHandle_t eventGroupHandle_{};
+
+    int workerCount_    = 0;
+    int lowWorkerCount_ = 0;
+    int running_        = 0;
+    int exited_         = 0;
+    Stats stats_{};
+
+    bool started_ = false;
+    bool exitReq_ = false;
+    volatile bool idle_ = true;
+};
 
 JobManager& getDefaultJobManager();
 
@@ -22,6 +22,7 @@ public:
 
     bool push(const T& v) { return xQueueSend(handle_, &v, portMAX_DELAY); }
     bool pop(T* v) { return xQueueReceive(handle_, v, portMAX_DELAY); }
+    bool pop(T* v, TickType_t wait) { return xQueueReceive(handle_, v, wait); }
     void clear() { xQueueReset(handle_); }
 
     size_t size() const { return uxQueueMessagesWaiting(handle_); }
@@ -54,6 +55,7 @@ public:
     }
 
     bool pop(T* v) { return queue_.pop(v); }
+    bool pop(T* v, TickType_t wait) { return queue_.pop(v, wait); }
 
     void clear() { queue_.clear(); }
     size_t size() const { return queue_.size(); }
@@ -5,13 +5,17 @@
 
 #include "timer.h"
 #include "../debug.h"
+#include "timer_scheduler.h"
 #include <assert.h>
+#include <audio/sound_chip_manager.h>
 #include <driver/periph_ctrl.h>
 #include <driver/timer.h>
 #include <music_player/music_player_manager.h>
 #include <mutex>
 #include <soc/timer_group_struct.h>
+#include <system/alloc_trap.h>
 #include <system/mutex.h>
+#include <system/util.h>
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
@@ -23,18 +27,23 @@ namespace sys
 namespace
 {
 
+// ハードウェアタイマは 1MHz で回しっぱなしにして、一番近い期限に
+// アラームを合わせ直す (auto reload は使わない)
+// 1 tick が 1us なので sys::micros() と同じ単位になる
+constexpr uint32_t HW_CLOCK = 1000000;
+
 class TimerImpl
 {
+    using Time = TimerScheduler::Time;
+
     timer_group_t timerGrp_ = TIMER_GROUP_0;
     timer_idx_t timerIdx_   = TIMER_0;
 
-    int currentPeriod_      = -1;
-    bool currentAutoReload_ = false;
-
     bool initialized_ = false;
-    bool started_     = false;
 
-    std::function<void()> callback_;
+    TimerScheduler scheduler_{HW_CLOCK};
+    std::function<void()> callbacks_[TimerScheduler::MAX_TIMERS];
+    Mutex mutex_; // scheduler_ と callbacks_ の登録
 
     SemaphoreHandle_t semaphore_{};
 
@@ -45,14 +54,10 @@ public:
     {
     }
 
-    void setCallback(std::function<void()>&& f) { callback_ = f; }
-
-    void init(int div, bool autoReload)
+    void init()
     {
         if (initialized_)
         {
-            setDivider(div);
-            setAutoReload(autoReload);
             return;
         }
 
@@ -66,73 +71,100 @@ public:
         assert(r);
 
         timer_config_t config{};
-        config.divider     = div;
+        config.divider     = TIMER_BASE_CLK / HW_CLOCK;
         config.counter_dir = TIMER_COUNT_UP;
         config.counter_en  = TIMER_PAUSE;
-        config.alarm_en    = TIMER_ALARM_EN;
+        config.alarm_en    = TIMER_ALARM_DIS;
         config.intr_type   = TIMER_INTR_LEVEL;
-        config.auto_reload =
-            autoReload ? TIMER_AUTORELOAD_EN : TIMER_AUTORELOAD_DIS;
+        config.auto_reload = TIMER_AUTORELOAD_DIS;
         timer_init(timerGrp_, timerIdx_, &config);
 
-        currentAutoReload_ = autoReload;
-
         timer_set_counter_value(timerGrp_, timerIdx_, 0);
         timer_isr_register(
             timerGrp_, timerIdx_, timerISR, this, ESP_INTR_FLAG_IRAM, nullptr);
+        timer_enable_intr(timerGrp_, timerIdx_);
+        timer_start(timerGrp_, timerIdx_);
+
         initialized_ = true;
     }
 
-    void setPeriod(uint32_t v)
+    int create(std::function<void()>&& f)
     {
-        if (v != currentPeriod_)
+        init();
+        std::lock_guard<Mutex> lock(mutex_);
+        int id = scheduler_.create();
+        if (id >= 0)
         {
-            timer_set_alarm_value(timerGrp_, timerIdx_, v);
-            currentPeriod_ = v;
+            callbacks_[id] = std::move(f);
         }
+        return id;
+    }
+
+    void destroy(int id)
+    {
+        std::lock_guard<Mutex> lock(mutex_);
+        scheduler_.destroy(id);
+        callbacks_[id] = {};
     }
 
-    void setAutoReload(bool f)
+    void start(int id, uint32_t num, uint32_t clock, bool periodic)
     {
-        if (f != currentAutoReload_)
         {
-            timer_set_auto_reload(timerGrp_,
-                                  timerIdx_,
-                                  f ? TIMER_AUTORELOAD_EN
-                                    : TIMER_AUTORELOAD_DIS);
-            currentAutoReload_ = f;
+            std::lock_guard<Mutex> lock(mutex_);
+            if (scheduler_.isActive(id))
+            {
+                scheduler_.setPeriod(id, num, clock);
+                scheduler_.setPeriodic(id, periodic);
+                return;
+            }
+            scheduler_.start(id, now(), num, clock, periodic);
         }
+        // アラームを合わせ直してもらう
+        xSemaphoreGive(semaphore_);
     }
 
-    void setDivider(int div) { timer_set_divider(timerGrp_, timerIdx_, div); }
-
-    void start()
+    void startAt(int id, Time deadline)
     {
-        if (started_)
         {
-            return;
+            std::lock_guard<Mutex> lock(mutex_);
+            scheduler_.startAt(id, deadline);
         }
-        timer_start(timerGrp_, timerIdx_);
+        xSemaphoreGive(semaphore_);
+    }
 
-        timer_enable_intr(timerGrp_, timerIdx_);
-        started_ = true;
+    Time getTime() { return now(); }
+
+    const TimerScheduler& getScheduler() const { return scheduler_; }
+
+    void stop(int id)
+    {
+        std::lock_guard<Mutex> lock(mutex_);
+        scheduler_.stop(id);
     }
 
-    void stop()
+    void setPeriod(int id, uint32_t num, uint32_t clock)
     {
-        if (started_)
-        {
-            timer_pause(timerGrp_, timerIdx_);
-        }
-        started_ = false;
+        std::lock_guard<Mutex> lock(mutex_);
+        scheduler_.setPeriod(id, num, clock);
+    }
+
+    void setPeriodic(int id, bool periodic)
+    {
+        std::lock_guard<Mutex> lock(mutex_);
+        scheduler_.setPeriodic(id, periodic);
+    }
+
+    bool isActive(int id)
+    {
+        std::lock_guard<Mutex> lock(mutex_);
+        return scheduler_.isActive(id);
     }
 
     static void IRAM_ATTR timerISR(void* p) { ((TimerImpl*)p)->timerFunc(); }
 
     void timerFunc()
     {
-        auto& tg    = timerGrp_ == TIMER_GROUP_0 ? TIMERG0 : TIMERG1;
-        auto& timer = tg.hw_timer[timerIdx_];
+        auto& tg = timerGrp_ == TIMER_GROUP_0 ? TIMERG0 : TIMERG1;
 
         xSemaphoreGiveFromISR(semaphore_, nullptr);
 
@@ -144,7 +176,6 @@ public:
         {
             tg.int_clr_timers.t1 = 1;
         }
-        timer.config.alarm_en = TIMER_ALARM_EN;
     }
 
     static void timerTaskEntry(void* p) { ((TimerImpl*)p)->timerTask(); }
@@ -152,75 +183,224 @@ public:
     void timerTask()
     {
         DBOUT(("Enter timerTask %d:%d\n", timerGrp_, timerIdx_));
+        sys::registerRealtimeTask();
         while (1)
         {
             xSemaphoreTake(semaphore_, portMAX_DELAY);
-            if (callback_)
+            dispatch();
+        }
+    }
+
+    void dispatch()
+    {
+        while (1)
+        {
+            int id;
+            Time deadline;
+            Time t;
             {
-                std::lock_guard<sys::Mutex> lock(music_player::getMutex());
-                callback_();
+                std::lock_guard<Mutex> lock(mutex_);
+                t = now();
+                if (!scheduler_.pop(t, &id, &deadline))
+                {
+                    // アラームを合わせた時にもう過ぎていたら鳴らないので
+                    // もう一度見る
+                    if (arm())
+                    {
+                        return;
+                    }
+                    continue;
+                }
+            }
+
+            // 鳴るはずだった時刻
+            auto late       = TimerScheduler::toTick(t - deadline);
+            uint32_t fireUs = sys::micros() - uint32_t(late);
+
+            std::lock_guard<sys::Mutex> lock(music_player::getMutex());
+            auto& f = callbacks_[id];
+            if (f)
+            {
+                // 1 tick の書き込みはまとめて、鳴った時刻を基準に出す
+                audio::beginFMWriteBatch(fireUs);
+                f();
+                audio::endFMWriteBatch();
             }
         }
     }
 
-    void enableInt() { timer_enable_intr(timerGrp_, timerIdx_); }
-    void disableInt() { timer_disable_intr(timerGrp_, timerIdx_); }
+    // 次の期限にアラームを合わせる。合わせる前に過ぎていたら false
+    bool arm()
+    {
+        Time next;
+        if (!scheduler_.getNextDeadline(&next))
+        {
+            timer_set_alarm(timerGrp_, timerIdx_, TIMER_ALARM_DIS);
+            return true;
+        }
+        uint64_t tick = TimerScheduler::toTick(next);
+        timer_set_alarm_value(timerGrp_, timerIdx_, tick);
+        timer_set_alarm(timerGrp_, timerIdx_, TIMER_ALARM_EN);
+        return counter() < tick;
+    }
+
+    uint64_t counter()
+    {
+        uint64_t v;
+        timer_get_counter_value(timerGrp_, timerIdx_, &v);
+        return v;
+    }
+
+    Time now() { return TimerScheduler::fromTick(counter()); }
 };
 
 TimerImpl timer0_;
 
+// 曲の再生用
+struct PlayerTimer
+{
+    TimerID id      = -1;
+    uint32_t clock  = HW_CLOCK;
+    uint32_t period = 1;
+    bool autoUpdate = true;
+    bool intEnabled = true;
+    std::function<void()> callback;
+};
+
+PlayerTimer playerTimer_;
+
+// initTimer() より先に周期を書かれることもあるので、最初に使う時に作る
+PlayerTimer&
+getPlayerTimer()
+{
+    auto& p = playerTimer_;
+    if (p.id < 0)
+    {
+        p.id = timer0_.create([&p] {
+            if (p.intEnabled && p.callback)
+            {
+                p.callback();
+            }
+        });
+        assert(p.id >= 0);
+    }
+    return p;
+}
+
 } // namespace
 
 void
 initTimer(int baseClock)
 {
-    auto div = TIMER_BASE_CLK / baseClock;
-    DBOUT(("initTimer: baseClock %d, div %d\n", baseClock, div));
-
-    timer0_.init(div, true);
+    DBOUT(("initTimer: baseClock %d\n", baseClock));
+    getPlayerTimer().clock = baseClock;
 }
 
 void
 startTimer()
 {
-    timer0_.start();
+    auto& p = getPlayerTimer();
+    timer0_.start(p.id, p.period, p.clock, p.autoUpdate);
 }
 
 void
 stopTimer()
 {
-    timer0_.stop();
+    timer0_.stop(getPlayerTimer().id);
 }
 
 void
 enableTimerInterrupt()
 {
-    timer0_.enableInt();
+    getPlayerTimer().intEnabled = true;
 }
 
 void
 disableTimerInterrupt()
 {
-    timer0_.disableInt();
+    getPlayerTimer().intEnabled = false;
 }
 
 void
 setTimerPeriod(int v, bool autoUpdate)
 {
-    timer0_.setPeriod(v);
-    timer0_.setAutoReload(autoUpdate);
+    auto& p      = getPlayerTimer();
+    p.period     = v;
+    p.autoUpdate = autoUpdate;
+    timer0_.setPeriod(p.id, p.period, p.clock);
+    timer0_.setPeriodic(p.id, autoUpdate);
 }
 
 void
 setTimerCallback(std::function<void()>&& f)
 {
-    timer0_.setCallback(std::move(f));
+    getPlayerTimer().callback = std::move(f);
 }
 
 void
 resetTimerCallback()
 {
-    timer0_.setCallback({});
+    getPlayerTimer().callback = {};
+}
+
+TimerID
+createTimer(std::function<void()>&& func)
+{
+    return timer0_.create(std::move(func));
+}
+
+void
+destroyTimer(TimerID id)
+{
+    timer0_.destroy(id);
+}
+
+void
+startTimer(TimerID id, uint32_t num, uint32_t clock, bool periodic)
+{
+    timer0_.start(id, num, clock, periodic);
+}
+
+void
+stopTimer(TimerID id)
+{
+    timer0_.stop(id);
+}
+
+void
+setTimerPeriod(TimerID id, uint32_t num, uint32_t clock)
+{
+    timer0_.setPeriod(id, num, clock);
+}
+
+bool
+isTimerActive(TimerID id)
+{
+    return timer0_.isActive(id);
+}
+
+TimerTime
+getTimerTime()
+{
+    return timer0_.getTime();
+}
+
+void
+startTimerAt(TimerID id, TimerTime deadline)
+{
+    timer0_.startAt(id, deadline);
+}
+
+TimerTime
+cyclesToTimerTime(uint64_t cycles, uint32_t clock)
+{
+    return timer0_.getScheduler().toTime(cycles, clock);
+}
+
+uint64_t
+timerTimeToCycles(TimerTime t, uint32_t clock)
+{
+    return timer0_.getScheduler().toCycles(t, clock);
 }
 
 } // namespace sys
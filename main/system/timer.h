@@ -11,6 +11,12 @@
 namespace sys
 {
 
+// ひとつのハードウェアタイマを仮想タイマで分けて使う
+// コールバックはタイマータスクから music_player のロックを取って呼ぶ
+// (ヒープを使わないこと)
+
+// 曲の再生用の仮想タイマ
+// 周期は baseClock を単位にして setTimerPeriod() で与える
 void initTimer(int baseClock);
 
 void startTimer();
@@ -23,6 +29,30 @@ void setTimerPeriod(int v, bool autoUpdate);
 void setTimerCallback(std::function<void()>&& func);
 void resetTimerCallback();
 
+// 別に仮想タイマを作る。作るのは最初に 1 回だけにする
+// (std::function に包む時に確保が起こりうる)
+// 一杯なら -1
+using TimerID = int;
+TimerID createTimer(std::function<void()>&& func);
+void destroyTimer(TimerID id);
+
+// 周期は num / clock 秒。止まっていた時は今から 1 周期後に鳴る
+void startTimer(TimerID id, uint32_t num, uint32_t clock, bool periodic = true);
+void stopTimer(TimerID id);
+// 次の周期から
+void setTimerPeriod(TimerID id, uint32_t num, uint32_t clock);
+bool isTimerActive(TimerID id);
+
+// 仮想タイマの時刻 (1us に TimerScheduler::FRAC_BITS の端数)
+// 別のクロックを数えて鳴らす時に使う
+using TimerTime = uint64_t;
+TimerTime getTimerTime();
+// deadline に 1 回だけ鳴らす。過ぎていればすぐ
+void startTimerAt(TimerID id, TimerTime deadline);
+// clock で cycles 回分の時間 (切り捨て) とその逆
+TimerTime cyclesToTimerTime(uint64_t cycles, uint32_t clock);
+uint64_t timerTimeToCycles(TimerTime t, uint32_t clock);
+
 } // namespace sys
 
 #endif /* _23BCBED8_B133_F06C_4FD2_F79B30C9E6B7 */
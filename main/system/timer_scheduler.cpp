@@ -0,0 +1,282 @@
+#include "timer_scheduler.h"
+#include <assert.h>
+
+namespace sys
+{
+
+TimerScheduler::TimerScheduler(uint32_t baseClock)
+    : baseClock_(baseClock)
+{
+    for (auto& e : entries_)
+    {
+        e.heapPos = -1;
+    }
+}
+
+TimerScheduler::Time
+TimerScheduler::toTime(uint64_t cycles, uint32_t clock) const
+{
+    // 掛けてあふれないように clock の単位と余りに分ける
+    uint64_t q = cycles / clock;
+    uint64_t r = cycles % clock;
+    return ((q * baseClock_) << FRAC_BITS) +
+           ((r * baseClock_) << FRAC_BITS) / clock;
+}
+
+uint64_t
+TimerScheduler::toCycles(Time t, uint32_t clock) const
+{
+    uint64_t unit = uint64_t(baseClock_) << FRAC_BITS;
+    return t / unit * clock + t % unit * clock / unit;
+}
+
+int
+TimerScheduler::create()
+{
+    for (int id = 0; id < MAX_TIMERS; ++id)
+    {
+        auto& e = entries_[id];
+        if (!e.used)
+        {
+            e         = {};
+            e.used    = true;
+            e.heapPos = -1;
+            return id;
+        }
+    }
+    return -1;
+}
+
+void
+TimerScheduler::destroy(int id)
+{
+    stop(id);
+    entries_[id].used = false;
+}
+
+void
+TimerScheduler::start(
+    int id, Time now, uint32_t num, uint32_t clock, bool periodic)
+{
+    auto& e = entries_[id];
+    assert(e.used);
+    if (e.heapPos >= 0)
+    {
+        erase(id);
+    }
+    setPeriod(id, num, clock);
+    e.periodic = periodic;
+    e.deadline = now;
+    e.acc      = 0;
+    advance(e, 1);
+    push(id);
+}
+
+void
+TimerScheduler::startAt(int id, Time deadline)
+{
+    auto& e = entries_[id];
+    assert(e.used);
+    if (e.heapPos >= 0)
+    {
+        erase(id);
+    }
+    e.periodic = false;
+    e.deadline = deadline;
+    push(id);
+}
+
+void
+TimerScheduler::stop(int id)
+{
+    if (entries_[id].heapPos >= 0)
+    {
+        erase(id);
+    }
+}
+
+void
+TimerScheduler::setPeriod(int id, uint32_t num, uint32_t clock)
+{
+    // num * baseClock / clock を FRAC_BITS の下まで割って、余りは残す
+    auto& e    = entries_[id];
+    uint64_t v = uint64_t(num) * baseClock_;
+    uint64_t r = (v % clock) << FRAC_BITS;
+    e.period   = ((v / clock) << FRAC_BITS) + r / clock;
+    e.rem      = r % clock;
+    e.den      = clock;
+    if (e.acc >= e.den)
+    {
+        e.acc = 0;
+    }
+    if (!e.period)
+    {
+        e.period = 1;
+        e.rem    = 0;
+    }
+}
+
+void
+TimerScheduler::setPeriodic(int id, bool periodic)
+{
+    entries_[id].periodic = periodic;
+}
+
+bool
+TimerScheduler::isActive(int id) const
+{
+    return entries_[id].heapPos >= 0;
+}
+
+bool
+TimerScheduler::getNextDeadline(Time* t) const
+{
+    if (!heapSize_)
+    {
+        return false;
+    }
+    *t = entries_[heap_[0]].deadline;
+    return true;
+}
+
+bool
+TimerScheduler::pop(Time now, int* id, Time* deadline)
+{
+    if (!heapSize_)
+    {
+        return false;
+    }
+    int top = heap_[0];
+    auto& e = entries_[top];
+    if (e.deadline > now)
+    {
+        return false;
+    }
+
+    *id       = top;
+    *deadline = e.deadline;
+
+    auto& st = e.stats;
+    ++st.fires;
+    if (now - e.deadline > st.maxLate)
+    {
+        st.maxLate = now - e.deadline;
+    }
+
+    erase(top);
+    if (e.periodic)
+    {
+        // 遅れていれば次も今すぐ出てくるので、順に追いかける
+        // 遅れすぎていたら追いかけずに飛ばす
+        advance(e, 1);
+        if (now > e.deadline && now - e.deadline > e.period * MAX_CATCH_UP)
+        {
+            uint64_t n = (now - e.deadline) / e.period;
+            advance(e, n);
+            st.skipped += n;
+        }
+        push(top);
+    }
+    return true;
+}
+
+const TimerScheduler::Stats&
+TimerScheduler::getStats(int id) const
+{
+    return entries_[id].stats;
+}
+
+void
+TimerScheduler::resetStats(int id)
+{
+    entries_[id].stats = {};
+}
+
+void
+TimerScheduler::advance(Entry& e, uint64_t n)
+{
+    uint64_t acc = e.acc + n * e.rem;
+    e.deadline += n * e.period + acc / e.den;
+    e.acc = acc % e.den;
+}
+
+bool
+TimerScheduler::before(int a, int b) const
+{
+    return entries_[a].deadline < entries_[b].deadline;
+}
+
+void
+TimerScheduler::place(int pos, int id)
+{
+    heap_[pos]           = id;
+    entries_[id].heapPos = pos;
+}
+
+void
+TimerScheduler::push(int id)
+{
+    assert(heapSize_ < MAX_TIMERS);
+    int pos = heapSize_++;
+    place(pos, id);
+    siftUp(pos);
+}
+
+void
+TimerScheduler::erase(int id)
+{
+    int pos              = entries_[id].heapPos;
+    int last             = heap_[--heapSize_];
+    entries_[id].heapPos = -1;
+    if (last == id)
+    {
+        return;
+    }
+    place(pos, last);
+    siftUp(pos);
+    siftDown(entries_[last].heapPos);
+}
+
+void
+TimerScheduler::siftUp(int pos)
+{
+    int id = heap_[pos];
+    while (pos)
+    {
+        int parent = (pos - 1) >> 1;
+        if (!before(id, heap_[parent]))
+        {
+            break;
+        }
+        place(pos, heap_[parent]);
+        pos = parent;
+    }
+    place(pos, id);
+}
+
+void
+TimerScheduler::siftDown(int pos)
+{
+    int id = heap_[pos];
+    while (true)
+    {
+        int child = pos * 2 + 1;
+        if (child >= heapSize_)
+        {
+            break;
+        }
+        if (child + 1 < heapSize_ && before(heap_[child + 1], heap_[child]))
+        {
+            ++child;
+        }
+        if (!before(heap_[child], id))
+        {
+            break;
+        }
+        place(pos, heap_[child]);
+        pos = child;
+    }
+    place(pos, id);
+}
+
+} // namespace sys
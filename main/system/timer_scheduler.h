@@ -0,0 +1,108 @@
+#ifndef _C3E95A17_64D2_4B0F_8E3A_9F21D07B4C58
+#define _C3E95A17_64D2_4B0F_8E3A_9F21D07B4C58
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace sys
+{
+
+// ひとつのハードウェアタイマに複数の仮想タイマを載せるための予定表
+// 期限の近い順のヒープで持つ。大きさは固定なので確保は起こらない
+//
+// 時刻は基準クロックの tick に FRAC_BITS の端数をつけたもの
+// 周期は num / clock 秒で受け取り、端数の下の余りも持って足していくので
+// tick で割り切れない周期でもずれていかない
+//
+// ロックはしないので呼ぶ側で排他すること
+class TimerScheduler
+{
+public:
+    static constexpr int MAX_TIMERS = 8;
+    static constexpr int FRAC_BITS  = 16;
+
+    // 遅れがこの周期数を超えたら追いかけずに飛ばす
+    static constexpr int MAX_CATCH_UP = 8;
+
+    using Time = uint64_t;
+
+    struct Stats
+    {
+        uint32_t fires;
+        uint32_t skipped; // 追いかけずに飛ばした周期
+        Time maxLate;     // 期限から取り出されるまで
+    };
+
+public:
+    explicit TimerScheduler(uint32_t baseClock);
+
+    // clock で cycles 回分の時間 (切り捨て) とその逆
+    Time toTime(uint64_t cycles, uint32_t clock) const;
+    uint64_t toCycles(Time t, uint32_t clock) const;
+
+    static Time fromTick(uint64_t tick) { return tick << FRAC_BITS; }
+    // 切り上げ
+    static uint64_t toTick(Time t)
+    {
+        return (t + (Time(1) << FRAC_BITS) - 1) >> FRAC_BITS;
+    }
+
+    // 一杯なら -1
+    int create();
+    void destroy(int id);
+
+    // 周期は num / clock 秒。最初の期限は now + 周期
+    void start(int id, Time now, uint32_t num, uint32_t clock, bool periodic);
+    // deadline に 1 回だけ
+    void startAt(int id, Time deadline);
+    void stop(int id);
+    // 次の周期から
+    void setPeriod(int id, uint32_t num, uint32_t clock);
+    void setPeriodic(int id, bool periodic);
+
+    bool isActive(int id) const;
+
+    // 一番近い期限。なければ false
+    bool getNextDeadline(Time* t) const;
+
+    // now までに期限が来たものを 1 つ取り出す
+    // 周期のものは次の期限で入れ直す
+    bool pop(Time now, int* id, Time* deadline);
+
+    const Stats& getStats(int id) const;
+    void resetStats(int id);
+
+protected:
+    struct Entry
+    {
+        Time deadline;
+        Time period;  // 端数の下を切り捨てたもの
+        uint32_t rem; // 切り捨てた分 (rem / den)
+        uint32_t den;
+        uint32_t acc; // 足してきた rem
+        bool used;
+        bool periodic;
+        int heapPos; // 入っていなければ -1
+        Stats stats;
+    };
+
+    void advance(Entry& e, uint64_t n);
+
+    bool before(int a, int b) const;
+    void place(int pos, int id);
+    void push(int id);
+    void erase(int id);
+    void siftUp(int pos);
+    void siftDown(int pos);
+
+private:
+    uint32_t baseClock_;
+
+    Entry entries_[MAX_TIMERS]{};
+    int heap_[MAX_TIMERS]{};
+    int heapSize_ = 0;
+};
+
+} // namespace sys
+
+#endif /* _C3E95A17_64D2_4B0F_8E3A_9F21D07B4C58 */
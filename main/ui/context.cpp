@@ -85,22 +85,25 @@ RenderContext::updateFrameBuffer(graphics::FrameBufferBase* b)
     return {this, prev};
 }
 
-graphics::FrameBuffer&
-RenderContext::getTemporaryFrameBuffer(uint32_t w, uint32_t h, int bpp)
+graphics::MemoryFrameBuffer&
+RenderContext::getTemporaryFrameBuffer(uint32_t w, uint32_t h)
 {
-    if (temporaryFrameBuffer_.getWidth() != w ||
-        temporaryFrameBuffer_.getHeight() != h ||
-        temporaryFrameBuffer_.getBitPerPixel() != bpp)
+    if (temporaryFrameBuffer_.getBufferWidth() != w ||
+        temporaryFrameBuffer_.getBufferHeight() != h)
     {
-        temporaryFrameBuffer_.initialize(w, h, bpp);
+        temporaryFrameBuffer_.initialize(w, h);
+    }
+    else
+    {
+        temporaryFrameBuffer_.setWindow(0, 0, w, h);
     }
     return temporaryFrameBuffer_;
 }
 
-graphics::FrameBuffer&
-RenderContext::getTemporaryFrameBuffer(const Dim2& size, int bpp)
+graphics::MemoryFrameBuffer&
+RenderContext::getTemporaryFrameBuffer(const Dim2& size)
 {
-    return getTemporaryFrameBuffer(size.w, size.h, bpp);
+    return getTemporaryFrameBuffer(size.w, size.h);
 }
 
 void
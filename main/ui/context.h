@@ -9,7 +9,7 @@
 #include "types.h"
 #include "window_setting.h"
 #include <graphics/font_manager.h>
-#include <graphics/framebuffer.h>
+#include <graphics/memory_framebuffer.h>
 
 namespace graphics
 {
@@ -160,7 +160,7 @@ class RenderContext : public Context
 
     WindowSettings windowSettings_;
 
-    graphics::FrameBuffer temporaryFrameBuffer_;
+    graphics::MemoryFrameBuffer temporaryFrameBuffer_;
 
 public:
     RenderContext();
@@ -176,11 +176,9 @@ public:
     const graphics::Texture* getTexture() const { return texture_; }
     void setTexture(const graphics::Texture* t) { texture_ = t; }
 
-    graphics::FrameBuffer&
-    getTemporaryFrameBuffer(uint32_t w, uint32_t h, int bpp = 16);
-
-    graphics::FrameBuffer& getTemporaryFrameBuffer(const Dim2& size,
-                                                   int bpp = 16);
+    graphics::MemoryFrameBuffer& getTemporaryFrameBuffer(uint32_t w,
+                                                         uint32_t h);
+    graphics::MemoryFrameBuffer& getTemporaryFrameBuffer(const Dim2& size);
 
     // utility
 
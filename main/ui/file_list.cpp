@@ -99,9 +99,7 @@ FileList::getItem(size_t i)
 void
 FileList::cancelAndWaitIdle()
 {
-    abortReq_ = true;
-    sys::getDefaultJobManager().waitIdle();
-    abortReq_ = false;
+    jobGroup_.cancelAndWait();
 }
 
 int
@@ -170,7 +168,6 @@ FileList::setPath(const std::string& path)
 
     path_       = path;
     parseIndex_ = 0;
-    abortReq_   = false;
 
     directories_.clear();
     files_.clear();
@@ -185,7 +182,7 @@ FileList::setPath(const std::string& path)
         isRootDir_ = false;
     }
 #if 0
-    sys::getDefaultJobManager().add([this] { loadFileList(); });
+    sys::getDefaultJobManager().add(jobGroup_, [this] { loadFileList(); });
 #else
     loadFileListDirect();
 #endif
@@ -308,7 +305,7 @@ FileList::loadFileList()
 
     while (auto e = readdir(dir))
     {
-        if (abortReq_)
+        if (jobGroup_.isCancelRequested())
         {
             break;
         }
@@ -384,10 +381,10 @@ FileList::onUpdate(UpdateContext& ctx)
     super::onUpdate(ctx);
 
     auto& jm = sys::getDefaultJobManager();
-    if (jm.isIdle() && parseIndex_ < files_.size())
+    if (jobGroup_.isIdle() && parseIndex_ < files_.size())
     {
         int i = parseIndex_;
-        jm.add([this, i] {
+        jm.add(jobGroup_, [this, i] {
             std::lock_guard<sys::Mutex> lock(getMutex());
             auto& f = files_[i];
             auto fn = makeAbsPath(f.filename_);
@@ -400,7 +397,7 @@ FileList::onUpdate(UpdateContext& ctx)
                     f.touch();
                 }
             }
-        });
+        }, sys::JobManager::Priority::LOW);
         ++parseIndex_;
     }
 }
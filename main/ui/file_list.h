@@ -8,6 +8,7 @@
 #include "scroll_list.h"
 #include <music_player/file_format.h>
 #include <string>
+#include <system/job_manager.h>
 #include <system/mutex.h>
 #include <utility>
 #include <vector>
@@ -72,8 +73,8 @@ private:
     std::string path_;
     std::string followFile_; // カーソルを合わせるファイル
 
-    volatile bool abortReq_ = false;
-    size_t parseIndex_      = 0;
+    sys::JobGroup jobGroup_; // タイトル読み込みなど
+    size_t parseIndex_ = 0;
 
 public:
     FileList();
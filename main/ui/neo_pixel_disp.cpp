@@ -174,11 +174,10 @@ NeoPixelDisp::NeoPixelDisp()
 }
 
 void
-NeoPixelDisp::update(const std::array<float, 2>& lv,
-                     const int16_t* wave,
-                     int n,
-                     float dt)
+NeoPixelDisp::update(const AnalyzerResult& result, float dt)
 {
+    const auto& lv = result.level;
+
     auto mode = ui::SystemSettings::instance().getNeoPixelMode();
     if (mode == ui::NeoPixelMode::OFF)
     {
@@ -196,11 +195,11 @@ NeoPixelDisp::update(const std::array<float, 2>& lv,
             break;
 
         case ui::NeoPixelMode::GAMING_LV:
-            gaming_.update(lv, wave, n, dt);
+            gaming_.update(lv, dt);
             break;
 
         case ui::NeoPixelMode::SPECTRUM:
-            spectrumMeter_.update(lv, wave, n, dt);
+            spectrumMeter_.update(result, dt);
             break;
 
         default:
@@ -253,11 +252,10 @@ NeoPixelDisp::LevelMeter::update(const std::array<float, 2>& lv)
 }
 
 void
-NeoPixelDisp::SpectrumMeter::update(const std::array<float, 2>& lv,
-                                    const int16_t* wave,
-                                    int n,
-                                    float dt)
+NeoPixelDisp::SpectrumMeter::update(const AnalyzerResult& result, float dt)
 {
+    const auto& lv = result.level;
+
     constexpr int N = 5;
 
     constexpr float pwScale = 1.0f / (30.0f) * 2; //  * 0.5f /* lv かける分 */;
@@ -268,7 +266,7 @@ NeoPixelDisp::SpectrumMeter::update(const std::array<float, 2>& lv,
 
     constexpr float l7040_60 = 4.765018886929988f; // log(7040/60)
     const float es           = l7040_60 / (N - 1);
-    const float ls           = 60.0f / (44100.0f / 3 / 256);
+    const float ls           = 60.0f / result.binFrequency;
 
     phase_ += phaseShiftPerSec * dt;
     if (phase_ > 1.0f)
@@ -290,9 +288,7 @@ NeoPixelDisp::SpectrumMeter::update(const std::array<float, 2>& lv,
         {
             float fpos = ls * expf(es * i);
             int ipos   = static_cast<int>(fpos);
-            int sr     = wave[ipos];
-            int si     = wave[n - ipos - 1];
-            float pw   = (sr * sr + si * si) * bs;
+            float pw   = result.power[ipos] * bs;
             float v    = pwScale * computeDB(pw) + pwBias;
             float pdb  = std::min(1.0f, std::max(0.0f, v));
             float pdb2 = std::min(1.0f, std::max(0.0f, 2.0f - v));
@@ -317,10 +313,7 @@ NeoPixelDisp::SpectrumMeter::update(const std::array<float, 2>& lv,
 }
 
 void
-NeoPixelDisp::Gaming::update(const std::array<float, 2>& lv,
-                             const int16_t* wave,
-                             int n,
-                             float dt)
+NeoPixelDisp::Gaming::update(const std::array<float, 2>& lv, float dt)
 {
     constexpr float scale        = 1.0f / (30.0f / 5);
     constexpr float bias         = 10.0f * scale;
@@ -6,6 +6,7 @@
 #define _99392E8B_0134_3E2C_2626_D5F99B8804F8
 
 #include <array>
+#include <audio/spectrum_analyzer.h>
 #include <stdint.h>
 
 namespace ui
@@ -17,10 +18,9 @@ class NeoPixelDisp
 public:
     NeoPixelDisp();
 
-    void update(const std::array<float, 2>& lv,
-                const int16_t* wave,
-                int n,
-                float dt);
+    using AnalyzerResult = audio::SpectrumAnalyzer::Result;
+
+    void update(const AnalyzerResult& result, float dt);
 
 private:
     struct LevelMeter
@@ -31,10 +31,7 @@ private:
     struct SpectrumMeter
     {
         float phase_ = 0;
-        void update(const std::array<float, 2>& lv,
-                    const int16_t* wave,
-                    int n,
-                    float dt);
+        void update(const AnalyzerResult& result, float dt);
     };
 
     struct Gaming
@@ -42,10 +39,7 @@ private:
         std::array<float, 2> phase_{};
         std::array<float, 2> prevValue_{};
 
-        void update(const std::array<float, 2>& lv,
-                    const int16_t* wave,
-                    int n,
-                    float dt);
+        void update(const std::array<float, 2>& lv, float dt);
     };
 
     LevelMeter lvMeter_;
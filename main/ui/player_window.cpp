@@ -16,12 +16,11 @@
 #include "ui_manager.h"
 #include <algorithm>
 #include <audio/audio_out.h>
-#include <audio/roudness.h>
+#include <audio/spectrum_analyzer.h>
+#include <math.h>
 #include <music_player/music_player_manager.h>
 #include <mutex>
 #include <system/mutex.h>
-#include <util/fft.h>
-#include <util/sin_table.h>
 
 namespace ui
 {
@@ -91,15 +90,6 @@ constexpr uint32_t freqBar    = 0x404040;
 PlayerWindow::PlayerWindow()
     : keyboardList_(std::make_shared<KeyboardList>())
 {
-    constexpr float baseSpectrumScale_ = 2.3e-10f;
-    roudnessTable_.resize(rect::freqView.size.w);
-    for (auto i = 0u; i < roudnessTable_.size(); ++i)
-    {
-        float freq =
-            55.0f *
-            powf(powf(7040.0f / 55.0f, 1.0f / roudnessTable_.size()), (float)i);
-        roudnessTable_[i] = audio::computeRoudness(freq) * baseSpectrumScale_;
-    }
 }
 
 void
@@ -416,18 +406,11 @@ PlayerWindow::onRender(RenderContext& ctx)
         ctx.applyClipRegion();
         ctx.fill({0, 0}, rect::waveFB.size, col::panel);
 
-        std::array<float, 2> total{};
-
-        static int16_t waveBuffer[256];
-
-        auto& audioManager = audio::AudioOutDriverManager::instance();
+        auto& analyzer =
+            audio::AudioOutDriverManager::instance().getSpectrumAnalyzer();
+        const auto& result = analyzer.acquire();
 
         // wave
-        auto* tmpWave = reinterpret_cast<std::array<int16_t, 2>*>(waveBuffer);
-        audioManager.lockHistoryBuffer();
-        audioManager.getHistoryBuffer().copyLatest(tmpWave, 128);
-        audioManager.unlockHistoryBuffer();
-
         for (int ch = 0; ch < 2; ++ch)
         {
             constexpr int waveScale = 2;
@@ -435,14 +418,13 @@ PlayerWindow::onRender(RenderContext& ctx)
             constexpr int scale     = h * waveScale;
             constexpr int bias      = (h * 65536) >> 1;
             const auto& r           = ch == 0 ? rect::waveL : rect::waveR;
-            const int16_t* wave     = &tmpWave[0][ch];
+            const int16_t* wave     = &result.wave[0][ch];
 
             drawGraph(
                 tmpFB,
                 r,
                 [&](int) {
                     int v = (*wave * scale + bias) >> 16;
-                    total[ch] += *wave * *wave;
                     wave += 2;
                     return v;
                 },
@@ -452,21 +434,6 @@ PlayerWindow::onRender(RenderContext& ctx)
         }
 
         // spectrum analyzer
-        const auto* sinCos = util::sincos256Table;
-        audioManager.lockHistoryBuffer();
-        // 窓関数を掛けつつ1/3に周波数下げてコピー (44100 -> 14700Hz)
-        audioManager.getHistoryBuffer().copyLatest(
-            waveBuffer, 256, 3, [&](const std::array<int16_t, 2>& v) {
-                int wf = 16384 - sinCos[1]; // (1 - cosθ)/2 * 2    [0:32768]
-                sinCos += 2;
-                return ((v[0] + v[1]) * wf) >> 16; // (15+1)+15-16=15
-            });
-        audioManager.unlockHistoryBuffer();
-
-        util::realFFT(waveBuffer, util::sincos256Table, 256);
-        waveBuffer[0]   = 0;
-        waveBuffer[255] = 0;
-
         // サンプルは 44100/3=14700Hz
         // 14700/256 = 57.421875Hzステップで7350Hzまで
         // 55, 110, 220, 440, 880, 1760, 3520, 7040Hz に点
@@ -474,10 +441,11 @@ PlayerWindow::onRender(RenderContext& ctx)
         // freq(x) = 55 * pow(pow(7040/55, 1/w), x)
         // i = freq(x) / (14700/256)
 
-        constexpr float l7040_55 = 4.852030263919617f; // log(7040/55)
+        constexpr float baseSpectrumScale = 2.3e-10f;
+        constexpr float l7040_55          = 4.852030263919617f; // log(7040/55)
         const float es =
             l7040_55 / rect::freqView.size.w; // log(pow(7040/55, 1/w))
-        const float ls = 55.0f / (44100.0f / 3 / 256);
+        const float ls = 55.0f / result.binFrequency;
 
         // n db を h pixel で
         // -20 * log10(v^1/2) / n * h
@@ -494,11 +462,9 @@ PlayerWindow::onRender(RenderContext& ctx)
                 int idx    = static_cast<int>(spos);
                 float t    = spos - idx;
 
-                const auto* pr = &waveBuffer[idx];
-                const auto* pi = &waveBuffer[256 - 1 - idx];
-                int32_t v0     = pr[0] * pr[0] + pi[0] * pi[0];
-                int32_t v1     = pr[1] * pr[1] + pi[-1] * pi[-1];
-                float v        = ((v1 - v0) * t + v0) * roudnessTable_[i];
+                float v0 = result.weight[idx];
+                float v1 = result.weight[idx + 1];
+                float v  = ((v1 - v0) * t + v0) * baseSpectrumScale;
 
                 float lv = logf(std::max(0.000001f, std::min(1.0f, v))) * vs;
                 return static_cast<int>(lv);
@@ -509,9 +475,7 @@ PlayerWindow::onRender(RenderContext& ctx)
             ctx.makeColor(col::freqBar));
 
         // neo pix
-        float lvs = 1.0f / (32768.0f * 32768.0f * 128.0f);
-        std::array<float, 2> lv{total[0] * lvs, total[1] * lvs};
-        neoPixelDisp_.update(lv, waveBuffer, 256, currentDt_);
+        neoPixelDisp_.update(result, currentDt_);
 
         // vol
         if (volVisible_ > 0)
@@ -33,8 +33,6 @@ class PlayerWindow : public Widget,
 
     float volVisible_ = 0;
 
-    std::vector<float> roudnessTable_;
-
     NeoPixelDisp neoPixelDisp_;
     float currentDt_ = 0;
 
@@ -15,6 +15,8 @@
 #include <debug.h>
 #include <functional>
 #include <m5dx_module.h>
+#include <music_player/midi_synth.h>
+#include <music_player/music_player_manager.h>
 #include <string>
 
 namespace ui
@@ -337,7 +339,7 @@ ListItem<bool, 2> internalSpeakerItem(
     [](auto m) { return getEnableDisableString(m); },
     {false, true});
 
-ListItem<DeltaSigmaMode, 2> internalSpeaker3rdDeltaSigmaModeItem(
+ListItem<DeltaSigmaMode, 5> internalSpeaker3rdDeltaSigmaModeItem(
     [] { return get(strings::deltaSigmaMode); },
     [] { return SystemSettings::instance().getDeltaSigmaMode(); },
     [](UpdateContext&, auto m) {
@@ -345,7 +347,11 @@ ListItem<DeltaSigmaMode, 2> internalSpeaker3rdDeltaSigmaModeItem(
         SystemSettings::instance().applyDeltaSigmaMode();
     },
     [](auto m) { return toString(m); },
-    {DeltaSigmaMode::ORDER_1ST, DeltaSigmaMode::ORDER_3RD});
+    {DeltaSigmaMode::ORDER_1ST,
+     DeltaSigmaMode::ORDER_2ND,
+     DeltaSigmaMode::ORDER_3RD,
+     DeltaSigmaMode::ORDER_4TH,
+     DeltaSigmaMode::ORDER_5TH});
 
 ListItem<bool, 2> dispOffReverseItem(
     [] { return get(strings::dispOffReverse); },
@@ -356,6 +362,46 @@ ListItem<bool, 2> dispOffReverseItem(
     [](auto m) { return getEnableDisableString(m); },
     {false, true});
 
+ListItem<int, 3> speakerSampleRateItem(
+    [] { return get(strings::speakerSampleRate); },
+    [] { return SystemSettings::instance().getInternalSpeakerSampleRate(); },
+    [](UpdateContext&, auto v) {
+        SystemSettings::instance().setInternalSpeakerSampleRate(v);
+        SystemSettings::instance().applyInternalSpeakerConfig();
+    },
+    [](auto v) { return toString(v) + "Hz"; },
+    {32000, 44100, 48000});
+
+ListItem<int, 3> speakerBlockSamplesItem(
+    [] { return get(strings::speakerBlockSamples); },
+    [] { return SystemSettings::instance().getInternalSpeakerBlockSamples(); },
+    [](UpdateContext&, auto v) {
+        SystemSettings::instance().setInternalSpeakerBlockSamples(v);
+        SystemSettings::instance().applyInternalSpeakerConfig();
+    },
+    [](auto v) { return toString(v); },
+    {32, 64, 128});
+
+ListItem<int, 3> btAudioBlockSamplesItem(
+    [] { return get(strings::btAudioBlockSamples); },
+    [] { return SystemSettings::instance().getBTAudioBlockSamples(); },
+    [](UpdateContext&, auto v) {
+        SystemSettings::instance().setBTAudioBlockSamples(v);
+        SystemSettings::instance().applyBTAudioBlockSamples();
+    },
+    [](auto v) { return toString(v); },
+    {32, 64, 128});
+
+ListItem<bool, 2> predecodeADPCMItem(
+    [] { return get(strings::predecodeADPCM); },
+    [] { return SystemSettings::instance().isEnabledPredecodeADPCM(); },
+    [](UpdateContext&, auto m) {
+        SystemSettings::instance().enablePredecodeADPCM(m);
+        SystemSettings::instance().applyPredecodeADPCM();
+    },
+    [](auto m) { return getEnableDisableString(m); },
+    {false, true});
+
 ListItem<int, 5> loopCountItem(
     [] { return get(strings::loopCount); },
     [] { return SystemSettings::instance().getLoopCount(); },
@@ -433,6 +479,27 @@ ListItem<InitialBTMode, 4> bootBTMIDIItem(
      InitialBTMode::_60SEC,
      InitialBTMode::ALWAYS});
 
+ListItem<bool, 2> midiSynthItem(
+    [] { return get(strings::MIDISynth); },
+    [] { return music_player::getMidiSynth().isRunning(); },
+    [](UpdateContext&, auto m) {
+        auto& synth = music_player::getMidiSynth();
+        if (!m)
+        {
+            synth.stop();
+            return;
+        }
+
+        // 最後に再生した MDX の音色を使う
+        const auto& file = music_player::getCurrentPlayFile();
+        auto* player = music_player::findMusicPlayerFromFile(file.c_str());
+        bool isMDX =
+            player && player->getFormat() == music_player::FileFormat::MDX;
+        synth.start(isMDX ? file.c_str() : nullptr);
+    },
+    [](auto m) { return getEnableDisableString(m); },
+    {false, true});
+
 LabelItem btAudioMenuItem([] { return make3DotString(get(strings::BTAudio)); },
                           [](UpdateContext& ctx) {
                               if (auto* uiManager = ctx.getUIManager())
@@ -467,13 +534,18 @@ SettingWindow::SettingWindow()
     append(&backLightItem);
     append(&internalSpeakerItem);
     append(&internalSpeaker3rdDeltaSigmaModeItem);
+    append(&speakerSampleRateItem);
+    append(&speakerBlockSamplesItem);
+    append(&predecodeADPCMItem);
     append(&playerDialModeItem);
     append(&dispOffReverseItem);
     append(&neoPixelModeItem);
     append(&neoPixelBrightnessItem);
     append(&btAudioMenuItem);
+    append(&btAudioBlockSamplesItem);
     append(&bootBTAudioItem);
     append(&bootBTMIDIItem);
+    append(&midiSynthItem);
     append(&soundModuleItem);
     append(&writeModuleMenuItem);
     append(&languageItem);
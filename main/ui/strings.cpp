@@ -54,6 +54,13 @@ constexpr Strings backLightIntensity = {"バックライト輝度",
                                         "BACKLIGHT INTENSITY"};
 constexpr Strings dispOffReverse     = {"裏返し画面オフ",
                                     "DISPLAY OFF When TURN DOWN"};
+constexpr Strings speakerSampleRate = {"スピーカー周波数",
+                                       "SPEAKER SAMPLE RATE"};
+constexpr Strings speakerBlockSamples = {"スピーカーブロック長",
+                                         "SPEAKER BLOCK SIZE"};
+constexpr Strings btAudioBlockSamples = {"BTオーディオブロック長",
+                                         "BT AUDIO BLOCK SIZE"};
+constexpr Strings predecodeADPCM = {"ADPCM先行展開", "PREDECODE ADPCM"};
 constexpr Strings trackOverride = {"MIDIオーバーライド", "MIDI OVERRIDE"};
 constexpr Strings playerDiadMode = {"プレイヤーダイアルモード",
                                     "PLAYER DIAL MODE"};
@@ -65,7 +72,10 @@ constexpr Strings bootBTAudio = {"起動時 Bluetooth Audio 待ち受け",
 constexpr Strings _30sec      = {"30秒", "30 SEC"};
 constexpr Strings _60sec      = {"60秒", "60 SEC"};
 constexpr Strings _1stOrder   = {"一次", "1ST ORDER"};
+constexpr Strings _2ndOrder   = {"二次", "2ND ORDER"};
 constexpr Strings _3rdOrder   = {"三次", "3RD ORDER"};
+constexpr Strings _4thOrder   = {"四次", "4TH ORDER"};
+constexpr Strings _5thOrder   = {"五次", "5TH ORDER"};
 
 constexpr Strings language = {"Language", "LANGUAGE"};
 constexpr Strings japanese = {"日本語", "JAPANESE"};
@@ -85,7 +95,8 @@ constexpr Strings BTAudio           = {"Bluetooth Audio", "BT AUDIO"};
 constexpr Strings BTAudioConnectMes = {"'%s' に接続しています...",
                                        "Connecting to '%s'..."};
 
-constexpr Strings BTMIDI = {"Bluetooth MIDI", "BT MIDI"};
+constexpr Strings BTMIDI    = {"Bluetooth MIDI", "BT MIDI"};
+constexpr Strings MIDISynth = {"MIDI シンセ (YM2151)", "MIDI SYNTH (YM2151)"};
 
 constexpr Strings YMF288FMVolume     = {"YMF288 FM 音量", "YMF288 FM VOLUME"};
 constexpr Strings YMF288RhythmVolume = {"YMF288 リズム音量",
@@ -50,6 +50,10 @@ extern const Strings internalSpeaker;
 extern const Strings deltaSigmaMode;
 extern const Strings backLightIntensity;
 extern const Strings dispOffReverse;
+extern const Strings speakerSampleRate;
+extern const Strings speakerBlockSamples;
+extern const Strings btAudioBlockSamples;
+extern const Strings predecodeADPCM;
 extern const Strings trackOverride;
 extern const Strings playerDiadMode;
 
@@ -58,7 +62,10 @@ extern const Strings bootBTAudio;
 extern const Strings _30sec;
 extern const Strings _60sec;
 extern const Strings _1stOrder;
+extern const Strings _2ndOrder;
 extern const Strings _3rdOrder;
+extern const Strings _4thOrder;
+extern const Strings _5thOrder;
 
 extern const Strings language;
 extern const Strings japanese;
@@ -75,6 +82,7 @@ extern const Strings writeModuleMes;
 extern const Strings BTAudio;
 extern const Strings BTAudioConnectMes;
 extern const Strings BTMIDI;
+extern const Strings MIDISynth;
 
 extern const Strings YMF288FMVolume;
 extern const Strings YMF288RhythmVolume;
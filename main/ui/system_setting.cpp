@@ -13,7 +13,10 @@
 #include <audio/audio.h>
 #include <audio/audio_out.h>
 #include <audio/sound_chip_manager.h>
+#include <esp_heap_caps.h>
 #include <graphics/display.h>
+#include <io/bt_a2dp_source_manager.h>
+#include <music_player/pdx_cache.h>
 
 namespace ui
 {
@@ -187,9 +190,18 @@ toString(DeltaSigmaMode m)
     case DeltaSigmaMode::ORDER_1ST:
         return get(strings::_1stOrder);
 
+    case DeltaSigmaMode::ORDER_2ND:
+        return get(strings::_2ndOrder);
+
     case DeltaSigmaMode::ORDER_3RD:
         return get(strings::_3rdOrder);
 
+    case DeltaSigmaMode::ORDER_4TH:
+        return get(strings::_4thOrder);
+
+    case DeltaSigmaMode::ORDER_5TH:
+        return get(strings::_5thOrder);
+
     default:
         return "Unknown";
     }
@@ -247,8 +259,33 @@ SystemSettings::applyBackLightIntensity() const
 void
 SystemSettings::applyDeltaSigmaMode() const
 {
-    audio::setInternalSpeaker3rdDeltaSigmaMode(deltaSigmaMode_ ==
-                                               DeltaSigmaMode::ORDER_3RD);
+    int order = 1;
+    switch (deltaSigmaMode_)
+    {
+    case DeltaSigmaMode::ORDER_2ND:
+        order = 2;
+        break;
+
+    case DeltaSigmaMode::ORDER_3RD:
+        order = 3;
+        break;
+
+    case DeltaSigmaMode::ORDER_4TH:
+        order = 4;
+        break;
+
+    case DeltaSigmaMode::ORDER_5TH:
+        order = 5;
+        break;
+
+    default:
+        break;
+    }
+    // 2 次以上は零点を散らした方が可聴帯域の雑音が少ない
+    audio::setInternalSpeakerDeltaSigma(
+        order,
+        order > 1 ? audio::NoiseShape::OPTIMIZED_ZEROS
+                  : audio::NoiseShape::DIFFERENTIATOR);
 }
 
 void
@@ -269,6 +306,19 @@ SystemSettings::applyInternalSpeakerMode() const
     }
 }
 
+void
+SystemSettings::applyInternalSpeakerConfig() const
+{
+    audio::setInternalSpeakerConfig(speakerSampleRate_, speakerBlockSamples_);
+}
+
+void
+SystemSettings::applyBTAudioBlockSamples() const
+{
+    io::BTA2DPSourceManager::instance().setBlockSampleCount(
+        btAudioBlockSamples_);
+}
+
 void
 SystemSettings::applyYMF288Volume() const
 {
@@ -323,13 +373,24 @@ SystemSettings::applySoundModuleType() const
     }
 }
 
+void
+SystemSettings::applyPredecodeADPCM() const
+{
+    // 展開すると 4 倍になるので内部 RAM だけでは足りない
+    bool psram = heap_caps_get_total_size(MALLOC_CAP_SPIRAM) > 0;
+    music_player::getPDXCache().setPredecodeADPCM(predecodeADPCM_ && psram);
+}
+
 void
 SystemSettings::apply() const
 {
     applyBackLightIntensity();
     applyDeltaSigmaMode();
+    applyInternalSpeakerConfig();
+    applyBTAudioBlockSamples();
     applyYMF288Volume();
     applySoundModuleType();
+    applyPredecodeADPCM();
 }
 
 namespace
@@ -359,6 +420,10 @@ SystemSettings::storeToNVS() const
         nvs.setInt("288ryvol", ymf288RhythmVol_);
         nvs.setInt("neopixmode", static_cast<int>(neoPixelMode_));
         nvs.setInt("neopixbl", neoPixelBrightness_);
+        nvs.setBool("pdxpredec", predecodeADPCM_);
+        nvs.setInt("sprate", speakerSampleRate_);
+        nvs.setInt("spblock", speakerBlockSamples_);
+        nvs.setInt("btablock", btAudioBlockSamples_);
 
         btMIDI_.storeTo(nvs);
         btAudio_.storeTo(nvs);
@@ -432,6 +497,22 @@ SystemSettings::loadFromNVS()
         {
             neoPixelBrightness_ = v.value();
         }
+        if (auto v = nvs.getBool("pdxpredec"))
+        {
+            predecodeADPCM_ = v.value();
+        }
+        if (auto v = nvs.getInt("sprate"))
+        {
+            speakerSampleRate_ = v.value();
+        }
+        if (auto v = nvs.getInt("spblock"))
+        {
+            speakerBlockSamples_ = v.value();
+        }
+        if (auto v = nvs.getInt("btablock"))
+        {
+            btAudioBlockSamples_ = v.value();
+        }
 
         btMIDI_.loadFrom(nvs);
         btAudio_.loadFrom(nvs);
@@ -7,6 +7,8 @@
 
 #include "locale.h"
 #include <array>
+#include <stddef.h>
+#include <stdint.h>
 
 namespace sys
 {
@@ -49,6 +51,10 @@ enum class DeltaSigmaMode
 {
     ORDER_1ST,
     ORDER_3RD,
+    // 保存する値が変わらないように後ろに足す
+    ORDER_2ND,
+    ORDER_4TH,
+    ORDER_5TH,
 };
 
 enum class NeoPixelMode
@@ -116,6 +122,10 @@ class SystemSettings
     //    NeoPixelMode neoPixelMode_     = NeoPixelMode::OFF;
     NeoPixelMode neoPixelMode_ = NeoPixelMode::SPECTRUM;
     int neoPixelBrightness_    = 20;
+    bool predecodeADPCM_       = true; // PSRAM がある時だけ効く
+    int speakerSampleRate_     = 44100;
+    int speakerBlockSamples_   = 128; // 小さいほど遅延が減る
+    int btAudioBlockSamples_   = 128;
 
     TrackSetting trackSetting_[100];
 
@@ -174,6 +184,18 @@ public:
     int getNeoPixelBrightness() const { return neoPixelBrightness_; }
     void setNeoPixelBrightness(int v) { neoPixelBrightness_ = v; }
 
+    bool isEnabledPredecodeADPCM() const { return predecodeADPCM_; }
+    void enablePredecodeADPCM(bool f) { predecodeADPCM_ = f; }
+
+    int getInternalSpeakerSampleRate() const { return speakerSampleRate_; }
+    void setInternalSpeakerSampleRate(int v) { speakerSampleRate_ = v; }
+
+    int getInternalSpeakerBlockSamples() const { return speakerBlockSamples_; }
+    void setInternalSpeakerBlockSamples(int n) { speakerBlockSamples_ = n; }
+
+    int getBTAudioBlockSamples() const { return btAudioBlockSamples_; }
+    void setBTAudioBlockSamples(int n) { btAudioBlockSamples_ = n; }
+
     BluetoothAudio& getBluetoothAudio() { return btAudio_; }
     BluetoothMIDI& getBluetoothMIDI() { return btMIDI_; }
 
@@ -181,9 +203,12 @@ public:
     void applyBackLightIntensity() const;
     void applyDeltaSigmaMode() const;
     void applyInternalSpeakerMode() const;
+    void applyInternalSpeakerConfig() const;
+    void applyBTAudioBlockSamples() const;
 
     void applyYMF288Volume() const;
     void applySoundModuleType() const;
+    void applyPredecodeADPCM() const;
 
     void apply() const;
 
@@ -4,68 +4,261 @@
  */
 
 #include "fft.h"
-#include <utility>
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
 
 namespace util
 {
 
-/// @param sincosTable sin[0]*16384, cos[0]*16384, ...
-void
-realFFT(int16_t* a, const int16_t* sincosTable, int n)
+namespace
 {
-    // http://www.kurims.kyoto-u.ac.jp/~ooura/fftman/ftmn2_12.html#sec2_1_2
 
-    /* ---- scrambler ---- */
-    int i = 0;
-    for (int j = 1; j < n - 1; ++j)
+constexpr int HEADROOM_LIMIT = 1 << 13; // 1段で最大 1+2√2 倍になるため 2bit
+constexpr int32_t SQRT_HALF  = 23170;   // 1/√2 (Q15)
+
+inline int16_t
+toQ15(double v)
+{
+    int i = static_cast<int>(floor(v * 32768 + 0.5));
+    return i > 32767 ? 32767 : (i < -32768 ? -32768 : i);
+}
+
+inline int32_t
+mulQ15(int32_t a, int32_t b)
+{
+    return (a * b + (1 << 14)) >> 15;
+}
+
+// 次の段で溢れないように全体をスケーリングする
+int
+normalize(int16_t* a, int n)
+{
+    int bits = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        bits |= abs(a[i]);
+    }
+
+    int shift = 0;
+    while ((bits >> shift) >= HEADROOM_LIMIT)
     {
-        for (int k = n >> 1; k > (i ^= k); k >>= 1)
+        ++shift;
+    }
+
+    if (shift)
+    {
+        const int round = 1 << (shift - 1);
+        for (int i = 0; i < n; ++i)
         {
+            a[i] = (a[i] + round) >> shift;
         }
-        if (j < i)
+    }
+    return shift;
+}
+
+} // namespace
+
+RealFFT::RealFFT(int n)
+    : n_(n)
+    , log2n_(0)
+{
+    assert(n >= 16 && (n & (n - 1)) == 0);
+    while ((1 << log2n_) < n)
+    {
+        ++log2n_;
+    }
+
+    // scrambler は毎回計算せずに swap する組を覚えておく
+    for (int i = 0, j = 0; i < n - 1; ++i)
+    {
+        if (i < j)
         {
-            std::swap(a[i], a[j]);
+            bitRevSwap_.push_back(i);
+            bitRevSwap_.push_back(j);
         }
+        int k = n >> 1;
+        while (k <= j)
+        {
+            j -= k;
+            k >>= 1;
+        }
+        j += k;
     }
 
-    int theta_step = n << 1; // 2pi
+    // L字 butterfly で使う角度は 3a < 3π/4 まで
+    int nTwiddle = n * 3 / 8;
+    sinCos_.resize(nTwiddle * 2);
+    for (int i = 0; i < nTwiddle; ++i)
+    {
+        double t           = 2 * M_PI * i / n;
+        sinCos_[i * 2 + 0] = toQ15(sin(t));
+        sinCos_[i * 2 + 1] = toQ15(cos(t));
+    }
 
-    int m, mh;
-    for (mh = 1; (m = mh << 1) <= n; mh = m)
+    // (1 - cosθ)/2
+    window_.resize(n);
+    for (int i = 0; i < n; ++i)
     {
-        int mq = mh >> 1;
-        theta_step >>= 1;
-        /* ---- real to real butterflies (W == 1) ---- */
-        for (int jr = 0; jr < n; jr += m)
+        window_[i] = toQ15((1 - cos(2 * M_PI * i / n)) * 0.5);
+    }
+}
+
+int
+RealFFT::apply(int16_t* a) const
+{
+    // Sorensen, Jones, Heideman, Burrus
+    // "Real-valued fast Fourier transform algorithms" (1987) の split-radix 版
+    // 各段の前にブロック浮動小数点で正規化する
+
+    const int n = n_;
+
+    /* ---- scrambler ---- */
+    {
+        auto p    = bitRevSwap_.data();
+        auto pEnd = p + bitRevSwap_.size();
+        for (; p != pEnd; p += 2)
         {
-            int kr  = jr + mh;
-            auto xr = a[kr];
-            a[kr]   = a[jr] - xr;
-            a[jr] += xr;
+            auto i = p[0];
+            auto j = p[1];
+            auto t = a[i];
+            a[i]   = a[j];
+            a[j]   = t;
         }
-        /* ---- complex to complex butterflies (W != 1) ---- */
-        auto sincosp = sincosTable;
-        for (int i = 1; i < mq; ++i)
+    }
+
+    int exp = normalize(a, n);
+
+    /* ---- length two butterflies ---- */
+    {
+        int i0 = 0;
+        int id = 4;
+        do
+        {
+            for (; i0 < n - 1; i0 += id)
+            {
+                int32_t t1 = a[i0];
+                int32_t t2 = a[i0 + 1];
+                a[i0]      = t1 + t2;
+                a[i0 + 1]  = t1 - t2;
+            }
+            id <<= 1;
+            i0 = id - 2;
+            id <<= 1;
+        } while (i0 < n - 1);
+    }
+
+    /* ---- L shaped butterflies ---- */
+    int n2        = 2;
+    int thetaStep = n >> 1; // sinCos_ 上の e = 2π/n2 の index
+    for (int k = n; k > 2; k >>= 1)
+    {
+        n2 <<= 1;
+        thetaStep >>= 1;
+        const int n4 = n2 >> 2;
+        const int n8 = n2 >> 3;
+
+        exp += normalize(a, n);
+
+        int i1 = 0;
+        int id = n2 << 1;
+        do
         {
-            sincosp += theta_step;
-            int16_t wi = -sincosp[0]; // sin (theta * i);
-            int16_t wr = sincosp[1];  // cos (theta * i);
-            for (int j = 0; j < n; j += m)
+            for (; i1 < n; i1 += id)
             {
-                int jr     = j + i;
-                int ji     = j + mh - i;
-                int kr     = j + mh + i;
-                int ki     = j + m - i;
-                int16_t xr = (wr * a[kr] + wi * a[ki]) >> 14;
-                int16_t xi = (wr * a[ki] - wi * a[kr]) >> 14;
-                a[kr]      = -a[ji] + xi;
-                a[ki]      = a[ji] + xi;
-                a[ji]      = a[jr] - xr;
-                a[jr]      = a[jr] + xr;
+                int i2 = i1 + n4;
+                int i3 = i2 + n4;
+                int i4 = i3 + n4;
+
+                int32_t t1 = a[i4] + a[i3];
+                a[i4]      = a[i4] - a[i3];
+                a[i3]      = a[i1] - t1;
+                a[i1]      = a[i1] + t1;
+
+                if (n4 != 1)
+                {
+                    int i0 = i1 + n8;
+                    i2 += n8;
+                    i3 += n8;
+                    i4 += n8;
+
+                    int32_t x3 = a[i3];
+                    int32_t x4 = a[i4];
+                    t1         = mulQ15(x3 + x4, SQRT_HALF);
+                    int32_t t2 = mulQ15(x3 - x4, SQRT_HALF);
+                    int32_t x2 = a[i2];
+                    a[i4]      = x2 - t1;
+                    a[i3]      = -x2 - t1;
+                    a[i2]      = a[i0] - t2;
+                    a[i0]      = a[i0] + t2;
+                }
             }
+            id <<= 1;
+            i1 = id - n2;
+            id <<= 1;
+        } while (i1 < n);
+
+        for (int j = 2; j <= n8; ++j)
+        {
+            const int16_t* sc1 = &sinCos_[(j - 1) * thetaStep * 2];
+            const int16_t* sc3 = &sinCos_[(j - 1) * thetaStep * 3 * 2];
+            const int32_t ss1  = sc1[0];
+            const int32_t cc1  = sc1[1];
+            const int32_t ss3  = sc3[0];
+            const int32_t cc3  = sc3[1];
+
+            int i  = 0;
+            int id = n2 << 1;
+            do
+            {
+                for (; i < n; i += id)
+                {
+                    int i1 = i + j - 1;
+                    int i2 = i1 + n4;
+                    int i3 = i2 + n4;
+                    int i4 = i3 + n4;
+                    int i5 = i + n4 - j + 1;
+                    int i6 = i5 + n4;
+                    int i7 = i6 + n4;
+                    int i8 = i7 + n4;
+
+                    int32_t x3 = a[i3];
+                    int32_t x4 = a[i4];
+                    int32_t x7 = a[i7];
+                    int32_t x8 = a[i8];
+
+                    int32_t t1 = (x3 * cc1 + x7 * ss1 + (1 << 14)) >> 15;
+                    int32_t t2 = (x7 * cc1 - x3 * ss1 + (1 << 14)) >> 15;
+                    int32_t t3 = (x4 * cc3 + x8 * ss3 + (1 << 14)) >> 15;
+                    int32_t t4 = (x8 * cc3 - x4 * ss3 + (1 << 14)) >> 15;
+
+                    int32_t t5 = t1 + t3;
+                    int32_t t6 = t2 + t4;
+                    t3         = t1 - t3;
+                    t4         = t2 - t4;
+
+                    int32_t x1 = a[i1];
+                    int32_t x2 = a[i2];
+                    int32_t x5 = a[i5];
+                    int32_t x6 = a[i6];
+
+                    a[i8] = x6 + t6;
+                    a[i3] = t6 - x6;
+                    a[i4] = x2 - t3;
+                    a[i7] = -x2 - t3;
+                    a[i1] = x1 + t5;
+                    a[i6] = x1 - t5;
+                    a[i2] = x5 + t4;
+                    a[i5] = x5 - t4;
+                }
+                id <<= 1;
+                i = id - n2;
+                id <<= 1;
+            } while (i < n);
         }
-        /* ---- real to complex butterflies are trivial ---- */
     }
+
+    return exp;
 }
 
 } // namespace util
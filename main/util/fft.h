@@ -6,11 +6,36 @@
 #define _4C6BAAB8_C134_3DCA_33A1_C88011EC0906
 
 #include <stdint.h>
+#include <vector>
 
 namespace util
 {
 
-void realFFT(int16_t* a, const int16_t* sincosTable, int n);
+// 固定小数点 split-radix 実数 FFT
+// 対応サイズは 16 以上の 2^n (256, 512, 1024 を想定)
+class RealFFT
+{
+    int n_;
+    int log2n_;
+    std::vector<uint16_t> bitRevSwap_; // swap する index の組
+    std::vector<int16_t> sinCos_;      // sin, cos (Q15) [0, 3n/8)
+    std::vector<int16_t> window_;      // Hann (Q15)
+
+public:
+    explicit RealFFT(int n);
+
+    int getSize() const { return n_; }
+    int getLog2Size() const { return log2n_; }
+
+    // 入力コピー時に掛ける窓関数
+    const int16_t* getWindow() const { return window_.data(); }
+
+    // in-place 変換
+    // 結果は a[k] = Re(X[k]) (0 <= k <= n/2), a[n - k] = Im(X[k])
+    // 戻り値はブロック浮動小数点の指数 (X[k] = a[k] << exp)
+    int apply(int16_t* a) const;
+};
+
+} // namespace util
 
-}
 #endif /* _4C6BAAB8_C134_3DCA_33A1_C88011EC0906 */
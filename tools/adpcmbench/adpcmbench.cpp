@@ -0,0 +1,245 @@
+/*
+ * M6258Coder のまとめて処理する版 (decodeBlock, encodeBlock) が、表を
+ * 使わずに式で書いた符号化と同じ結果になるかを見て、速さを比べる
+ * ホスト用のツール
+ *
+ *  adpcmbench [-n msamples] [-r repeat]
+ *
+ *  -n  サンプル数 (M 単位, default 8)
+ *  -r  時間を測る回数 (default 3、一番速いものを使う)
+ */
+
+#include <sound_sys/m6258_coder.h>
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+using sound_sys::M6258Coder;
+using Clock = std::chrono::steady_clock;
+
+int failures_ = 0;
+
+void
+check(bool cond, const char* what)
+{
+    if (!cond)
+    {
+        printf("NG: %s\n", what);
+        ++failures_;
+    }
+}
+
+// 表を使わずに式で書いたもの (M6258Coder::update() の #if 0 の方と、
+// 前の分岐で書いた encodeSample())
+class RefCoder
+{
+    int value_ = 0;
+    int idx_   = 0;
+
+    static int getPredict(int i)
+    {
+        static const int table[] = {
+            16,  17,  19,  21,  23,  25,  28,  31,  34,   37,   41,   45,  50,
+            55,  60,  66,  73,  80,  88,  97,  107, 118,  130,  143,  157, 173,
+            190, 209, 230, 253, 279, 307, 337, 371, 408,  449,  494,  544, 598,
+            658, 724, 796, 875, 963, 1060, 1166, 1282, 1411, 1552,
+        };
+        return table[i];
+    }
+
+public:
+    int update(int x)
+    {
+        static const int adjTable[] = {-1, -1, -1, -1, 2, 4, 6, 8};
+        int d = getPredict(idx_) * (((x & 7) << 1) + 1) >> 3;
+        value_ += x & 8 ? -d : d;
+        idx_ = std::max(0, std::min(48, idx_ + adjTable[x & 7]));
+        return value_;
+    }
+
+    int encodeSample(int v)
+    {
+        int predict = getPredict(idx_);
+        int diff    = v - value_;
+        int sp      = std::abs(diff) << 2;
+        int x       = diff < 0 ? 8 : 0;
+        if (sp > predict * 4)
+        {
+            x += 4;
+            sp -= predict * 4;
+        }
+        if (sp > predict * 2)
+        {
+            x += 2;
+            sp -= predict * 2;
+        }
+        if (sp > predict)
+        {
+            x += 1;
+        }
+        update(x);
+        return x;
+    }
+};
+
+// 一番速かったものの秒数
+template <class F>
+double
+measure(int repeat, F&& f)
+{
+    double best = INFINITY;
+    for (int i = 0; i < repeat; ++i)
+    {
+        auto t0 = Clock::now();
+        f();
+        best = std::min(
+            best, std::chrono::duration<double>(Clock::now() - t0).count());
+    }
+    return best;
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+    size_t count = 8 << 20;
+    int repeat   = 3;
+
+    int c;
+    while ((c = getopt(argc, argv, "n:r:")) != -1)
+    {
+        switch (c)
+        {
+        case 'n':
+            count = size_t(std::max(1, atoi(optarg))) << 20;
+            break;
+        case 'r':
+            repeat = std::max(1, atoi(optarg));
+            break;
+        default:
+            fprintf(stderr, "usage: adpcmbench [-n msamples] [-r repeat]\n");
+            return 1;
+        }
+    }
+
+    // 正弦波に雑音を足したもの
+    std::mt19937 rng(3);
+    std::vector<int16_t> pcm(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        pcm[i] = int16_t(12000 * sin(i * 0.013) + int(rng() % 4000) - 2000);
+    }
+
+    // 符号化 (16bit を 4bit 右シフトして 12bit に)
+    constexpr int SHIFT = 4;
+    std::vector<uint8_t> adpcm(count / 2);
+    std::vector<uint8_t> adpcmRef(count / 2);
+    {
+        RefCoder ref;
+        for (size_t i = 0; i < count; i += 2)
+        {
+            auto clamp = [](int v) {
+                return std::min(2047, std::max(-2048, v >> SHIFT));
+            };
+            int x0          = ref.encodeSample(clamp(pcm[i]));
+            int x1          = ref.encodeSample(clamp(pcm[i + 1]));
+            adpcmRef[i / 2] = x0 | (x1 << 4);
+        }
+    }
+    double encSample = measure(repeat, [&] {
+        M6258Coder coder;
+        coder.encode<SHIFT>(adpcm.data(), pcm.data(), count);
+    });
+    check(adpcm == adpcmRef, "encode<>() matches the reference");
+    std::fill(adpcm.begin(), adpcm.end(), 0);
+    double encBlock = measure(repeat, [&] {
+        M6258Coder coder;
+        coder.encodeBlock(adpcm.data(), pcm.data(), count, SHIFT);
+    });
+    check(adpcm == adpcmRef, "encodeBlock() matches the reference");
+
+    // 復号
+    std::vector<int> ref(count);
+    {
+        RefCoder coder;
+        for (size_t i = 0; i < count / 2; ++i)
+        {
+            ref[i * 2]     = coder.update(adpcm[i] & 15);
+            ref[i * 2 + 1] = coder.update(adpcm[i] >> 4);
+        }
+    }
+    std::vector<int> decoded(count);
+    double decSample = measure(repeat, [&] {
+        M6258Coder coder;
+        coder.decode<4>(decoded.data(), adpcm.data(), count / 2);
+    });
+    check(decoded == ref, "decode<>() matches the reference");
+    std::vector<int16_t> decoded16(count);
+    bool inRange    = false;
+    double decBlock = measure(repeat, [&] {
+        M6258Coder coder;
+        inRange = coder.decodeBlock(decoded16.data(), adpcm.data(), count / 2);
+    });
+    check(inRange && std::equal(ref.begin(), ref.end(), decoded16.begin()),
+          "decodeBlock() matches the reference");
+
+    // でたらめな ADPCM で int16_t からはみ出したら false になること
+    {
+        std::vector<uint8_t> noise(1 << 16);
+        for (auto& v : noise)
+        {
+            v = uint8_t(rng());
+        }
+        RefCoder coder;
+        bool fits = true;
+        for (auto v : noise)
+        {
+            for (int x : {v & 15, v >> 4})
+            {
+                int s = coder.update(x);
+                fits &= s >= -32768 && s <= 32767;
+            }
+        }
+        std::vector<int16_t> out(noise.size() * 2);
+        M6258Coder m;
+        check(m.decodeBlock(out.data(), noise.data(), noise.size()) == fits,
+              "decodeBlock() detects overflow");
+    }
+
+    // 1 サンプルずつ
+    {
+        RefCoder a;
+        M6258Coder b;
+        int bad = 0;
+        for (int i = 0; i < 2000000; ++i)
+        {
+            int v = int(rng() % 4096) - 2048;
+            bad += a.encodeSample(v) != b.encodeSample(v);
+        }
+        check(bad == 0, "encodeSample() matches the reference");
+    }
+
+    printf("%zu samples\n", count);
+    printf("encode  encode<>()    %8.1f MB/s  encodeBlock() %8.1f MB/s"
+           "  (PCM16 in)\n",
+           count * 2 / encSample / 1e6,
+           count * 2 / encBlock / 1e6);
+    printf("decode  decode<>()    %8.1f MB/s  decodeBlock() %8.1f MB/s"
+           "  (ADPCM in)\n",
+           count / 2 / decSample / 1e6,
+           count / 2 / decBlock / 1e6);
+
+    printf("%s\n", failures_ ? "NG" : "OK");
+    return failures_ ? 1 : 0;
+}
@@ -0,0 +1,286 @@
+/*
+ * 出力のブロックサイズとサンプリング周波数の組み合わせごとに
+ * AudioOut タスクの 1 ブロックの処理 (FM のデコード、レート変換、履歴、
+ * スペクトル、ドライバの変換) にかかる時間と、バッファによる遅延を
+ * 表にするホスト用のツール
+ *
+ *  audiobench [-f fm_rate] [-s seconds]
+ *
+ *  -f  FM の出力のサンプリング周波数 (default 62500, YMF288 は 55466)
+ *  -s  1 つの設定で回す長さ (default 10)
+ *
+ *  CPU はホストでの値なので設定同士の比べる用
+ */
+
+#include <audio/drift_compensator.h>
+#include <audio/sampling_rate_converter.h>
+#include <audio/spectrum_analyzer.h>
+#include <audio/ym_sample_decoder.h>
+#include <util/ring_buffer.h>
+#include <util/simple_ring_buffer.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+namespace
+{
+
+// AudioOutDriverManager, FMOutputHandler と同じ
+constexpr int MAX_UNIT_SAMPLE_COUNT = 128;
+constexpr int HISTORY_SAMPLE_COUNT  = 1024;
+constexpr int FM_RING_SIZE          = 2048;
+constexpr int FM_DMA_FRAMES         = 128;
+constexpr int FM_TARGET_FRAMES      = 384;
+
+// InternalSpeakerOut と同じ
+constexpr int OVERSAMPLE_SHIFT = 2;
+constexpr int MIN_BUFFER_US    = 2500;
+
+// BTA2DPSourceManager の既定値
+constexpr int A2DP_LATENCY_MS = 50;
+
+enum class Driver
+{
+    SPEAKER,
+    A2DP,
+};
+
+struct Setting
+{
+    Driver driver;
+    uint32_t rate;
+    int block;
+};
+
+const Setting settings_[] = {
+    {Driver::SPEAKER, 44100, 128},
+    {Driver::SPEAKER, 44100, 64},
+    {Driver::SPEAKER, 44100, 32},
+    {Driver::SPEAKER, 44100, 16},
+    {Driver::SPEAKER, 48000, 128},
+    {Driver::SPEAKER, 48000, 32},
+    {Driver::A2DP, 44100, 128},
+    {Driver::A2DP, 48000, 128},
+    {Driver::A2DP, 48000, 64},
+};
+
+using Sample    = std::array<int32_t, 2>;
+using PCMSample = std::array<int16_t, 2>;
+
+struct Result
+{
+    int buffers;
+    double latencyMs;
+    double usPerBlock;
+    double maxUs;
+    double nsPerSample;
+    double cpu;
+};
+
+// InternalSpeakerOut::onUpdate() の 1 次の方
+void
+speakerStage(const Sample* src, int n, int& prev, int& pv, int& pv1)
+{
+    uint16_t out[MAX_UNIT_SAMPLE_COUNT << 3];
+    int scale = int(0.6f * 128);
+    int bias  = int(0.6f * 32768);
+    auto* dst = out;
+    for (int i = 0; i < n; ++i)
+    {
+        int v       = (((src[i][0] + src[i][1]) * scale) >> 16) + bias;
+        auto update = [&](int v0, int ofs) {
+            pv1 += (v0 - pv);
+            int vq       = pv1 & 0xff00;
+            pv           = vq;
+            dst[ofs + 0] = vq;
+            dst[ofs + 1] = vq;
+        };
+        update((prev * 3 + v) >> 2, 0);
+        update((prev + v) >> 1, 2);
+        update((prev + v * 3) >> 2, 4);
+        update(v, 6);
+        dst += 8;
+        prev = v;
+    }
+    volatile uint16_t sink = out[0];
+    (void)sink;
+}
+
+// BTA2DPSourceManager の pushSamples() と updateSampleData()
+void
+a2dpStage(const Sample* src, int n, PCMSample* fifo)
+{
+    for (int i = 0; i < n; ++i)
+    {
+        fifo[i][0] = int16_t(std::max(-32768, std::min(32767, src[i][0] >> 8)));
+        fifo[i][1] = int16_t(std::max(-32768, std::min(32767, src[i][1] >> 8)));
+    }
+    int16_t out[MAX_UNIT_SAMPLE_COUNT * 2];
+    int scale = 256;
+    for (int i = 0; i < n; ++i)
+    {
+        out[i * 2 + 0] = fifo[i][0] * scale >> 8;
+        out[i * 2 + 1] = fifo[i][1] * scale >> 8;
+    }
+    volatile int16_t sink = out[0];
+    (void)sink;
+}
+
+Result
+run(const Setting& s, uint32_t fmRate, double seconds)
+{
+    Result r{};
+    if (s.driver == Driver::SPEAKER)
+    {
+        int minSamples = uint64_t(s.rate) * MIN_BUFFER_US / 1000000;
+        r.buffers = std::max(2, (minSamples + s.block - 1) / s.block);
+        r.latencyMs = (r.buffers + 1) * s.block * 1000.0 / s.rate;
+    }
+    else
+    {
+        r.buffers   = 1;
+        r.latencyMs = A2DP_LATENCY_MS + s.block * 1000.0 / s.rate;
+    }
+
+    // FM 側
+    std::vector<uint32_t> raw(FM_DMA_FRAMES * 2);
+    for (auto& v : raw)
+    {
+        v = rand() * 65537u;
+    }
+    int16_t ringBuffer[FM_RING_SIZE]{};
+    util::RingBuffer<int16_t> ring(ringBuffer, FM_RING_SIZE);
+    float baseStep = fmRate / float(s.rate);
+    audio::SimpleLinearSamplingRateConverter src(baseStep);
+    audio::DriftCompensator drift;
+    drift.setTarget(FM_TARGET_FRAMES);
+    double produced = FM_TARGET_FRAMES;
+
+    // 出力側
+    Sample block[MAX_UNIT_SAMPLE_COUNT];
+    PCMSample history[HISTORY_SAMPLE_COUNT]{};
+    util::SimpleRingBuffer<PCMSample> historyRing(history,
+                                                  HISTORY_SAMPLE_COUNT);
+    audio::SpectrumAnalyzer spectrum;
+    PCMSample fifo[MAX_UNIT_SAMPLE_COUNT];
+    int prev = 0, pv = 0, pv1 = 0;
+
+    int blocks    = int(seconds * s.rate / s.block);
+    double total  = 0;
+    double maxUs  = 0;
+    using Clock   = std::chrono::steady_clock;
+    for (int b = 0; b < blocks; ++b)
+    {
+        auto t0 = Clock::now();
+
+        // 届いた DMA バッファをデコードしてリングに入れる
+        produced += double(fmRate) * s.block / s.rate;
+        while (produced >= FM_DMA_FRAMES &&
+               int(ring.getFullWritableSize()) >= FM_DMA_FRAMES * 2)
+        {
+            int n = FM_DMA_FRAMES;
+            while (n)
+            {
+                int ct = std::min<int>(n, ring.getWritableSize() >> 1);
+                audio::decodeYM3012Sample(ring.getWritePointer(),
+                                          raw.data(),
+                                          ct);
+                ring.advanceWritePointer(ct << 1);
+                n -= ct;
+            }
+            produced -= FM_DMA_FRAMES;
+        }
+
+        memset(block, 0, sizeof(block[0]) * s.block);
+        src.convertAccum(block, s.block, ring);
+        src.setSamplingStep(
+            baseStep * drift.update(ring.getFullReadableSize() >> 1));
+
+        // 履歴とスペクトル
+        auto pos = historyRing.getCurrentPos();
+        for (int i = 0; i < s.block; ++i)
+        {
+            auto& h = history[(pos + i) & (HISTORY_SAMPLE_COUNT - 1)];
+            h[0]    = block[i][0] >> 8;
+            h[1]    = block[i][1] >> 8;
+        }
+        historyRing.advancePointer(s.block);
+        spectrum.update(historyRing, s.block, s.rate);
+
+        if (s.driver == Driver::SPEAKER)
+        {
+            speakerStage(block, s.block, prev, pv, pv1);
+        }
+        else
+        {
+            a2dpStage(block, s.block, fifo);
+        }
+
+        double us =
+            std::chrono::duration<double, std::micro>(Clock::now() - t0)
+                .count();
+        total += us;
+        maxUs = std::max(maxUs, us);
+    }
+
+    r.usPerBlock  = total / blocks;
+    r.maxUs       = maxUs;
+    r.nsPerSample = total * 1000 / (double(blocks) * s.block);
+    r.cpu         = r.usPerBlock / (s.block * 1e6 / s.rate) * 100;
+    return r;
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+    uint32_t fmRate = 62500;
+    double seconds  = 10;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+        {
+            fmRate = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+        {
+            seconds = atof(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "usage: audiobench [-f fm_rate] [-s seconds]\n");
+            return 1;
+        }
+    }
+    if (!fmRate || seconds <= 0)
+    {
+        return 1;
+    }
+
+    printf("FM %d Hz, %.0f s per setting\n", fmRate, seconds);
+    printf("driver   rate  block  bufs  latency  us/block    max  ns/sample  "
+           "host CPU\n");
+    for (auto& s : settings_)
+    {
+        auto r = run(s, fmRate, seconds);
+        printf("%-7s %5d  %5d  %4d  %5.1fms  %8.2f  %5.0f  %9.1f  %7.2f%%\n",
+               s.driver == Driver::SPEAKER ? "speaker" : "a2dp",
+               s.rate,
+               s.block,
+               r.buffers,
+               r.latencyMs,
+               r.usPerBlock,
+               r.maxUs,
+               r.nsPerSample,
+               r.cpu);
+    }
+    return 0;
+}
@@ -0,0 +1,259 @@
+/*
+ * BLE MIDI のパケットを MidiJitterBuffer に通して
+ * 受信時刻のまま出した場合と揃えた場合の間隔のずれを比べる
+ *
+ *  ble_midi_replay [-d delay_us] capture.txt
+ *  ble_midi_replay [-d delay_us] -g [seconds]
+ *
+ *  capture.txt : ENABLE_PACKET_CAPTURE で出した "BLEMIDI <us> <hex>..." の行
+ *  -g : 送信側を真似て作る (16分音符, 7.5-30ms の接続間隔, 再送, 40ppm のずれ)
+ */
+
+#include <io/ble_midi_packet.h>
+#include <io/midi_jitter_buffer.h>
+
+#include <algorithm>
+#include <math.h>
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+namespace
+{
+
+struct Packet
+{
+    uint32_t rxUs;
+    std::vector<uint8_t> data;
+};
+
+struct Event
+{
+    int timestamp; // 13bit ms
+    uint32_t rxUs;
+    uint32_t releaseUs;
+};
+
+bool
+loadCapture(std::vector<Packet>& packets, const char* filename)
+{
+    auto fp = fopen(filename, "r");
+    if (!fp)
+    {
+        return false;
+    }
+
+    char line[1024];
+    while (fgets(line, sizeof(line), fp))
+    {
+        auto p = strstr(line, "BLEMIDI ");
+        if (!p)
+        {
+            continue;
+        }
+
+        char* s;
+        Packet pk{uint32_t(strtoul(p + 8, &s, 10)), {}};
+        while (1)
+        {
+            char* e;
+            auto v = strtoul(s, &e, 16);
+            if (e == s)
+            {
+                break;
+            }
+            pk.data.push_back(v);
+            s = e;
+        }
+        packets.push_back(std::move(pk));
+    }
+    fclose(fp);
+    return true;
+}
+
+// 送信側を真似る
+// 120BPM の 16 分音符 (125ms) を出し、接続イベントごとにまとめて送る
+void
+generate(std::vector<Packet>& packets, double seconds)
+{
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> interval(7.5, 30.0);
+    std::uniform_real_distribution<double> unit(0, 1);
+    std::exponential_distribution<double> retry(1 / 8.0);
+
+    constexpr double DRIFT   = 1 + 40e-6; // 送信側の時計が速い
+    constexpr double STEP_MS = 125;
+    constexpr uint32_t START = 0xfff00000; // 途中で 32bit が回るように
+
+    double connMs   = interval(rng); // 接続間隔 (途中で変わる)
+    double nextConn = 0;
+    double noteMs   = 3;
+    double rx       = 0;
+    int note        = 0;
+
+    while (noteMs < seconds * 1000)
+    {
+        // 次の接続イベントまでにできたものを 1 パケットにする
+        while (nextConn < noteMs)
+        {
+            nextConn += connMs;
+        }
+        if (unit(rng) < 0.01)
+        {
+            connMs = interval(rng);
+        }
+
+        Packet pk;
+        int prevTs = -1;
+        while (noteMs < nextConn && pk.data.size() < 16)
+        {
+            int ts = int(noteMs * DRIFT) & 8191;
+            if (prevTs < 0)
+            {
+                pk.data.push_back(0x80 | ((ts >> 7) & 0x3f));
+            }
+            pk.data.push_back(0x80 | (ts & 0x7f));
+            pk.data.push_back(0x90);
+            pk.data.push_back(60 + (note++ & 7));
+            pk.data.push_back(100);
+            prevTs = ts;
+            noteMs += STEP_MS;
+        }
+
+        // 電波の都合で次以降の接続イベントに回されることがある
+        double sent = nextConn;
+        if (unit(rng) < 0.05)
+        {
+            sent += connMs * (1 + int(retry(rng) / connMs));
+        }
+        // 順番は入れ替わらない
+        rx      = std::max(rx, sent + 0.3);
+        pk.rxUs = START + uint32_t(rx * 1000);
+        packets.push_back(std::move(pk));
+    }
+}
+
+struct Jitter
+{
+    double rms;
+    double max;
+};
+
+// 送信側の間隔とのずれ
+Jitter
+measure(const std::vector<Event>& events, uint32_t Event::*time)
+{
+    double sum = 0;
+    double mx  = 0;
+    int n      = 0;
+    for (size_t i = 1; i < events.size(); ++i)
+    {
+        int sent    = (events[i].timestamp - events[i - 1].timestamp) & 8191;
+        int32_t got = events[i].*time - events[i - 1].*time;
+        double e    = got - sent * 1000.0;
+        sum += e * e;
+        mx = std::max(mx, fabs(e));
+        ++n;
+    }
+    return {n ? sqrt(sum / n) : 0, mx};
+}
+
+void
+usage()
+{
+    fprintf(stderr,
+            "usage: ble_midi_replay [-d delay_us] capture.txt\n"
+            "       ble_midi_replay [-d delay_us] -g [seconds]\n");
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+    const char* in = nullptr;
+    bool gen       = false;
+    double seconds = 60;
+    uint32_t delay = io::MidiJitterBuffer::DEFAULT_DELAY_US;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+        {
+            delay = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-g") == 0)
+        {
+            gen = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                seconds = atof(argv[++i]);
+            }
+        }
+        else if (argv[i][0] != '-' && !in)
+        {
+            in = argv[i];
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    std::vector<Packet> packets;
+    if (gen)
+    {
+        generate(packets, seconds);
+    }
+    else if (!in || !loadCapture(packets, in))
+    {
+        usage();
+        return 1;
+    }
+
+    io::MidiJitterBuffer jitter;
+    jitter.setDelay(delay);
+
+    std::vector<Event> events;
+    int broken = 0;
+    for (auto& pk : packets)
+    {
+        auto f = [&](int ts, const uint8_t*, const uint8_t*) {
+            events.push_back({ts, pk.rxUs, jitter.schedule(ts, pk.rxUs)});
+        };
+        if (!io::parseBLEMidiPacket(pk.data.data(), pk.data.size(), f))
+        {
+            ++broken;
+        }
+    }
+
+    auto rx  = measure(events, &Event::rxUs);
+    auto rel = measure(events, &Event::releaseUs);
+
+    // 受信から出すまで
+    double wait = 0;
+    for (auto& e : events)
+    {
+        wait += int32_t(e.releaseUs - e.rxUs);
+    }
+
+    auto& st = jitter.getStats();
+    printf("%d packets (%d broken), %d events, delay %d us\n",
+           (int)packets.size(),
+           broken,
+           (int)events.size(),
+           delay);
+    printf("as received : jitter rms %7.0f us, max %7.0f us\n", rx.rms, rx.max);
+    printf("scheduled   : jitter rms %7.0f us, max %7.0f us\n",
+           rel.rms,
+           rel.max);
+    printf("late %d, resync %d, added latency avg %.0f us\n",
+           st.late,
+           st.resyncs,
+           events.empty() ? 0 : wait / events.size());
+    return 0;
+}
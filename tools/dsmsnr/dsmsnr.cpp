@@ -0,0 +1,288 @@
+/*
+ * 内蔵スピーカーの ΔΣ 変調の出力を FFT して可聴帯域の SN 比を測る
+ * ホスト用のツール
+ *
+ *  dsmsnr [-f freq] [-a dBFS] [-r rate]
+ *
+ *  -f  正弦波の周波数 (default 1000)
+ *  -a  振幅 (default -6)
+ *  -r  入力のサンプリング周波数 (default 44100)
+ *
+ * InternalSpeakerOut::onUpdate() と同じく L+R を DAC の範囲にして
+ * 4 倍に補間してから変調する。比べるため前の線形補間の 1 次/3 次も回す
+ * SN 比は 20Hz-20kHz の信号以外 (歪みを含む) との比
+ */
+
+#include <audio/delta_sigma_modulator.h>
+
+#include <algorithm>
+#include <chrono>
+#include <complex>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+namespace
+{
+
+constexpr int FFT_SIZE    = 65536;
+constexpr int BLOCK       = 128; // AudioOutDriverManager の最大ブロック
+constexpr int OVERSAMPLE  = 4;
+constexpr int WARMUP      = 8192;
+constexpr int TIMED_SEC   = 10; // 時間を測るのでこれだけ回す
+constexpr double BAND_LOW = 20;
+constexpr double BAND_HI  = 20000;
+
+// InternalSpeakerOut の音量 1 の時
+constexpr int SCALE = int(0.3f * 2 * 128);
+constexpr int BIAS  = int(0.3f * 2 * 32768);
+
+using Sample = int32_t[2]; // 16.8
+
+// 1 ブロック分 (L+R を DAC の範囲にした値、4 倍にしたもの) を作る
+class Modulator
+{
+public:
+    virtual ~Modulator() = default;
+    virtual void process(uint16_t* dst, const int32_t* src, int n) = 0;
+};
+
+class TemplateModulator : public Modulator
+{
+    audio::PolyphaseInterpolator4 interp_;
+    audio::DeltaSigmaFunc func_;
+    audio::DeltaSigmaState state_{};
+    int32_t work_[BLOCK * OVERSAMPLE];
+
+public:
+    TemplateModulator(int order, audio::NoiseShape shape)
+        : func_(audio::getDeltaSigmaFunc(order, shape))
+    {
+    }
+
+    void process(uint16_t* dst, const int32_t* src, int n) override
+    {
+        interp_.process(work_, src, n);
+        func_(dst, work_, n * OVERSAMPLE, state_);
+    }
+};
+
+// 前の InternalSpeakerOut::onUpdate() (線形補間)
+class LegacyModulator : public Modulator
+{
+    bool order3_;
+    int prev_ = 0, pv_ = 0, pv1_ = 0, pv2_ = 0, pv3_ = 0;
+
+public:
+    explicit LegacyModulator(bool order3)
+        : order3_(order3)
+    {
+    }
+
+    void process(uint16_t* dst, const int32_t* src, int n) override
+    {
+        for (int i = 0; i < n; ++i)
+        {
+            int v       = src[i];
+            auto update = [&](int v0, int ofs) {
+                pv1_ += (v0 - pv_);
+                int vq = pv1_ & 0xff00;
+                if (order3_)
+                {
+                    pv2_ += (pv1_ - pv_);
+                    pv3_ += (pv2_ - pv_);
+                    vq = pv3_ & 0xff00;
+                }
+                pv_          = vq;
+                dst[ofs + 0] = vq;
+                dst[ofs + 1] = vq;
+            };
+            update((prev_ * 3 + v) >> 2, 0);
+            update((prev_ + v) >> 1, 2);
+            update((prev_ + v * 3) >> 2, 4);
+            update(v, 6);
+            dst += 8;
+            prev_ = v;
+        }
+    }
+};
+
+void
+fft(std::vector<std::complex<double>>& a)
+{
+    int n = a.size();
+    for (int i = 1, j = 0; i < n; ++i)
+    {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+        {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j)
+        {
+            std::swap(a[i], a[j]);
+        }
+    }
+    for (int len = 2; len <= n; len <<= 1)
+    {
+        double ang = -2 * M_PI / len;
+        std::complex<double> wl(cos(ang), sin(ang));
+        for (int i = 0; i < n; i += len)
+        {
+            std::complex<double> w(1);
+            for (int j = 0; j < len / 2; ++j)
+            {
+                auto u               = a[i + j];
+                auto v               = a[i + j + len / 2] * w;
+                a[i + j]             = u + v;
+                a[i + j + len / 2]   = u - v;
+                w *= wl;
+            }
+        }
+    }
+}
+
+struct Result
+{
+    double snr;
+    double nsPerSample; // 出力 1 サンプルあたり
+};
+
+Result
+measure(Modulator& m, double freq, double dbfs, int rate)
+{
+    int outRate = rate * OVERSAMPLE;
+    int inCount = std::max((WARMUP + FFT_SIZE) / OVERSAMPLE + BLOCK,
+                           rate * TIMED_SEC);
+    double amp  = 32767 * pow(10, dbfs / 20);
+
+    // 入力 (16.8) から DAC の範囲へ
+    std::vector<int32_t> in(inCount);
+    for (int i = 0; i < inCount; ++i)
+    {
+        int32_t s = int32_t(amp * sin(2 * M_PI * freq * i / rate)) << 8;
+        in[i]     = (((s + s) * SCALE) >> 16) + BIAS;
+    }
+
+    std::vector<uint16_t> out(inCount * OVERSAMPLE * 2);
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i + BLOCK <= inCount; i += BLOCK)
+    {
+        m.process(&out[i * OVERSAMPLE * 2], &in[i], BLOCK);
+    }
+    double ns = std::chrono::duration<double, std::nano>(
+                    std::chrono::steady_clock::now() - t0)
+                    .count();
+
+    // Blackman-Harris 窓
+    std::vector<std::complex<double>> a(FFT_SIZE);
+    double mean = 0;
+    for (int i = 0; i < FFT_SIZE; ++i)
+    {
+        mean += out[(WARMUP + i) * 2];
+    }
+    mean /= FFT_SIZE;
+    for (int i = 0; i < FFT_SIZE; ++i)
+    {
+        double t = 2 * M_PI * i / FFT_SIZE;
+        double w = 0.35875 - 0.48829 * cos(t) + 0.14128 * cos(2 * t) -
+                   0.01168 * cos(3 * t);
+        a[i] = (out[(WARMUP + i) * 2] - mean) * w;
+    }
+    fft(a);
+
+    double binHz = double(outRate) / FFT_SIZE;
+    int sigBin   = int(freq / binHz + 0.5);
+    double sig = 0, noise = 0;
+    for (int k = int(BAND_LOW / binHz); k <= int(BAND_HI / binHz); ++k)
+    {
+        double p = std::norm(a[k]);
+        if (abs(k - sigBin) <= 6)
+        {
+            sig += p;
+        }
+        else
+        {
+            noise += p;
+        }
+    }
+
+    Result r;
+    r.snr         = 10 * log10(sig / noise);
+    r.nsPerSample = ns / (double(inCount / BLOCK * BLOCK) * OVERSAMPLE);
+    return r;
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+    double freq = 1000;
+    double dbfs = -6;
+    int rate    = 44100;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+        {
+            freq = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc)
+        {
+            dbfs = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+        {
+            rate = atoi(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "usage: dsmsnr [-f freq] [-a dBFS] [-r rate]\n");
+            return 1;
+        }
+    }
+    if (freq <= 0 || freq >= BAND_HI || rate <= 0)
+    {
+        return 1;
+    }
+
+    printf("%.0f Hz, %.1f dBFS, %d Hz x %d\n", freq, dbfs, rate, OVERSAMPLE);
+    printf("modulator               SNR(dB)  ns/sample\n");
+
+    auto print = [&](const char* name, Modulator& m) {
+        auto r = measure(m, freq, dbfs, rate);
+        printf("%-22s %7.1f  %9.2f\n", name, r.snr, r.nsPerSample);
+    };
+
+    LegacyModulator legacy1(false);
+    LegacyModulator legacy3(true);
+    print("linear, 1st (old)", legacy1);
+    print("linear, 3rd (old)", legacy3);
+
+    for (auto shape : {audio::NoiseShape::DIFFERENTIATOR,
+                       audio::NoiseShape::OPTIMIZED_ZEROS})
+    {
+        for (int order = 1; order <= audio::DELTA_SIGMA_MAX_ORDER; ++order)
+        {
+            if (order == 1 && shape == audio::NoiseShape::OPTIMIZED_ZEROS)
+            {
+                continue; // 1 次は同じ
+            }
+            char name[32];
+            snprintf(name,
+                     sizeof(name),
+                     "polyphase, %d %s",
+                     order,
+                     shape == audio::NoiseShape::DIFFERENTIATOR ? "diff"
+                                                                : "opt");
+            TemplateModulator m(order, shape);
+            print(name, m);
+        }
+    }
+    return 0;
+}
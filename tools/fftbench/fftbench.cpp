@@ -0,0 +1,382 @@
+/*
+ * util::RealFFT の精度を double の DFT と比べ、1 回の時間を測るホスト用の
+ * ツール
+ *
+ *  fftbench [-t trials] [-r repeat] [-m min_snr] [-f fps] [-b block]
+ *
+ *  -t  サイズごとの入力の数 (default 50)
+ *  -r  時間を測る回数 (default 20000)
+ *  -m  これより SNR の悪いものがあれば失敗にする dB (default 45)
+ *  -f  前の作りで解析していた画面の更新回数 /s (default 60)
+ *  -b  オーディオのブロックのサンプル数 (default 128)
+ *
+ * 入力は小さい音と大きい音の正弦波と白色雑音
+ *
+ * 続けて、スペクトル表示の解析を音声 1 秒あたりどれだけ使うかを比べる
+ *  - 前の作り: PlayerWindow が画面の更新ごとに履歴をロックして 2 回写し
+ *    FFT する (NeoPixel はその結果を使っていた)
+ *  - 表示ごとに別々に FFT する場合 (上の倍)
+ *  - audio::SpectrumAnalyzer をオーディオのブロックごとに毎回解析する場合
+ *  - audio::SpectrumAnalyzer の今の作り (ブロックごとに呼び 60 回/s 解析)
+ * 描画は含まない。x86 ならタイムスタンプカウンタのサイクル数も出す
+ */
+
+#include <audio/spectrum_analyzer.h>
+#include <util/fft.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <math.h>
+#include <mutex>
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+// 入力を作る。前の 10 個は正弦波、残りは雑音で、小さい音と大きい音を交互に
+void
+makeInput(std::vector<int16_t>& a, int trial, std::mt19937& rng)
+{
+    int n      = int(a.size());
+    double amp = trial & 1 ? 32000 : 300;
+    std::uniform_real_distribution<double> noise(-amp, amp);
+    for (int i = 0; i < n; ++i)
+    {
+        double v = trial < 10
+                       ? amp * cos(2 * M_PI * (trial + 3) * i / n + 0.3)
+                       : noise(rng);
+        a[i] = int16_t(lrint(v));
+    }
+}
+
+// double の DFT と比べた SNR (dB)
+double
+measureSNR(const std::vector<int16_t>& x, const std::vector<int16_t>& a, int e)
+{
+    int n       = int(x.size());
+    double err  = 0;
+    double sig  = 0;
+    double unit = ldexp(1.0, e);
+    for (int k = 0; k <= n / 2; ++k)
+    {
+        double re = 0;
+        double im = 0;
+        for (int i = 0; i < n; ++i)
+        {
+            double th = 2 * M_PI * k * i / n;
+            re += x[i] * cos(th);
+            im -= x[i] * sin(th);
+        }
+        double fr = a[k] * unit;
+        double fi = k == 0 || k == n / 2 ? 0 : a[n - k] * unit;
+        err += (re - fr) * (re - fr) + (im - fi) * (im - fi);
+        sig += re * re + im * im;
+    }
+    return err > 0 ? 10 * log10(sig / err) : INFINITY;
+}
+
+////
+
+constexpr uint32_t SAMPLE_RATE = 44100;
+constexpr int AUDIO_SECONDS    = 20;
+
+using HistorySample = audio::SpectrumAnalyzer::HistorySample;
+using HistoryRing   = audio::SpectrumAnalyzer::HistoryRingBuffer;
+
+uint64_t
+readCycles()
+{
+#ifdef HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// 前の PlayerWindow::onRender() の解析の所 (描画を除く)
+class OldAnalysis
+{
+    static constexpr int FFT_SIZE   = 256;
+    static constexpr int DECIMATION = 3;
+
+    util::RealFFT fft_{FFT_SIZE};
+    std::mutex& mutex_;
+    HistorySample wave_[128];
+    int16_t fftBuffer_[FFT_SIZE];
+
+public:
+    OldAnalysis(std::mutex& m)
+        : mutex_(m)
+    {
+    }
+
+    float run(const HistoryRing& history)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            history.copyLatest(wave_, 128);
+        }
+        std::array<float, 2> total{};
+        for (auto& v : wave_)
+        {
+            total[0] += v[0] * v[0];
+            total[1] += v[1] * v[1];
+        }
+
+        const int16_t* window = fft_.getWindow();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            history.copyLatest(
+                fftBuffer_, FFT_SIZE, DECIMATION, [&](const HistorySample& v) {
+                    int wf = *window++;
+                    return ((v[0] + v[1]) * wf) >> 16;
+                });
+        }
+        int exp = fft_.apply(fftBuffer_);
+        return total[0] + total[1] + fftBuffer_[1] + exp;
+    }
+};
+
+struct AnalysisCost
+{
+    int perSec;    // 音声 1 秒あたりの解析回数
+    double us;     // 音声 1 秒あたり
+    double cycles; // 音声 1 秒あたり
+};
+
+// 音声を block ずつ進め、interval サンプルごとに f を呼ぶ
+// f は解析した回数を返す。3 回測って一番速いもの
+template <class F>
+AnalysisCost
+measureAnalysis(HistoryRing& history, int block, uint32_t interval, F&& f)
+{
+    AnalysisCost best{0, INFINITY, INFINITY};
+    for (int trial = 0; trial < 3; ++trial)
+    {
+        int count    = 0;
+        uint32_t acc = 0;
+        auto t0      = Clock::now();
+        auto c0      = readCycles();
+        for (uint32_t s = 0; s < SAMPLE_RATE * AUDIO_SECONDS; s += block)
+        {
+            history.advancePointer(block);
+            acc += block;
+            if (acc >= interval)
+            {
+                acc = 0;
+                count += f();
+            }
+        }
+        auto c1 = readCycles();
+        double us =
+            std::chrono::duration<double, std::micro>(Clock::now() - t0)
+                .count();
+        if (us / AUDIO_SECONDS < best.us)
+        {
+            best = {count / AUDIO_SECONDS,
+                    us / AUDIO_SECONDS,
+                    double(c1 - c0) / AUDIO_SECONDS};
+        }
+    }
+    return best;
+}
+
+// 結果が入れ替わったら解析したということ
+int
+pollAnalyzer(audio::SpectrumAnalyzer& a, const void*& last)
+{
+    const void* p = &a.acquire();
+    bool fresh    = p != last;
+    last          = p;
+    return fresh;
+}
+
+void
+benchAnalysis(int fps, int block)
+{
+    std::vector<HistorySample> buffer(1024);
+    HistoryRing history(buffer.data(), int(buffer.size()));
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> noise(-8000, 8000);
+    for (auto& v : buffer)
+    {
+        v = {int16_t(noise(rng)), int16_t(noise(rng))};
+    }
+
+    std::mutex historyMutex;
+    OldAnalysis oldA(historyMutex);
+    OldAnalysis oldB(historyMutex);
+    volatile float sink = 0;
+    uint32_t frame      = SAMPLE_RATE / fps;
+
+    // 解析は private なので、n にサンプルレートを渡して毎回解析させる
+    audio::SpectrumAnalyzer everyBlock;
+    audio::SpectrumAnalyzer shared;
+    const void* lastEveryBlock = nullptr;
+    const void* lastShared     = nullptr;
+
+    struct Row
+    {
+        const char* name;
+        AnalysisCost cost;
+    };
+    Row rows[] = {
+        {"old: per frame",
+         measureAnalysis(history,
+                         block,
+                         frame,
+                         [&] {
+                             sink = sink + oldA.run(history);
+                             return 1;
+                         })},
+        {"old x2 (each view)",
+         measureAnalysis(history,
+                         block,
+                         frame,
+                         [&] {
+                             sink = sink + oldA.run(history);
+                             sink = sink + oldB.run(history);
+                             return 2;
+                         })},
+        {"analyzer: per block",
+         measureAnalysis(history,
+                         block,
+                         block,
+                         [&] {
+                             everyBlock.update(
+                                 history, SAMPLE_RATE, SAMPLE_RATE);
+                             return pollAnalyzer(everyBlock, lastEveryBlock);
+                         })},
+        {"analyzer: shared",
+         measureAnalysis(history,
+                         block,
+                         block,
+                         [&] {
+                             shared.update(history, block, SAMPLE_RATE);
+                             return pollAnalyzer(shared, lastShared);
+                         })},
+    };
+
+    printf("\nspectrum analysis per second of audio "
+           "(UI %d fps, block %d)\n",
+           fps,
+           block);
+    printf("%-20s %8s %10s %10s %12s\n",
+           "",
+           "FFT/s",
+           "us/FFT",
+           "us/s",
+           "Mcycles/s");
+    for (auto& r : rows)
+    {
+        printf("%-20s %8d %10.2f %10.1f %12.3f\n",
+               r.name,
+               r.cost.perSec,
+               r.cost.us / r.cost.perSec,
+               r.cost.us,
+               r.cost.cycles / 1e6);
+    }
+#ifndef HAVE_TSC
+    printf("(no cycle counter on this host)\n");
+#endif
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+    int trials    = 50;
+    int repeat    = 20000;
+    double minSNR = 45;
+    int fps       = 60;
+    int block     = 128;
+
+    int c;
+    while ((c = getopt(argc, argv, "t:r:m:f:b:")) != -1)
+    {
+        switch (c)
+        {
+        case 't':
+            trials = std::max(1, atoi(optarg));
+            break;
+        case 'r':
+            repeat = std::max(1, atoi(optarg));
+            break;
+        case 'm':
+            minSNR = atof(optarg);
+            break;
+        case 'f':
+            fps = std::clamp(atoi(optarg), 1, 1000);
+            break;
+        case 'b':
+            block = std::clamp(atoi(optarg), 16, 1024);
+            break;
+        default:
+            fprintf(stderr,
+                    "usage: fftbench [-t trials] [-r repeat] [-m snr] "
+                    "[-f fps] [-b block]\n");
+            return 1;
+        }
+    }
+
+    int failures = 0;
+    printf("%5s %12s %12s %10s\n", "size", "worst SNR", "mean SNR", "us");
+    for (int n : {16, 32, 64, 128, 256, 512, 1024})
+    {
+        util::RealFFT fft(n);
+        std::mt19937 rng(n);
+
+        double worst = INFINITY;
+        double sum   = 0;
+        std::vector<int16_t> x(n);
+        std::vector<int16_t> a(n);
+        for (int t = 0; t < trials; ++t)
+        {
+            makeInput(x, t, rng);
+            a         = x;
+            int e     = fft.apply(a.data());
+            double db = measureSNR(x, a, e);
+            worst     = std::min(worst, db);
+            sum += db;
+        }
+
+        // 毎回入力を書き直すので、その分も入る
+        makeInput(x, 10, rng);
+        auto t0 = Clock::now();
+        for (int r = 0; r < repeat; ++r)
+        {
+            a = x;
+            fft.apply(a.data());
+        }
+        double us = std::chrono::duration<double, std::micro>(Clock::now() - t0)
+                        .count() /
+                    repeat;
+
+        bool ok = worst >= minSNR;
+        printf("%5d %9.1f dB %9.1f dB %10.2f%s\n",
+               n,
+               worst,
+               sum / trials,
+               us,
+               ok ? "" : "  NG");
+        failures += !ok;
+    }
+
+    benchAnalysis(fps, block);
+
+    printf("%s\n", failures ? "NG" : "OK");
+    return failures ? 1 : 0;
+}
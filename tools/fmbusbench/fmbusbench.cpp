@@ -0,0 +1,600 @@
+/*
+ * VGM のレジスタ書き込みを FMWriteQueue と模擬のバスに通して
+ * tick ごとのバスの確保回数と時間を数えるホスト用のツール
+ * 1 書き込みごとにバスを確保して固定で待っていた以前のやり方とも比べる
+ *
+ * タイマーのコールバックの中で書く場合と、書き込みタスクに任せる場合の
+ * コールバックの時間と書き込みの時刻の揺れも比べる
+ *
+ *  fmbusbench [-t tick_us] [-j jitter_us] [-d delay_us] in.vgm
+ *  fmbusbench -s
+ *
+ *  YM2151 (0x54) か YM2608 (0x56, 0x57) の VGM
+ *  (midi2opm で作ったものなど)
+ *  -j  コールバックが起きるまでの遅れの最大 (default 200)
+ *  -d  書き込みタスクに任せる時の遅らせる時間 (default 500)
+ *  -s  スレッドを 2 つ立ててリングバッファの順序を確かめる
+ *      OPNA の F-Number のラッチの書き込みが落ちないかも見る
+ */
+
+#include <audio/fm_write_queue.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <math.h>
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+constexpr int VGM_SAMPLE_RATE = 44100;
+
+// 模擬のバスの時間 (us)
+// GPIO matrix の切り替えと SPI のロック、CS のパルス
+constexpr uint32_t BUS_SETUP_US   = 3;
+constexpr uint32_t BUS_RESTORE_US = 3;
+constexpr uint32_t STROBE_US      = 1;
+
+// 以前の FMChip::setValue() は 1 回ごとに 1 + 10 + 9us 待っていた
+constexpr uint32_t LEGACY_WRITE_US = 1 + 10 + 9;
+
+// シーケンサが 1 書き込みを作るのにかかる時間 (us)
+constexpr uint32_t COMPUTE_US = 2;
+
+constexpr uint32_t STRESS_COUNT = 200000;
+
+class MockBus final : public audio::FMWriteQueue::Bus
+{
+public:
+    void begin() override { now_ += BUS_SETUP_US; }
+    void end() override { now_ += BUS_RESTORE_US; }
+
+    void write(int addr, int v) override
+    {
+        if (first_ == UINT32_MAX)
+        {
+            first_ = now_;
+        }
+        log_.push_back((addr << 8) | v);
+        now_ += STROBE_US;
+    }
+
+    uint32_t getMicros() override { return now_; }
+    void delayMicroseconds(uint32_t us) override { now_ += us; }
+
+    void setTime(uint32_t us) { now_ = std::max(now_, us); }
+
+    // tick の最初の書き込みの時刻
+    void resetFirst() { first_ = UINT32_MAX; }
+    uint32_t getFirst() const { return first_; }
+
+    const std::vector<int>& getLog() const { return log_; }
+
+private:
+    uint32_t now_   = 0;
+    uint32_t first_ = UINT32_MAX;
+    std::vector<int> log_;
+};
+
+// 本物の時計で動くバス。書いた値が順番どおりか確かめる
+class CheckBus final : public audio::FMWriteQueue::Bus
+{
+public:
+    void begin() override {}
+    void end() override {}
+
+    void write(int addr, int v) override
+    {
+        if (!(addr & 1))
+        {
+            return;
+        }
+        if (v != (expect_ & 0xff))
+        {
+            ++errors_;
+        }
+        expect_ = v + 1;
+        ++count_;
+    }
+
+    uint32_t getMicros() override
+    {
+        using namespace std::chrono;
+        return duration_cast<microseconds>(
+                   steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    void delayMicroseconds(uint32_t us) override
+    {
+        auto t0 = getMicros();
+        while (getMicros() - t0 < us)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    int getCount() const { return count_; }
+    int getErrors() const { return errors_; }
+
+private:
+    int expect_ = 0;
+    int count_  = 0;
+    int errors_ = 0;
+};
+
+struct Result
+{
+    int ticks;
+    int maxWrites;
+    uint32_t maxBusUs;
+    uint32_t maxLegacy;
+    uint64_t legacyUs;
+
+    // コールバックの時間
+    uint64_t callbackUs;
+    uint32_t maxCallbackUs;
+
+    // tick の最初の書き込みの tick からの時刻
+    double offsetSum;
+    double offsetSq;
+    uint32_t minOffset;
+    uint32_t maxOffset;
+
+    audio::FMWriteQueue::Stats stats;
+    std::vector<int> log;
+};
+
+struct Write
+{
+    uint32_t sample;
+    uint8_t port;
+    uint8_t reg;
+    uint8_t value;
+};
+
+bool
+loadVGM(std::vector<Write>& writes, bool& opna, int& clock, const char* filename)
+{
+    auto fp = fopen(filename, "rb");
+    if (!fp)
+    {
+        return false;
+    }
+    std::vector<uint8_t> buf;
+    fseek(fp, 0, SEEK_END);
+    buf.resize(ftell(fp));
+    fseek(fp, 0, SEEK_SET);
+    bool r = fread(buf.data(), 1, buf.size(), fp) == buf.size();
+    fclose(fp);
+    if (!r || buf.size() < 0x40 || memcmp(buf.data(), "Vgm ", 4))
+    {
+        return false;
+    }
+
+    auto get32 = [&](size_t ofs) {
+        return ofs + 4 <= buf.size() ? buf[ofs] | (buf[ofs + 1] << 8) |
+                                           (buf[ofs + 2] << 16) |
+                                           (buf[ofs + 3] << 24)
+                                     : 0;
+    };
+    uint32_t version = get32(0x08);
+    uint32_t opmClk  = get32(0x30);
+    uint32_t opnaClk = version >= 0x151 ? get32(0x48) : 0;
+    opna             = !opmClk && opnaClk;
+    clock            = opna ? opnaClk : opmClk;
+
+    size_t pos = version >= 0x150 && get32(0x34) ? 0x34 + get32(0x34) : 0x40;
+    uint32_t sample = 0;
+    while (pos < buf.size())
+    {
+        int cmd = buf[pos];
+        if (cmd == 0x66)
+        {
+            break;
+        }
+
+        if ((cmd == 0x54 || cmd == 0x56 || cmd == 0x57) &&
+            pos + 3 <= buf.size())
+        {
+            bool ok = opna ? cmd != 0x54 : cmd == 0x54;
+            if (ok)
+            {
+                writes.push_back({sample,
+                                  uint8_t(cmd == 0x57),
+                                  buf[pos + 1],
+                                  buf[pos + 2]});
+            }
+            pos += 3;
+        }
+        else if (cmd == 0x61 && pos + 3 <= buf.size())
+        {
+            sample += buf[pos + 1] | (buf[pos + 2] << 8);
+            pos += 3;
+        }
+        else if (cmd == 0x62 || cmd == 0x63)
+        {
+            sample += cmd == 0x62 ? 735 : 882;
+            ++pos;
+        }
+        else if (cmd >= 0x70 && cmd <= 0x7f)
+        {
+            sample += (cmd & 15) + 1;
+            ++pos;
+        }
+        else if (cmd == 0x67)
+        {
+            pos += 7 + get32(pos + 3);
+        }
+        else if (cmd >= 0x30 && cmd <= 0x3f)
+        {
+            pos += 2;
+        }
+        else if (cmd >= 0x40 && cmd <= 0x5f)
+        {
+            pos += 3;
+        }
+        else if (cmd >= 0xa0 && cmd <= 0xbf)
+        {
+            pos += 3;
+        }
+        else if (cmd >= 0xc0 && cmd <= 0xdf)
+        {
+            pos += 4;
+        }
+        else if (cmd >= 0xe0)
+        {
+            pos += 5;
+        }
+        else
+        {
+            fprintf(stderr, "unknown command %02x at 0x%zx\n", cmd, pos);
+            return false;
+        }
+    }
+    return true;
+}
+
+Result
+run(const std::vector<Write>& writes,
+    bool opna,
+    int clock,
+    int tickUs,
+    int jitterUs,
+    int delayUs,
+    bool async)
+{
+    MockBus bus;
+    audio::FMWriteQueue queue;
+    queue.setBus(&bus);
+    queue.setChip(opna ? audio::FMWriteQueue::ChipType::OPNA
+                       : audio::FMWriteQueue::ChipType::OPM,
+                  clock);
+    queue.resetStats();
+
+    // 書き込みタスクは別のコアで動いているとみなして、起こされたら
+    // その時刻から空になるまで回す
+    uint32_t producerUs = 0;
+    auto runWriter      = [&] {
+        bus.setTime(producerUs);
+        while (int32_t rest = queue.drain())
+        {
+            bus.delayMicroseconds(rest);
+        }
+    };
+    if (async)
+    {
+        queue.setWriteDelay(delayUs);
+        queue.setWakeup([&] {
+            if (queue.getDepth() >= audio::FMWriteQueue::FIFO_SIZE)
+            {
+                runWriter();
+            }
+        });
+    }
+
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> jitter(0, jitterUs);
+
+    Result r{};
+    r.minOffset = UINT32_MAX;
+
+    // tick ごとにまとめて書く
+    size_t i = 0;
+    while (i < writes.size())
+    {
+        auto tick = uint64_t(writes[i].sample) * 1000000 / VGM_SAMPLE_RATE /
+                    tickUs;
+        uint32_t tickTime = uint32_t(tick * tickUs);
+
+        // タイマータスクが起きるまでの遅れ
+        uint32_t start = tickTime + jitter(rng);
+        if (!async)
+        {
+            bus.setTime(start);
+        }
+        bus.resetFirst();
+
+        auto busUs = queue.getStats().busUs;
+        int n      = 0;
+        queue.beginBatch(tickTime);
+        while (i < writes.size() &&
+               uint64_t(writes[i].sample) * 1000000 / VGM_SAMPLE_RATE /
+                       tickUs ==
+                   tick)
+        {
+            auto& w = writes[i++];
+            queue.write(w.port << 1, w.reg);
+            queue.write((w.port << 1) | 1, w.value);
+            ++n;
+        }
+
+        // 同期の時は作り終わってからバスに出す
+        uint32_t compute = n * COMPUTE_US;
+        if (!async)
+        {
+            bus.delayMicroseconds(compute);
+        }
+        queue.endBatch();
+
+        uint32_t callback;
+        if (async)
+        {
+            callback   = compute;
+            producerUs = start + compute;
+            runWriter();
+        }
+        else
+        {
+            callback = bus.getMicros() - start;
+        }
+        r.callbackUs += callback;
+        r.maxCallbackUs = std::max(r.maxCallbackUs, callback);
+
+        if (bus.getFirst() != UINT32_MAX)
+        {
+            uint32_t ofs = bus.getFirst() - tickTime;
+            r.offsetSum += ofs;
+            r.offsetSq += double(ofs) * ofs;
+            r.minOffset = std::min(r.minOffset, ofs);
+            r.maxOffset = std::max(r.maxOffset, ofs);
+        }
+
+        // 以前はアドレスとデータの 1 回ずつにバスを確保して待っていた
+        uint32_t legacy =
+            n * 2 * (BUS_SETUP_US + LEGACY_WRITE_US + BUS_RESTORE_US);
+        r.legacyUs += legacy;
+        r.maxLegacy = std::max(r.maxLegacy, legacy);
+        r.maxBusUs  = std::max(r.maxBusUs, queue.getStats().busUs - busUs);
+        r.maxWrites = std::max(r.maxWrites, n);
+        ++r.ticks;
+    }
+
+    r.stats = queue.getStats();
+    r.log   = bus.getLog();
+    return r;
+}
+
+void
+printTiming(const char* name, const Result& r)
+{
+    int n       = std::max(r.ticks, 1);
+    double mean = r.offsetSum / n;
+    double sd   = sqrt(std::max(0.0, r.offsetSq / n - mean * mean));
+    printf("%s: callback %.1f us (max %d), first write +%.1f us "
+           "(sd %.1f, %d..%d)\n",
+           name,
+           r.callbackUs / double(n),
+           r.maxCallbackUs,
+           mean,
+           sd,
+           r.minOffset,
+           r.maxOffset);
+}
+
+// OPNA の F-Number は上位がラッチで下位を書いた時に入るので、
+// 上位 (ブロック) だけ変わっても下位を捨ててはいけない
+int
+checkLatch()
+{
+    MockBus bus;
+    audio::FMWriteQueue queue;
+    queue.setBus(&bus);
+    queue.setChip(audio::FMWriteQueue::ChipType::OPNA, 8000000);
+
+    static const uint8_t seq[][2] = {
+        {0xa4, 0x22}, {0xa0, 0x69}, {0xa4, 0x2a}, {0xa0, 0x69},
+        {0xac, 0x22}, {0xa8, 0x69}, {0xac, 0x2a}, {0xa8, 0x69},
+    };
+    std::vector<int> expected;
+    for (int port = 0; port < 2; ++port)
+    {
+        for (auto& w : seq)
+        {
+            queue.write(port << 1, w[0]);
+            queue.write((port << 1) | 1, w[1]);
+            expected.push_back((((port << 1) | 1) << 8) | w[1]);
+        }
+    }
+
+    std::vector<int> data;
+    for (auto v : bus.getLog())
+    {
+        if (v & 0x100)
+        {
+            data.push_back(v);
+        }
+    }
+    bool ok = data == expected;
+    printf("latch: %d/%d F-Number writes reached the bus%s\n",
+           (int)data.size(),
+           (int)expected.size(),
+           ok ? "" : " (ERROR)");
+    return ok ? 0 : 1;
+}
+
+// 書く側と出力側を別のスレッドで回して、落ちや順番の入れ替わりがないか
+int
+stress()
+{
+    CheckBus bus;
+    audio::FMWriteQueue queue;
+    queue.setBus(&bus);
+    // ビジーを短くする
+    queue.setChip(audio::FMWriteQueue::ChipType::OPM, 1000 * 1000 * 1000);
+
+    std::atomic<bool> done{false};
+    std::atomic<int> wakeups{0};
+    queue.setWakeup([&] { ++wakeups; });
+
+    std::thread writer([&] {
+        while (!done || queue.getDepth())
+        {
+            if (!queue.drain())
+            {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < STRESS_COUNT; ++i)
+    {
+        if (i % 64 == 0)
+        {
+            queue.beginBatch();
+        }
+        // キーオンは値が同じでも捨てない
+        queue.write(0, 0x08);
+        queue.write(1, i & 0xff);
+        if (i % 64 == 63)
+        {
+            queue.endBatch();
+        }
+    }
+    queue.endBatch();
+    auto t1 = std::chrono::steady_clock::now();
+    done    = true;
+    writer.join();
+
+    auto& st = queue.getStats();
+    double ns =
+        std::chrono::duration<double, std::nano>(t1 - t0).count() /
+        STRESS_COUNT;
+    printf("stress: %d/%d written, %d out of order, fifo full %d, "
+           "max depth %d, %.0f ns/write on the producer\n",
+           bus.getCount(),
+           STRESS_COUNT,
+           bus.getErrors(),
+           st.fifoFull,
+           st.maxDepth,
+           ns);
+    return bus.getCount() == int(STRESS_COUNT) && !bus.getErrors() ? 0 : 1;
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+    const char* in = nullptr;
+    int tickUs     = 1000;
+    int jitterUs   = 200;
+    int delayUs    = 500;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+        {
+            tickUs = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+        {
+            jitterUs = std::max(0, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+        {
+            delayUs = std::max(0, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "-s") == 0)
+        {
+            return checkLatch() | stress();
+        }
+        else if (argv[i][0] != '-' && !in)
+        {
+            in = argv[i];
+        }
+        else
+        {
+            in = nullptr;
+            break;
+        }
+    }
+    if (!in)
+    {
+        fprintf(stderr,
+                "usage: fmbusbench [-t tick_us] [-j jitter_us] "
+                "[-d delay_us] in.vgm\n"
+                "       fmbusbench -s\n");
+        return 1;
+    }
+
+    std::vector<Write> writes;
+    bool opna;
+    int clock;
+    if (!loadVGM(writes, opna, clock, in) || !clock)
+    {
+        fprintf(stderr, "%s: not a YM2151/YM2608 VGM.\n", in);
+        return 1;
+    }
+
+    auto sync  = run(writes, opna, clock, tickUs, jitterUs, delayUs, false);
+    auto async = run(writes, opna, clock, tickUs, jitterUs, delayUs, true);
+
+    auto& st = sync.stats;
+    printf("%s: %s %d Hz, %d writes in %d ticks of %d us (max %d)\n",
+           in,
+           opna ? "YM2608" : "YM2151",
+           clock,
+           (int)writes.size(),
+           sync.ticks,
+           tickUs,
+           sync.maxWrites);
+    printf("queue : %d dropped, %d strobes, %d sessions, "
+           "bus %.1f us/tick (max %d), wait %d us\n",
+           st.dropped,
+           st.strobes,
+           st.sessions,
+           sync.ticks ? st.busUs / double(sync.ticks) : 0,
+           sync.maxBusUs,
+           st.waitUs);
+    printf("legacy: %d sessions, bus %.1f us/tick (max %d)\n",
+           (int)writes.size() * 2,
+           sync.ticks ? sync.legacyUs / double(sync.ticks) : 0,
+           sync.maxLegacy);
+
+    printTiming("in callback ", sync);
+    printTiming("writer task ", async);
+    auto& as = async.stats;
+    printf("writer task : delay %d us, late %.1f us avg (max %d), "
+           "%d sessions, max depth %d\n",
+           delayUs,
+           as.timed ? as.lateTotalUs / double(as.timed) : 0,
+           as.lateMaxUs,
+           as.sessions,
+           as.maxDepth);
+
+    if (sync.log != async.log)
+    {
+        printf("ERROR: the writer task wrote a different sequence.\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,209 @@
+/*
+ * SampleGeneratorManager を複数のスレッドから叩く
+ * オーディオのスレッドは 128 サンプルずつ鳴らし続け、その間に
+ * 別のスレッドが add()/remove() を繰り返す
+ *
+ * 数えるもの
+ *   - remove() から戻った後に呼ばれた
+ *   - add() の後、setSampleRate() より先に accumSamples() が呼ばれた
+ *   - サンプルレートが伝わっていない
+ */
+
+#include <audio/sample_generator.h>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+constexpr int BLOCK       = 128;
+constexpr int POOL        = 12; // MAX_GENERATORS より多くして一杯も試す
+constexpr int WRITERS     = 3;
+constexpr float RATES[2]  = {44100, 48000};
+constexpr int DEFAULT_SEC = 5;
+
+std::atomic<uint32_t> retiredCalls_{};
+std::atomic<uint32_t> noRateCalls_{};
+std::atomic<uint32_t> wrongRateCalls_{};
+std::atomic<float> currentRate_{};
+
+class TestGenerator : public audio::SampleGenerator
+{
+public:
+    // 登録している間だけ true。呼ばれてよいかの判定に使う
+    std::atomic<bool> active{};
+    std::atomic<float> rate{};
+
+    void accumSamples(std::array<int32_t, 2>* buffer,
+                      uint32_t samples) override
+    {
+        if (!active.load())
+        {
+            ++retiredCalls_;
+        }
+        float r = rate.load();
+        if (r == 0)
+        {
+            ++noRateCalls_;
+        }
+        else if (r != currentRate_.load())
+        {
+            ++wrongRateCalls_;
+        }
+        for (uint32_t i = 0; i < samples; ++i)
+        {
+            buffer[i][0] += 1;
+            buffer[i][1] += 1;
+        }
+    }
+
+    void setSampleRate(float r) override { rate.store(r); }
+};
+
+uint32_t
+elapsedUs(std::chrono::steady_clock::time_point t0)
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now() - t0).count();
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+    int sec = argc > 1 ? atoi(argv[1]) : DEFAULT_SEC;
+
+    audio::SampleGeneratorManager manager;
+    TestGenerator pool[POOL];
+    std::atomic<bool> owned[POOL]{};
+    std::atomic<bool> quit{};
+
+    std::atomic<uint32_t> adds{};
+    std::atomic<uint32_t> removes{};
+    std::atomic<uint32_t> fulls{};
+    std::atomic<uint32_t> maxRemoveUs{};
+
+    // 書き換える側。自分が取った generator だけ出し入れする
+    std::vector<std::thread> writers;
+    for (int w = 0; w < WRITERS; ++w)
+    {
+        writers.emplace_back([&, w] {
+            std::mt19937 rng(w + 1);
+            std::vector<int> mine;
+            while (!quit.load())
+            {
+                if (mine.empty() || rng() % 2)
+                {
+                    int i = rng() % POOL;
+                    bool expected = false;
+                    if (!owned[i].compare_exchange_strong(expected, true))
+                    {
+                        continue;
+                    }
+                    auto& g = pool[i];
+                    g.rate.store(0);
+                    g.active.store(true);
+                    if (manager.add(&g))
+                    {
+                        mine.push_back(i);
+                        ++adds;
+                    }
+                    else
+                    {
+                        g.active.store(false);
+                        owned[i].store(false);
+                        ++fulls;
+                    }
+                }
+                else
+                {
+                    size_t k = rng() % mine.size();
+                    int i    = mine[k];
+                    mine.erase(mine.begin() + k);
+
+                    auto t0 = std::chrono::steady_clock::now();
+                    manager.remove(&pool[i]);
+                    uint32_t us = elapsedUs(t0);
+                    pool[i].active.store(false);
+                    owned[i].store(false);
+                    ++removes;
+
+                    uint32_t m = maxRemoveUs.load();
+                    while (us > m && !maxRemoveUs.compare_exchange_weak(m, us))
+                    {
+                    }
+                }
+                std::this_thread::sleep_for(
+                    std::chrono::microseconds(rng() % 500));
+            }
+            for (int i : mine)
+            {
+                manager.remove(&pool[i]);
+                pool[i].active.store(false);
+            }
+        });
+    }
+
+    // オーディオのスレッド
+    uint32_t blocks     = 0;
+    uint32_t maxBlockUs = 0;
+    auto end = std::chrono::steady_clock::now() + std::chrono::seconds(sec);
+    std::array<int32_t, 2> buffer[BLOCK];
+    while (std::chrono::steady_clock::now() < end)
+    {
+        // ときどきサンプルレートを変える
+        float rate = RATES[(blocks >> 10) & 1];
+        currentRate_.store(rate);
+        manager.setSampleRate(rate);
+
+        auto t0 = std::chrono::steady_clock::now();
+        manager.accumSamples(buffer, BLOCK);
+        maxBlockUs = std::max(maxBlockUs, elapsedUs(t0));
+        ++blocks;
+
+        // 実機は 128 / 44100 秒ごと。ここでは詰めて回す
+        if ((blocks & 15) == 0)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    audio::SampleGeneratorManager::Stats stats[POOL];
+    size_t nstats = manager.getStats(stats, POOL);
+
+    quit.store(true);
+    for (auto& t : writers)
+    {
+        t.join();
+    }
+
+    printf("blocks          %u\n", blocks);
+    printf("add / remove    %u / %u (full %u)\n",
+           adds.load(),
+           removes.load(),
+           fulls.load());
+    printf("max block       %u us\n", maxBlockUs);
+    printf("max remove wait %u us\n", maxRemoveUs.load());
+    for (size_t i = 0; i < nstats; ++i)
+    {
+        auto& s = stats[i];
+        printf("  generator %2d  calls %7u  avg %.2f us  max %u us\n",
+               int(static_cast<const TestGenerator*>(s.generator) - pool),
+               s.calls,
+               s.calls ? double(s.totalUs) / s.calls : 0.0,
+               s.maxUs);
+    }
+
+    uint32_t errors = retiredCalls_ + noRateCalls_ + wrongRateCalls_;
+    printf("called after remove  %u\n", retiredCalls_.load());
+    printf("called before rate   %u\n", noRateCalls_.load());
+    printf("wrong rate           %u\n", wrongRateCalls_.load());
+    printf("%s\n", errors ? "NG" : "OK");
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,16 @@
+/*
+ * ホストでビルドする時の system/mutex.h の代わり
+ */
+#ifndef _2D81C6A4_7E3B_4F59_9A0C_5B14E8F7D263
+#define _2D81C6A4_7E3B_4F59_9A0C_5B14E8F7D263
+
+#include <mutex>
+
+namespace sys
+{
+
+using Mutex = std::recursive_mutex;
+
+} // namespace sys
+
+#endif /* _2D81C6A4_7E3B_4F59_9A0C_5B14E8F7D263 */
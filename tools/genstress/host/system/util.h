@@ -0,0 +1,31 @@
+/*
+ * ホストでビルドする時の system/util.h の代わり
+ */
+#ifndef _B6F0A2D9_1C57_4E83_8D4B_0E9A37C51F68
+#define _B6F0A2D9_1C57_4E83_8D4B_0E9A37C51F68
+
+#include <chrono>
+#include <stdint.h>
+#include <thread>
+
+namespace sys
+{
+
+inline uint32_t
+micros()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(
+               steady_clock::now().time_since_epoch())
+        .count();
+}
+
+inline void
+delay(uint32_t ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+} // namespace sys
+
+#endif /* _B6F0A2D9_1C57_4E83_8D4B_0E9A37C51F68 */
@@ -0,0 +1,341 @@
+/*
+ * MemoryFrameBuffer の直接書く kernel (drawBits, drawBitsThick, put 系) を
+ * FrameBufferBase の setPixel() で書く処理と比べるホスト用のツール
+ *
+ *  glyphbench [-d datadir] [-n count] [-f frames]
+ *
+ *  -d  テクスチャのある所 (default ../../main/data)
+ *  -n  比べる描画の数 (default 20000)
+ *  -f  時間を測るフレーム数 (default 200)
+ *
+ * 1. 窓と位置をでたらめにして両方に描き、バッファが同じか見る
+ * 2. 320x240 を 8x8 の文字やテクスチャで埋める時間を測る
+ */
+
+#include <graphics/bmp.h>
+#include <graphics/memory_framebuffer.h>
+#include <graphics/texture.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+using graphics::FrameBufferBase;
+using graphics::MemoryFrameBuffer;
+using graphics::Texture;
+using Clock = std::chrono::steady_clock;
+
+// setPixel() だけを持ち、描画は FrameBufferBase のものを使う
+class RefFrameBuffer final : public FrameBufferBase
+{
+    std::vector<uint16_t> buffer_;
+    uint32_t bw_;
+    uint32_t bh_;
+    uint32_t wx_ = 0;
+    uint32_t wy_ = 0;
+    uint32_t ww_;
+    uint32_t wh_;
+
+public:
+    RefFrameBuffer(uint32_t w, uint32_t h)
+        : buffer_(w * h)
+        , bw_(w)
+        , bh_(h)
+        , ww_(w)
+        , wh_(h)
+    {
+    }
+
+    uint16_t* getBits() { return buffer_.data(); }
+
+    // MemoryFrameBuffer と同じくバッファの中に収める
+    void setWindow(uint32_t x, uint32_t y, uint32_t w, uint32_t h) override
+    {
+        wx_ = std::min(x, bw_);
+        wy_ = std::min(y, bh_);
+        ww_ = std::min(w, bw_ - wx_);
+        wh_ = std::min(h, bh_ - wy_);
+    }
+    uint32_t getLeft() const override { return wx_; }
+    uint32_t getTop() const override { return wy_; }
+    uint32_t getWidth() const override { return ww_; }
+    uint32_t getHeight() const override { return wh_; }
+    uint32_t getBufferWidth() const override { return bw_; }
+    uint32_t getBufferHeight() const override { return bh_; }
+
+    uint32_t makeColor(int r, int g, int b) const override
+    {
+        return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+    }
+
+    void setPixel(uint32_t x, uint32_t y, uint32_t c) override
+    {
+        if (x < bw_ && y < bh_)
+        {
+            buffer_[x + y * bw_] = MemoryFrameBuffer::toNative(c);
+        }
+    }
+    uint32_t getPixel(uint32_t x, uint32_t y) const override
+    {
+        return MemoryFrameBuffer::toNative(buffer_[x + y * bw_]);
+    }
+};
+
+enum class Op
+{
+    BITS,
+    BITS_BG,
+    BITS_THICK,
+    PUT,
+    PUT_TRANS,
+    PUT_REPLACED,
+    N,
+};
+
+const char* opNames_[] = {
+    "drawBits",
+    "drawBits bg",
+    "drawBitsThick",
+    "put",
+    "putTrans",
+    "putReplaced",
+};
+
+struct Draw
+{
+    Op op;
+    int x, y, w, h;
+    int sx, sy;
+    const uint8_t* bits;
+    uint16_t color, bg;
+};
+
+void
+draw(FrameBufferBase& fb, const Texture& tex, const Draw& d)
+{
+    switch (d.op)
+    {
+    case Op::BITS:
+        fb.drawBits(d.x, d.y, d.w, d.h, d.bits, d.color);
+        break;
+    case Op::BITS_BG:
+        fb.drawBits(d.x, d.y, d.w, d.h, d.bits, d.color, d.bg);
+        break;
+    case Op::BITS_THICK:
+        fb.drawBitsThick(d.x, d.y, d.w, d.h, d.bits, d.color, d.bg);
+        break;
+    case Op::PUT:
+        fb.put(tex, d.x, d.y, d.sx, d.sy, d.w, d.h);
+        break;
+    case Op::PUT_TRANS:
+        fb.putTrans(tex, d.x, d.y, d.sx, d.sy, d.w, d.h);
+        break;
+    case Op::PUT_REPLACED:
+        fb.putReplaced(tex, d.x, d.y, d.sx, d.sy, d.w, d.h, d.color, d.bg);
+        break;
+    default:
+        break;
+    }
+}
+
+// 1. 同じ結果になるか
+int
+compare(const Texture& tex, int count)
+{
+    constexpr int W = 67; // pitch を奇数にしてそろっていない所も通す
+    constexpr int H = 45;
+
+    std::mt19937 rng(1);
+    auto rnd = [&](int n) { return int(rng() % n); };
+
+    int failures[int(Op::N)] = {};
+    int counts[int(Op::N)]   = {};
+    for (int i = 0; i < count; ++i)
+    {
+        MemoryFrameBuffer mem(W, H);
+        RefFrameBuffer ref(W, H);
+        for (int p = 0; p < W * H; ++p)
+        {
+            mem.getBits()[p] = ref.getBits()[p] = uint16_t(rng());
+        }
+
+        // 窓ははみ出すこともある
+        if (rnd(3))
+        {
+            int wx = rnd(W);
+            int wy = rnd(H);
+            int ww = rnd(W + 10);
+            int wh = rnd(H + 10);
+            mem.setWindow(wx, wy, ww, wh);
+            ref.setWindow(wx, wy, ww, wh);
+        }
+
+        // 1 行 40 bit まで
+        uint8_t bits[5 * 20];
+        for (auto& v : bits)
+        {
+            v = uint8_t(rng() & rng());
+        }
+
+        Draw d;
+        d.op    = Op(rnd(int(Op::N)));
+        d.w     = 1 + rnd(36);
+        d.h     = 1 + rnd(20);
+        d.x     = rnd(W + 20) - 10;
+        d.y     = rnd(H + 20) - 10;
+        d.sx    = rnd(tex.getWidth() - d.w);
+        d.sy    = rnd(tex.getHeight() - d.h);
+        d.bits  = bits;
+        d.color = uint16_t(rng());
+        d.bg    = uint16_t(rng());
+
+        draw(mem, tex, d);
+        draw(ref, tex, d);
+
+        ++counts[int(d.op)];
+        if (memcmp(mem.getBits(), ref.getBits(), W * H * 2))
+        {
+            if (failures[int(d.op)]++ == 0)
+            {
+                printf("NG: %s at (%d, %d) %dx%d\n",
+                       opNames_[int(d.op)],
+                       d.x,
+                       d.y,
+                       d.w,
+                       d.h);
+            }
+        }
+    }
+
+    int total = 0;
+    for (int op = 0; op < int(Op::N); ++op)
+    {
+        printf("%-14s %6d draws %6d different\n",
+               opNames_[op],
+               counts[op],
+               failures[op]);
+        total += failures[op];
+    }
+    return total;
+}
+
+// 2. 320x240 を 8x8 で埋めるのにかかる時間 (us/frame)
+double
+measure(FrameBufferBase& fb, const Texture& tex, Op op, int frames)
+{
+    static const uint8_t glyph[8] = {
+        0x18, 0x24, 0x42, 0x7e, 0x42, 0x42, 0x42, 0x00};
+
+    Draw d{};
+    d.op    = op;
+    d.w     = op == Op::BITS_THICK ? 6 : 8;
+    d.h     = d.w;
+    d.bits  = glyph;
+    d.color = 0xffff;
+    d.bg    = 0x1234;
+
+    auto t0 = Clock::now();
+    for (int f = 0; f < frames; ++f)
+    {
+        for (int y = 0; y < 240; y += 8)
+        {
+            for (int x = 0; x < 320; x += 8)
+            {
+                d.x  = x + (8 - d.w) / 2;
+                d.y  = y + (8 - d.h) / 2;
+                d.sx = x % (tex.getWidth() - 8);
+                d.sy = y % (tex.getHeight() - 8);
+                draw(fb, tex, d);
+            }
+        }
+    }
+    return std::chrono::duration<double, std::micro>(Clock::now() - t0)
+               .count() /
+           frames;
+}
+
+bool
+readFile(std::vector<uint8_t>& buf, const std::string& filename)
+{
+    auto fp = fopen(filename.c_str(), "rb");
+    if (!fp)
+    {
+        return false;
+    }
+    fseek(fp, 0, SEEK_END);
+    buf.resize(ftell(fp));
+    fseek(fp, 0, SEEK_SET);
+    bool r = fread(buf.data(), 1, buf.size(), fp) == buf.size();
+    fclose(fp);
+    return r;
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+    std::string dataDir = "../../main/data";
+    int count           = 20000;
+    int frames          = 200;
+
+    int c;
+    while ((c = getopt(argc, argv, "d:n:f:")) != -1)
+    {
+        switch (c)
+        {
+        case 'd':
+            dataDir = optarg;
+            break;
+        case 'n':
+            count = std::max(0, atoi(optarg));
+            break;
+        case 'f':
+            frames = std::max(1, atoi(optarg));
+            break;
+        default:
+            fprintf(stderr,
+                    "usage: glyphbench [-d datadir] [-n count] [-f frames]\n");
+            return 1;
+        }
+    }
+
+    // 本体と同じテクスチャ (8bit パレット、下から上の並び)
+    std::vector<uint8_t> bmp;
+    Texture tex;
+    if (!readFile(bmp, dataDir + "/m5dx_material.bmp") ||
+        !tex.initialize(reinterpret_cast<const graphics::BMP*>(bmp.data())))
+    {
+        fprintf(stderr, "%s: can't load the texture.\n", dataDir.c_str());
+        return 1;
+    }
+
+    int failures = compare(tex, count);
+
+    MemoryFrameBuffer mem(320, 240);
+    RefFrameBuffer ref(320, 240);
+    printf("\n%-14s %12s %12s %8s\n",
+           "320x240",
+           "setPixel us",
+           "kernel us",
+           "ratio");
+    for (int op = 0; op < int(Op::N); ++op)
+    {
+        double r = measure(ref, tex, Op(op), frames);
+        double m = measure(mem, tex, Op(op), frames);
+        printf("%-14s %12.1f %12.1f %7.2fx\n", opNames_[op], r, m, r / m);
+    }
+
+    printf("%s\n", failures ? "NG" : "OK");
+    return failures ? 1 : 0;
+}
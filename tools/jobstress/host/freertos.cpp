@@ -0,0 +1,154 @@
+/*
+ * ホストでビルドする時の FreeRTOS の代わり
+ * 時間切れはなく、portMAX_DELAY で待つものとして扱う
+ */
+
+#include <freertos/event_groups.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+struct HostSemaphore
+{
+    // 再帰 mutex か数えるセマフォのどちらか
+    std::recursive_mutex recursive;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    UBaseType_t count = 0;
+};
+
+struct HostEventGroup
+{
+    std::mutex mutex;
+    std::condition_variable cond;
+    EventBits_t bits = 0;
+};
+
+SemaphoreHandle_t
+xSemaphoreCreateRecursiveMutex()
+{
+    return new HostSemaphore;
+}
+
+SemaphoreHandle_t
+xSemaphoreCreateCounting(UBaseType_t, UBaseType_t init)
+{
+    auto h   = new HostSemaphore;
+    h->count = init;
+    return h;
+}
+
+void
+vSemaphoreDelete(SemaphoreHandle_t h)
+{
+    delete h;
+}
+
+BaseType_t
+xSemaphoreTakeRecursive(SemaphoreHandle_t h, TickType_t)
+{
+    h->recursive.lock();
+    return pdTRUE;
+}
+
+BaseType_t
+xSemaphoreGiveRecursive(SemaphoreHandle_t h)
+{
+    h->recursive.unlock();
+    return pdTRUE;
+}
+
+BaseType_t
+xSemaphoreTake(SemaphoreHandle_t h, TickType_t)
+{
+    std::unique_lock<std::mutex> lock(h->mutex);
+    h->cond.wait(lock, [h] { return h->count > 0; });
+    --h->count;
+    return pdTRUE;
+}
+
+BaseType_t
+xSemaphoreGive(SemaphoreHandle_t h)
+{
+    {
+        std::lock_guard<std::mutex> lock(h->mutex);
+        ++h->count;
+    }
+    h->cond.notify_one();
+    return pdTRUE;
+}
+
+BaseType_t
+xTaskCreatePinnedToCore(TaskFunction_t func,
+                        const char*,
+                        uint32_t,
+                        void* param,
+                        UBaseType_t,
+                        TaskHandle_t*,
+                        BaseType_t)
+{
+    std::thread(func, param).detach();
+    return pdPASS;
+}
+
+void
+vTaskDelete(TaskHandle_t)
+{
+    // 呼んだスレッドはこの後タスク関数から戻って終わる
+}
+
+EventGroupHandle_t
+xEventGroupCreate()
+{
+    return new HostEventGroup;
+}
+
+void
+vEventGroupDelete(EventGroupHandle_t h)
+{
+    delete h;
+}
+
+EventBits_t
+xEventGroupWaitBits(EventGroupHandle_t h,
+                    EventBits_t bits,
+                    BaseType_t clear,
+                    BaseType_t waitForAll,
+                    TickType_t)
+{
+    std::unique_lock<std::mutex> lock(h->mutex);
+    h->cond.wait(lock, [&] {
+        return waitForAll ? (h->bits & bits) == bits : (h->bits & bits) != 0;
+    });
+    auto r = h->bits;
+    if (clear)
+    {
+        h->bits &= ~bits;
+    }
+    return r;
+}
+
+EventBits_t
+xEventGroupSetBits(EventGroupHandle_t h, EventBits_t bits)
+{
+    EventBits_t r;
+    {
+        std::lock_guard<std::mutex> lock(h->mutex);
+        r = h->bits |= bits;
+    }
+    h->cond.notify_all();
+    return r;
+}
+
+EventBits_t
+xEventGroupClearBits(EventGroupHandle_t h, EventBits_t bits)
+{
+    std::lock_guard<std::mutex> lock(h->mutex);
+    auto r = h->bits;
+    h->bits &= ~bits;
+    return r;
+}
@@ -0,0 +1,23 @@
+/*
+ * ホストでビルドする時の FreeRTOS の代わり
+ * JobManager と sys::Mutex が使うものだけを std::thread で作る
+ */
+#ifndef _35359BD9_7FF2_4F5A_A4AE_7212146A96A1
+#define _35359BD9_7FF2_4F5A_A4AE_7212146A96A1
+
+#include <stddef.h>
+#include <stdint.h>
+
+using BaseType_t  = int;
+using UBaseType_t = unsigned;
+using TickType_t  = uint32_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define portMAX_DELAY 0xffffffff
+#define portNUM_PROCESSORS 2
+#define tskNO_AFFINITY 0x7fffffff
+#define configMAX_TASK_NAME_LEN 16
+
+#endif /* _35359BD9_7FF2_4F5A_A4AE_7212146A96A1 */
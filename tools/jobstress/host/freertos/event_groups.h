@@ -0,0 +1,21 @@
+#ifndef _200DEC25_2DCE_44F2_85BF_EB273BAC3A07
+#define _200DEC25_2DCE_44F2_85BF_EB273BAC3A07
+
+#include "FreeRTOS.h"
+
+struct HostEventGroup;
+using EventGroupHandle_t = HostEventGroup*;
+using EventBits_t        = uint32_t;
+
+EventGroupHandle_t xEventGroupCreate();
+void vEventGroupDelete(EventGroupHandle_t h);
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t h,
+                                EventBits_t bits,
+                                BaseType_t clear,
+                                BaseType_t waitForAll,
+                                TickType_t wait);
+EventBits_t xEventGroupSetBits(EventGroupHandle_t h, EventBits_t bits);
+EventBits_t xEventGroupClearBits(EventGroupHandle_t h, EventBits_t bits);
+
+#endif /* _200DEC25_2DCE_44F2_85BF_EB273BAC3A07 */
@@ -0,0 +1,18 @@
+#ifndef _CC76ABB2_6088_43CB_8DD7_3D01CE96DD63
+#define _CC76ABB2_6088_43CB_8DD7_3D01CE96DD63
+
+#include "FreeRTOS.h"
+
+struct HostSemaphore;
+using SemaphoreHandle_t = HostSemaphore*;
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex();
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t init);
+void vSemaphoreDelete(SemaphoreHandle_t h);
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t h, TickType_t wait);
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t h);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t h, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t h);
+
+#endif /* _CC76ABB2_6088_43CB_8DD7_3D01CE96DD63 */
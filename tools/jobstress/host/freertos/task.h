@@ -0,0 +1,19 @@
+#ifndef _7BD382BE_1F7F_4CBE_8942_49931E3F818F
+#define _7BD382BE_1F7F_4CBE_8942_49931E3F818F
+
+#include "FreeRTOS.h"
+
+using TaskHandle_t   = void*;
+using TaskFunction_t = void (*)(void*);
+
+// 優先度とコアは見ない
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t func,
+                                   const char* name,
+                                   uint32_t stackSize,
+                                   void* param,
+                                   UBaseType_t prio,
+                                   TaskHandle_t* handle,
+                                   BaseType_t core);
+void vTaskDelete(TaskHandle_t h);
+
+#endif /* _7BD382BE_1F7F_4CBE_8942_49931E3F818F */
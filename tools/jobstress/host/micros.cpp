@@ -0,0 +1,22 @@
+/*
+ * ホストでビルドする時の sys::micros()
+ * 時刻を自分で進めるツール (uitest) は、これの代わりに自分で持つ
+ */
+
+#include <system/util.h>
+
+#include <chrono>
+
+namespace sys
+{
+
+uint32_t
+micros()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(
+               steady_clock::now().time_since_epoch())
+        .count();
+}
+
+} // namespace sys
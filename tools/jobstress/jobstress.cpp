@@ -0,0 +1,451 @@
+/*
+ * JobManager をホストで回して、ジョブの数え漏れやデータ競合がないかと
+ * add() から実行までの時間を見るツール
+ *
+ *  jobstress [-r rounds] [-n samples]
+ *
+ *  -r  ストレスの回数 (default 200)
+ *  -n  時間を測るジョブの数 (default 5000)
+ *
+ * 1. 小さいジョブがヒープを使わないこと
+ * 2. 複数のスレッドから優先度とグループを混ぜて積み、半分はキャンセルして、
+ *    実行とキャンセルの数が積んだ数と合うこと
+ * 3. worker が 1 つなら優先度の高いものから、同じ優先度は積んだ順
+ * 4. worker が空いている時と、LOW で埋まっている時の HIGH の待ち時間
+ *    (p50, p99, max)
+ * 5. start と stop を繰り返す
+ * 6. cancel() して待った後のグループに積んだものは実行される
+ * 7. LOW だけを取る worker は、他の worker がふさがっていても LOW を実行し
+ *    NORMAL には手を出さない
+ *
+ * make SANITIZE=thread でデータ競合を調べる
+ */
+
+#include <system/job_manager.h>
+#include <system/util.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <new>
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+using sys::Job;
+using sys::JobGroup;
+using sys::JobManager;
+using Priority = JobManager::Priority;
+
+std::atomic<long> allocs_{0};
+int failures_ = 0;
+
+void
+check(bool cond, const char* what)
+{
+    if (!cond)
+    {
+        printf("NG: %s\n", what);
+        ++failures_;
+    }
+}
+
+// 1. ヒープを使う数
+void
+testInplace()
+{
+    long a0 = allocs_;
+    int x   = 1;
+    double y = 2;
+    Job small([x, y, &a0] {
+        (void)x;
+        (void)y;
+    });
+    Job moved(std::move(small));
+    moved();
+    check(allocs_ == a0, "small job stays inplace");
+
+    char big[Job::INPLACE_SIZE * 2] = {};
+    a0 = allocs_;
+    Job large([big] { (void)big; });
+    Job movedLarge(std::move(large));
+    movedLarge();
+    check(allocs_ == a0 + 1, "large job allocates once");
+
+    // 持ち物は実行後に片付く
+    std::string s = "a string long enough to live on the heap";
+    size_t n      = 0;
+    {
+        Job j([s, &n] { n += s.size(); });
+        j();
+    }
+    check(n == s.size(), "captured string");
+}
+
+// 2. 数え漏れがないこと
+void
+testStress(int rounds)
+{
+    constexpr int THREADS = 3;
+    constexpr int JOBS    = 50;
+
+    JobManager jm;
+    jm.start(0, 4096, "JM", 2);
+
+    std::atomic<long> ran{0};
+    long added = 0;
+    for (int r = 0; r < rounds; ++r)
+    {
+        JobGroup keep;
+        JobGroup drop;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < THREADS; ++t)
+        {
+            threads.emplace_back([&, t] {
+                for (int i = 0; i < JOBS; ++i)
+                {
+                    jm.add(keep, [&] { ++ran; }, Priority((i + t) % 3));
+                    jm.add(drop, [&] {
+                        for (volatile int k = 0; k < 1000; ++k)
+                        {
+                        }
+                        ++ran;
+                    });
+                }
+            });
+        }
+        if (r & 1)
+        {
+            drop.cancel();
+        }
+        for (auto& t : threads)
+        {
+            t.join();
+        }
+        keep.wait();
+        drop.wait();
+        check(keep.isIdle() && drop.isIdle(), "groups are idle");
+        added += THREADS * JOBS * 2;
+    }
+    jm.waitIdle();
+
+    auto st = jm.getStats();
+    printf("stress: %ld added, %u executed, %u canceled\n",
+           added,
+           st.executed,
+           st.canceled);
+    check(st.executed + st.canceled == added, "every job is counted");
+    check(st.executed == ran, "executed jobs ran");
+    jm.stop();
+}
+
+// 3. 実行順
+void
+testOrder()
+{
+    JobManager jm;
+    jm.start(0, 4096, "one", 1);
+
+    std::atomic<bool> go{false};
+    std::mutex m;
+    std::vector<int> order;
+    auto push = [&](int v) {
+        std::lock_guard<std::mutex> lock(m);
+        order.push_back(v);
+    };
+
+    // 最初のジョブで worker をふさいでから積む
+    jm.add([&] {
+        while (!go)
+        {
+            std::this_thread::yield();
+        }
+    });
+    for (int i = 0; i < 3; ++i)
+    {
+        jm.add([&, i] { push(i); }, Priority::LOW);
+    }
+    jm.add([&] { push(10); }, Priority::NORMAL);
+    jm.add([&] { push(100); }, Priority::HIGH);
+    jm.add([&] { push(101); }, Priority::HIGH);
+    go = true;
+    jm.waitIdle();
+    jm.stop();
+
+    check(order == std::vector<int>({100, 101, 10, 0, 1, 2}), "job order");
+}
+
+struct Latency
+{
+    uint32_t p50;
+    uint32_t p99;
+    uint32_t max;
+};
+
+Latency
+summarize(std::vector<uint32_t>& v)
+{
+    std::sort(v.begin(), v.end());
+    return {v[v.size() / 2], v[v.size() * 99 / 100], v.back()};
+}
+
+// 4. add() から実行が始まるまで
+// busy なら 200us かかる LOW のジョブを worker の数より多く積み続ける
+// 積む時刻が LOW の実行とそろわないように、間を 0-300us でずらす
+Latency
+measureLatency(JobManager& jm, int samples, bool busy)
+{
+    constexpr uint32_t LOAD_US = 200;
+
+    std::atomic<bool> stop{false};
+    std::atomic<int> queued{0};
+    JobGroup background;
+    auto fill = [&] {
+        while (busy && queued < jm.getWorkerCount() * 2)
+        {
+            ++queued;
+            jm.add(background,
+                   [&] {
+                       auto t0 = sys::micros();
+                       while (!stop && sys::micros() - t0 < LOAD_US)
+                       {
+                       }
+                       --queued;
+                   },
+                   Priority::LOW);
+        }
+    };
+
+    std::mt19937 rng(1);
+    std::vector<uint32_t> lat;
+    lat.reserve(samples);
+    for (int i = 0; i < samples; ++i)
+    {
+        fill();
+        std::this_thread::sleep_for(std::chrono::microseconds(rng() % 300));
+
+        JobGroup g;
+        uint32_t t0 = sys::micros();
+        uint32_t t1 = 0;
+        jm.add(g, [&] { t1 = sys::micros(); }, Priority::HIGH);
+        g.wait();
+        lat.push_back(t1 - t0);
+    }
+    stop = true;
+    background.wait();
+    return summarize(lat);
+}
+
+// 5. start/stop を繰り返す。積んだまま止めたものは捨てられる
+void
+testRestart()
+{
+    JobManager jm;
+    std::atomic<int> ran{0};
+    for (int i = 0; i < 50; ++i)
+    {
+        jm.start(0, 4096, "JM", 1 + i % 3);
+        JobGroup g;
+        for (int k = 0; k < 20; ++k)
+        {
+            jm.add(g, [&] { ++ran; });
+        }
+        if (i & 1)
+        {
+            g.wait();
+        }
+        jm.stop();
+        check(g.isIdle(), "group is released by stop");
+    }
+    check(ran > 0, "jobs ran between restarts");
+}
+
+// 6. cancel() の後で全部終われば、また使える
+void
+testCancelThenAdd()
+{
+    JobManager jm;
+    jm.start(0, 4096, "JM", 1);
+
+    JobGroup g;
+    std::atomic<int> ran{0};
+    std::atomic<bool> started{false};
+    std::atomic<bool> go{false};
+    jm.add(g, [&] {
+        started = true;
+        while (!go)
+        {
+            std::this_thread::yield();
+        }
+        ++ran;
+    });
+    jm.add(g, [&] { ++ran; });
+    while (!started)
+    {
+        std::this_thread::yield();
+    }
+    g.cancel();
+    go = true;
+    g.wait();
+    check(ran == 1, "cancel drops queued jobs");
+    check(!g.isCancelRequested(), "cancel is cleared when drained");
+
+    jm.add(g, [&] { ++ran; });
+    g.wait();
+    check(ran == 2, "job added after cancel and wait runs");
+
+    g.cancel();
+    jm.add(g, [&] { ++ran; });
+    g.wait();
+    check(ran == 3, "cancel of an idle group is ignored");
+    jm.stop();
+}
+
+// 7. LOW だけを取る worker
+void
+testLowWorker()
+{
+    JobManager jm;
+    jm.start(0, 4096, "JM", 1, 1);
+
+    std::atomic<bool> go{false};
+    std::atomic<bool> lowRan{false};
+    std::atomic<bool> normalRan{false};
+    std::thread::id mainWorker, lowWorker, normalWorker;
+
+    // NORMAL も取る worker をふさぐ
+    std::atomic<bool> started{false};
+    jm.add([&] {
+        mainWorker = std::this_thread::get_id();
+        started    = true;
+        while (!go)
+        {
+            std::this_thread::yield();
+        }
+    });
+    while (!started)
+    {
+        std::this_thread::yield();
+    }
+    jm.add([&] {
+        normalWorker = std::this_thread::get_id();
+        normalRan    = true;
+    });
+    jm.add(
+        [&] {
+            lowWorker = std::this_thread::get_id();
+            lowRan    = true;
+        },
+        Priority::LOW);
+
+    auto t0 = std::chrono::steady_clock::now();
+    while (!lowRan &&
+           std::chrono::steady_clock::now() - t0 < std::chrono::seconds(1))
+    {
+        std::this_thread::yield();
+    }
+    check(lowRan, "LOW runs while the other worker is busy");
+    check(!normalRan, "LOW worker leaves NORMAL alone");
+
+    go = true;
+    jm.waitIdle();
+    check(normalRan && normalWorker == mainWorker, "NORMAL on main worker");
+    check(lowWorker != mainWorker, "LOW on LOW worker");
+    jm.stop();
+}
+
+} // namespace
+
+// ヒープを使った数を数える
+// inline にすると gcc が malloc と new の組み違いと見て警告する
+__attribute__((noinline)) void*
+operator new(size_t n)
+{
+    ++allocs_;
+    if (auto p = malloc(n))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void
+operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+__attribute__((noinline)) void
+operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+int
+main(int argc, char* argv[])
+{
+    int rounds  = 200;
+    int samples = 5000;
+
+    int c;
+    while ((c = getopt(argc, argv, "r:n:")) != -1)
+    {
+        switch (c)
+        {
+        case 'r':
+            rounds = std::max(1, atoi(optarg));
+            break;
+        case 'n':
+            samples = std::max(1, atoi(optarg));
+            break;
+        default:
+            fprintf(stderr, "usage: jobstress [-r rounds] [-n samples]\n");
+            return 1;
+        }
+    }
+
+    testInplace();
+    testStress(rounds);
+    testOrder();
+    testCancelThenAdd();
+    testLowWorker();
+
+    // CPU が worker より少ないと OS の切り替えの時間も入る
+    printf("%u CPUs\n", std::thread::hardware_concurrency());
+    printf("%-18s %8s %8s %8s\n", "HIGH latency us", "p50", "p99", "max");
+    // worker の数と、そのうち LOW だけを取るものの数
+    const std::pair<int, int> configs[] = {{1, 0}, {2, 0}, {1, 1}};
+    for (auto [workers, lowWorkers] : configs)
+    {
+        JobManager jm;
+        jm.start(0, 4096, "JM", workers, lowWorkers);
+        for (bool busy : {false, true})
+        {
+            auto l = measureLatency(jm, samples, busy);
+            char name[32];
+            snprintf(name,
+                     sizeof(name),
+                     "%d+%d workers, %s",
+                     workers,
+                     lowWorkers,
+                     busy ? "busy" : "idle");
+            printf("%-18s %8u %8u %8u\n", name, l.p50, l.p99, l.max);
+        }
+        jm.stop();
+    }
+
+    testRestart();
+
+    printf("%s\n", failures_ ? "NG" : "OK");
+    return failures_ ? 1 : 0;
+}
@@ -0,0 +1,491 @@
+/*
+ * SMF を SMFSequence と FMVoiceAllocator に流して VGM にするホスト用のツール
+ * 音色の割り当てやイベントの時刻を確かめたり、処理時間を測るのに使う
+ *
+ *  midi2opm [-p voice.mdx] [-d] [-a] -o out.vgm in.mid
+ *
+ *  -p : 音色を取り出す MDX (無ければ GM の音色)
+ *  -d : 10ch (ドラム) も音程のある音として鳴らす
+ *  -a : YM2151 ではなく YMF288 (VGM では YM2608) にする
+ *
+ * イベントの時刻は SMFSequence とは別に計算したものと比べる
+ * 本体と同じ 1ms ごとの tick で出した場合の遅れも測る
+ */
+
+#include <audio/sound_chip.h>
+#include <music_player/smf_sequence.h>
+#include <sound_sys/gm_fm_bank.h>
+#include <sound_sys/opm_voice_allocator.h>
+#include <sound_sys/opna_voice_allocator.h>
+#include <sound_sys/ym2151.h>
+#include <sound_sys/ymf288.h>
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+namespace
+{
+
+constexpr int VGM_SAMPLE_RATE = 44100;
+constexpr int OPM_CLOCK       = 3579545;
+
+// 本体のプレイヤーの tick
+constexpr int TICK_US        = 1000;
+constexpr int TICK_JITTER_US = 100;
+
+struct Event
+{
+    uint32_t tick;
+    uint32_t order; // 同じ tick の中で元の順番を保つ
+    uint8_t data[3];
+    uint8_t size;
+    uint32_t tempo; // size == 0 の時はテンポ (us/四分音符)
+    double us;      // 曲の頭からの時刻
+};
+
+bool
+readFile(std::vector<uint8_t>& buf, const char* filename)
+{
+    auto fp = fopen(filename, "rb");
+    if (!fp)
+    {
+        return false;
+    }
+    fseek(fp, 0, SEEK_END);
+    buf.resize(ftell(fp));
+    fseek(fp, 0, SEEK_SET);
+    bool r = fread(buf.data(), 1, buf.size(), fp) == buf.size();
+    fclose(fp);
+    return r;
+}
+
+uint32_t
+getBE(const uint8_t* p, int n)
+{
+    uint32_t v = 0;
+    while (n--)
+    {
+        v = (v << 8) | *p++;
+    }
+    return v;
+}
+
+uint32_t
+getVLQ(const uint8_t*& p, const uint8_t* end)
+{
+    uint32_t v = 0;
+    while (p < end)
+    {
+        int c = *p++;
+        v     = (v << 7) | (c & 127);
+        if (!(c & 128))
+        {
+            break;
+        }
+    }
+    return v;
+}
+
+// 比べるための時刻
+// 全トラックのイベントを並べ替えて 1 列にし、テンポから浮動小数で計算する
+bool
+loadReference(std::vector<Event>& events, const std::vector<uint8_t>& buf)
+{
+    int nTracks  = getBE(&buf[10], 2);
+    int division = getBE(&buf[12], 2);
+    if (division & 0x8000)
+    {
+        return false;
+    }
+
+    uint32_t order = 0;
+    size_t pos     = 8 + getBE(&buf[4], 4);
+    for (int tr = 0; tr < nTracks && pos + 8 <= buf.size(); ++tr)
+    {
+        size_t len       = getBE(&buf[pos + 4], 4);
+        const uint8_t* p = &buf[pos + 8];
+        auto end         = p + std::min(len, buf.size() - pos - 8);
+        pos += 8 + len;
+
+        uint32_t tick   = 0;
+        uint8_t running = 0;
+        while (p < end)
+        {
+            tick += getVLQ(p, end);
+            if (p >= end)
+            {
+                break;
+            }
+
+            uint8_t st = *p;
+            if (st == 0xff)
+            {
+                int type = p[1];
+                p += 2;
+                uint32_t n = getVLQ(p, end);
+                if (type == 0x51 && n == 3 && p + 3 <= end)
+                {
+                    events.push_back({tick, order++, {}, 0, getBE(p, 3), 0});
+                }
+                if (type == 0x2f)
+                {
+                    break;
+                }
+                p += n;
+                continue;
+            }
+            if (st == 0xf0 || st == 0xf7)
+            {
+                ++p;
+                p += getVLQ(p, end);
+                continue;
+            }
+
+            if (st & 0x80)
+            {
+                running = st;
+                ++p;
+            }
+            static constexpr uint8_t sizeTbl[] = {3, 3, 3, 3, 2, 2, 3, 1};
+            Event e{
+                tick, order++, {running}, sizeTbl[(running >> 4) & 7], 0, 0};
+            for (int i = 1; i < e.size && p < end; ++i)
+            {
+                e.data[i] = *p++;
+            }
+            events.push_back(e);
+        }
+    }
+
+    std::sort(events.begin(), events.end(), [](const Event& a, const Event& b) {
+        return a.tick < b.tick || (a.tick == b.tick && a.order < b.order);
+    });
+
+    double usPerTick = 500000.0 / division;
+    double us        = 0;
+    uint32_t prev    = 0;
+    for (auto& e : events)
+    {
+        us += (e.tick - prev) * usPerTick;
+        prev = e.tick;
+        e.us = us;
+        if (!e.size)
+        {
+            usPerTick = e.tempo / double(division);
+        }
+    }
+
+    // テンポは要らない
+    events.erase(std::remove_if(events.begin(),
+                                events.end(),
+                                [](const Event& e) { return !e.size; }),
+                 events.end());
+    return true;
+}
+
+// YM2151 か YMF288 に書かれたものを VGM のコマンドにする
+class VGMWriter : public audio::SoundChipBase
+{
+    std::vector<uint8_t> data_;
+    uint32_t samples_ = 0;
+    uint32_t pending_ = 0;
+    int reg_[2]       = {};
+    bool opna_        = false;
+
+public:
+    explicit VGMWriter(bool opna)
+        : opna_(opna)
+    {
+    }
+
+    void setValue(int addr, int v) override
+    {
+        int port = addr >> 1;
+        if (!(addr & 1))
+        {
+            reg_[port] = v;
+            return;
+        }
+        flushWait();
+        data_.push_back(opna_ ? 0x56 + port : 0x54);
+        data_.push_back(reg_[port]);
+        data_.push_back(v);
+    }
+    int getValue(int) override { return 0; }
+    int setClock(int clock) override { return clock; }
+
+    void wait(uint32_t n)
+    {
+        pending_ += n;
+        samples_ += n;
+    }
+
+    void flushWait()
+    {
+        while (pending_)
+        {
+            uint32_t n = std::min<uint32_t>(pending_, 65535);
+            data_.push_back(0x61);
+            data_.push_back(n);
+            data_.push_back(n >> 8);
+            pending_ -= n;
+        }
+    }
+
+    bool write(const char* filename)
+    {
+        flushWait();
+        data_.push_back(0x66);
+
+        uint8_t header[0x100]{};
+        auto set32 = [&](int ofs, uint32_t v) {
+            for (int i = 0; i < 4; ++i)
+            {
+                header[ofs + i] = v >> (i * 8);
+            }
+        };
+        memcpy(header, "Vgm ", 4);
+        set32(0x04, sizeof(header) + data_.size() - 4);
+        set32(0x08, 0x151);
+        set32(0x18, samples_);
+        set32(opna_ ? 0x48 : 0x30,
+              opna_ ? sound_sys::OPNAVoiceAllocator::DEFAULT_CLOCK
+                    : OPM_CLOCK);
+        set32(0x34, sizeof(header) - 0x34);
+
+        auto fp = fopen(filename, "wb");
+        if (!fp)
+        {
+            return false;
+        }
+        bool r = fwrite(header, sizeof(header), 1, fp) == 1 &&
+                 fwrite(data_.data(), 1, data_.size(), fp) == data_.size();
+        fclose(fp);
+        return r;
+    }
+
+    uint32_t getSamples() const { return samples_; }
+};
+
+void
+usage()
+{
+    fprintf(stderr,
+            "usage: midi2opm [-p voice.mdx] [-d] [-a] -o out.vgm in.mid\n");
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+    const char* in    = nullptr;
+    const char* out   = nullptr;
+    const char* voice = nullptr;
+    bool drum         = false;
+    bool opna         = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            out = argv[++i];
+        }
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+        {
+            voice = argv[++i];
+        }
+        else if (strcmp(argv[i], "-d") == 0)
+        {
+            drum = true;
+        }
+        else if (strcmp(argv[i], "-a") == 0)
+        {
+            opna = true;
+        }
+        else if (argv[i][0] != '-' && !in)
+        {
+            in = argv[i];
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if (!in || !out)
+    {
+        usage();
+        return 1;
+    }
+
+    std::vector<uint8_t> smf;
+    music_player::SMFSequence seq;
+    if (!readFile(smf, in) || !seq.load(smf.data(), smf.size()))
+    {
+        fprintf(stderr, "%s: not a SMF.\n", in);
+        return 1;
+    }
+
+    // SMPTE の時は比べない
+    std::vector<Event> ref;
+    bool hasRef = loadReference(ref, smf);
+
+    VGMWriter vgm(opna);
+    sound_sys::YM2151 ym2151;
+    sound_sys::YMF288 ymf288;
+    sound_sys::OPMVoiceAllocator opm;
+    sound_sys::OPNAVoiceAllocator opnaAllocator;
+    sound_sys::FMVoiceAllocator* allocator;
+    if (opna)
+    {
+        ymf288.setChip(&vgm);
+        opnaAllocator.setSystem(&ymf288);
+        allocator = &opnaAllocator;
+    }
+    else
+    {
+        ym2151.setChip(&vgm);
+        opm.setSystem(&ym2151);
+        allocator = &opm;
+    }
+
+    std::vector<sound_sys::OPMPatch> bank;
+    if (voice)
+    {
+        std::vector<uint8_t> buf;
+        if (!readFile(buf, voice) ||
+            !sound_sys::loadMDXVoices(bank, buf.data(), buf.size()))
+        {
+            fprintf(stderr, "%s: no voice data.\n", voice);
+            return 1;
+        }
+    }
+    else
+    {
+        bank = sound_sys::makeGMBank();
+    }
+    allocator->setPatchBank(std::move(bank));
+    allocator->setDrumChannelEnabled(drum);
+    allocator->reset();
+    allocator->resetStats();
+
+    // イベントの時刻ちょうどに鳴らす
+    uint32_t written = 0;
+    int maxDemand    = 0; // 同時に鳴らそうとしたノート数
+    int demand       = 0;
+    int nEvents      = 0;
+    int mismatch     = 0;
+    double maxErrUs  = 0;
+
+    auto t0 = std::chrono::steady_clock::now();
+    while (!seq.isFinished())
+    {
+        auto us = seq.getNextEventUs();
+        auto n  = uint32_t(us * VGM_SAMPLE_RATE / 1000000);
+        vgm.wait(n - written);
+        written = n;
+
+        music_player::SMFSequence::Message m;
+        while (seq.pop(&m, us))
+        {
+            if (hasRef)
+            {
+                if (nEvents >= (int)ref.size() ||
+                    memcmp(ref[nEvents].data, m.data, m.size))
+                {
+                    ++mismatch;
+                }
+                else
+                {
+                    maxErrUs = std::max(maxErrUs, fabs(ref[nEvents].us - us));
+                }
+            }
+            ++nEvents;
+
+            int st = m.data[0] >> 4;
+            if (st == 9 && m.data[2])
+            {
+                maxDemand = std::max(maxDemand, ++demand);
+            }
+            else if (st == 8 || st == 9)
+            {
+                demand = std::max(0, demand - 1);
+            }
+
+            allocator->message(m.data, m.size);
+        }
+    }
+    double procNs = std::chrono::duration<double, std::nano>(
+                        std::chrono::steady_clock::now() - t0)
+                        .count();
+
+    // 余韻
+    allocator->allNotesOff();
+    vgm.wait(VGM_SAMPLE_RATE * 2);
+
+    if (!vgm.write(out))
+    {
+        fprintf(stderr, "%s: write error.\n", out);
+        return 1;
+    }
+
+    // 本体と同じく揺れのある 1ms ごとの tick で出した時の遅れ
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> jitter(0, TICK_JITTER_US);
+    double lateSum = 0;
+    double lateMax = 0;
+    int idx        = 0;
+    uint64_t now   = 0;
+    seq.rewind();
+    while (!seq.isFinished())
+    {
+        now += TICK_US + jitter(rng);
+        seq.advance(now, [&](const music_player::SMFSequence::Message&) {
+            if (hasRef && idx < (int)ref.size())
+            {
+                double late = now - ref[idx].us;
+                lateSum += late;
+                lateMax = std::max(lateMax, late);
+            }
+            ++idx;
+        });
+    }
+
+    auto& st = allocator->getStats();
+    printf("%s: %d tracks, %d events, %.1f sec, %s, %d patches\n",
+           in,
+           seq.getTrackCount(),
+           nEvents,
+           vgm.getSamples() / double(VGM_SAMPLE_RATE),
+           opna ? "YMF288" : "YM2151",
+           (int)allocator->getPatchCount());
+    printf("note on %d, steal %d (max demand %d voices), "
+           "patch load %d, reuse %d\n",
+           st.noteOns,
+           st.steals,
+           maxDemand,
+           st.patchLoads,
+           st.patchReuses);
+    printf("register writes %d (%.1f per note on), %.0f ns per event\n",
+           st.regWrites,
+           st.noteOns ? st.regWrites / double(st.noteOns) : 0,
+           nEvents ? procNs / nEvents : 0);
+    if (hasRef)
+    {
+        printf("timing: %d mismatch, max error %.1f us, "
+               "%d us tick late avg %.0f us, max %.0f us\n",
+               mismatch,
+               maxErrUs,
+               TICK_US,
+               idx ? lateSum / idx : 0,
+               lateMax);
+    }
+    return 0;
+}
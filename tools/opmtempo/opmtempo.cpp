@@ -0,0 +1,376 @@
+/*
+ * OPMTimer のテンポの正確さを確かめるホスト用のツール
+ *
+ *  opmtempo [-t sec]
+ *
+ *  -t  1 つのテンポを回す時間 (default 600)
+ *
+ * 1. レジスタの振る舞い (LOAD, IRQ EN, F-RESET, フラグのエッジ)
+ * 2. MXDRV と同じく割り込みのたびに $14 に $3a を書いて、タイマ B の
+ *    値ごとの割り込みの数を数え、周期から出した数と比べる
+ * 3. 同じ手順を x68sound.cpp と同じ RealtimeOPMTimer で実時間のタイマ
+ *    (TimerScheduler) でも回し、割り込みの時刻がクロックを数えた方と
+ *    一致するか見る
+ *    途中でテンポを変え、タイマ A も動かす
+ */
+
+#include <mxdrv/realtime_opm_timer.h>
+#include <system/timer_scheduler.h>
+
+#include <algorithm>
+#include <math.h>
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+using sys::TimerScheduler;
+using Time = TimerScheduler::Time;
+
+constexpr uint32_t OPM_CLOCK = 4000000;
+constexpr uint32_t HW_CLOCK  = 1000000; // timer.cpp と同じ
+
+// MDX は 4 分音符が 48 クロック
+constexpr int CLOCKS_PER_BEAT = 48;
+
+int failures_ = 0;
+
+void
+check(bool cond, const char* what)
+{
+    if (!cond)
+    {
+        printf("NG: %s\n", what);
+        ++failures_;
+    }
+}
+
+// 1. レジスタの振る舞い
+void
+testRegisters()
+{
+    OPMTimer t;
+    bool irq;
+
+    // 止まっていれば進まない
+    check(t.getCyclesToOverflow() == 0, "stopped timer has no overflow");
+
+    t.write(0x12, 200);
+    check(t.getPeriod(OPMTimer::TIMER_B) == 1024 * 56, "timer B period");
+    t.write(0x10, 0x80);
+    t.write(0x11, 0x02);
+    check(t.getPeriod(OPMTimer::TIMER_A) == 64 * (1024 - 0x202),
+          "timer A period");
+
+    // IRQ EN なしではフラグは立たない
+    t.write(0x14, 0x02);
+    t.advance(1024 * 56, &irq);
+    check(!irq && t.readStatus() == 0, "no flag without IRQ EN");
+
+    // IRQ EN で立ち、下ろすまでは次の割り込みが来ない
+    t.write(0x14, 0x0a);
+    t.advance(1024 * 56, &irq);
+    check(irq && t.readStatus() == OPMTimer::STATUS_B, "flag B and IRQ");
+    t.advance(1024 * 56, &irq);
+    check(!irq && t.readStatus() == OPMTimer::STATUS_B, "IRQ is an edge");
+
+    // F-RESET A では B は下りない
+    t.write(0x14, 0x1a);
+    check(t.readStatus() == OPMTimer::STATUS_B, "F-RESET A keeps B");
+    t.write(0x14, 0x2a);
+    check(t.readStatus() == 0, "F-RESET B clears B");
+
+    // 動いている間に LOAD を書き直しても数え直さない
+    t.advance(1000, &irq);
+    uint32_t left = t.getCyclesToOverflow();
+    t.write(0x14, 0x0a);
+    check(t.getCyclesToOverflow() == left, "LOAD while running");
+
+    // 周期の書き換えはあふれた後から
+    t.write(0x12, 100);
+    check(t.getCyclesToOverflow() == left, "CLKB applies at reload");
+    t.advance(left, &irq);
+    check(t.getCyclesToOverflow() == 1024 * 156, "reload with new CLKB");
+
+    // 止めて LOAD し直すと最初から
+    t.write(0x14, 0x30);
+    t.write(0x14, 0x0a);
+    check(t.getCyclesToOverflow() == 1024 * 156, "restart from zero");
+
+    // 同時にあふれたら IRQ は 1 回
+    OPMTimer s;
+    s.write(0x10, 0xff - 15); // 64 * 64 = 4096
+    s.write(0x11, 0x00);
+    s.write(0x12, 252); // 1024 * 4 = 4096
+    s.write(0x14, 0x0f);
+    uint32_t n = s.advance(8192, &irq);
+    check(irq && n == 4096 &&
+              s.readStatus() == (OPMTimer::STATUS_A | OPMTimer::STATUS_B),
+          "simultaneous overflow");
+}
+
+// 割り込みで MXDRV がすることをまねる
+// 1000 回目でテンポを変え、2000 回目からタイマ A も割り込ませる
+struct Driver
+{
+    int irqs    = 0;
+    int aIrqs   = 0;
+    bool script = false;
+    std::vector<uint64_t> cycles; // 割り込みの時のクロック数
+
+    template <class Poke>
+    void onIRQ(uint8_t status, uint64_t cycle, Poke&& poke)
+    {
+        ++irqs;
+        aIrqs += (status & OPMTimer::STATUS_A) != 0;
+        cycles.push_back(cycle);
+        if (script)
+        {
+            if (irqs == 1000)
+            {
+                poke(0x12, 230);
+            }
+            if (irqs == 2000)
+            {
+                poke(0x10, 0x40);
+            }
+        }
+        // L000756: 両方のフラグを下ろして B を回し続ける
+        bool a = script && irqs >= 2000;
+        poke(0x14, a ? 0x3f : 0x3a);
+    }
+};
+
+// 割り込みの外から書いたもの。実時間の方で入った所を記録して
+// クロックを数える方でも同じ所で書く
+struct Write
+{
+    uint64_t cycle;
+    uint8_t addr;
+    uint8_t data;
+};
+
+// クロックを数えて回す (X68Sound_OpmTimerRun() と同じ)
+void
+runOffline(Driver& d,
+           uint8_t nb,
+           uint64_t cycles,
+           const std::vector<Write>& writes = {})
+{
+    OPMTimer t;
+    t.setClock(OPM_CLOCK);
+    auto poke = [&](int addr, int data) { t.write(addr, data); };
+    poke(0x12, nb);
+    poke(0x14, 0x3a);
+
+    uint64_t now = 0;
+    auto w       = writes.begin();
+    while (now < cycles)
+    {
+        for (; w != writes.end() && w->cycle == now; ++w)
+        {
+            poke(w->addr, w->data);
+        }
+        uint64_t next = t.getCyclesToOverflow();
+        if (!next)
+        {
+            break;
+        }
+        if (w != writes.end())
+        {
+            next = std::min(next, w->cycle - now);
+        }
+        bool irq;
+        now += t.advance(next, &irq);
+        if (irq && now <= cycles)
+        {
+            d.onIRQ(t.readStatus(), now, poke);
+        }
+    }
+}
+
+// 実時間のタイマで回す。x68sound.cpp と同じ RealtimeOPMTimer を
+// TimerScheduler の上に載せる
+// コールバックは最大 latency 遅れ、その間にも割り込みの外から書く
+class Realtime final : public RealtimeOPMTimer::Host
+{
+public:
+    RealtimeOPMTimer timer;
+    TimerScheduler sched{HW_CLOCK};
+    int id   = sched.create();
+    Time now = 0;
+    std::vector<Write> writes;
+
+    explicit Realtime(Driver& d)
+        : driver_(d)
+    {
+        timer.setHost(this);
+        timer.setClock(OPM_CLOCK);
+    }
+
+    void poke(int addr, int data)
+    {
+        timer.write(addr, data);
+        if (!timer.isInTimer())
+        {
+            writes.push_back({timer.getCycles(), uint8_t(addr), uint8_t(data)});
+        }
+    }
+
+    Time getTime() override { return now; }
+
+    Time toTime(uint64_t cycles, uint32_t clock) override
+    {
+        return sched.toTime(cycles, clock);
+    }
+
+    uint64_t toCycles(Time t, uint32_t clock) override
+    {
+        return sched.toCycles(t, clock);
+    }
+
+    void startTimerAt(Time deadline) override { sched.startAt(id, deadline); }
+    void stopTimer() override { sched.stop(id); }
+
+    void onIRQ() override
+    {
+        driver_.onIRQ(timer.getTimer().readStatus(),
+                      timer.getCycles(),
+                      [&](int addr, int data) { poke(addr, data); });
+    }
+
+private:
+    Driver& driver_;
+};
+
+void
+runRealtime(Driver& d,
+            uint8_t nb,
+            uint64_t cycles,
+            std::vector<Write>* writes,
+            uint32_t seed)
+{
+    constexpr int LATENCY_US = 200;
+    constexpr int POKE_US    = 50000; // 割り込みの外から書く間隔
+
+    std::mt19937 rng(seed);
+    Realtime r(d);
+    r.poke(0x12, nb);
+    r.poke(0x14, 0x3a);
+
+    Time end      = r.sched.toTime(cycles, OPM_CLOCK);
+    Time us       = TimerScheduler::fromTick(1);
+    Time nextPoke = us * (rng() % POKE_US);
+    Time deadline;
+    while (r.sched.getNextDeadline(&deadline))
+    {
+        Time fireAt = deadline + us * (rng() % LATENCY_US);
+        if (nextPoke < fireAt)
+        {
+            // 割り込みの外から振る舞いの変わらない値を書く
+            // (仮想クロックを今まで進めて合わせ直す所を通す)
+            r.now = nextPoke;
+            r.poke(0x11, 0x00);
+            nextPoke += us * (rng() % POKE_US);
+            continue;
+        }
+        if (deadline > end)
+        {
+            break;
+        }
+        r.now = fireAt;
+        int id;
+        while (r.sched.pop(r.now, &id, &deadline))
+        {
+            r.timer.onTimer();
+        }
+    }
+    *writes = std::move(r.writes);
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+    int sec = 600;
+    int c;
+    while ((c = getopt(argc, argv, "t:")) != -1)
+    {
+        switch (c)
+        {
+        case 't':
+            sec = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: opmtempo [-t sec]\n");
+            return 1;
+        }
+    }
+
+    testRegisters();
+
+    // 2. タイマ B の値ごとのテンポ
+    uint64_t cycles = uint64_t(sec) * OPM_CLOCK;
+    printf("%4s %10s %10s %10s %10s %12s\n",
+           "CLKB",
+           "BPM",
+           "irqs",
+           "expected",
+           "measured",
+           "realtime");
+    for (int nb : {0, 64, 128, 156, 200, 220, 240, 250, 255})
+    {
+        uint32_t p = 1024 * (256 - nb);
+        double bpm = 60.0 * OPM_CLOCK / (double(p) * CLOCKS_PER_BEAT);
+        uint64_t expected = cycles / p;
+
+        Driver off;
+        runOffline(off, nb, cycles);
+        double measured = off.irqs * 60.0 / (CLOCKS_PER_BEAT * double(sec));
+
+        Driver rt;
+        std::vector<Write> writes;
+        runRealtime(rt, nb, cycles, &writes, nb + 1);
+        Driver replay;
+        runOffline(replay, nb, cycles, writes);
+        bool same = rt.cycles == replay.cycles && rt.cycles == off.cycles;
+
+        printf("%4d %10.4f %10d %10llu %10.4f %12s\n",
+               nb,
+               bpm,
+               off.irqs,
+               (unsigned long long)expected,
+               measured,
+               same ? "same" : "DIFFERENT");
+        check(uint64_t(off.irqs) == expected, "interrupt count");
+        check(same, "realtime matches offline");
+    }
+
+    // 3. テンポを変えてタイマ A も回す
+    Driver off;
+    off.script = true;
+    runOffline(off, 200, cycles);
+    Driver rt;
+    rt.script = true;
+    std::vector<Write> writes;
+    runRealtime(rt, 200, cycles, &writes, 1);
+    Driver replay;
+    replay.script = true;
+    runOffline(replay, 200, cycles, writes);
+    bool same = rt.cycles == replay.cycles && rt.cycles == off.cycles;
+    printf("tempo change + timer A: %d irqs (%d with flag A), realtime %s\n",
+           off.irqs,
+           off.aIrqs,
+           same ? "same" : "DIFFERENT");
+    check(off.aIrqs > 0, "timer A interrupts");
+    check(same, "realtime matches offline (script)");
+
+    printf("%s\n", failures_ ? "NG" : "OK");
+    return failures_ ? 1 : 0;
+}
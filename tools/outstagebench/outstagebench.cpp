@@ -0,0 +1,219 @@
+/*
+ * OutputStage (音量、リミッタ、形式の変換を 1 回で) と、前のドライバごとに
+ * 別々にしていた処理の時間と振り切れた数を比べるホスト用のツール
+ *
+ *  outstagebench [-s seconds] [-p peak_dBFS]
+ *
+ *  -s  長さ (default 10)
+ *  -p  FM + PCM を足した時のピーク (default +4)
+ *
+ * 入力は -6dBFS の FM (1kHz) に、500ms ごとに 30ms の PCM を足したもの
+ */
+
+#include <audio/output_stage.h>
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+namespace
+{
+
+constexpr int SAMPLE_RATE = 44100;
+constexpr int BLOCK       = 128;
+
+using Sample    = audio::OutputStage::Sample;
+using PCMSample = audio::OutputStage::PCMSample;
+using Clock     = std::chrono::steady_clock;
+
+struct Result
+{
+    double nsPerSample;
+    uint32_t clips;
+    uint32_t limited;
+    float minGain;
+};
+
+// 前の処理
+// 履歴は >> 8、A2DP は振り切れを切ってから BT のコールバックで音量、
+// 内蔵 DAC は L+R に音量をかけた値
+Result
+runLegacy(const std::vector<Sample>& in, float volume, bool dac)
+{
+    PCMSample history[BLOCK];
+    PCMSample fifo[BLOCK];
+    int16_t bt[BLOCK * 2];
+    int32_t mono[BLOCK];
+
+    Result r{};
+    int scale    = int(volume * 256);
+    int dacScale = int(volume * audio::OutputStage::DAC_SWING * 128);
+    int dacBias  = int(volume * audio::OutputStage::DAC_SWING * 32768);
+
+    auto t0 = Clock::now();
+    for (size_t b = 0; b + BLOCK <= in.size(); b += BLOCK)
+    {
+        const auto* src = &in[b];
+        for (int i = 0; i < BLOCK; ++i)
+        {
+            history[i][0] = src[i][0] >> 8;
+            history[i][1] = src[i][1] >> 8;
+        }
+        if (dac)
+        {
+            for (int i = 0; i < BLOCK; ++i)
+            {
+                mono[i] = (((src[i][0] + src[i][1]) * dacScale) >> 16) + dacBias;
+                r.clips += mono[i] < 0 || mono[i] > 0xffff;
+            }
+        }
+        else
+        {
+            auto clip = [&](int v) {
+                v >>= 8;
+                r.clips += v < -32768 || v > 32767;
+                return int16_t(std::max(-32768, std::min(32767, v)));
+            };
+            for (int i = 0; i < BLOCK; ++i)
+            {
+                fifo[i][0] = clip(src[i][0]);
+                fifo[i][1] = clip(src[i][1]);
+            }
+            for (int i = 0; i < BLOCK; ++i)
+            {
+                // 音量が 1 を超えると 16bit をはみ出して回り込む
+                int l = fifo[i][0] * scale >> 8;
+                int rr = fifo[i][1] * scale >> 8;
+                r.clips += l < -32768 || l > 32767 || rr < -32768 || rr > 32767;
+                bt[i * 2 + 0] = l;
+                bt[i * 2 + 1] = rr;
+            }
+        }
+    }
+    double ns =
+        std::chrono::duration<double, std::nano>(Clock::now() - t0).count();
+    r.nsPerSample = ns / in.size();
+    r.minGain     = 1;
+
+    volatile int sink = history[0][0] + bt[0] + mono[0];
+    (void)sink;
+    return r;
+}
+
+Result
+runStage(const std::vector<Sample>& in, float volume, bool dac)
+{
+    PCMSample history[BLOCK];
+    PCMSample pcm[BLOCK];
+    int32_t mono[BLOCK];
+
+    audio::OutputStage stage;
+    stage.setSampleRate(SAMPLE_RATE);
+    stage.setVolume(volume);
+
+    audio::OutputStage::Output out{};
+    out.history = history;
+    if (dac)
+    {
+        out.dac = mono;
+    }
+    else
+    {
+        out.pcm = pcm;
+    }
+
+    auto t0 = Clock::now();
+    for (size_t b = 0; b + BLOCK <= in.size(); b += BLOCK)
+    {
+        stage.process(out, &in[b], BLOCK);
+    }
+    double ns =
+        std::chrono::duration<double, std::nano>(Clock::now() - t0).count();
+
+    auto& st = stage.getStats();
+    Result r;
+    r.nsPerSample = ns / in.size();
+    r.clips       = st.clips;
+    r.limited     = st.limited;
+    r.minGain     = st.minGain;
+
+    volatile int sink = history[0][0] + pcm[0][0] + mono[0];
+    (void)sink;
+    return r;
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+    double seconds = 10;
+    double peakDb  = 4;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+        {
+            seconds = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+        {
+            peakDb = atof(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "usage: outstagebench [-s seconds] [-p peak]\n");
+            return 1;
+        }
+    }
+    if (seconds <= 0)
+    {
+        return 1;
+    }
+
+    // FM と PCM を足したもの (16.8)
+    std::vector<Sample> in(size_t(seconds * SAMPLE_RATE) / BLOCK * BLOCK);
+    double fmAmp  = 32767 * 0.5;
+    double pcmAmp = 32767 * pow(10, peakDb / 20) - fmAmp;
+    for (size_t i = 0; i < in.size(); ++i)
+    {
+        double t = double(i) / SAMPLE_RATE;
+        double v = fmAmp * sin(2 * M_PI * 1000 * t);
+        if (fmod(t, 0.5) < 0.03)
+        {
+            v += pcmAmp * sin(2 * M_PI * 440 * t);
+        }
+        in[i][0] = int32_t(v * 256);
+        in[i][1] = int32_t(v * 0.8 * 256);
+    }
+
+    printf("%.0f s, peak %+.1f dBFS, %d samples/block\n",
+           seconds,
+           peakDb,
+           BLOCK);
+    printf("output  volume  path     ns/sample   clipped  limited  min gain\n");
+    for (float volume : {0.5f, 1.0f, 2.0f})
+    {
+        for (bool dac : {false, true})
+        {
+            auto print = [&](const char* name, const Result& r) {
+                printf("%-6s  %5.1f   %-7s  %9.2f  %8d  %6.1f%%  %7.3f\n",
+                       dac ? "dac" : "pcm16",
+                       volume,
+                       name,
+                       r.nsPerSample,
+                       r.clips,
+                       r.limited * 100.0 / in.size(),
+                       r.minGain);
+            };
+            print("legacy", runLegacy(in, volume, dac));
+            print("fused", runStage(in, volume, dac));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,16 @@
+/*
+ * ホストでビルドする時の system/mutex.h の代わり
+ */
+#ifndef _47E016D4_4DC3_4588_BFC6_AE9024B733F9
+#define _47E016D4_4DC3_4588_BFC6_AE9024B733F9
+
+#include <mutex>
+
+namespace sys
+{
+
+using Mutex = std::recursive_mutex;
+
+} // namespace sys
+
+#endif /* _47E016D4_4DC3_4588_BFC6_AE9024B733F9 */
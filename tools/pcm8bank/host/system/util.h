@@ -0,0 +1,31 @@
+/*
+ * ホストでビルドする時の system/util.h の代わり
+ */
+#ifndef _BC475C5D_7B5B_4BCE_B0C7_9682E0E77173
+#define _BC475C5D_7B5B_4BCE_B0C7_9682E0E77173
+
+#include <chrono>
+#include <stdint.h>
+#include <thread>
+
+namespace sys
+{
+
+inline uint32_t
+micros()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(
+               steady_clock::now().time_since_epoch())
+        .count();
+}
+
+inline void
+delay(uint32_t ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+} // namespace sys
+
+#endif /* _BC475C5D_7B5B_4BCE_B0C7_9682E0E77173 */
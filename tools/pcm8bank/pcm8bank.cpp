@@ -0,0 +1,232 @@
+/*
+ * ADPCMBank で展開済みのものを使った SWPCM8 の出力が、再生時に decode
+ * したものとビット単位で一致するかを確かめ、時間を測るホスト用のツール
+ *
+ *  pcm8bank [-t sec] [-e entries] [-s seed]
+ *
+ *  -t  鳴らす時間 (default 10)
+ *  -e  PDX のエントリの数 (default 40)
+ *  -s  乱数の種 (default 1)
+ *
+ * 何本かは 16bit をはみ出すほど大きな音にし、エントリの途中から鳴らす
+ * (バンクにないので再生時に decode する) ものも混ぜる
+ */
+
+#include <sound_sys/adpcm_bank.h>
+#include <sound_sys/m6258_coder.h>
+#include <sound_sys/swpcm8.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <math.h>
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+using Frame = std::array<int32_t, 2>;
+
+constexpr int SAMPLE_RATE = 44100;
+constexpr int BLOCK       = 128;
+constexpr int CHANNELS    = 8;
+constexpr int RETRIGGER   = 8;        // 何ブロックごとに鳴らし直すか
+constexpr int MODE        = 0x080403; // 音量 8, 15.6kHz, 両方
+
+int failures_ = 0;
+
+void
+check(bool cond, const char* what)
+{
+    if (!cond)
+    {
+        printf("NG: %s\n", what);
+        ++failures_;
+    }
+}
+
+void
+putBE32(uint8_t* p, uint32_t v)
+{
+    p[0] = uint8_t(v >> 24);
+    p[1] = uint8_t(v >> 16);
+    p[2] = uint8_t(v >> 8);
+    p[3] = uint8_t(v);
+}
+
+struct Entry
+{
+    uint32_t offset;
+    uint32_t length;
+};
+
+// 96 個分のヘッダの後に ADPCM を並べた PDX を作る
+// 4 本に 1 本は 16bit をはみ出す大きさの音にする
+void
+makePDX(std::vector<uint8_t>& pdx,
+        std::vector<Entry>& entries,
+        int n,
+        std::mt19937& rng)
+{
+    pdx.assign(96 * 8, 0);
+    entries.clear();
+    for (int i = 0; i < n; ++i)
+    {
+        uint32_t len = 2000 + rng() % 20000;
+        uint32_t ofs = uint32_t(pdx.size());
+        putBE32(&pdx[i * 8], ofs);
+        putBE32(&pdx[i * 8 + 4], len);
+
+        double amp = i % 4 == 3 ? 40000 : 1500;
+        std::vector<int16_t> pcm(len * 2);
+        double ph = 0;
+        for (auto& v : pcm)
+        {
+            ph += 0.01 + 0.001 * i;
+            int x = int(amp * sin(ph)) + int(rng() % 400) - 200;
+            v     = int16_t(std::clamp(x, -32768, 32767));
+        }
+
+        sound_sys::M6258Coder enc;
+        pdx.resize(ofs + len);
+        enc.encode<0>(&pdx[ofs], pcm.data(), len * 2);
+        entries.push_back({ofs, len});
+    }
+}
+
+struct Result
+{
+    std::vector<Frame> out;
+    double us;
+    sound_sys::SWPCM8::Stats stats;
+};
+
+// 同じ手順で鳴らす。8 回に 1 回はエントリの途中から
+void
+run(Result& r,
+    const sound_sys::ADPCMBank* bank,
+    const std::vector<uint8_t>& pdx,
+    const std::vector<Entry>& entries,
+    int samples,
+    uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    sound_sys::SWPCM8 p;
+    p.initialize();
+    p.setADPCMBank(bank);
+
+    r.out.assign(samples, Frame{0, 0});
+    auto t0 = Clock::now();
+    for (int blk = 0; blk < samples / BLOCK; ++blk)
+    {
+        if (blk % RETRIGGER == 0)
+        {
+            for (int ch = 0; ch < CHANNELS; ++ch)
+            {
+                auto& e  = entries[rng() % entries.size()];
+                auto ofs = e.offset;
+                auto len = e.length;
+                if (rng() % 8 == 0)
+                {
+                    uint32_t skip = 1 + rng() % (len / 2);
+                    ofs += skip;
+                    len -= skip;
+                }
+                p.pcm8(ch, pdx.data() + ofs, MODE, int(len));
+            }
+        }
+        p.accumSamples(&r.out[blk * BLOCK], BLOCK);
+    }
+    r.us    = std::chrono::duration<double, std::micro>(Clock::now() - t0)
+               .count();
+    r.stats = p.getStats();
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+    int sec       = 10;
+    int nEntries  = 40;
+    uint32_t seed = 1;
+
+    int c;
+    while ((c = getopt(argc, argv, "t:e:s:")) != -1)
+    {
+        switch (c)
+        {
+        case 't':
+            sec = std::max(1, atoi(optarg));
+            break;
+        case 'e':
+            nEntries = std::clamp(atoi(optarg), 1, 96);
+            break;
+        case 's':
+            seed = uint32_t(strtoul(optarg, nullptr, 0));
+            break;
+        default:
+            fprintf(stderr,
+                    "usage: pcm8bank [-t sec] [-e entries] [-s seed]\n");
+            return 1;
+        }
+    }
+
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> pdx;
+    std::vector<Entry> entries;
+    makePDX(pdx, entries, nEntries, rng);
+
+    sound_sys::ADPCMBank bank;
+    auto t0 = Clock::now();
+    bool ok = bank.build(pdx.data(), pdx.size());
+    double buildUs =
+        std::chrono::duration<double, std::micro>(Clock::now() - t0).count();
+    check(ok, "build");
+    check(bank.getEntryCount() == entries.size(), "entry count");
+    check(bank.getDecodedBytes() ==
+              sound_sys::ADPCMBank::computeDecodedBytes(pdx.data(),
+                                                        pdx.size()),
+          "decoded bytes");
+    printf("bank: %zu entries, %zu bytes -> %zu bytes, build %.0f us\n",
+           bank.getEntryCount(),
+           bank.getSourceBytes(),
+           bank.getDecodedBytes(),
+           buildUs);
+
+    int samples = sec * SAMPLE_RATE / BLOCK * BLOCK;
+    Result a, b;
+    run(a, nullptr, pdx, entries, samples, seed);
+    run(b, &bank, pdx, entries, samples, seed);
+
+    int diff = 0;
+    for (int i = 0; i < samples; ++i)
+    {
+        diff += a.out[i] != b.out[i];
+    }
+    check(diff == 0, "output is bit exact");
+    check(a.stats.decodedNibbles == 0, "no predecoded without the bank");
+    check(b.stats.decodedNibbles > 0, "predecoded used");
+    check(b.stats.adpcmNibbles > 0, "decode for the middle of an entry");
+
+    printf("%-10s %12s %12s %10s\n", "", "adpcm", "predecoded", "us");
+    for (auto* r : {&a, &b})
+    {
+        printf("%-10s %12u %12u %10.0f\n",
+               r == &a ? "decode" : "bank",
+               r->stats.adpcmNibbles,
+               r->stats.decodedNibbles,
+               r->us);
+    }
+    printf("%d / %d samples differ\n", diff, samples);
+
+    printf("%s\n", failures_ ? "NG" : "OK");
+    return failures_ ? 1 : 0;
+}
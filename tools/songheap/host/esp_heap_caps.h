@@ -0,0 +1,26 @@
+/*
+ * ホストでビルドする時の esp_heap_caps.h
+ * 中身は model_heap.cpp の ESP32 を真似たヒープ
+ */
+#ifndef _8C1F4A27_9D3E_4B56_A0E8_52B7F3C6D914
+#define _8C1F4A27_9D3E_4B56_A0E8_52B7F3C6D914
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_EXEC (1 << 0)
+#define MALLOC_CAP_32BIT (1 << 1)
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_DMA (1 << 3)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_DEFAULT (1 << 12)
+
+void* heap_caps_malloc(size_t size, uint32_t caps);
+void* heap_caps_calloc(size_t n, size_t size, uint32_t caps);
+void heap_caps_free(void* p);
+size_t heap_caps_get_free_size(uint32_t caps);
+size_t heap_caps_get_largest_free_block(uint32_t caps);
+size_t heap_caps_get_total_size(uint32_t caps);
+
+#endif /* _8C1F4A27_9D3E_4B56_A0E8_52B7F3C6D914 */
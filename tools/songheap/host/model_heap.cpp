@@ -0,0 +1,394 @@
+/*
+ * ESP32 のヒープを真似たもの
+ */
+
+#include "model_heap.h"
+#include "esp_heap_caps.h"
+#include <algorithm>
+#include <mutex>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace model_heap
+{
+
+namespace
+{
+
+constexpr size_t ALIGN     = 16;
+constexpr size_t HEADER    = ALIGN; // 確保したブロックの前に大きさを置く
+constexpr size_t MIN_BLOCK = 32;
+
+// 内蔵 RAM に置く大きさ (CONFIG_SPIRAM_MALLOC_ALWAYSINTERNAL)
+constexpr size_t ALWAYS_INTERNAL = 16384;
+
+struct FreeBlock
+{
+    size_t size; // ヘッダ込み
+    FreeBlock* next;
+};
+
+class Heap
+{
+    uint8_t* top_    = nullptr;
+    size_t total_    = 0;
+    size_t free_     = 0;
+    size_t minFree_  = 0;
+    FreeBlock* list_ = nullptr;
+
+public:
+    void initialize(size_t size)
+    {
+        size = size / ALIGN * ALIGN;
+        free(top_);
+        top_ = size ? static_cast<uint8_t*>(aligned_alloc(ALIGN, size))
+                    : nullptr;
+        total_   = size;
+        free_    = size;
+        minFree_ = size;
+        list_    = nullptr;
+        if (top_)
+        {
+            list_       = reinterpret_cast<FreeBlock*>(top_);
+            list_->size = size;
+            list_->next = nullptr;
+        }
+    }
+
+    bool contains(const void* p) const
+    {
+        auto* b = static_cast<const uint8_t*>(p);
+        return top_ && b >= top_ && b < top_ + total_;
+    }
+
+    void* allocate(size_t size)
+    {
+        size_t need =
+            std::max(MIN_BLOCK, (size + HEADER + ALIGN - 1) / ALIGN * ALIGN);
+        FreeBlock** pp = &list_;
+        for (; *pp; pp = &(*pp)->next)
+        {
+            auto* b = *pp;
+            if (b->size < need)
+            {
+                continue;
+            }
+            if (b->size - need >= MIN_BLOCK)
+            {
+                auto* rest = reinterpret_cast<FreeBlock*>(
+                    reinterpret_cast<uint8_t*>(b) + need);
+                rest->size = b->size - need;
+                rest->next = b->next;
+                *pp        = rest;
+            }
+            else
+            {
+                need = b->size;
+                *pp  = b->next;
+            }
+            free_ -= need;
+            minFree_ = std::min(minFree_, free_);
+            *reinterpret_cast<size_t*>(b) = need;
+            return reinterpret_cast<uint8_t*>(b) + HEADER;
+        }
+        return nullptr;
+    }
+
+    // アドレス順に差し込んで、前後の空きとつなぐ
+    void deallocate(void* p)
+    {
+        auto* b = reinterpret_cast<FreeBlock*>(static_cast<uint8_t*>(p) -
+                                               HEADER);
+        b->size = *reinterpret_cast<size_t*>(b);
+        free_ += b->size;
+
+        FreeBlock* prev = nullptr;
+        FreeBlock* next = list_;
+        while (next && next < b)
+        {
+            prev = next;
+            next = next->next;
+        }
+        b->next = next;
+        if (next && reinterpret_cast<uint8_t*>(b) + b->size ==
+                        reinterpret_cast<uint8_t*>(next))
+        {
+            b->size += next->size;
+            b->next = next->next;
+        }
+        if (prev && reinterpret_cast<uint8_t*>(prev) + prev->size ==
+                        reinterpret_cast<uint8_t*>(b))
+        {
+            prev->size += b->size;
+            prev->next = b->next;
+        }
+        else if (prev)
+        {
+            prev->next = b;
+        }
+        else
+        {
+            list_ = b;
+        }
+    }
+
+    Stats getStats() const
+    {
+        Stats s{total_, free_, 0, minFree_, 0};
+        for (auto* b = list_; b; b = b->next)
+        {
+            s.largest = std::max(s.largest, b->size - HEADER);
+            ++s.freeBlocks;
+        }
+        return s;
+    }
+};
+
+std::mutex mutex_;
+bool initialized_ = false;
+Heap internal_;
+Heap spiram_;
+uint32_t allocCount_ = 0;
+
+void
+initializeIfNeeded(size_t internal, size_t spiram)
+{
+    if (!initialized_)
+    {
+        internal_.initialize(internal);
+        spiram_.initialize(spiram);
+        initialized_ = true;
+    }
+}
+
+Heap*
+getHeap(Region r)
+{
+    return r == Region::SPIRAM ? &spiram_ : &internal_;
+}
+
+void*
+allocate(size_t size, uint32_t caps)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    initializeIfNeeded(DEFAULT_INTERNAL, DEFAULT_SPIRAM);
+
+    Heap* order[2];
+    int n = 0;
+    if (caps & MALLOC_CAP_SPIRAM)
+    {
+        order[n++] = &spiram_;
+    }
+    else if (caps & (MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA))
+    {
+        order[n++] = &internal_;
+    }
+    else if (size <= ALWAYS_INTERNAL)
+    {
+        order[n++] = &internal_;
+        order[n++] = &spiram_;
+    }
+    else
+    {
+        order[n++] = &spiram_;
+        order[n++] = &internal_;
+    }
+
+    for (int i = 0; i < n; ++i)
+    {
+        if (auto* p = order[i]->allocate(size))
+        {
+            ++allocCount_;
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+void
+deallocate(void* p)
+{
+    if (!p)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (internal_.contains(p))
+    {
+        internal_.deallocate(p);
+    }
+    else if (spiram_.contains(p))
+    {
+        spiram_.deallocate(p);
+    }
+    else
+    {
+        fprintf(stderr, "model_heap: free %p (not ours)\n", p);
+        abort();
+    }
+}
+
+size_t
+collect(uint32_t caps, size_t Stats::*field, bool sum)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    initializeIfNeeded(DEFAULT_INTERNAL, DEFAULT_SPIRAM);
+
+    size_t r = 0;
+    for (auto reg : {Region::INTERNAL, Region::SPIRAM})
+    {
+        bool match = reg == Region::SPIRAM
+                         ? !(caps & (MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA))
+                         : !(caps & MALLOC_CAP_SPIRAM);
+        if (match)
+        {
+            auto v = getHeap(reg)->getStats().*field;
+            r      = sum ? r + v : std::max(r, v);
+        }
+    }
+    return r;
+}
+
+} // namespace
+
+void
+configure(size_t internal, size_t spiram)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!initialized_)
+    {
+        initializeIfNeeded(internal, spiram);
+        return;
+    }
+
+    // main() の前に確保されたものがあるので、使っていない所だけ作り直す
+    for (auto r : {Region::INTERNAL, Region::SPIRAM})
+    {
+        auto size = r == Region::SPIRAM ? spiram : internal;
+        auto* h   = getHeap(r);
+        auto st   = h->getStats();
+        if (st.total == size / ALIGN * ALIGN)
+        {
+            continue;
+        }
+        if (st.free != st.total)
+        {
+            fprintf(stderr, "model_heap: configure() after alloc\n");
+            abort();
+        }
+        h->initialize(size);
+    }
+}
+
+Stats
+getStats(Region r)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    initializeIfNeeded(DEFAULT_INTERNAL, DEFAULT_SPIRAM);
+    return getHeap(r)->getStats();
+}
+
+uint32_t
+getAllocCount()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return allocCount_;
+}
+
+} // namespace model_heap
+
+void*
+heap_caps_malloc(size_t size, uint32_t caps)
+{
+    return model_heap::allocate(size, caps);
+}
+
+void*
+heap_caps_calloc(size_t n, size_t size, uint32_t caps)
+{
+    auto* p = model_heap::allocate(n * size, caps);
+    if (p)
+    {
+        memset(p, 0, n * size);
+    }
+    return p;
+}
+
+void
+heap_caps_free(void* p)
+{
+    model_heap::deallocate(p);
+}
+
+size_t
+heap_caps_get_free_size(uint32_t caps)
+{
+    return model_heap::collect(caps, &model_heap::Stats::free, true);
+}
+
+size_t
+heap_caps_get_largest_free_block(uint32_t caps)
+{
+    return model_heap::collect(caps, &model_heap::Stats::largest, false);
+}
+
+size_t
+heap_caps_get_total_size(uint32_t caps)
+{
+    return model_heap::collect(caps, &model_heap::Stats::total, true);
+}
+
+void*
+operator new(size_t size)
+{
+    auto* p = model_heap::allocate(size, MALLOC_CAP_DEFAULT);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void*
+operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void*
+operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return model_heap::allocate(size, MALLOC_CAP_DEFAULT);
+}
+
+void*
+operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return model_heap::allocate(size, MALLOC_CAP_DEFAULT);
+}
+
+void
+operator delete(void* p) noexcept
+{
+    model_heap::deallocate(p);
+}
+
+void
+operator delete[](void* p) noexcept
+{
+    model_heap::deallocate(p);
+}
+
+void
+operator delete(void* p, size_t) noexcept
+{
+    model_heap::deallocate(p);
+}
+
+void
+operator delete[](void* p, size_t) noexcept
+{
+    model_heap::deallocate(p);
+}
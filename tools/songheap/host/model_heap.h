@@ -0,0 +1,44 @@
+/*
+ * ESP32 のヒープを真似たもの
+ * 内蔵 RAM と PSRAM の 2 つの領域を、それぞれアドレス順の空きリストで
+ * first fit で取る。隣り合う空きはつなぐので、断片化の具合が見える
+ *
+ * operator new と heap_caps_*() はここから取る
+ */
+#ifndef _2B7E5D90_4F1A_4C83_9E26_D1A08C3F7B45
+#define _2B7E5D90_4F1A_4C83_9E26_D1A08C3F7B45
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace model_heap
+{
+
+enum class Region
+{
+    INTERNAL,
+    SPIRAM,
+};
+
+struct Stats
+{
+    size_t total;
+    size_t free;
+    size_t largest;
+    size_t minFree; // これまでで一番少なかった空き
+    int freeBlocks;
+};
+
+constexpr size_t DEFAULT_INTERNAL = 160 * 1024;
+constexpr size_t DEFAULT_SPIRAM   = 4 * 1024 * 1024;
+
+// 大きさを変える領域は、まだ何も取っていないこと
+// spiram が 0 なら PSRAM のないボード
+void configure(size_t internal, size_t spiram);
+
+Stats getStats(Region r);
+uint32_t getAllocCount();
+
+} // namespace model_heap
+
+#endif /* _2B7E5D90_4F1A_4C83_9E26_D1A08C3F7B45 */
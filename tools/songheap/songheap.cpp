@@ -0,0 +1,648 @@
+/*
+ * 曲を何度も替えた後にヒープがどれだけ断片化するかを見るホスト用のツール
+ *
+ *  songheap [-n changes] [-s seed] [-p] [-r]
+ *
+ *  -n  曲を替える回数 (default 1000)
+ *  -s  乱数の種 (default 1)
+ *  -p  PDX の ADPCM を展開しておく (PDXCache の predecode)
+ *  -r  PSRAM の無いボード (曲のアリーナは取れず、全部ヒープから)
+ *
+ * 作った S98 と MDX/PDX を、本体の playMusicFile() と同じ順で
+ * stop/terminate/start/load/play する。プレイリストの先の PDX の先読みと
+ * ファイル一覧のタイトル読みも混ぜる
+ *
+ * ヒープは host/model_heap.cpp の内蔵 RAM + 4MB PSRAM を真似たもの
+ * S98 にはアリーナに入らない大きさのものを 1 つ混ぜる
+ * 100 回ごとに空き、最大の空きブロック、断片化 (1 - 最大 / 空き) を出す
+ * 最後に全部を捨てて、始めと同じだけ空きが戻るかを確かめる
+ * MXDRV と音源チップ、タイマは何もしないものに置き換える
+ */
+
+#include "host/model_heap.h"
+#include <audio/audio.h>
+#include <audio/sound_chip_manager.h>
+#include <esp_heap_caps.h>
+#include <music_player/mdxplayer.h>
+#include <music_player/music_player_manager.h>
+#include <music_player/pdx_cache.h>
+#include <music_player/s98player.h>
+#include <mxdrv/mxdrv.h>
+#include <mxdrv/sys.h>
+#include <system/arena.h>
+#include <system/job_manager.h>
+#include <system/timer.h>
+#include <system/util.h>
+
+#include <algorithm>
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// 本体の代わり
+MXDRVSoundSystemSet mxdrvSoundSystemSet_;
+
+namespace
+{
+
+constexpr size_t SONG_ARENA_SIZE = 1024 * 1024; // music_player_manager.cpp
+constexpr int PREWARM_AHEAD      = 2;
+constexpr int BROWSE_INTERVAL    = 10; // 何曲ごとに一覧を読み直すか
+constexpr int REPORT_INTERVAL    = 100;
+constexpr size_t LEAK_TOLERANCE  = 1024;
+
+constexpr int S98_FILES = 20;
+constexpr int MDX_FILES = 20;
+constexpr int PDX_FILES = 6;
+
+constexpr size_t HUGE_S98_SIZE = SONG_ARENA_SIZE + 256 * 1024;
+
+sys::Arena songArena_;
+bool songArenaTried_ = false;
+
+// MXDRV_GetWork() で返すもの。鳴らさないので 0 のまま
+MXWORK_GLOBAL mxGlobal_;
+UBYTE mxPCM8_;
+uint8_t mxOther_[4096];
+
+} // namespace
+
+extern "C"
+{
+    int
+    MXDRV_Start(void*, int, void*, int)
+    {
+        return 0;
+    }
+
+    void
+    MXDRV_End(void)
+    {
+    }
+
+    void
+    MXDRV_Play(void*, DWORD, void*, DWORD)
+    {
+    }
+
+    void volatile*
+    MXDRV_GetWork(int i)
+    {
+        switch (i)
+        {
+        case MXDRV_WORK_GLOBAL:
+            return &mxGlobal_;
+        case MXDRV_WORK_PCM8:
+            return &mxPCM8_;
+        default:
+            return mxOther_;
+        }
+    }
+
+    void
+    MXDRV(X68REG*)
+    {
+    }
+}
+
+namespace audio
+{
+
+void
+setFMVolume(float)
+{
+}
+
+SoundChipBase*
+allocateYM2151()
+{
+    return nullptr;
+}
+
+void
+freeYM2151(SoundChipBase*)
+{
+}
+
+SoundChipBase*
+allocateYMF288()
+{
+    return nullptr;
+}
+
+void
+freeYMF288(SoundChipBase*)
+{
+}
+
+} // namespace audio
+
+namespace sys
+{
+
+void
+initTimer(int)
+{
+}
+
+void
+startTimer()
+{
+}
+
+void
+stopTimer()
+{
+}
+
+void
+enableTimerInterrupt()
+{
+}
+
+void
+setTimerPeriod(int, bool)
+{
+}
+
+void
+setTimerCallback(std::function<void()>&&)
+{
+}
+
+void
+resetTimerCallback()
+{
+}
+
+void
+delay(uint32_t ms)
+{
+    usleep(ms * 1000);
+}
+
+} // namespace sys
+
+namespace music_player
+{
+
+sys::Arena&
+getSongArena()
+{
+    if (!songArenaTried_)
+    {
+        songArenaTried_ = true;
+        songArena_.initialize(SONG_ARENA_SIZE);
+    }
+    return songArena_;
+}
+
+} // namespace music_player
+
+namespace
+{
+
+int failures_ = 0;
+
+void
+check(bool cond, const char* what)
+{
+    if (!cond)
+    {
+        printf("NG: %s\n", what);
+        ++failures_;
+    }
+}
+
+void
+putLE32(std::vector<uint8_t>& v, uint32_t x)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        v.push_back(uint8_t(x >> (i * 8)));
+    }
+}
+
+void
+putBE32(uint8_t* p, uint32_t v)
+{
+    p[0] = uint8_t(v >> 24);
+    p[1] = uint8_t(v >> 16);
+    p[2] = uint8_t(v >> 8);
+    p[3] = uint8_t(v);
+}
+
+bool
+writeFile(const std::string& path, const std::vector<uint8_t>& data)
+{
+    FILE* fp = fopen(path.c_str(), "wb");
+    if (!fp)
+    {
+        return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), fp) == data.size();
+    return fclose(fp) == 0 && ok;
+}
+
+// OPNA 1 つ、コマンドの後ろにタグを置いた S98
+std::vector<uint8_t>
+makeS98(size_t size, int n, std::mt19937& rng)
+{
+    constexpr uint32_t START = 0x20 + 12;
+
+    std::vector<uint8_t> v{'S', '9', '8', '3'};
+    putLE32(v, 10);
+    putLE32(v, 1000);
+    putLE32(v, 0);
+    auto tagPos = v.size();
+    putLE32(v, 0);
+    putLE32(v, START);
+    putLE32(v, START);
+    putLE32(v, 1);
+    putLE32(v, 3); // OPNA
+    putLE32(v, 7987200);
+    putLE32(v, 0);
+
+    while (v.size() + 2 < size)
+    {
+        v.push_back(uint8_t(rng() % 2));
+        v.push_back(uint8_t(rng()));
+        v.push_back(uint8_t(rng()));
+        v.push_back(0xff);
+    }
+    v.push_back(0xfd);
+
+    auto tagOfs = uint32_t(v.size());
+    for (int i = 0; i < 4; ++i)
+    {
+        v[tagPos + i] = uint8_t(tagOfs >> (i * 8));
+    }
+    auto tags = "[S98]title=S98 song " + std::to_string(n) +
+                "\nartist=songheap\n";
+    v.insert(v.end(), tags.begin(), tags.end());
+    v.push_back(0);
+    return v;
+}
+
+std::vector<uint8_t>
+makeMDX(size_t size, int n, int pdx, std::mt19937& rng)
+{
+    auto head = "MDX song " + std::to_string(n) + "\r\n\x1a" + "pdx" +
+                std::to_string(pdx);
+    std::vector<uint8_t> v(head.begin(), head.end());
+    v.push_back(0);
+    while (v.size() < size)
+    {
+        v.push_back(uint8_t(rng()));
+    }
+    return v;
+}
+
+// 96 個分のヘッダの後に ADPCM を並べた PDX
+std::vector<uint8_t>
+makePDX(size_t size, std::mt19937& rng)
+{
+    constexpr int ENTRIES = 32;
+    constexpr int HEADER  = 96 * 8;
+
+    std::vector<uint8_t> v(size);
+    uint32_t len = uint32_t((size - HEADER) / ENTRIES);
+    for (int i = 0; i < ENTRIES; ++i)
+    {
+        putBE32(&v[i * 8], HEADER + i * len);
+        putBE32(&v[i * 8 + 4], len);
+    }
+    for (size_t i = HEADER; i < size; ++i)
+    {
+        v[i] = uint8_t(rng());
+    }
+    return v;
+}
+
+struct Song
+{
+    std::string path;
+    bool mdx;
+};
+
+// PSRAM が無ければ内蔵 RAM に入る大きさにする
+bool
+makeSongs(std::vector<Song>& songs,
+          const std::string& dir,
+          uint32_t seed,
+          bool noSPIRAM)
+{
+    std::mt19937 rng(seed);
+    bool ok = true;
+    for (int i = 0; i < PDX_FILES; ++i)
+    {
+        size_t size = noSPIRAM ? 8192 + rng() % (32 * 1024)
+                               : 100 * 1024 + rng() % (600 * 1024);
+        ok &= writeFile(dir + "/pdx" + std::to_string(i) + ".pdx",
+                        makePDX(size, rng));
+    }
+    for (int i = 0; i < S98_FILES; ++i)
+    {
+        size_t size = noSPIRAM ? 4096 + rng() % (48 * 1024)
+                               : 4096 + rng() % (900 * 1024);
+        if (!noSPIRAM && i == 0)
+        {
+            size = HUGE_S98_SIZE;
+        }
+        auto path = dir + "/song" + std::to_string(i) + ".s98";
+        ok &= writeFile(path, makeS98(size, i, rng));
+        songs.push_back({path, false});
+    }
+    for (int i = 0; i < MDX_FILES; ++i)
+    {
+        size_t size = 2048 + rng() % ((noSPIRAM ? 30 : 60) * 1024);
+        auto path   = dir + "/song" + std::to_string(i) + ".mdx";
+        ok &= writeFile(path, makeMDX(size, i, rng() % PDX_FILES, rng));
+        songs.push_back({path, true});
+    }
+    std::shuffle(songs.begin(), songs.end(), rng);
+    return ok;
+}
+
+struct Player
+{
+    music_player::MDXPlayer mdx;
+    music_player::S98Player s98;
+    music_player::MusicPlayer* active = nullptr;
+
+    // playMusicFile() と同じ順
+    bool play(const Song& song)
+    {
+        music_player::MusicPlayer* p = &s98;
+        if (song.mdx)
+        {
+            p = &mdx;
+        }
+        if (active)
+        {
+            active->stop();
+            if (active != p)
+            {
+                active->terminate();
+            }
+            active = nullptr;
+        }
+        p->start();
+        p->stop();
+        if (!p->load(song.path.c_str()))
+        {
+            p->terminate();
+            return false;
+        }
+        active = p;
+        return p->play(0);
+    }
+
+    void terminate()
+    {
+        if (active)
+        {
+            active->stop();
+            active->terminate();
+            active = nullptr;
+        }
+    }
+};
+
+struct HeapState
+{
+    model_heap::Stats internal;
+    model_heap::Stats spiram;
+
+    static HeapState get()
+    {
+        return {model_heap::getStats(model_heap::Region::INTERNAL),
+                model_heap::getStats(model_heap::Region::SPIRAM)};
+    }
+};
+
+double
+fragmentation(const model_heap::Stats& s)
+{
+    return s.free ? 1.0 - double(s.largest) / s.free : 0;
+}
+
+void
+printHeader()
+{
+    printf("%6s %8s %8s %5s %8s %8s %5s %7s %8s %8s\n",
+           "change",
+           "int free",
+           "largest",
+           "frag",
+           "ps free",
+           "largest",
+           "frag",
+           "blocks",
+           "new",
+           "arena");
+}
+
+void
+printState(const char* label, const HeapState& h)
+{
+    auto& a = music_player::getSongArena();
+    printf("%6s %8zu %8zu %4.0f%% %8zu %8zu %4.0f%% %7d %8u %8zu\n",
+           label,
+           h.internal.free,
+           h.internal.largest,
+           fragmentation(h.internal) * 100,
+           h.spiram.free,
+           h.spiram.largest,
+           fragmentation(h.spiram) * 100,
+           h.internal.freeBlocks + h.spiram.freeBlocks,
+           model_heap::getAllocCount(),
+           a.getUsed());
+}
+
+void
+waitPredecode()
+{
+    sys::getDefaultJobManager().waitIdle();
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+    int changes    = 1000;
+    uint32_t seed  = 1;
+    bool predecode = false;
+    bool noSPIRAM  = false;
+
+    int c;
+    while ((c = getopt(argc, argv, "n:s:pr")) != -1)
+    {
+        switch (c)
+        {
+        case 'n':
+            changes = std::max(1, atoi(optarg));
+            break;
+        case 's':
+            seed = uint32_t(strtoul(optarg, nullptr, 0));
+            break;
+        case 'p':
+            predecode = true;
+            break;
+        case 'r':
+            noSPIRAM = true;
+            break;
+        default:
+            fprintf(stderr,
+                    "usage: songheap [-n changes] [-s seed] [-p] [-r]\n");
+            return 1;
+        }
+    }
+
+    char dirBuf[] = "/tmp/songheapXXXXXX";
+    if (!mkdtemp(dirBuf))
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+    std::string dir = dirBuf;
+
+    std::vector<Song> songs;
+    check(makeSongs(songs, dir, seed, noSPIRAM), "write songs");
+
+    // 作る時に使ったものは返してあるので、ここで PSRAM を外せる
+    model_heap::configure(model_heap::DEFAULT_INTERNAL,
+                          noSPIRAM ? 0 : model_heap::DEFAULT_SPIRAM);
+
+    sys::getDefaultJobManager().start(0, 4096, "JobManager0");
+    music_player::getPDXCache().setPredecodeADPCM(predecode);
+    music_player::getSongArena();
+
+    // 一通り鳴らして捨てた所を始めとする
+    // (一度だけ確保して持ち続けるものは断片化とは別)
+    Player player;
+    for (auto& s : songs)
+    {
+        player.play(s);
+    }
+    waitPredecode();
+    player.terminate();
+    music_player::getPDXCache().clear();
+
+    auto start = HeapState::get();
+    printHeader();
+    printState("start", start);
+
+    std::mt19937 rng(seed);
+    std::vector<std::string> titles;
+    int loadErrors     = 0;
+    int titleErrors    = 0;
+    size_t maxOverflow = 0;
+    size_t idx         = 0;
+    HeapState worst    = start;
+
+    for (int n = 1; n <= changes; ++n)
+    {
+        // たまに一覧の中を飛ぶ
+        idx = rng() % 8 ? (idx + 1) % songs.size() : rng() % songs.size();
+
+        if (n % BROWSE_INTERVAL == 0)
+        {
+            std::vector<std::string>().swap(titles);
+            for (auto& s : songs)
+            {
+                auto t = s.mdx ? player.mdx.loadTitle(s.path.c_str())
+                               : player.s98.loadTitle(s.path.c_str());
+                titles.push_back(t ? *t : std::string());
+                if (titles.back().empty())
+                {
+                    ++titleErrors;
+                }
+            }
+        }
+
+        if (!player.play(songs[idx]))
+        {
+            printf("load error: %s\n", songs[idx].path.c_str());
+            ++loadErrors;
+        }
+
+        for (int i = 1; i <= PREWARM_AHEAD; ++i)
+        {
+            auto& s = songs[(idx + i) % songs.size()];
+            if (s.mdx)
+            {
+                player.mdx.prewarmPDX(s.path.c_str());
+            }
+        }
+        waitPredecode();
+
+        maxOverflow =
+            std::max(maxOverflow,
+                     music_player::getSongArena().getOverflowBytes());
+
+        auto h = HeapState::get();
+        if (h.spiram.largest < worst.spiram.largest)
+        {
+            worst = h;
+        }
+        if (n % REPORT_INTERVAL == 0)
+        {
+            printState(std::to_string(n).c_str(), h);
+        }
+    }
+
+    auto last = HeapState::get();
+    auto pdxStats = music_player::getPDXCache().getStats();
+    printf("PDX cache: %u hits, %u misses, %u prewarms, %u evictions\n",
+           pdxStats.hits,
+           pdxStats.misses,
+           pdxStats.prewarms,
+           pdxStats.evictions);
+    printf("worst PSRAM largest free block: %zu (%.0f%% fragmented)\n",
+           worst.spiram.largest,
+           fragmentation(worst.spiram) * 100);
+    printf("song data from heap (out of arena): up to %zu bytes\n",
+           maxOverflow);
+    printf("lowest free: internal %zu, PSRAM %zu\n",
+           last.internal.minFree,
+           last.spiram.minFree);
+
+    // 全部捨てたら始めに戻るはず
+    // 内蔵 RAM は vector の容量などで多少前後する
+    waitPredecode();
+    player.terminate();
+    music_player::getPDXCache().clear();
+    std::vector<std::string>().swap(titles);
+    auto end = HeapState::get();
+    printState("end", end);
+
+    check(loadErrors == 0, "every song loads");
+    check(titleErrors == 0, "every title reads");
+    check(maxOverflow > 0, "song data out of the arena");
+    check(end.internal.free + LEAK_TOLERANCE >= start.internal.free &&
+              end.spiram.free == start.spiram.free,
+          "no leak");
+    check(end.spiram.largest == start.spiram.largest,
+          "PSRAM comes back to one block");
+
+    sys::getDefaultJobManager().stop();
+
+    for (auto& s : songs)
+    {
+        unlink(s.path.c_str());
+    }
+    for (int i = 0; i < PDX_FILES; ++i)
+    {
+        unlink((dir + "/pdx" + std::to_string(i) + ".pdx").c_str());
+    }
+    rmdir(dir.c_str());
+
+    printf("%s\n", failures_ ? "NG" : "OK");
+    return failures_ ? 1 : 0;
+}
@@ -0,0 +1,244 @@
+/*
+ * FM チップの時計と出力の時計がずれている時に、DriftCompensator で
+ * 変換比を直すとリングバッファが溢れたり足りなくなったりしないかを
+ * 確かめるホスト用のツール
+ *
+ *  srcdrift [options]
+ *
+ *  -r rate     FM の出力のサンプリング周波数 (default 62500)
+ *  -i ppm      FM 側の時計のずれ (default 300)
+ *  -o ppm      出力側の時計のずれ (default -150)
+ *  -w ppm      FM 側の温度によるゆらぎの振れ幅 (default 30, 周期 30 分)
+ *  -h hours    模擬する時間 (default 4)
+ *  -n          直さない (比べる用)
+ */
+
+#include <audio/drift_compensator.h>
+#include <audio/sampling_rate_converter.h>
+#include <util/ring_buffer.h>
+
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace
+{
+
+constexpr double OUT_RATE = 44100;
+
+// FMOutputHandler と同じ
+constexpr int DMA_FRAMES     = 128;
+constexpr size_t DMA_COUNT   = 4;
+constexpr int OUT_FRAMES     = 128;
+constexpr int RING_SIZE      = 2048; // int16 L/R
+constexpr int TARGET_FRAMES  = 384;
+constexpr double WANDER_SECS = 1800;
+
+// 最初のこれだけは落ち着くまでとして数えない
+constexpr double SETTLE_SECS = 60;
+
+constexpr double PPM_PER_CENT = 577.8;
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+    double inRate    = 62500;
+    double inPPM     = 300;
+    double outPPM    = -150;
+    double wanderPPM = 30;
+    double hours     = 4;
+    bool compensate  = true;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        auto arg = [&] { return i + 1 < argc ? atof(argv[++i]) : 0.0; };
+        if (strcmp(argv[i], "-r") == 0)
+        {
+            inRate = arg();
+        }
+        else if (strcmp(argv[i], "-i") == 0)
+        {
+            inPPM = arg();
+        }
+        else if (strcmp(argv[i], "-o") == 0)
+        {
+            outPPM = arg();
+        }
+        else if (strcmp(argv[i], "-w") == 0)
+        {
+            wanderPPM = arg();
+        }
+        else if (strcmp(argv[i], "-h") == 0)
+        {
+            hours = arg();
+        }
+        else if (strcmp(argv[i], "-n") == 0)
+        {
+            compensate = false;
+        }
+        else
+        {
+            fprintf(stderr,
+                    "usage: srcdrift [-r rate] [-i ppm] [-o ppm] [-w ppm] "
+                    "[-h hours] [-n]\n");
+            return 1;
+        }
+    }
+    if (inRate <= 0 || hours <= 0)
+    {
+        return 1;
+    }
+
+    int16_t buffer[RING_SIZE]{};
+    util::RingBuffer<int16_t> ring(buffer, RING_SIZE);
+    float baseStep = float(inRate / OUT_RATE);
+    audio::SimpleLinearSamplingRateConverter src(baseStep);
+    audio::DriftCompensator comp;
+    comp.setTarget(TARGET_FRAMES);
+
+    auto inFreq = [&](double t) {
+        double ppm =
+            inPPM + wanderPPM * sin(2 * M_PI * t / WANDER_SECS);
+        return inRate * (1 + ppm * 1e-6);
+    };
+    double outFreq = OUT_RATE * (1 + outPPM * 1e-6);
+
+    // 届いていて、まだ読んでいない DMA バッファ
+    std::deque<double> dma;
+
+    double tIn  = 0; // 次の DMA バッファが埋まる時刻
+    double tOut = 0; // 次に出力を作る時刻
+    double end  = hours * 3600;
+
+    int underruns = 0;
+    int overruns  = 0;
+    int srcFailed = 0;
+    int minFill   = RING_SIZE;
+    int maxFill   = 0;
+    double errSum = 0;
+    double errSq  = 0;
+    double errMax = 0;
+    int blocks    = 0;
+    int64_t frame = 0;
+
+    std::array<int32_t, 2> out[OUT_FRAMES];
+
+    auto pushDMA = [&](double t) {
+        if (dma.size() == DMA_COUNT)
+        {
+            // 読まれないうちに上書きされる
+            dma.pop_front();
+            if (t > SETTLE_SECS)
+            {
+                ++overruns;
+            }
+        }
+        dma.push_back(t);
+        tIn += DMA_FRAMES / inFreq(tIn);
+    };
+
+    // 読めるだけリングに移す
+    auto pull = [&] {
+        while (!dma.empty() &&
+               int(ring.getFullWritableSize()) >= DMA_FRAMES * 2)
+        {
+            for (int i = 0; i < DMA_FRAMES; ++i)
+            {
+                auto* p = ring.getWritePointer();
+                p[0]    = int16_t(frame);
+                p[1]    = int16_t(frame);
+                ring.advanceWritePointer(2);
+                ++frame;
+            }
+            dma.pop_front();
+        }
+    };
+
+    while (tOut < end)
+    {
+        while (tIn <= tOut)
+        {
+            pushDMA(tIn);
+        }
+
+        pull();
+
+        // 足りなければ目標まで届くのを待つ (i2s_read で止まる)
+        double step = inRate / OUT_RATE * comp.getRatio();
+        int need    = int(OUT_FRAMES * step) + 2;
+        if (int(ring.getFullReadableSize() >> 1) < need)
+        {
+            if (tOut > SETTLE_SECS)
+            {
+                ++underruns;
+            }
+            while (int(ring.getFullReadableSize() >> 1) < need + TARGET_FRAMES)
+            {
+                tOut = std::max(tOut, tIn);
+                pushDMA(tIn);
+                pull();
+            }
+        }
+
+        memset(out, 0, sizeof(out));
+        if (!src.convertAccum(out, OUT_FRAMES, ring))
+        {
+            ++srcFailed;
+        }
+
+        int fill = ring.getFullReadableSize() >> 1;
+        if (compensate)
+        {
+            src.setSamplingStep(baseStep * comp.update(fill));
+        }
+
+        if (tOut > SETTLE_SECS)
+        {
+            minFill = std::min(minFill, fill);
+            maxFill = std::max(maxFill, fill);
+
+            // 本当の比からのずれ (音程のずれ)
+            double actual = inFreq(tOut) / outFreq;
+            double used   = baseStep * (compensate ? comp.getRatio() : 1.0);
+            double e      = (used / actual - 1) * 1e6;
+            errSum += e;
+            errSq += e * e;
+            errMax = std::max(errMax, fabs(e));
+            ++blocks;
+        }
+
+        tOut += OUT_FRAMES / outFreq;
+    }
+
+    double mean = blocks ? errSum / blocks : 0;
+    double rms  = blocks ? sqrt(errSq / blocks) : 0;
+    printf("%.1f hours, FM %.0f Hz %+.0f ppm (wander %.0f), out %+.0f ppm, "
+           "%s\n",
+           hours,
+           inRate,
+           inPPM,
+           wanderPPM,
+           outPPM,
+           compensate ? "compensated" : "fixed ratio");
+    printf("underrun %d, overrun %d, src failed %d, fill %d..%d (target %d)\n",
+           underruns,
+           overruns,
+           srcFailed,
+           minFill,
+           maxFill,
+           TARGET_FRAMES);
+    printf("ratio error: mean %+.2f ppm, rms %.2f ppm, max %.2f ppm "
+           "(%.3f cents)\n",
+           mean,
+           rms,
+           errMax,
+           errMax / PPM_PER_CENT);
+    return underruns || overruns ? 1 : 0;
+}
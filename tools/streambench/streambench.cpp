@@ -0,0 +1,451 @@
+/*
+ * FileBinaryStream の先読み窓で、S98 のヘッダとタグを読む時の
+ * ファイルアクセスがどれだけ減るかを数えるホスト用のツール
+ *
+ *  streambench [-n files] [-c count]
+ *
+ *  -n  作る S98 の数 (default 2000)
+ *  -c  1. で比べるファイルの数 (1 つに 2000 回の操作、default 300)
+ *
+ * 1. でたらめな seek, peek, get, advance, getU* の結果をファイルの中身と
+ *    比べる
+ * 2. S98Player::Header::load と同じ順にヘッダとタグを読み、1 ファイルあたり
+ *    にストリームが呼ぶ fread/fseek の数を数える
+ *    (本体は stdio のバッファを切るので、これがそのまま FATFS に行く)
+ *    前の作り (呼ばれるたびに fread/fseek する) とも比べる
+ * 3. 曲データを頭から getU8 で流して読む時の fread の数
+ *    先読みは続けて読む間だけ窓の大きさまで増える
+ *
+ * ファイルは fmemopen でメモリに置くので、時間は読む量の違いしか表さない
+ */
+
+#include <io/file_stream.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+struct Counter
+{
+    uint64_t reads;
+    uint64_t seeks;
+    uint64_t bytes;
+};
+
+FILE*
+openMem(const std::vector<uint8_t>& data)
+{
+    auto fp = fmemopen(const_cast<uint8_t*>(data.data()), data.size(), "rb");
+    setvbuf(fp, nullptr, _IONBF, 0);
+    return fp;
+}
+
+// 窓を持つ前の FileBinaryStream と同じく、呼ばれるたびに fread/fseek する
+class PerCallStream final : public io::BinaryStream
+{
+    FILE* fp_;
+    std::vector<char> cache_;
+    mutable int adj_ = 0;
+    mutable Counter counter_{};
+
+public:
+    explicit PerCallStream(FILE* fp)
+        : fp_(fp)
+    {
+    }
+
+    const Counter& getCounter() const { return counter_; }
+
+    bool seek(int pos, bool tail) override
+    {
+        ++counter_.seeks;
+        fseek(fp_, pos, tail ? SEEK_END : SEEK_SET);
+        adj_ = 0;
+        return true;
+    }
+    uint32_t tell() const override { return ftell(fp_) + adj_; }
+    const char* peek(size_t size) override
+    {
+        adjustPointer();
+        cache_.resize(std::max(cache_.size(), size));
+        ++counter_.reads;
+        counter_.bytes += fread(cache_.data(), 1, size, fp_);
+        adj_ = -int(size);
+        return cache_.data();
+    }
+    bool advance(size_t size) override
+    {
+        adj_ += size;
+        return true;
+    }
+    bool isEndOfStream() const override
+    {
+        adjustPointer();
+        return feof(fp_);
+    }
+
+protected:
+    void adjustPointer() const
+    {
+        if (adj_)
+        {
+            ++counter_.seeks;
+            fseek(fp_, adj_, SEEK_CUR);
+            adj_ = 0;
+        }
+    }
+};
+
+// 1. ファイルの中身と比べる
+int
+check(int files, int ops)
+{
+    std::mt19937 rng(5);
+    auto rnd = [&](int n) { return int(rng() % std::max(n, 1)); };
+
+    int bad = 0;
+    for (int it = 0; it < files; ++it)
+    {
+        int n = 1 + rnd(20000);
+        std::vector<uint8_t> d(n);
+        for (auto& v : d)
+        {
+            v = uint8_t(rng());
+        }
+
+        FILE* fp = openMem(d);
+        io::FileBinaryStream fs(fp, n, size_t(512) << rnd(4));
+
+        for (int op = 0; op < ops; ++op)
+        {
+            uint32_t pos = fs.tell();
+            int avail    = n - int(pos);
+            int before   = bad;
+            switch (rnd(7))
+            {
+            case 0:
+                fs.seek(rnd(n + 1));
+                break;
+            case 1:
+                if (avail >= 1)
+                {
+                    bad += fs.getU8() != d[pos];
+                }
+                break;
+            case 2:
+                if (avail >= 2)
+                {
+                    bad += fs.getU16() != uint32_t(d[pos] | d[pos + 1] << 8);
+                }
+                break;
+            case 3:
+                if (avail >= 4)
+                {
+                    uint32_t v = d[pos] | d[pos + 1] << 8 | d[pos + 2] << 16 |
+                                 uint32_t(d[pos + 3]) << 24;
+                    bad += fs.getU32Aligned() != v;
+                }
+                break;
+            case 4:
+                if (avail > 0)
+                {
+                    int s  = 1 + rnd(std::min(avail, 9000));
+                    auto p = fs.get(s);
+                    bad += !p || memcmp(p.get(), &d[pos], s);
+                }
+                break;
+            case 5:
+                if (avail > 0)
+                {
+                    int s  = 1 + rnd(std::min(avail, 3000));
+                    auto p = fs.peek(s);
+                    bad += !p || memcmp(p, &d[pos], s);
+                    if (rnd(2))
+                    {
+                        fs.advance(s);
+                    }
+                }
+                break;
+            case 6:
+                fs.advance(rnd(avail + 1));
+                break;
+            }
+            bad += (fs.tell() >= uint32_t(n)) != fs.isEndOfStream();
+            if (rnd(50) == 0)
+            {
+                fs.flush();
+                bad += uint32_t(ftell(fp)) != fs.tell();
+            }
+            if (bad != before && bad <= 5)
+            {
+                printf("NG: file %d op %d at %u (size %d)\n", it, op, pos, n);
+            }
+        }
+
+        // 終わりを越える peek は失敗する
+        fs.seek(n - 1);
+        bad += fs.peek(2) != nullptr;
+        fs.seek(-1, true);
+        bad += fs.getU8() != d[n - 1];
+        bad += !fs.isEndOfStream();
+        fclose(fp);
+    }
+    return bad;
+}
+
+// S98 のヘッダ、デバイス情報、曲データ、タグ
+std::vector<uint8_t>
+makeS98(int index, std::mt19937& rng)
+{
+    std::vector<uint8_t> f;
+    auto u32 = [&](uint32_t v) {
+        for (int i = 0; i < 4; ++i)
+        {
+            f.push_back(uint8_t(v >> (i * 8)));
+        }
+    };
+
+    int dataSize    = 2000 + rng() % 60000;
+    int deviceCount = 1 + rng() % 3;
+    uint32_t start  = 32 + 16 * deviceCount;
+
+    f.insert(f.end(), {'S', '9', '8', '3'});
+    u32(10);
+    u32(1000);
+    u32(0);
+    u32(start + dataSize); // タグ
+    u32(start);
+    u32(start);
+    u32(deviceCount);
+    for (int i = 0; i < deviceCount * 4; ++i)
+    {
+        u32(rng());
+    }
+    for (int i = 0; i < dataSize; ++i)
+    {
+        f.push_back(uint8_t(rng()));
+    }
+
+    char tags[128];
+    int n = snprintf(tags,
+                     sizeof(tags),
+                     "[S98]title=Song %d\nartist=Someone\ngame=Game %d\n"
+                     "year=1990\n",
+                     index,
+                     index);
+    f.insert(f.end(), tags, tags + n + 1);
+    return f;
+}
+
+// S98Player::Header::load, loadTags と同じ順に読んでタイトルを返す
+std::string
+loadTitle(io::BinaryStream* stream)
+{
+    uint8_t magic[3];
+    for (auto& v : magic)
+    {
+        v = stream->getU8();
+    }
+    if (memcmp(magic, "S98", 3))
+    {
+        return {};
+    }
+    stream->getU8();
+
+    stream->getU32Aligned();
+    stream->getU32Aligned();
+    stream->getU32Aligned();
+    auto tagOfs = stream->getU32Aligned();
+    stream->getU32Aligned();
+    stream->getU32Aligned();
+    int deviceCount = stream->getU32Aligned();
+    for (int i = 0; i < deviceCount; ++i)
+    {
+        stream->getU32Aligned();
+        stream->getU32Aligned();
+        stream->getU32Aligned();
+        stream->getU32Aligned();
+    }
+
+    stream->seek(tagOfs);
+    for (int i = 0; i < 5; ++i)
+    {
+        stream->getU8();
+    }
+
+    std::map<std::string, std::string> tags;
+    std::string str;
+    auto appendTag = [&] {
+        auto p = str.find('=');
+        if (p != std::string::npos)
+        {
+            tags[str.substr(0, p)] = str.substr(p + 1);
+        }
+        str.clear();
+    };
+    while (!stream->isEndOfStream())
+    {
+        char c = char(stream->getU8());
+        if (c == 0xa || c == 0)
+        {
+            appendTag();
+        }
+        else
+        {
+            str.push_back(c);
+        }
+    }
+    appendTag();
+    return tags["title"];
+}
+
+// 再生と同じく頭から終わりまで 1 byte ずつ読む
+uint32_t
+readAll(io::BinaryStream* stream)
+{
+    uint32_t sum = 0;
+    while (!stream->isEndOfStream())
+    {
+        sum += stream->getU8();
+    }
+    return sum;
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+    int files = 2000;
+    int count = 300;
+
+    int c;
+    while ((c = getopt(argc, argv, "n:c:")) != -1)
+    {
+        switch (c)
+        {
+        case 'n':
+            files = std::max(1, atoi(optarg));
+            break;
+        case 'c':
+            count = std::max(0, atoi(optarg));
+            break;
+        default:
+            fprintf(stderr, "usage: streambench [-n files] [-c count]\n");
+            return 1;
+        }
+    }
+
+    int failures = check(count, 2000);
+    printf("random access: %d mismatches\n\n", failures);
+
+    std::mt19937 rng(3);
+    std::vector<std::vector<uint8_t>> s98;
+    for (int i = 0; i < files; ++i)
+    {
+        s98.push_back(makeS98(i, rng));
+    }
+
+    // 窓の大きさ。0 は前の作り
+    printf("%-14s %8s %8s %10s %10s\n",
+           "window",
+           "reads",
+           "seeks",
+           "bytes",
+           "us");
+    for (size_t windowSize : {0, 512, 1024, 4096, 16384})
+    {
+        Counter counter{};
+        int ok  = 0;
+        auto t0 = Clock::now();
+        for (int i = 0; i < files; ++i)
+        {
+            FILE* fp = openMem(s98[i]);
+            std::string title;
+            if (windowSize)
+            {
+                io::FileBinaryStream stream(fp, -1, windowSize);
+                title   = loadTitle(&stream);
+                auto& s = stream.getStats();
+                counter.reads += s.reads;
+                counter.seeks += s.seeks;
+                counter.bytes += s.bytesRead;
+            }
+            else
+            {
+                PerCallStream stream(fp);
+                title   = loadTitle(&stream);
+                auto& s = stream.getCounter();
+                counter.reads += s.reads;
+                counter.seeks += s.seeks;
+                counter.bytes += s.bytes;
+            }
+            fclose(fp);
+            ok += title == "Song " + std::to_string(i);
+        }
+        double us =
+            std::chrono::duration<double, std::micro>(Clock::now() - t0)
+                .count();
+
+        char name[16];
+        snprintf(name, sizeof(name), "%zu", windowSize);
+        printf("%-14s %8.2f %8.2f %10.0f %10.2f%s\n",
+               windowSize ? name : "per call",
+               double(counter.reads) / files,
+               double(counter.seeks) / files,
+               double(counter.bytes) / files,
+               us / files,
+               ok == files ? "" : "  NG");
+        failures += ok != files;
+    }
+
+    printf("\n%-14s %8s %10s %10s\n", "sequential", "reads", "bytes", "us");
+    for (size_t windowSize : {512, 1024, 4096, 16384})
+    {
+        Counter counter{};
+        int ok  = 0;
+        auto t0 = Clock::now();
+        for (int i = 0; i < files; ++i)
+        {
+            uint32_t sum = 0;
+            for (auto v : s98[i])
+            {
+                sum += v;
+            }
+
+            FILE* fp = openMem(s98[i]);
+            io::FileBinaryStream stream(fp, -1, windowSize);
+            ok += readAll(&stream) == sum;
+            auto& s = stream.getStats();
+            counter.reads += s.reads;
+            counter.bytes += s.bytesRead;
+            fclose(fp);
+        }
+        double us =
+            std::chrono::duration<double, std::micro>(Clock::now() - t0)
+                .count();
+        printf("%-14zu %8.2f %10.0f %10.2f%s\n",
+               windowSize,
+               double(counter.reads) / files,
+               double(counter.bytes) / files,
+               us / files,
+               ok == files ? "" : "  NG");
+        failures += ok != files;
+    }
+
+    printf("%s\n", failures ? "NG" : "OK");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,298 @@
+/*
+ * TimerScheduler に複数の仮想タイマを載せて、時刻を進めながら
+ * タイマータスクと同じ手順で鳴らすホスト用のツール
+ *
+ *  timersim [-t sec] [-s seed]
+ *
+ *  -t  回す時間 (default 600)
+ *  -s  乱数の種 (default 1)
+ *
+ * 割り込みの遅れとコールバックの重さは乱数で与え、時々長く止める
+ * 見るもの
+ *   - 期限より前に鳴らない
+ *   - 期限が num / clock 秒の整数倍からずれていかない
+ *   - 鳴った回数が時間 / 周期と合う (飛ばした分を足して)
+ *   - 回している間にヒープの確保が起こらない
+ */
+
+#include <system/timer_scheduler.h>
+
+#include <algorithm>
+#include <functional>
+#include <math.h>
+#include <new>
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+namespace
+{
+
+using sys::TimerScheduler;
+using Time = TimerScheduler::Time;
+
+constexpr uint32_t HW_CLOCK  = 1000000; // timer.cpp と同じ
+constexpr int ISR_LATENCY_US = 30;
+constexpr int LOAD_US        = 150;
+constexpr int STALL_US       = 30000; // 1ms のタイマなら MAX_CATCH_UP を超える
+constexpr int STALL_SEC      = 10;
+
+// 回している間の確保を数える
+bool countAlloc_ = false;
+size_t allocs_   = 0;
+
+} // namespace
+
+void*
+operator new(size_t size)
+{
+    if (countAlloc_)
+    {
+        ++allocs_;
+    }
+    if (void* p = malloc(size ? size : 1))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void
+operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void
+operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+namespace
+{
+
+struct Spec
+{
+    const char* name;
+    uint32_t num;
+    uint32_t clock;
+};
+
+constexpr Spec SPECS[] = {
+    {"S98 1ms", 1000, 1000000},
+    {"MDX timer-B", 1024 * (256 - 200), 4000000},
+    {"OPM timer-A 3.58MHz", 64 * (1024 - 500), 3579545},
+    {"UI 60Hz", 1, 60},
+    {"audio block", 128, 44100},
+};
+constexpr int N_SPECS = sizeof(SPECS) / sizeof(SPECS[0]);
+
+struct Track
+{
+    int id;
+    Time start;       // start() した時刻
+    uint32_t skipped; // この期限までに飛ばした数
+    double maxDrift;  // 整数倍からのずれ (us)
+    Time maxLate;
+    uint32_t early;
+    uint32_t calls;
+};
+
+// 鳴るはずの時刻を 128bit で直接出す (端数の下は切り捨て)
+Time
+exactDeadline(const Spec& s, Time start, uint64_t k)
+{
+    auto v = static_cast<unsigned __int128>(k) * s.num * HW_CLOCK
+             << TimerScheduler::FRAC_BITS;
+    return start + static_cast<Time>(v / s.clock);
+}
+
+double
+toUs(Time t)
+{
+    return double(t) / (1 << TimerScheduler::FRAC_BITS);
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+    int sec  = 600;
+    int seed = 1;
+    int c;
+    while ((c = getopt(argc, argv, "t:s:")) != -1)
+    {
+        switch (c)
+        {
+        case 't':
+            sec = atoi(optarg);
+            break;
+        case 's':
+            seed = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: timersim [-t sec] [-s seed]\n");
+            return 1;
+        }
+    }
+
+    std::mt19937 rng(seed);
+    TimerScheduler scheduler(HW_CLOCK);
+    uint64_t hw = 0; // ハードウェアのカウンタ (us)
+    auto now    = [&] { return TimerScheduler::fromTick(hw); };
+
+    // 一杯になるまで作れる
+    Track tracks[N_SPECS]{};
+    std::function<void()> callbacks[TimerScheduler::MAX_TIMERS];
+    for (int i = 0; i < N_SPECS; ++i)
+    {
+        tracks[i].id = scheduler.create();
+    }
+
+    // 周期を毎回変えて 1 回ずつ鳴らすもの (コールバックから start する)
+    int oneShot        = scheduler.create();
+    uint32_t oneShots  = 0;
+    callbacks[oneShot] = [&] {
+        ++oneShots;
+        scheduler.start(oneShot, now(), 100 + rng() % 5000, 1000000, false);
+    };
+
+    // 他のタイマを止めたり動かしたりするもの
+    int toggler         = scheduler.create();
+    int churn           = scheduler.create();
+    uint32_t churnCalls = 0;
+    callbacks[churn]    = [&] { ++churnCalls; };
+    callbacks[toggler]  = [&] {
+        if (scheduler.isActive(churn))
+        {
+            scheduler.stop(churn);
+        }
+        else
+        {
+            scheduler.start(churn, now(), 1 + rng() % 20, 1000, true);
+        }
+    };
+
+    int extra = scheduler.create();
+    if (extra >= 0)
+    {
+        printf("NG: created more than MAX_TIMERS\n");
+        return 1;
+    }
+
+    auto load = [&] {
+        hw += rng() % LOAD_US;
+        // 時々長く止まる
+        if (rng() % (STALL_SEC * 2000) == 0)
+        {
+            hw += STALL_US;
+        }
+    };
+
+    for (int i = 0; i < N_SPECS; ++i)
+    {
+        auto& tr         = tracks[i];
+        auto& s          = SPECS[i];
+        callbacks[tr.id] = [&tr, load] {
+            ++tr.calls;
+            load();
+        };
+        tr.start = now();
+        scheduler.start(tr.id, tr.start, s.num, s.clock, true);
+        hw += 1 + rng() % 1000; // ずらして始める
+    }
+    scheduler.start(oneShot, now(), 1, 1000, false);
+    scheduler.start(toggler, now(), 37, 1000, true);
+
+    countAlloc_   = true;
+    uint64_t end  = uint64_t(sec) * HW_CLOCK;
+    uint32_t wake = 0;
+    while (hw < end)
+    {
+        // アラームまで進めて割り込み
+        Time next;
+        if (!scheduler.getNextDeadline(&next))
+        {
+            break;
+        }
+        hw = std::max<uint64_t>(hw, TimerScheduler::toTick(next));
+        hw += rng() % ISR_LATENCY_US;
+        ++wake;
+
+        // タイマータスクの dispatch()
+        int id;
+        Time deadline;
+        while (scheduler.pop(now(), &id, &deadline))
+        {
+            for (auto& tr : tracks)
+            {
+                if (tr.id != id)
+                {
+                    continue;
+                }
+                auto& s = SPECS[&tr - tracks];
+                if (deadline > now())
+                {
+                    ++tr.early;
+                }
+                tr.maxLate = std::max(tr.maxLate, now() - deadline);
+
+                // 飛ばした分も数えて何番目か出す
+                // pop() で足された分はこの次の期限から
+                auto& st   = scheduler.getStats(id);
+                auto index = uint64_t(st.fires) + tr.skipped;
+                tr.skipped = st.skipped;
+
+                double d = toUs(deadline) -
+                           toUs(exactDeadline(s, tr.start, index));
+                tr.maxDrift = std::max(tr.maxDrift, fabs(d));
+            }
+            callbacks[id]();
+        }
+    }
+    countAlloc_ = false;
+
+    bool ok = allocs_ == 0;
+    printf("simulated %d s, %u wakeups, %zu allocations while running\n",
+           sec,
+           wake,
+           allocs_);
+    printf("%-20s %8s %8s %6s %9s %9s %s\n",
+           "timer",
+           "fires",
+           "expected",
+           "skip",
+           "max late",
+           "drift",
+           "early");
+    for (int i = 0; i < N_SPECS; ++i)
+    {
+        auto& tr = tracks[i];
+        auto& s  = SPECS[i];
+        auto& st = scheduler.getStats(tr.id);
+
+        double period  = double(s.num) * HW_CLOCK / s.clock;
+        double span    = end - TimerScheduler::toTick(tr.start);
+        auto expected  = uint64_t(span / period);
+        uint64_t total = uint64_t(st.fires) + st.skipped;
+        bool countOk   = total + 1 >= expected && total <= expected + 1;
+        bool driftOk   = tr.maxDrift == 0;
+        ok             = ok && countOk && driftOk && !tr.early;
+        printf("%-20s %8u %8llu %6u %6.0f us %6.3f us %u%s\n",
+               s.name,
+               st.fires,
+               (unsigned long long)expected,
+               st.skipped,
+               toUs(tr.maxLate),
+               tr.maxDrift,
+               tr.early,
+               countOk && driftOk ? "" : "  NG");
+    }
+    printf("one shot %u, churn %u\n", oneShots, churnCalls);
+    printf("%s\n", ok ? "OK" : "NG");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,333 @@
+/*
+ * ホストで PlayerWindow を動かす時の music_player と audio の代わり
+ * 曲は sys::micros() の時刻だけで決まるので、同じスクリプトなら同じ画面になる
+ *
+ * 鍵盤は YM2151 の 8ch で、ch ごとに周期の違うアルペジオを鳴らす
+ * スペクトルは同じ音を正弦波で作って SpectrumAnalyzer に通したもの
+ * FileWindow と SettingWindow はスクリプトでは開かないので空のもの
+ */
+
+#include <audio/audio_out.h>
+#include <audio/spectrum_analyzer.h>
+#include <music_player/music_player_manager.h>
+#include <sound_sys/sound_system.h>
+#include <system/mutex.h>
+#include <system/util.h>
+#include <ui/file_window.h>
+#include <ui/neo_pixel_disp.h>
+#include <ui/setting_window.h>
+
+#include <algorithm>
+#include <array>
+#include <math.h>
+#include <memory>
+#include <stdint.h>
+#include <string>
+
+namespace
+{
+
+constexpr int CHANNELS     = 8;
+constexpr uint32_t NOTE_US = 125000; // 1 音の長さ (ch 0)
+constexpr int SAMPLE_RATE  = 44100;
+constexpr int HISTORY_SIZE = 1024; // FFT_SIZE * DECIMATION 以上の 2^n
+const int arpeggio_[]      = {0, 4, 7, 12, 7, 4};
+
+// ch ごとの今の音
+struct Voice
+{
+    int note;
+    uint32_t index; // 何音目か
+};
+
+Voice
+getVoice(int ch, uint32_t t)
+{
+    uint32_t len = NOTE_US * (1 + ch % 3);
+    uint32_t i   = t / len;
+    return {-24 + ch * 5 + arpeggio_[i % std::size(arpeggio_)], i};
+}
+
+class HostSoundSystem final : public sound_sys::SoundSystem
+{
+public:
+    HostSoundSystem()
+    {
+        info_.systemID       = SYSTEM_YM2151;
+        info_.clock          = 4000000;
+        info_.actualSystemID = SYSTEM_YM2151;
+        info_.actualClock    = 4000000;
+        info_.channelCount   = CHANNELS;
+    }
+
+    const SystemInfo& getSystemInfo() const override { return info_; }
+
+    float getNote(int ch, int voice) const override
+    {
+        return float(getVoice(ch, sys::micros()).note);
+    }
+
+    float getVolume(int ch) const override
+    {
+        return getEnabledChannels() & (1 << ch) ? 0.5f + 0.05f * ch : 0;
+    }
+
+    float getPan(int ch) const override { return ch & 1 ? 0.5f : -0.5f; }
+    int getInstrument(int ch) const override { return ch; }
+
+    bool mute(int ch, bool f) override
+    {
+        muted_ = f ? muted_ | (1 << ch) : muted_ & ~(1 << ch);
+        return true;
+    }
+
+    uint32_t getKeyOnChannels() const override
+    {
+        return ~muted_ & ((1 << CHANNELS) - 1);
+    }
+
+    // 前に呼んだ時から音が変わった ch
+    uint32_t getKeyOnTrigger() override
+    {
+        uint32_t t    = sys::micros();
+        uint32_t bits = 0;
+        for (int ch = 0; ch < CHANNELS; ++ch)
+        {
+            auto i = getVoice(ch, t).index;
+            if (t < lastTime_ || i != lastIndex_[ch])
+            {
+                bits |= 1 << ch;
+            }
+            lastIndex_[ch] = i;
+        }
+        lastTime_ = t;
+        return bits & getKeyOnChannels();
+    }
+
+    uint32_t getEnabledChannels() const override { return getKeyOnChannels(); }
+
+private:
+    SystemInfo info_;
+    uint32_t muted_    = 0;
+    uint32_t lastTime_ = 0;
+    std::array<uint32_t, CHANNELS> lastIndex_{};
+};
+
+class HostMusicPlayer final : public music_player::MusicPlayer
+{
+public:
+    bool isSupported(const char* filename) override { return false; }
+    std::experimental::optional<std::string>
+    loadTitle(const char* filename) override
+    {
+        return {};
+    }
+
+    bool start() override { return true; }
+    bool terminate() override { return true; }
+    bool load(const char* filename) override { return true; }
+    bool play(int track) override { return true; }
+    bool stop() override { return true; }
+    bool pause() override { return true; }
+    bool cont() override { return true; }
+    bool fadeout() override { return true; }
+    bool isFinished() const override { return false; }
+    bool isPaused() const override { return false; }
+    int getCurrentLoop() const override { return sys::micros() / 3000000; }
+    int getTrackCount() const override { return 1; }
+    int getCurrentTrack() const override { return -1; }
+    float getPlayTime() const override { return sys::micros() * 1e-6f; }
+
+    const char* getTitle() const override
+    {
+        return "テスト曲 Host Arpeggio for the Player Window";
+    }
+
+    music_player::FileFormat getFormat() const override
+    {
+        return music_player::FileFormat::S98;
+    }
+
+    sound_sys::SoundSystem* getSystem(int idx) override
+    {
+        return idx == 0 ? &soundSystem_ : nullptr;
+    }
+
+private:
+    HostSoundSystem soundSystem_;
+};
+
+HostMusicPlayer player_;
+std::string playFile_ = "/host/arpeggio.s98";
+
+} // namespace
+
+namespace music_player
+{
+
+MusicPlayer*
+getActiveMusicPlayer()
+{
+    return &player_;
+}
+
+bool
+nextPlayList(bool wrap)
+{
+    return false;
+}
+
+bool
+prevOrRewindPlayList()
+{
+    return false;
+}
+
+const std::string&
+getCurrentPlayFile()
+{
+    return playFile_;
+}
+
+int
+getCurrentListIndex()
+{
+    return 0;
+}
+
+sys::Mutex&
+getMutex()
+{
+    static sys::Mutex mutex;
+    return mutex;
+}
+
+} // namespace music_player
+
+namespace audio
+{
+
+struct AudioOutDriverManager::Impl
+{
+    std::array<HistorySample, HISTORY_SIZE> history;
+    HistoryRingBuffer ring{history.data(), HISTORY_SIZE};
+    std::unique_ptr<SpectrumAnalyzer> analyzer;
+    uint32_t samples = 0; // 作ったサンプル数
+
+    // sys::micros() までの音を作って解析する
+    // 時刻が戻ったら最初から
+    void generate()
+    {
+        uint64_t target = uint64_t(sys::micros()) * SAMPLE_RATE / 1000000;
+        if (!analyzer || target < samples)
+        {
+            history.fill({});
+            ring.set(history.data(), HISTORY_SIZE);
+            analyzer = std::make_unique<SpectrumAnalyzer>();
+            samples  = 0;
+        }
+        while (samples < target)
+        {
+            uint32_t n = std::min<uint64_t>(target - samples, 128);
+            for (uint32_t i = 0; i < n; ++i)
+            {
+                uint32_t s = samples + i;
+                uint32_t t = uint64_t(s) * 1000000 / SAMPLE_RATE;
+                std::array<float, 2> v{};
+                for (int ch = 0; ch < CHANNELS; ++ch)
+                {
+                    double f  = 440 * pow(2, getVoice(ch, t).note / 12.0);
+                    double ph = fmod(f * s / SAMPLE_RATE, 1.0);
+                    v[ch & 1] += float(sin(2 * M_PI * ph) * 2000);
+                }
+                ring.getCurrent() = {int16_t(v[0]), int16_t(v[1])};
+                ring.advancePointer(1);
+            }
+            samples += n;
+            analyzer->update(ring, n, SAMPLE_RATE);
+        }
+    }
+};
+
+AudioOutDriverManager::AudioOutDriverManager()
+    : pimpl_(new Impl)
+{
+}
+
+AudioOutDriverManager::~AudioOutDriverManager() = default;
+
+AudioOutDriverManager&
+AudioOutDriverManager::instance()
+{
+    static AudioOutDriverManager inst;
+    return inst;
+}
+
+SpectrumAnalyzer&
+AudioOutDriverManager::getSpectrumAnalyzer()
+{
+    pimpl_->generate();
+    return *pimpl_->analyzer;
+}
+
+} // namespace audio
+
+namespace ui
+{
+
+NeoPixelDisp::NeoPixelDisp() {}
+
+void
+NeoPixelDisp::update(const AnalyzerResult& result, float dt)
+{
+}
+
+FileWindow::FileWindow(const std::string& path) {}
+
+FileList::FileList() {}
+FileList::~FileList() {}
+
+Dim2
+FileList::getSize() const
+{
+    return {};
+}
+
+uint16_t
+FileList::getBaseItemSize() const
+{
+    return 1;
+}
+
+size_t
+FileList::getWidgetCount() const
+{
+    return 0;
+}
+
+const Widget*
+FileList::getWidget(size_t i) const
+{
+    return nullptr;
+}
+
+Widget*
+FileList::getWidget(size_t i)
+{
+    return nullptr;
+}
+
+void
+FileList::onUpdate(UpdateContext& ctx)
+{
+}
+
+SettingWindow::SettingWindow() {}
+SettingWindow::~SettingWindow() {}
+
+void
+SettingWindow::onUpdate(UpdateContext& ctx)
+{
+}
+
+} // namespace ui
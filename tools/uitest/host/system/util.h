@@ -0,0 +1,17 @@
+/*
+ * ホストでビルドする時の system/util.h の代わり
+ * 時刻はスクリプトで進める (uitest.cpp)
+ */
+#ifndef _E4C07B2A_91F3_4D6E_8B52_3A0F6D19C7E4
+#define _E4C07B2A_91F3_4D6E_8B52_3A0F6D19C7E4
+
+#include <stdint.h>
+
+namespace sys
+{
+
+uint32_t micros();
+
+} // namespace sys
+
+#endif /* _E4C07B2A_91F3_4D6E_8B52_3A0F6D19C7E4 */
@@ -0,0 +1,441 @@
+/*
+ * ui/ をホストで動かすツール
+ * 決めたキー入力で画面を更新し、フレームごとの描画と転送の時間を測って、
+ * 途中の画面を golden の PNG と比べる
+ * 曲のリストとダイアログの場面と、再生画面 (PlayerWindow) の場面を通す
+ * 再生画面の曲とスペクトルは host/player_host.cpp で時刻から作る
+ *
+ *  uitest [-d datadir] [-g goldendir] [-o outdir] [-n repeat] [-u]
+ *
+ *  -d  フォントとテクスチャのある所 (default ../../main/data)
+ *  -g  golden の PNG のある所 (default golden)
+ *  -o  違った時に描いた画面を書き出す所 (default .)
+ *  -n  時間を測るために通す回数 (default 20)
+ *  -u  golden を書き直す
+ */
+
+#include <audio/audio_out.h>
+#include <graphics/bmp.h>
+#include <graphics/compositor.h>
+#include <graphics/font_data.h>
+#include <graphics/memory_framebuffer.h>
+#include <graphics/texture.h>
+#include <ui/context.h>
+#include <ui/control_bar.h>
+#include <ui/dialog.h>
+#include <ui/key.h>
+#include <ui/player_window.h>
+#include <ui/simple_list_window.h>
+#include <ui/system_setting.h>
+#include <ui/ui_manager.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+constexpr uint32_t FRAME_US = 16667;
+constexpr int SCREEN_W      = 320;
+constexpr int SCREEN_H      = 240;
+constexpr int DIAL_STEP     = 4; // 1 クリックの値
+
+uint32_t now_ = 0;
+
+} // namespace
+
+namespace sys
+{
+
+uint32_t
+micros()
+{
+    return now_;
+}
+
+} // namespace sys
+
+namespace ui
+{
+
+SystemSettings&
+SystemSettings::instance()
+{
+    static SystemSettings inst;
+    return inst;
+}
+
+} // namespace ui
+
+namespace
+{
+
+// キー入力の 1 区切り
+// keys は押しているボタン ('A', 'B', 'C' と 'P' がダイアルの押し込み)
+struct Step
+{
+    const char* label;
+    const char* keys;
+    int dial; // フレームごと
+    int frames;
+    const char* snapshot; // 最後のフレームの後の画面
+};
+
+// 曲のリストを開いてダイアルで送り、ボタン C を押し続けて流し、
+// 選んだらダイアログを出して閉じる
+const Step listScript_[] = {
+    {"open", "", 0, 2, "list_top"},
+    {"dial", "", -DIAL_STEP, 20, "list_scroll"},
+    {"repeat", "C", 0, 40, nullptr},
+    {"idle", "", 0, 10, nullptr},
+    {"decide", "B", 0, 1, nullptr},
+    {"decide", "", 0, 2, "dialog"},
+    {"dialog", "", -DIAL_STEP, 1, nullptr},
+    {"dialog", "B", 0, 1, nullptr},
+    {"close", "", 0, 3, "list_back"},
+};
+
+// 再生画面を出して、鍵盤とスペクトルが動くのを待つ
+// ボタン A の長押しで音量の操作に入り、B で下げる
+const Step playerScript_[] = {
+    {"play", "", 0, 2, "player"},
+    {"playing", "", 0, 60, "player_1s"},
+    {"vol", "A", 0, 40, nullptr},
+    {"vol", "AB", 0, 1, nullptr},
+    {"vol", "A", 0, 2, "player_vol"},
+    {"release", "", 0, 30, nullptr},
+};
+
+constexpr int N_ITEMS = 64;
+
+class SongListWindow final : public ui::SimpleListWindow
+{
+    std::vector<ui::SimpleList::TextItem> items_;
+
+public:
+    SongListWindow()
+    {
+        setTitle("曲選択 SELECT SONG");
+        items_.resize(N_ITEMS);
+        for (int i = 0; i < N_ITEMS; ++i)
+        {
+            char buf[64];
+            snprintf(buf, sizeof(buf), "%02d: テスト曲 Track Title %d", i, i);
+            items_[i].setText(buf);
+            append(&items_[i]);
+        }
+        getList().setIndex(0);
+
+        getList().setDecideFunc([](ui::UpdateContext& ctx, int i) {
+            auto p = std::make_shared<ui::Dialog>("確認 CONFIRM",
+                                                  ui::Dim2{240, 120});
+            p->setMessage("この曲を再生しますか? Play this song?");
+            p->appendButton("再生 PLAY");
+            p->appendButton("閉じる CLOSE");
+            if (auto* um = ctx.getUIManager())
+            {
+                um->push(p);
+            }
+        });
+    }
+};
+
+void
+openSongList(ui::UIManager& m)
+{
+    m.push(std::make_shared<SongListWindow>(), {0, 0});
+}
+
+void
+openPlayer(ui::UIManager& m)
+{
+    std::make_shared<ui::PlayerWindow>()->show(m);
+}
+
+// 場面ごとに UIManager を作り直して通す
+struct Scene
+{
+    const char* name;
+    void (*open)(ui::UIManager& m);
+    const Step* steps;
+    size_t count;
+};
+
+const Scene scenes_[] = {
+    {"list", openSongList, listScript_, std::size(listScript_)},
+    {"player", openPlayer, playerScript_, std::size(playerScript_)},
+};
+
+struct Timing
+{
+    int frames;
+    double renderUs;
+    double flushUs;
+    uint32_t maxRenderUs;
+    uint64_t regions;
+    uint64_t pixels;
+};
+
+bool
+readFile(std::vector<uint8_t>& buf, const std::string& filename)
+{
+    auto fp = fopen(filename.c_str(), "rb");
+    if (!fp)
+    {
+        return false;
+    }
+    fseek(fp, 0, SEEK_END);
+    buf.resize(ftell(fp));
+    fseek(fp, 0, SEEK_SET);
+    bool r = fread(buf.data(), 1, buf.size(), fp) == buf.size();
+    fclose(fp);
+    return r;
+}
+
+class Runner
+{
+public:
+    bool load(const std::string& dir)
+    {
+        if (!readFile(fontAsciiBin_, dir + "/_4x8_font.bin") ||
+            !readFile(fontKanjiBin_, dir + "/misaki_font.bin") ||
+            !readFile(textureBin_, dir + "/m5dx_material.bmp"))
+        {
+            return false;
+        }
+        fontAscii_.setData(fontAsciiBin_.data());
+        fontKanji_.setData(fontKanjiBin_.data());
+        return texture_.initialize(
+            reinterpret_cast<const graphics::BMP*>(textureBin_.data()));
+    }
+
+    // check が false なら時間だけ測る
+    int run(const Scene& scene,
+            Timing* timing,
+            bool check,
+            bool update,
+            const std::string& goldenDir,
+            const std::string& outDir)
+    {
+        graphics::MemoryFrameBuffer screen(SCREEN_W, SCREEN_H);
+        graphics::MemoryFrameBuffer lcd(SCREEN_W, SCREEN_H);
+        graphics::Compositor compositor;
+        compositor.setBackingStore(&screen);
+
+        ui::UIManager uiManager;
+        ui::KeyState keyState;
+        auto controlBar = std::make_shared<ui::ControlBar>();
+        uiManager.push(controlBar, {0, 232});
+        scene.open(uiManager);
+
+        now_       = 0;
+        int errors = 0;
+        for (size_t s = 0; s < scene.count; ++s)
+        {
+            auto& step = scene.steps[s];
+            auto& t    = timing[s];
+            auto has   = [&](char c) { return strchr(step.keys, c); };
+
+            for (int f = 0; f < step.frames; ++f)
+            {
+                now_ += FRAME_US;
+                keyState.update(
+                    has('A'), has('B'), has('C'), has('P'), step.dial);
+
+                ui::UpdateContext uctx(
+                    FRAME_US * 1e-6f, &uiManager, &keyState, controlBar.get());
+                uiManager.update(uctx);
+
+                // 曲の音を作って解析するのは描画の時間に入れない
+                audio::AudioOutDriverManager::instance().getSpectrumAnalyzer();
+
+                using clock = std::chrono::steady_clock;
+                auto t0     = clock::now();
+
+                ui::RenderContext ctx;
+                ctx.setFrameBuffer(&compositor);
+                ctx.setTexture(&texture_);
+                auto& fm = ctx.getFontManager();
+                fm.setAsciiFontData(&fontAscii_);
+                fm.setKanjiFontData(&fontKanji_);
+                uiManager.render(ctx);
+
+                auto t1 = clock::now();
+                compositor.flush(lcd);
+                auto t2 = clock::now();
+
+                using us = std::chrono::duration<double, std::micro>;
+                double render = us(t1 - t0).count();
+                ++t.frames;
+                t.renderUs += render;
+                t.flushUs += us(t2 - t1).count();
+                t.maxRenderUs = std::max(t.maxRenderUs, uint32_t(render));
+                t.regions += compositor.getLastStats().regions;
+                t.pixels += compositor.getLastStats().pixels;
+            }
+
+            if (check && step.snapshot)
+            {
+                errors +=
+                    !compare(lcd, step.snapshot, update, goldenDir, outDir);
+            }
+        }
+        return errors;
+    }
+
+protected:
+    bool compare(const graphics::MemoryFrameBuffer& fb,
+                 const char* name,
+                 bool update,
+                 const std::string& goldenDir,
+                 const std::string& outDir)
+    {
+        auto golden = goldenDir + "/" + name + ".png";
+        if (update)
+        {
+            bool r = graphics::writePNG(golden.c_str(), fb);
+            printf("%s: %s\n", golden.c_str(), r ? "updated" : "write error");
+            return r;
+        }
+
+        auto out = outDir + "/" + name + ".png";
+        std::vector<uint8_t> a, b;
+        if (!graphics::writePNG(out.c_str(), fb) || !readFile(a, out))
+        {
+            printf("%s: write error\n", out.c_str());
+            return false;
+        }
+        if (!readFile(b, golden))
+        {
+            printf("%s: no golden, see %s\n", name, out.c_str());
+            return false;
+        }
+        if (a != b)
+        {
+            printf("%s: DIFFERENT, see %s\n", name, out.c_str());
+            return false;
+        }
+        remove(out.c_str());
+        printf("%s: same\n", name);
+        return true;
+    }
+
+private:
+    std::vector<uint8_t> fontAsciiBin_;
+    std::vector<uint8_t> fontKanjiBin_;
+    std::vector<uint8_t> textureBin_;
+
+    graphics::FontData fontAscii_;
+    graphics::FontData fontKanji_;
+    graphics::Texture texture_;
+};
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+    std::string dataDir   = "../../main/data";
+    std::string goldenDir = "golden";
+    std::string outDir    = ".";
+    int repeat            = 20;
+    bool update           = false;
+
+    int c;
+    while ((c = getopt(argc, argv, "d:g:o:n:u")) != -1)
+    {
+        switch (c)
+        {
+        case 'd':
+            dataDir = optarg;
+            break;
+        case 'g':
+            goldenDir = optarg;
+            break;
+        case 'o':
+            outDir = optarg;
+            break;
+        case 'n':
+            repeat = std::max(1, atoi(optarg));
+            break;
+        case 'u':
+            update = true;
+            break;
+        default:
+            fprintf(stderr,
+                    "usage: uitest [-d datadir] [-g goldendir] [-o outdir] "
+                    "[-n repeat] [-u]\n");
+            return 1;
+        }
+    }
+
+    Runner runner;
+    if (!runner.load(dataDir))
+    {
+        fprintf(stderr, "%s: can't load the fonts or the texture.\n",
+                dataDir.c_str());
+        return 1;
+    }
+
+    int errors = 0;
+    for (auto& scene : scenes_)
+    {
+        // 1 回目だけ画面を比べる
+        std::vector<Timing> timing(scene.count);
+        for (int i = 0; i < repeat; ++i)
+        {
+            errors += runner.run(
+                scene, timing.data(), i == 0, update, goldenDir, outDir);
+        }
+
+        printf("%-8s %7s %10s %10s %10s %8s %9s\n",
+               scene.name,
+               "frames",
+               "render us",
+               "max",
+               "flush us",
+               "regions",
+               "pixels");
+        int frames    = 0;
+        double pixels = 0;
+        for (size_t s = 0; s < scene.count; ++s)
+        {
+            auto& t = timing[s];
+            int n   = std::max(t.frames, 1);
+            printf("%-8s %7d %10.1f %10u %10.1f %8.1f %9.0f\n",
+                   scene.steps[s].label,
+                   t.frames / repeat,
+                   t.renderUs / n,
+                   t.maxRenderUs,
+                   t.flushUs / n,
+                   double(t.regions) / n,
+                   double(t.pixels) / n);
+            frames += t.frames;
+            pixels += t.pixels;
+        }
+
+        // 差分にする前は毎フレーム画面全体を送っていた
+        constexpr double FULL = SCREEN_W * SCREEN_H;
+        double perFrame       = pixels / std::max(frames, 1);
+        printf("%s: %.0f pixels/frame flushed, full screen %.0f (%.1f%%)\n\n",
+               scene.name,
+               perFrame,
+               FULL,
+               perFrame * 100 / FULL);
+    }
+
+    if (update)
+    {
+        return errors ? 1 : 0;
+    }
+    printf("%s\n", errors ? "NG" : "OK");
+    return errors ? 1 : 0;
+}
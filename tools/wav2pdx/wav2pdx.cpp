@@ -0,0 +1,398 @@
+/*
+ * WAV から PDX を作るホスト用のツール
+ *
+ *  wav2pdx [-r rate] [-j jobs] -o out.pdx [note=]in.wav ...
+ *
+ *  rate : 3900, 5200, 7800, 10400, 15600 (default)
+ *  note : 格納先の番号 (0-95)。省略すると前から順に詰める
+ */
+
+#include <sound_sys/m6258_coder.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+constexpr int PDX_ENTRY_COUNT = 96;
+
+// PCM8 の mode と同じ並び
+constexpr int sampleRates_[] = {3906, 5208, 7813, 10417, 15625};
+
+struct Sample
+{
+    std::string filename;
+    int note = -1;
+
+    std::vector<int16_t> pcm; // 変換先のレートにしたもの
+    std::vector<uint8_t> adpcm;
+
+    int srcRate     = 0;
+    double snr      = 0;
+    double encodeUS = 0;
+    bool ok         = false;
+};
+
+uint32_t
+getLE32(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24);
+}
+
+int
+getLE16(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+void
+setBE32(uint8_t* p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+bool
+readFile(std::vector<uint8_t>& buf, const char* filename)
+{
+    auto fp = fopen(filename, "rb");
+    if (!fp)
+    {
+        return false;
+    }
+    fseek(fp, 0, SEEK_END);
+    buf.resize(ftell(fp));
+    fseek(fp, 0, SEEK_SET);
+    bool r = fread(buf.data(), 1, buf.size(), fp) == buf.size();
+    fclose(fp);
+    return r;
+}
+
+// 8/16bit の PCM を mono の float にする
+bool
+loadWAV(std::vector<float>& dst, int& rate, const char* filename)
+{
+    std::vector<uint8_t> buf;
+    if (!readFile(buf, filename))
+    {
+        fprintf(stderr, "%s: read error.\n", filename);
+        return false;
+    }
+
+    if (buf.size() < 12 || memcmp(&buf[0], "RIFF", 4) ||
+        memcmp(&buf[8], "WAVE", 4))
+    {
+        fprintf(stderr, "%s: not a WAV file.\n", filename);
+        return false;
+    }
+
+    int channels = 0;
+    int bits     = 0;
+    size_t pos   = 12;
+    while (pos + 8 <= buf.size())
+    {
+        auto id   = &buf[pos];
+        auto size = getLE32(&buf[pos + 4]);
+        auto body = pos + 8;
+        if (size > buf.size() - body)
+        {
+            size = buf.size() - body;
+        }
+
+        if (memcmp(id, "fmt ", 4) == 0 && size >= 16)
+        {
+            int format = getLE16(&buf[body]);
+            channels   = getLE16(&buf[body + 2]);
+            rate       = getLE32(&buf[body + 4]);
+            bits       = getLE16(&buf[body + 14]);
+            if (format != 1 || (bits != 8 && bits != 16) || channels < 1)
+            {
+                fprintf(stderr, "%s: unsupported format.\n", filename);
+                return false;
+            }
+        }
+        else if (memcmp(id, "data", 4) == 0 && channels)
+        {
+            int bytesPerFrame = channels * bits / 8;
+            size_t frames     = size / bytesPerFrame;
+            dst.resize(frames);
+
+            auto p = &buf[body];
+            for (size_t i = 0; i < frames; ++i)
+            {
+                float s = 0;
+                for (int ch = 0; ch < channels; ++ch)
+                {
+                    s += bits == 8 ? (p[0] - 128) * 256 : (int16_t)getLE16(p);
+                    p += bits / 8;
+                }
+                dst[i] = s / channels;
+            }
+            return true;
+        }
+
+        pos = body + size + (size & 1);
+    }
+
+    fprintf(stderr, "%s: no data.\n", filename);
+    return false;
+}
+
+// Hann 窓をかけた sinc で変換する
+void
+resample(std::vector<int16_t>& dst,
+         const std::vector<float>& src,
+         int srcRate,
+         int dstRate)
+{
+    constexpr int HALF_TAPS = 16;
+
+    double step   = (double)srcRate / dstRate;
+    double cutoff = std::min(1.0, 1.0 / step); // ナイキストに対する比
+    int taps      = (int)ceil(HALF_TAPS / cutoff);
+
+    size_t n = (size_t)(src.size() / step);
+    dst.resize(n & ~1); // ADPCM は 2 サンプルで 1 byte
+
+    for (size_t i = 0; i < dst.size(); ++i)
+    {
+        double center = i * step;
+        int c         = (int)center;
+
+        double acc = 0;
+        for (int k = c - taps + 1; k <= c + taps; ++k)
+        {
+            if (k < 0 || k >= (int)src.size())
+            {
+                continue;
+            }
+            double x = (k - center) * cutoff;
+            double w = 0.5 + 0.5 * cos(M_PI * (k - center) / (taps + 1));
+            double s = x == 0 ? 1 : sin(M_PI * x) / (M_PI * x);
+            acc += src[k] * s * w * cutoff;
+        }
+        dst[i] = (int16_t)std::min(32767.0, std::max(-32768.0, round(acc)));
+    }
+}
+
+void
+encode(Sample& s)
+{
+    auto t0 = std::chrono::steady_clock::now();
+
+    s.adpcm.resize(s.pcm.size() / 2);
+    sound_sys::M6258Coder coder;
+    coder.encodeBlock(s.adpcm.data(), s.pcm.data(), s.pcm.size(), 4);
+
+    s.encodeUS = std::chrono::duration<double, std::micro>(
+                     std::chrono::steady_clock::now() - t0)
+                     .count();
+
+    // 実機と同じ decoder で戻して 12bit の入力と比べる
+    std::vector<int16_t> decoded(s.pcm.size());
+    sound_sys::M6258Coder decoder;
+    decoder.decodeBlock(decoded.data(), s.adpcm.data(), s.adpcm.size());
+
+    double sig   = 0;
+    double noise = 0;
+    for (size_t i = 0; i < s.pcm.size(); ++i)
+    {
+        double ref = std::min(2047, std::max(-2048, s.pcm[i] >> 4));
+        double d   = decoded[i] - ref;
+        sig += ref * ref;
+        noise += d * d;
+    }
+    s.snr = noise > 0 ? 10 * log10(sig / noise) : INFINITY;
+}
+
+void
+usage()
+{
+    fprintf(stderr,
+            "usage: wav2pdx [-r rate] [-j jobs] -o out.pdx [note=]in.wav "
+            "...\n"
+            "  rate: 3900, 5200, 7800, 10400, 15600 (default)\n");
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+    int rate        = 15625;
+    int jobCount    = std::max(1u, std::thread::hardware_concurrency());
+    const char* out = nullptr;
+    std::vector<Sample> samples;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* a = argv[i];
+        if (strcmp(a, "-r") == 0 && i + 1 < argc)
+        {
+            // 近いものに合わせる
+            int r = atoi(argv[++i]);
+            rate  = *std::min_element(std::begin(sampleRates_),
+                                     std::end(sampleRates_),
+                                     [r](int x, int y) {
+                                         return abs(x - r) < abs(y - r);
+                                     });
+        }
+        else if (strcmp(a, "-j") == 0 && i + 1 < argc)
+        {
+            jobCount = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(a, "-o") == 0 && i + 1 < argc)
+        {
+            out = argv[++i];
+        }
+        else if (a[0] == '-')
+        {
+            usage();
+            return 1;
+        }
+        else
+        {
+            Sample s;
+            auto eq = strchr(a, '=');
+            if (eq && eq != a && strspn(a, "0123456789") == size_t(eq - a))
+            {
+                s.note     = atoi(a);
+                s.filename = eq + 1;
+            }
+            else
+            {
+                s.filename = a;
+            }
+            samples.push_back(std::move(s));
+        }
+    }
+
+    if (!out || samples.empty())
+    {
+        usage();
+        return 1;
+    }
+
+    // 番号の割り当て
+    bool used[PDX_ENTRY_COUNT]{};
+    for (auto& s : samples)
+    {
+        if (s.note >= PDX_ENTRY_COUNT || (s.note >= 0 && used[s.note]))
+        {
+            fprintf(stderr,
+                    "%s: invalid note %d.\n",
+                    s.filename.c_str(),
+                    s.note);
+            return 1;
+        }
+        if (s.note >= 0)
+        {
+            used[s.note] = true;
+        }
+    }
+    int next = 0;
+    for (auto& s : samples)
+    {
+        if (s.note < 0)
+        {
+            while (next < PDX_ENTRY_COUNT && used[next])
+            {
+                ++next;
+            }
+            if (next == PDX_ENTRY_COUNT)
+            {
+                fprintf(stderr, "too many samples.\n");
+                return 1;
+            }
+            s.note     = next;
+            used[next] = true;
+        }
+    }
+
+    // ファイルごとに独立しているのでそのまま並列にする
+    auto t0 = std::chrono::steady_clock::now();
+    std::atomic<size_t> index{0};
+    auto worker = [&] {
+        size_t i;
+        while ((i = index++) < samples.size())
+        {
+            auto& s = samples[i];
+            std::vector<float> wav;
+            if (!loadWAV(wav, s.srcRate, s.filename.c_str()))
+            {
+                continue;
+            }
+            resample(s.pcm, wav, s.srcRate, rate);
+            encode(s);
+            s.ok = true;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < jobCount; ++i)
+    {
+        threads.emplace_back(worker);
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    double totalUS = std::chrono::duration<double, std::micro>(
+                         std::chrono::steady_clock::now() - t0)
+                         .count();
+
+    // PDX: 96 個の (offset, size) の後に ADPCM を並べる
+    std::vector<uint8_t> pdx(PDX_ENTRY_COUNT * 8);
+    size_t pcmSamples = 0;
+    double encodeUS   = 0;
+    for (auto& s : samples)
+    {
+        if (!s.ok)
+        {
+            return 1;
+        }
+        setBE32(&pdx[s.note * 8], pdx.size());
+        setBE32(&pdx[s.note * 8 + 4], s.adpcm.size());
+        pdx.insert(pdx.end(), s.adpcm.begin(), s.adpcm.end());
+
+        pcmSamples += s.pcm.size();
+        encodeUS += s.encodeUS;
+
+        printf("%2d: %s, %d Hz -> %d Hz, %d bytes, SNR %.1f dB\n",
+               s.note,
+               s.filename.c_str(),
+               s.srcRate,
+               rate,
+               (int)s.adpcm.size(),
+               s.snr);
+    }
+
+    auto fp = fopen(out, "wb");
+    if (!fp || fwrite(pdx.data(), 1, pdx.size(), fp) != pdx.size())
+    {
+        fprintf(stderr, "%s: write error.\n", out);
+        return 1;
+    }
+    fclose(fp);
+
+    printf("%s: %d bytes\n", out, (int)pdx.size());
+    printf("encode: %.1f Msamples/s (%.1f MB/s of PCM16) per core, "
+           "total %.1f ms with %d jobs (including load and resample)\n",
+           encodeUS > 0 ? pcmSamples / encodeUS : 0,
+           encodeUS > 0 ? pcmSamples * 2 / encodeUS : 0,
+           totalUS / 1000,
+           jobCount);
+    return 0;
+}